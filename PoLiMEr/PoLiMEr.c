@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,11 +11,28 @@
 #include <math.h>
 #include <assert.h>
 #include <stdarg.h>
+#ifndef _TIMER_OFF
+#include <sched.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#endif
 
 #include "helpers.h"
 #include "frequency_handler.h"
 #include "power_cap_handler.h"
 #include "output.h"
+#include "cct.h"
+#include "thread_tags.h"
+#include "node_tags.h"
+#include "node_power.h"
+#include "tag_interpolation.h"
+#include "tag_sampling.h"
+#include "adaptive_poll.h"
+#include "busy_sampler.h"
+#include "online_stats.h"
+#include "stats_kernels.h"
 
 #ifndef _NOMPI
 #include <mpi.h>
@@ -54,24 +72,53 @@ struct poller_t *poller = 0;
 //the main struct holding the entire system states used througout the program
 struct system_info_t *system_info = 0;
 
+#ifndef _NOMPI
+//tags of non-monitor ranks, shared with the monitor of the node
+struct node_tags_t *node_tags = 0;
+#endif
+//latest energy reading of the node, shared by the monitor with all ranks of the node
+struct node_power_t *node_power = 0;
+
 static void init_system_info (void);
 static void get_jobid (void);
 
 static void init_power_interfaces (struct system_info_t * system_info);
 static void finalize_power_interfaces (struct system_info_t * system_info);
+#ifdef _MSR
+static void init_package_energy (struct system_info_t * system_info);
+#endif
 
 static struct poli_tag *get_poli_tag_for_end_time_counter(int counter);
-static int start_poli_tag_no_sync (char *tag_name);
-static int end_poli_tag_no_sync (char *tag_name);
-static struct poli_tag *find_poli_tag_for_name (char *tag_name);
+static struct tag_names *local_tag_names (void);
+static int register_tag_name (char *tag_name);
+static int valid_tag_handle (int handle);
+static int get_thread_id (void);
+static int start_tag_for_name (int name_id);
+static int end_tag_for_name (int name_id);
+static int enter_tag_context (int name_id);
+static int exit_tag_context (int name_id);
+static int start_poli_tag_no_sync (int name_id);
+static int end_poli_tag_no_sync (int name_id);
+static struct poli_tag *find_poli_tag_for_name (int name_id);
 static struct poli_tag *get_poli_tag_for_start_time_counter(int counter);
 static int end_existing_poli_tag (struct poli_tag *this_poli_tag);
+static int reserve_open_tag (void);
+static void remove_open_tag (struct poli_tag *this_poli_tag);
+static void add_open_tag_name (struct poli_tag *new_poli_tag);
+static void remove_open_tag_name (struct poli_tag *this_poli_tag);
 
 #ifndef _TIMER_OFF
 static int setup_timer (void);
 static int stop_timer (void);
 static void timer_handler (int signum);
-static int restart_timer (void);
+static int arm_poll_timer (double delay, double interval);
+static void poll_system (void);
+static int start_sampler_thread (void);
+static int stop_sampler_thread (void);
+static void *sampler_loop (void *arg);
+static int create_sampler_thread (void *(*loop) (void *));
+static int init_busy_polling (void);
+static void *busy_sampler_loop (void *arg);
 #endif
 static void get_poli_config (void);
 static void poli_sync (void);
@@ -93,6 +140,16 @@ int poli_init (void)
 #else
     single_node_init(monitor);
 #endif
+    if (init_clock(poli_config->use_tsc))
+        poli_log(TRACE, monitor, "Using the time stamp counter as clock");
+    else
+        poli_log(TRACE, monitor, "Using CLOCK_MONOTONIC_RAW as clock");
+    if (stats_use_kernels(poli_config->stats_kernels) != 0)
+    {
+        poli_log(WARNING, monitor, "Statistics kernels %s are not supported here", poli_config->stats_kernels);
+        stats_use_kernels("auto");
+    }
+    poli_log(TRACE, monitor, "Using the %s statistics kernels", stats_kernels_name());
 
 #ifndef _NOOMP
     monitor->num_threads = omp_get_num_threads();
@@ -107,13 +164,22 @@ int poli_init (void)
 
     if (monitor->imonitor)
     {
-        poller = malloc(sizeof(struct poller_t));
-        poller->time_counter = 0;
+        poller = calloc(1, sizeof(struct poller_t));
+#ifndef _TIMER_OFF
+        poller->timer_fd = -1;
+        poller->stop_fd = -1;
+        poller->writer_fd = -1;
+        poller->writer_on = 0; //until start_polling_writer, which is skipped if polling is off
+        poller->poll_file = NULL;
+#endif
 
         //initialize the main struct
         init_system_info();
         //initialize all power monitoring and control interfaces
         init_power_interfaces(system_info);
+#ifdef _MSR
+        init_package_energy(system_info);
+#endif
 
         get_initial_time(system_info, monitor);
 
@@ -121,12 +187,34 @@ int poli_init (void)
         if (get_system_power_caps(system_info, monitor) != 0)
             poli_log(ERROR, monitor, "Couldn't get power caps on init!");
 
-        start_poli_tag_no_sync("application_summary");
+        start_poli_tag_no_sync(register_tag_name("application_summary"));
         // record energy
-        system_info->initial_energy = read_current_energy(system_info);
+        system_info->initial_energy = read_package_energy(system_info, system_info->package_energy.initial);
+        init_thread_tag_attribution(system_info);
         get_power_info(&system_info->power_info, system_info);
     }
 
+#ifndef _NOMPI
+    if (poli_config->node_tag_events > 0 && monitor->node_size > 1)
+    {
+        node_tags = malloc(sizeof(struct node_tags_t));
+        if (init_node_tags(node_tags, monitor, poli_config) != 0)
+        {
+            free(node_tags);
+            node_tags = 0;
+        }
+        else if (monitor->imonitor)
+            system_info->node_tags = node_tags;
+    }
+#endif
+
+    node_power = malloc(sizeof(struct node_power_t));
+    if (init_node_power(node_power, monitor) != 0)
+    {
+        free(node_power);
+        node_power = 0;
+    }
+
     poli_sync();
 
 #ifdef _POWMGR
@@ -136,7 +224,13 @@ int poli_init (void)
 #ifndef _TIMER_OFF
     //setup and start timer
     if (monitor->imonitor)
+    {
+        if (poli_config->poll_interval && poli_config->sampler_mode == SAMPLER_BUSY)
+            init_busy_polling();
+        if (poli_config->poll_interval)
+            start_polling_writer(system_info, monitor, poller, poli_config);
         setup_timer();
+    }
 #endif
 
     poli_log(TRACE, monitor,   "Finishing %s\n", __FUNCTION__);
@@ -186,6 +280,162 @@ static void get_poli_config (void)
     else
         poli_config->cap_short_window = atoi(cap);
 
+    char *tag_mode = getenv("POLIMER_TAG_MODE");
+    if (tag_mode != NULL && strcmp(tag_mode, "cct") == 0)
+        poli_config->aggregate_tags = 1;
+    else
+        poli_config->aggregate_tags = 0;
+
+    char *node_tag_events = getenv("POLIMER_NODE_TAG_EVENTS");
+    if (node_tag_events == NULL)
+        poli_config->node_tag_events = NODE_TAG_EVENTS;
+    else
+        poli_config->node_tag_events = atoi(node_tag_events);
+
+    char *power_smoothing = getenv("POLIMER_POWER_SMOOTHING");
+    if (power_smoothing == NULL)
+        poli_config->power_smoothing = POWER_SMOOTHING;
+    else
+        sscanf(power_smoothing, "%f", &poli_config->power_smoothing);
+
+    char *energy_ttl = getenv("POLIMER_ENERGY_TTL");
+    if (energy_ttl == NULL)
+        poli_config->energy_ttl = ENERGY_TTL;
+    else
+        sscanf(energy_ttl, "%f", &poli_config->energy_ttl);
+
+    char *clock_source = getenv("POLIMER_CLOCK");
+    if (clock_source != NULL && strcmp(clock_source, "monotonic") == 0)
+        poli_config->use_tsc = 0;
+    else
+        poli_config->use_tsc = 1;
+
+    char *precise_tags = getenv("POLIMER_PRECISE_TAGS");
+    if (precise_tags == NULL)
+        poli_config->precise_tags = 0;
+    else
+        poli_config->precise_tags = atoi(precise_tags);
+
+    //default sampling policy of all tag names: every:N, time:seconds or reservoir:size
+    char *tag_sampling = getenv("POLIMER_TAG_SAMPLING");
+    poli_config->tag_sampling = POLI_SAMPLE_ALL;
+    poli_config->tag_sampling_parameter = 0;
+    if (tag_sampling != NULL)
+    {
+        if (sscanf(tag_sampling, "every:%lf", &poli_config->tag_sampling_parameter) == 1)
+            poli_config->tag_sampling = POLI_SAMPLE_EVERY_N;
+        else if (sscanf(tag_sampling, "time:%lf", &poli_config->tag_sampling_parameter) == 1)
+            poli_config->tag_sampling = POLI_SAMPLE_TIME;
+        else if (sscanf(tag_sampling, "reservoir:%lf", &poli_config->tag_sampling_parameter) == 1)
+            poli_config->tag_sampling = POLI_SAMPLE_RESERVOIR;
+    }
+
+    //auto, avx512, avx2 or scalar
+    poli_config->stats_kernels = getenv("POLIMER_STATS_KERNELS");
+    if (poli_config->stats_kernels == NULL)
+        poli_config->stats_kernels = "auto";
+
+    //auto, msr, powercap or perf
+    char *rapl = getenv("POLIMER_RAPL");
+    if (rapl != NULL && strcmp(rapl, "msr") == 0)
+        poli_config->rapl_backend = RAPL_MSR;
+    else if (rapl != NULL && strcmp(rapl, "powercap") == 0)
+        poli_config->rapl_backend = RAPL_POWERCAP;
+    else if (rapl != NULL && strcmp(rapl, "perf") == 0)
+        poli_config->rapl_backend = RAPL_PERF;
+    else
+        poli_config->rapl_backend = RAPL_AUTO;
+    poli_config->powercap_root = getenv("POLIMER_POWERCAP_ROOT");
+
+#ifndef _TIMER_OFF
+    char *sampler = getenv("POLIMER_SAMPLER");
+    if (sampler != NULL && strcmp(sampler, "signal") == 0)
+        poli_config->sampler_mode = SAMPLER_SIGNAL;
+    else if (sampler != NULL && strcmp(sampler, "busy") == 0)
+        poli_config->sampler_mode = SAMPLER_BUSY;
+    else
+        poli_config->sampler_mode = SAMPLER_THREAD;
+
+    char *sampler_cpu = getenv("POLIMER_SAMPLER_CPU");
+    if (sampler_cpu == NULL)
+        poli_config->sampler_cpu = -1;
+    else
+        poli_config->sampler_cpu = atoi(sampler_cpu);
+
+    char *sampler_priority = getenv("POLIMER_SAMPLER_PRIORITY");
+    if (sampler_priority == NULL)
+        poli_config->sampler_priority = 0;
+    else
+        poli_config->sampler_priority = atoi(sampler_priority);
+
+    char *ring_size = getenv("POLIMER_RING_SIZE");
+    if (ring_size == NULL)
+        poli_config->ring_size = POLL_RING_SIZE;
+    else
+        poli_config->ring_size = atoi(ring_size);
+    if (poli_config->ring_size < 2)
+        poli_config->ring_size = 2;
+
+    char *marker_ring_size = getenv("POLIMER_MARKER_RING_SIZE");
+    if (marker_ring_size == NULL)
+        poli_config->marker_ring_size = MARKER_RING_SIZE;
+    else
+        poli_config->marker_ring_size = atoi(marker_ring_size);
+    if (poli_config->marker_ring_size < 2)
+        poli_config->marker_ring_size = 2;
+
+    char *raw_ring_size = getenv("POLIMER_RAW_RING_SIZE");
+    if (raw_ring_size == NULL)
+        poli_config->raw_ring_size = RAW_RING_SIZE;
+    else
+        poli_config->raw_ring_size = atoi(raw_ring_size);
+    if (poli_config->raw_ring_size < 2)
+        poli_config->raw_ring_size = 2;
+
+    char *hf_filter = getenv("POLIMER_HF_FILTER");
+    if (hf_filter != NULL && strcmp(hf_filter, "median3") == 0)
+        poli_config->hf_filter = FILTER_MEDIAN3;
+    else if (hf_filter != NULL && strcmp(hf_filter, "hampel") == 0)
+        poli_config->hf_filter = FILTER_HAMPEL;
+    else
+        poli_config->hf_filter = FILTER_NONE;
+
+    char *flush_interval = getenv("POLIMER_FLUSH_INTERVAL");
+    if (flush_interval == NULL)
+        poli_config->flush_interval = FLUSH_INTERVAL;
+    else
+        sscanf(flush_interval, "%f", &poli_config->flush_interval);
+
+    //adaptive mode polls between the bounds, starting at POLIMER_POLL_INTERVAL
+    char *adaptive_poll = getenv("POLIMER_POLL_ADAPTIVE");
+    if (adaptive_poll == NULL)
+        poli_config->adaptive_poll = 0;
+    else
+        poli_config->adaptive_poll = atoi(adaptive_poll);
+
+    char *poll_interval_min = getenv("POLIMER_POLL_INTERVAL_MIN");
+    if (poll_interval_min == NULL)
+        poli_config->poll_interval_min = POLL_INTERVAL_MIN;
+    else
+        sscanf(poll_interval_min, "%f", &poli_config->poll_interval_min);
+    if (poli_config->poll_interval_min <= 0)
+        poli_config->poll_interval_min = POLL_INTERVAL_MIN;
+
+    char *poll_interval_max = getenv("POLIMER_POLL_INTERVAL_MAX");
+    if (poll_interval_max == NULL)
+        poli_config->poll_interval_max = POLL_INTERVAL_MAX;
+    else
+        sscanf(poll_interval_max, "%f", &poli_config->poll_interval_max);
+    if (poli_config->poll_interval_max < poli_config->poll_interval_min)
+        poli_config->poll_interval_max = poli_config->poll_interval_min;
+
+    char *poll_power_change = getenv("POLIMER_POLL_POWER_CHANGE");
+    if (poll_power_change == NULL)
+        poli_config->poll_power_change = POLL_POWER_CHANGE;
+    else
+        sscanf(poll_power_change, "%f", &poli_config->poll_power_change);
+#endif
+
 #ifdef _POWMGR
     char *palloc_freq = getenv("POLIMER_POWER_ALLOC_FREQ");
     if (palloc_freq == NULL)
@@ -262,17 +512,17 @@ static void init_system_info (void)
     //allocate memory and set dummy values
     system_info = malloc(sizeof(struct system_info_t));
 
-    system_info->poli_tag_list = 0;
-    system_info->pcap_tag_list = 0;
     system_info->current_pcap_list = 0;
+    memset(&system_info->package_energy, 0, sizeof(struct package_energy_t));
 
 #ifndef _TIMER_OFF
-    system_info->system_poll_list = 0;
+    system_info->dropped_samples = 0;
+    pthread_mutex_init(&system_info->energy_lock, NULL);
+    system_info->energy_lock_on = 0;
 #endif
 
 #ifdef _POWMGR
-    system_info->palloc_list = 0;
-    system_info->palloc_list = calloc(MAX_POLL_SAMPLES, sizeof(struct power_manager_t));
+    arena_init(&system_info->palloc_list, sizeof(struct power_manager_t));
     system_info->palloc_count = 0;
 #endif
 
@@ -280,23 +530,80 @@ static void init_system_info (void)
     system_info->num_open_tags = 0;
     system_info->num_closed_tags = 0;
 
-    system_info->poli_opentag_tracker = -1;
-    system_info->poli_closetag_tracker = -1;
-
     system_info->num_pcap_tags = 0;
 
-    // allocate list of poli tags (power measurements)
-    system_info->poli_tag_list = calloc(MAX_TAGS, sizeof(struct poli_tag));
+    // list of poli tags (power measurements), grows as tags are started
+    arena_init(&system_info->poli_tag_list, sizeof(struct poli_tag));
+    system_info->open_tag_ids_size = OPEN_TAGS_INITIAL;
+    system_info->open_tag_ids = malloc(system_info->open_tag_ids_size * sizeof(int));
+    system_info->num_open_tag_ids = 0;
+    if (tag_names_init(&system_info->tag_names) != 0)
+        poli_log(ERROR, monitor, "Failed to allocate tag name table");
+    if (tag_table_init(&system_info->open_tag_table, 64) != 0)
+        poli_log(ERROR, monitor, "Failed to allocate open tag table");
+    if (cct_init(&system_info->cct) != 0)
+        poli_log(ERROR, monitor, "Failed to allocate calling context tree");
+    system_info->thread_tag_buffers = 0;
+    system_info->energy_cache.sequence = 0;
+    system_info->energy_cache.wtime = -1;
+    system_info->energy_cache.ttl = poli_config->energy_ttl;
+#ifndef _NOMPI
+    system_info->node_tags = 0;
+#endif
+    system_info->active_tag_pool = 0;
+    system_info->active_tag_pool_len = 0;
+    system_info->active_tag_pool_size = 0;
 
-    // allocate list of power cap tags (create a tag each time we specifically set a power cap)
-    system_info->pcap_tag_list = calloc(MAX_TAGS, sizeof(struct pcap_tag));
+    // list of power cap tags (create a tag each time we specifically set a power cap)
+    arena_init(&system_info->pcap_tag_list, sizeof(struct pcap_tag));
 
     //
     system_info->current_pcap_list = calloc(NUM_ZONES, sizeof(struct pcap_info));
 
+    // journal of power cap changes, referenced by poll samples
+    arena_init(&system_info->pcap_journal, sizeof(struct pcap_event));
+    arena_init(&system_info->tag_samplers, sizeof(struct tag_sampler));
+    system_info->tag_events = 0;
+    system_info->num_pcap_events = 0;
+
 #ifndef _TIMER_OFF
-    //allocate list keeping the poll info
-    system_info->system_poll_list = calloc(MAX_POLL_SAMPLES, sizeof(struct system_poll_info));
+    //allocate the rings buffering the poll info until it is written out
+    ring_init(&system_info->poll_ring, poli_config->ring_size, 0);
+    system_info->poll_columns.wtime = calloc(system_info->poll_ring.size, sizeof(double));
+    system_info->poll_columns.energy = calloc(system_info->poll_ring.size, sizeof(struct energy_reading));
+    system_info->poll_columns.pcap_ref = calloc(system_info->poll_ring.size, sizeof(int));
+    system_info->poll_columns.time_error = 0;
+    system_info->tag_interpolation = 0;
+    system_info->raw_samples = 0;
+    if (init_tag_power_stats(&system_info->tag_power_stats) != 0)
+        poli_log(ERROR, monitor, "Failed to allocate tag power statistics");
+    if (poli_config->precise_tags && !poli_config->poll_interval)
+    {
+        poli_log(WARNING, monitor, "Precise tag boundaries need polling. Set POLIMER_POLL_INTERVAL to use them");
+        poli_config->precise_tags = 0;
+    }
+    if (poli_config->precise_tags)
+    {
+        system_info->poll_columns.time_error = calloc(system_info->poll_ring.size, sizeof(double));
+        system_info->tag_interpolation = malloc(sizeof(struct tag_interpolation_t));
+        if (!system_info->poll_columns.time_error || !system_info->tag_interpolation
+            || init_tag_interpolation(system_info->tag_interpolation) != 0)
+        {
+            poli_log(ERROR, monitor, "Failed to allocate memory for precise tag boundaries");
+            free(system_info->poll_columns.time_error);
+            free(system_info->tag_interpolation);
+            system_info->poll_columns.time_error = 0;
+            system_info->tag_interpolation = 0;
+            poli_config->precise_tags = 0;
+        }
+    }
+    if (!system_info->poll_columns.wtime || !system_info->poll_columns.energy || !system_info->poll_columns.pcap_ref)
+    {
+        poli_log(ERROR, monitor, "Failed to allocate ring for %d poll samples", poli_config->ring_size);
+        ring_free(&system_info->poll_ring);
+    }
+    if (ring_init(&system_info->marker_ring, poli_config->marker_ring_size, sizeof(struct poll_marker)) != 0)
+        poli_log(ERROR, monitor, "Failed to allocate ring for %d poll markers", poli_config->marker_ring_size);
 #endif
 
 #ifdef _BENCH
@@ -320,7 +627,7 @@ static void init_power_interfaces (struct system_info_t * system_info)
 {
 #ifdef _MSR
     //initialize the msr environment to read from/write to msrs
-    init_msrs(system_info);
+    init_msrs(system_info, poli_config->rapl_backend, poli_config->powercap_root);
 #endif
 #ifdef _CRAY
     //initialize the cray environment to read the power monitoring counters
@@ -328,6 +635,39 @@ static void init_power_interfaces (struct system_info_t * system_info)
 #endif
 }
 
+#ifdef _MSR
+/* init_package_energy - sets up recording the energy of each package on multi-package nodes.
+   single package nodes only record the node totals*/
+static void init_package_energy (struct system_info_t * system_info)
+{
+    struct package_energy_t *package_energy = &system_info->package_energy;
+    int num_packages = rapl_num_packages(system_info);
+    if (system_info->sysmsr->error_state || num_packages < 2)
+        return;
+    if (num_packages > MAX_RECORDED_PACKAGES)
+        num_packages = MAX_RECORDED_PACKAGES;
+
+    package_energy->cache = calloc(num_packages, sizeof(struct rapl_energy));
+    int failed = (package_energy->cache == NULL || arena_init(&package_energy->tags, 2 * num_packages * sizeof(struct rapl_energy)) != 0);
+#ifndef _TIMER_OFF
+    if (!failed && system_info->poll_columns.energy)
+    {
+        package_energy->poll = calloc((size_t) system_info->poll_ring.size * num_packages, sizeof(struct rapl_energy));
+        failed = (package_energy->poll == NULL);
+    }
+#endif
+    if (failed)
+    {
+        poli_log(ERROR, monitor, "Failed to allocate memory for the energy of %d packages. Only node totals will be recorded", num_packages);
+        free(package_energy->poll);
+        free(package_energy->cache);
+        memset(package_energy, 0, sizeof(struct package_energy_t));
+        return;
+    }
+    package_energy->num_packages = num_packages;
+}
+#endif
+
 /*                          END OF INITIALIZATION                             */
 
 /******************************************************************************/
@@ -430,19 +770,47 @@ void poli_set_global_power_cap(double pcap)
 /*                      POLIMER TAGS                                          */
 /******************************************************************************/
 
-static struct poli_tag *find_poli_tag_for_name (char *tag_name)
+/* find_poli_tag_for_name - returns the most recently opened tag of this name which is still open, 0 if there is none*/
+static struct poli_tag *find_poli_tag_for_name (int name_id)
 {
-    int tag_num;
-    for (tag_num = 0; tag_num < system_info->num_poli_tags; tag_num++)
-    {
-        struct poli_tag *this_poli_tag = &system_info->poli_tag_list[tag_num];
-        if (strcmp(this_poli_tag->tag_name, tag_name) == 0 && !this_poli_tag->closed) {
-            return this_poli_tag;
-        }
-    }
+    struct tag_table_entry *entry = tag_table_find(&system_info->open_tag_table,
+        tag_names_hash(&system_info->tag_names, name_id), name_id);
+    if (entry == NULL)
+        return 0;
+    return arena_at(&system_info->poli_tag_list, entry->value);
+}
+
+/* the names tag handles of this rank refer to, NULL if this rank does not record tags*/
+static struct tag_names *local_tag_names (void)
+{
+    if (monitor->imonitor)
+        return &system_info->tag_names;
+#ifndef _NOMPI
+    if (node_tags)
+        return &node_tags->names;
+#endif
     return 0;
 }
 
+static int register_tag_name (char *tag_name)
+{
+    struct tag_names *tag_names = local_tag_names();
+    if (tag_names == NULL)
+        return 0;
+    int name_id = tag_names_intern(tag_names, tag_name);
+    if (name_id < 0)
+        poli_log(ERROR, monitor, "Failed to register tag name %s: no room left for tag names", tag_name);
+    return name_id;
+}
+
+static int valid_tag_handle (int handle)
+{
+    struct tag_names *tag_names = local_tag_names();
+    if (tag_names == NULL)
+        return 1;
+    return handle >= 0 && handle < tag_names_count(tag_names);
+}
+
 static struct poli_tag *get_poli_tag_for_start_time_counter(int counter)
 {
     if (monitor->imonitor)
@@ -450,7 +818,7 @@ static struct poli_tag *get_poli_tag_for_start_time_counter(int counter)
         int i;
         for (i = 0; i < system_info->num_poli_tags; i++)
         {
-            struct poli_tag *this_poli_tag = &system_info->poli_tag_list[i];
+            struct poli_tag *this_poli_tag = arena_at(&system_info->poli_tag_list, i);
             if (this_poli_tag->start_timer_count == counter)
                 return this_poli_tag;
         }
@@ -465,7 +833,7 @@ static struct poli_tag *get_poli_tag_for_end_time_counter(int counter)
         int i;
         for (i = 0; i < system_info->num_poli_tags; i++)
         {
-            struct poli_tag *this_poli_tag = &system_info->poli_tag_list[i];
+            struct poli_tag *this_poli_tag = arena_at(&system_info->poli_tag_list, i);
             if (this_poli_tag->end_timer_count == counter)
                 return this_poli_tag;
         }
@@ -483,28 +851,204 @@ int poli_start_tag (char *format_str, ...)
 
     //poli_sync_node();
     poli_log(TRACE, monitor,   "Entering %s %s\n", __FUNCTION__, tag_name);
-    int ret = start_poli_tag_no_sync(tag_name);
+    int name_id = register_tag_name(tag_name);
+    if (name_id < 0)
+        return 1;
+    int ret = start_tag_for_name(name_id);
     poli_log(TRACE, monitor,   "Finishing %s %s\n", __FUNCTION__, tag_name);
     return ret;
 }
 
-static int start_poli_tag_no_sync (char *tag_name)
+int poli_register_tag (char *format_str, ...)
+{
+    char tag_name[TAG_NAME_LEN];
+    va_list argptr;
+    va_start(argptr, format_str);
+    vsnprintf(tag_name, TAG_NAME_LEN, format_str, argptr);
+    va_end(argptr);
+
+    return register_tag_name(tag_name);
+}
+
+int poli_start_tag_handle (int handle)
+{
+    if (!valid_tag_handle(handle))
+    {
+        poli_log(WARNING, monitor, "You attempted to start a tag with unregistered handle %d! This tag will be omitted", handle);
+        return 1;
+    }
+    return start_tag_for_name(handle);
+}
+
+int poli_end_tag_handle (int handle)
+{
+    if (!valid_tag_handle(handle))
+    {
+        poli_log(WARNING, monitor, "You attempted to close a tag with unregistered handle %d! This tag will be omitted", handle);
+        return 1;
+    }
+    return end_tag_for_name(handle);
+}
+
+int poli_set_tag_sampling (int handle, poli_sampling_t policy, double parameter)
+{
+    if (!monitor->imonitor)
+        return 0;
+    if (!valid_tag_handle(handle))
+    {
+        poli_log(WARNING, monitor, "You attempted to set the sampling of unregistered handle %d!", handle);
+        return 1;
+    }
+    if (poli_config->aggregate_tags)
+    {
+        poli_log(WARNING, monitor, "Tags are aggregated into the calling context tree, sampling of %s is ignored",
+            tag_names_get(&system_info->tag_names, handle));
+        return 1;
+    }
+    struct tag_sampler *sampler = get_tag_sampler(handle, system_info, poli_config);
+    if (sampler == NULL || set_tag_sampler_policy(sampler, policy, parameter) != 0)
+    {
+        poli_log(WARNING, monitor, "Could not set the sampling of %s, it must not be open and the parameter must be valid",
+            tag_names_get(&system_info->tag_names, handle));
+        return 1;
+    }
+    return 0;
+}
+
+/* user tags are either recorded one by one or aggregated into the calling context tree,
+   application_summary is always recorded as a poli tag.
+   the master thread of a non-monitor rank hands its tags to the monitor through node shared memory*/
+static int start_tag_for_name (int name_id)
+{
+    int thread_id = get_thread_id();
+    if (!monitor->imonitor)
+    {
+#ifndef _NOMPI
+        if (node_tags && thread_id == 0)
+            return record_node_tag_event(node_tags, THREAD_TAG_START, name_id);
+#endif
+        return 0;
+    }
+    if (thread_id != 0)
+        return record_thread_tag_event(THREAD_TAG_START, name_id, thread_id, monitor->world_rank, system_info);
+    __atomic_store_n(&system_info->tag_events, system_info->tag_events + 1, __ATOMIC_RELAXED);
+    if (poli_config->aggregate_tags)
+        return enter_tag_context(name_id);
+    struct tag_sampler *sampler = get_tag_sampler(name_id, system_info, poli_config);
+    if (sampler != NULL && sampler->policy != POLI_SAMPLE_ALL && !sampler_start_invocation(sampler))
+        return 0;
+    return start_poli_tag_no_sync(name_id);
+}
+
+static int end_tag_for_name (int name_id)
+{
+    int thread_id = get_thread_id();
+    if (!monitor->imonitor)
+    {
+#ifndef _NOMPI
+        if (node_tags && thread_id == 0)
+            return record_node_tag_event(node_tags, THREAD_TAG_END, name_id);
+#endif
+        return 0;
+    }
+    if (thread_id != 0)
+        return record_thread_tag_event(THREAD_TAG_END, name_id, thread_id, monitor->world_rank, system_info);
+    __atomic_store_n(&system_info->tag_events, system_info->tag_events + 1, __ATOMIC_RELAXED);
+    if (poli_config->aggregate_tags)
+        return exit_tag_context(name_id);
+    struct tag_sampler *sampler = get_tag_sampler(name_id, system_info, poli_config);
+    if (sampler != NULL && sampler->policy != POLI_SAMPLE_ALL)
+    {
+        int sampled = sampler_end_invocation(sampler);
+        if (sampled < 0)
+        {
+            poli_log(WARNING, monitor, "You attempted to close tag %s, but no such tag is open! This tag will be omitted", tag_names_get(&system_info->tag_names, name_id));
+            return 1;
+        }
+        if (!sampled)
+            return 0;
+        struct poli_tag *tag = find_poli_tag_for_name(name_id);
+        int ret = end_poli_tag_no_sync(name_id);
+        if (ret == 0 && tag != NULL)
+            sampler_add_invocation(sampler, tag);
+        return ret;
+    }
+    return end_poli_tag_no_sync(name_id);
+}
+
+/* tags issued by OpenMP threads other than the master thread (thread id != 0) go to per thread buffers,
+   so they neither race on the tag lists nor serialize on a lock*/
+static int get_thread_id (void)
+{
+#ifndef _NOOMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+static int enter_tag_context (int name_id)
+{
+    if (monitor->imonitor)
+    {
+        double wtime;
+        struct energy_reading energy = read_cached_energy(system_info, &wtime);
+        if (cct_enter(&system_info->cct, name_id, tag_names_hash(&system_info->tag_names, name_id), &energy, wtime) != 0)
+        {
+            poli_log(ERROR, monitor, "Failed to add tag %s to the calling context tree", tag_names_get(&system_info->tag_names, name_id));
+            return 1;
+        }
+#ifndef _TIMER_OFF
+        push_poll_marker(CONTEXT_ENTER_MARKER, name_id, system_info, poller);
+#endif
+    }
+    return 0;
+}
+
+static int exit_tag_context (int name_id)
+{
+    if (monitor->imonitor)
+    {
+        double wtime;
+        struct energy_reading energy = read_cached_energy(system_info, &wtime);
+        if (cct_exit(&system_info->cct, name_id, &energy, wtime) != 0)
+        {
+            poli_log(WARNING, monitor, "You attempted to close tag %s, but no such tag is open! This tag will be omitted", tag_names_get(&system_info->tag_names, name_id));
+            return -1;
+        }
+#ifndef _TIMER_OFF
+        push_poll_marker(CONTEXT_EXIT_MARKER, name_id, system_info, poller);
+#endif
+    }
+    return 0;
+}
+
+static int start_poli_tag_no_sync (int name_id)
 {
     if (monitor->imonitor)
     {
         int num_tags = system_info->num_poli_tags;
-        struct poli_tag *new_poli_tag = &system_info->poli_tag_list[num_tags];
+        struct poli_tag *new_poli_tag = arena_at(&system_info->poli_tag_list, num_tags);
+        if (new_poli_tag == NULL || reserve_open_tag() != 0)
+        {
+            poli_log(ERROR, monitor, "Failed to allocate poli tag %s", tag_names_get(&system_info->tag_names, name_id));
+            return 1;
+        }
         new_poli_tag->id = num_tags;
-        system_info->poli_opentag_tracker = num_tags;
-        strncpy(new_poli_tag->tag_name, tag_name, TAG_NAME_LEN);
+        new_poli_tag->name_id = name_id;
         new_poli_tag->monitor_id = monitor->color;
         new_poli_tag->monitor_rank = monitor->world_rank;
 
-        new_poli_tag->start_energy = read_current_energy(system_info);
+        //the time is that of the energy reading, which may be a cached one
+        new_poli_tag->start_energy = read_cached_package_energy(system_info, &new_poli_tag->start_time, tag_package_energy(system_info, num_tags, 0));
+        new_poli_tag->start_timer_count = __atomic_load_n(&poller->time_counter, __ATOMIC_ACQUIRE);
+#ifndef _TIMER_OFF
+        push_poll_marker(TAG_START_MARKER, num_tags, system_info, poller);
+#endif
 
-        new_poli_tag->start_time = get_time();
-        gettimeofday(&(new_poli_tag->start_timestamp), NULL);
-        new_poli_tag->start_timer_count = poller->time_counter;
+        new_poli_tag->open_index = system_info->num_open_tag_ids;
+        system_info->open_tag_ids[system_info->num_open_tag_ids++] = num_tags;
+        add_open_tag_name(new_poli_tag);
 
         system_info->num_poli_tags++;
         system_info->num_open_tags++;
@@ -522,32 +1066,39 @@ int poli_end_tag (char *format_str, ...)
 
     //poli_sync_node();
     poli_log(TRACE, monitor,   "Entering %s %s\n", __FUNCTION__, tag_name);
-    int ret = end_poli_tag_no_sync(tag_name);
+    int ret = 0;
+    struct tag_names *tag_names = local_tag_names();
+    if (tag_names != NULL)
+    {
+        int name_id = tag_names_lookup(tag_names, tag_name);
+        if (name_id < 0)
+        {
+            poli_log(WARNING, monitor, "You attempted to close tag %s, but no such tag is open! This tag will be omitted", tag_name);
+            return -1;
+        }
+        ret = end_tag_for_name(name_id);
+    }
     poli_log(TRACE, monitor,   "Finishing %s %s\n", __FUNCTION__, tag_name);
     return ret;
 }
 
-static int end_poli_tag_no_sync (char *tag_name)
+static int end_poli_tag_no_sync (int name_id)
 {
     int ret = 0;
     if (monitor->imonitor)
     {
-        struct poli_tag *this_poli_tag = &system_info->poli_tag_list[system_info->poli_opentag_tracker];
-        if (system_info->poli_opentag_tracker < 1) //1 because we don't want application_summary to be prematurely closed
+        char *tag_name = tag_names_get(&system_info->tag_names, name_id);
+        //tags are matched by name, so they may be interleaved as well as nested
+        struct poli_tag *this_poli_tag = find_poli_tag_for_name(name_id);
+        if (this_poli_tag == 0)
         {
-            if (strcmp(this_poli_tag->tag_name, tag_name) != 0)
-            {
-                poli_log(WARNING, monitor, "You attempted to close tag %s, but no tags were opened! This tag will be omitted", tag_name);
-                return -1;
-            }
+            poli_log(WARNING, monitor, "You attempted to close tag %s, but no such tag is open! This tag will be omitted", tag_name);
+            return -1;
         }
-
-        //if (strcmp(this_poli_tag->tag_name, tag_name) != 0) //this enables interleaving tags
-        //    this_poli_tag = find_poli_tag_for_name(tag_name);
-        if (this_poli_tag == 0)
+        if (this_poli_tag->id == 0) //we don't want application_summary to be prematurely closed
         {
-            poli_log(ERROR, monitor,   "%s: Failed to find poli tag to end: %s\n", __FUNCTION__, tag_name);
-            return 1;
+            poli_log(WARNING, monitor, "You attempted to close tag %s, which is reserved for the application summary! This tag will be omitted", tag_name);
+            return -1;
         }
         //TD
         if (this_poli_tag->monitor_rank != monitor->world_rank)
@@ -567,22 +1118,83 @@ static int end_existing_poli_tag (struct poli_tag *this_poli_tag)
     {
         poli_log(TRACE, monitor,   "Entering %s", __FUNCTION__);
 
-        this_poli_tag->end_energy = read_current_energy(system_info);
-
-        this_poli_tag->end_time = get_time();
-        gettimeofday(&(this_poli_tag->end_timestamp), NULL);
-        this_poli_tag->end_timer_count = poller->time_counter;
+        this_poli_tag->end_energy = read_cached_package_energy(system_info, &this_poli_tag->end_time, tag_package_energy(system_info, this_poli_tag->id, 1));
+        this_poli_tag->end_timer_count = __atomic_load_n(&poller->time_counter, __ATOMIC_ACQUIRE);
+#ifndef _TIMER_OFF
+        push_poll_marker(TAG_END_MARKER, this_poli_tag->id, system_info, poller);
+#endif
+        if (!this_poli_tag->closed)
+            remove_open_tag(this_poli_tag);
         this_poli_tag->closed = 1;
-        system_info->poli_closetag_tracker = system_info->poli_opentag_tracker;
         system_info->num_closed_tags--; //yes, decrement
-        system_info->poli_closetag_tracker = system_info->poli_opentag_tracker;
-        system_info->poli_opentag_tracker--;
 
         poli_log(TRACE, monitor, "Finishing %s", __FUNCTION__);
     }
     return 0;
 }
 
+/* reserve_open_tag - makes room for one more id in open_tag_ids
+   returns: 0 if successful, 1 otherwise*/
+static int reserve_open_tag (void)
+{
+    if (system_info->num_open_tag_ids < system_info->open_tag_ids_size)
+        return 0;
+    int *open_tag_ids = realloc(system_info->open_tag_ids, 2 * system_info->open_tag_ids_size * sizeof(int));
+    if (open_tag_ids == NULL)
+        return 1;
+    system_info->open_tag_ids = open_tag_ids;
+    system_info->open_tag_ids_size *= 2;
+    return 0;
+}
+
+static void remove_open_tag (struct poli_tag *this_poli_tag)
+{
+    int last = system_info->open_tag_ids[--system_info->num_open_tag_ids];
+    system_info->open_tag_ids[this_poli_tag->open_index] = last;
+    struct poli_tag *last_poli_tag = arena_at(&system_info->poli_tag_list, last);
+    last_poli_tag->open_index = this_poli_tag->open_index;
+    remove_open_tag_name(this_poli_tag);
+}
+
+static void add_open_tag_name (struct poli_tag *new_poli_tag)
+{
+    uint32_t hash = tag_names_hash(&system_info->tag_names, new_poli_tag->name_id);
+    struct tag_table_entry *entry = tag_table_find(&system_info->open_tag_table, hash, new_poli_tag->name_id);
+    if (entry)
+    {
+        //shadow the open tag of the same name, it is closed by name again once this one is
+        new_poli_tag->prev_same_name = entry->value;
+        entry->value = new_poli_tag->id;
+        return;
+    }
+    new_poli_tag->prev_same_name = -1;
+    if (tag_table_insert(&system_info->open_tag_table, hash, new_poli_tag->name_id, new_poli_tag->id) != 0)
+        poli_log(ERROR, monitor, "Failed to add tag %s to the open tag table", tag_names_get(&system_info->tag_names, new_poli_tag->name_id));
+}
+
+static void remove_open_tag_name (struct poli_tag *this_poli_tag)
+{
+    struct tag_table_entry *entry = tag_table_find(&system_info->open_tag_table,
+        tag_names_hash(&system_info->tag_names, this_poli_tag->name_id), this_poli_tag->name_id);
+    if (entry == NULL)
+        return;
+    if (entry->value == this_poli_tag->id)
+    {
+        if (this_poli_tag->prev_same_name != -1)
+            entry->value = this_poli_tag->prev_same_name;
+        else
+            tag_table_remove(&system_info->open_tag_table, entry);
+        return;
+    }
+
+    //closed out of order (e.g. when finalizing), unlink it from the chain of shadowed tags
+    struct poli_tag *next = arena_at(&system_info->poli_tag_list, entry->value);
+    while (next->prev_same_name != -1 && next->prev_same_name != this_poli_tag->id)
+        next = arena_at(&system_info->poli_tag_list, next->prev_same_name);
+    if (next->prev_same_name == this_poli_tag->id)
+        next->prev_same_name = this_poli_tag->prev_same_name;
+}
+
 /*                      END OF EMON TAGS                                      */
 
 /******************************************************************************/
@@ -687,6 +1299,40 @@ int poli_print_frequency_info (void)
 
 /*               END OF FREQUENNCY                                            */
 
+/******************************************************************************/
+/*              CURRENT POWER                                                 */
+/******************************************************************************/
+
+int poli_get_current_power (double *watts)
+{
+    return poli_get_current_zone_power(0, watts);
+}
+
+int poli_get_current_zone_power (int zone, double *watts)
+{
+    struct energy_snapshot snapshot;
+    if (node_power == NULL || read_energy_snapshot(node_power, &snapshot) != 0)
+        return 1;
+    if (zone < 0 || zone >= snapshot.num_zones)
+        return 1;
+    *watts = snapshot.power[zone];
+    return 0;
+}
+
+int poli_get_node_energy (int zone, double *joules, double *wtime)
+{
+    struct energy_snapshot snapshot;
+    if (node_power == NULL || read_energy_snapshot(node_power, &snapshot) != 0)
+        return 1;
+    if (zone < 0 || zone >= snapshot.num_zones)
+        return 1;
+    *joules = snapshot.node_energy[zone];
+    *wtime = snapshot.wtime;
+    return 0;
+}
+
+/*               END OF CURRENT POWER                                         */
+
 /******************************************************************************/
 /*              TIMER                                                         */
 /******************************************************************************/
@@ -702,6 +1348,15 @@ static int setup_timer (void)
             poller->timer_on = 0;
             return 0;
         }
+        init_adaptive_poll(&system_info->adaptive_poll, poli_config);
+
+        if (poli_config->sampler_mode != SAMPLER_SIGNAL)
+        {
+            if (start_sampler_thread() == 0)
+                return 0;
+            poli_log(WARNING, monitor, "Could not start sampler thread. Falling back to SIGALRM timer");
+            poli_config->sampler_mode = SAMPLER_SIGNAL;
+        }
 
         memset(&poller->sa, 0, sizeof(poller->sa));
         poller->sa.sa_handler = &timer_handler;
@@ -713,14 +1368,7 @@ static int setup_timer (void)
             return 1;
         }
 
-        poller->timer.it_value.tv_sec = 0;
-        poller->timer.it_value.tv_usec = INITIAL_TIMER_DELAY;
-
-        poller->timer.it_interval.tv_sec = 0;
-        poller->timer.it_interval.tv_usec = poli_config->poll_interval * 1000000;
-
-        status = setitimer(ITIMER_REAL, &poller->timer, NULL);
-        if (0 != status)
+        if (arm_poll_timer(INITIAL_TIMER_DELAY * 1e-6, system_info->adaptive_poll.interval) != 0)
         {
             poli_log(ERROR, monitor,   "Failed to set timer: %s", strerror(errno));
             return 1;
@@ -729,36 +1377,235 @@ static int setup_timer (void)
     return 0;
 }
 
-static int restart_timer (void)
+/* arm_poll_timer - (re)arms the timer of the sampler thread or SIGALRM to expire after delay, then every interval seconds
+   returns: 0 if successful, 1 otherwise*/
+static int arm_poll_timer (double delay, double interval)
 {
-    poller->timer_on = 1;
+    if (poli_config->sampler_mode == SAMPLER_BUSY)
+    {
+        poller->next_poll = get_time() + delay;
+        return 0;
+    }
+    if (poli_config->sampler_mode == SAMPLER_THREAD)
+    {
+        struct itimerspec its;
+        its.it_value.tv_sec = (time_t) delay;
+        its.it_value.tv_nsec = (long) ((delay - its.it_value.tv_sec) * 1e9);
+        its.it_interval.tv_sec = (time_t) interval;
+        its.it_interval.tv_nsec = (long) ((interval - its.it_interval.tv_sec) * 1e9);
+        return timerfd_settime(poller->timer_fd, 0, &its, NULL) != 0;
+    }
+
+    poller->timer.it_value.tv_sec = (time_t) delay;
+    poller->timer.it_value.tv_usec = (suseconds_t) ((delay - poller->timer.it_value.tv_sec) * 1e6);
+    poller->timer.it_interval.tv_sec = (time_t) interval;
+    poller->timer.it_interval.tv_usec = (suseconds_t) ((interval - poller->timer.it_interval.tv_sec) * 1e6);
+    return setitimer(ITIMER_REAL, &poller->timer, NULL) != 0;
+}
+
+/* start_sampler_thread - starts a dedicated polling thread woken up by a CLOCK_MONOTONIC timerfd,
+   or spinning on the energy counters in busy polling mode.
+   Polling happens outside of signal context and does not interrupt the application's threads.
+   The thread is pinned to POLIMER_SAMPLER_CPU and runs as SCHED_FIFO with POLIMER_SAMPLER_PRIORITY if those are set.
+   returns: 0 if the thread is running, 1 otherwise*/
+static int start_sampler_thread (void)
+{
+    if (poli_config->sampler_mode == SAMPLER_BUSY)
+    {
+        arm_poll_timer(INITIAL_TIMER_DELAY * 1e-6, system_info->adaptive_poll.interval);
+        return create_sampler_thread(busy_sampler_loop);
+    }
 
-    int status = sigaction(SIGALRM, &poller->sa, NULL);
-    if (0 != status)
+    poller->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (poller->timer_fd < 0)
+    {
+        poli_log(ERROR, monitor, "Failed to create timerfd: %s", strerror(errno));
+        return 1;
+    }
+    poller->stop_fd = eventfd(0, EFD_CLOEXEC);
+    if (poller->stop_fd < 0)
     {
-        poli_log(ERROR, monitor,   "Failed to set SIGACTION: %s", strerror(errno));
+        poli_log(ERROR, monitor, "Failed to create eventfd: %s", strerror(errno));
+        close(poller->timer_fd);
         return 1;
     }
 
-    poller->timer.it_value.tv_sec = 0;
-    poller->timer.it_value.tv_usec = INITIAL_TIMER_DELAY;
+    if (arm_poll_timer(INITIAL_TIMER_DELAY * 1e-6, system_info->adaptive_poll.interval) != 0)
+    {
+        poli_log(ERROR, monitor, "Failed to set timerfd: %s", strerror(errno));
+        close(poller->timer_fd);
+        close(poller->stop_fd);
+        return 1;
+    }
 
-    poller->timer.it_interval.tv_sec = 0;
-    poller->timer.it_interval.tv_usec = POLL_INTERVAL * 1000000;
+    if (create_sampler_thread(sampler_loop) != 0)
+    {
+        close(poller->timer_fd);
+        close(poller->stop_fd);
+        return 1;
+    }
+    return 0;
+}
 
-    status = setitimer(ITIMER_REAL, &poller->timer, NULL);
-    if (0 != status)
+/* create_sampler_thread - starts the sampler thread running loop, with the affinity and priority of the configuration
+   returns: 0 if the thread is running, 1 otherwise*/
+static int create_sampler_thread (void *(*loop) (void *))
+{
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (poli_config->sampler_cpu >= 0)
+    {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(poli_config->sampler_cpu, &cpuset);
+        pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &cpuset);
+    }
+    if (poli_config->sampler_priority > 0)
+    {
+        struct sched_param param;
+        param.sched_priority = poli_config->sampler_priority;
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        pthread_attr_setschedparam(&attr, &param);
+    }
+
+    system_info->energy_lock_on = 1;
+    int status = pthread_create(&poller->sampler_thread, &attr, loop, NULL);
+    if (status == EPERM && poli_config->sampler_priority > 0)
+    {
+        poli_log(WARNING, monitor, "Not permitted to run sampler thread as SCHED_FIFO. Using default scheduling");
+        pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+        status = pthread_create(&poller->sampler_thread, &attr, loop, NULL);
+    }
+    pthread_attr_destroy(&attr);
+
+    if (status != 0)
+    {
+        poli_log(ERROR, monitor, "Failed to create sampler thread: %s", strerror(status));
+        system_info->energy_lock_on = 0;
+        return 1;
+    }
+    poller->sampler_on = 1;
+    return 0;
+}
+
+/* init_busy_polling - sets up the raw samples of busy polling, or falls back to the timer driven sampler thread
+   returns: 0 if busy polling is used, 1 otherwise*/
+static int init_busy_polling (void)
+{
+    if (poli_config->sampler_cpu < 0)
+        poli_log(WARNING, monitor, "Busy polling spins a core. Set POLIMER_SAMPLER_CPU to a core the application does not use");
+    system_info->raw_samples = malloc(sizeof(struct raw_samples));
+    if (system_info->raw_samples == NULL
+        || init_raw_samples(system_info->raw_samples, poli_config->raw_ring_size, poli_config->hf_filter, system_info) != 0)
     {
-        poli_log(ERROR, monitor,   "Failed to set timer: %s", strerror(errno));
+        poli_log(WARNING, monitor, "Busy polling needs raw access to the energy counters. Using the timer driven sampler thread");
+        free(system_info->raw_samples);
+        system_info->raw_samples = 0;
+        poli_config->sampler_mode = SAMPLER_THREAD;
         return 1;
     }
+    return 0;
+}
+
+/* busy_sampler_loop - spins on the energy counters, keeping each update as a raw sample,
+   and takes the poll samples when they are due*/
+static void *busy_sampler_loop (void *arg)
+{
+    (void) arg;
+    //leave all signals to the application threads
+    sigset_t sigset;
+    sigfillset(&sigset);
+    pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+    struct raw_samples *raw_samples = system_info->raw_samples;
+    while (!__atomic_load_n(&raw_samples->stop, __ATOMIC_ACQUIRE))
+    {
+        if (read_raw_sample(raw_samples, system_info) && ring_count(&raw_samples->ring) == raw_samples->ring.size / 2)
+            notify_polling_writer(poller);
+
+        double now = get_time();
+        if (poller->timer_on && now >= poller->next_poll)
+        {
+            //after a stall, resume the interval from now instead of catching up
+            poller->next_poll += system_info->adaptive_poll.interval;
+            if (poller->next_poll < now)
+                poller->next_poll = now + system_info->adaptive_poll.interval;
+            poll_system();
+        }
+    }
+    return NULL;
+}
+
+static void *sampler_loop (void *arg)
+{
+    (void) arg;
+    //leave all signals to the application threads
+    sigset_t sigset;
+    sigfillset(&sigset);
+    pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+    struct pollfd fds[2];
+    fds[0].fd = poller->timer_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = poller->stop_fd;
+    fds[1].events = POLLIN;
+
+    while (1)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (fds[1].revents & POLLIN)
+            break;
+        if (fds[0].revents & POLLIN)
+        {
+            uint64_t expirations;
+            if (read(poller->timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+                continue;
+            if (poller->timer_on)
+                poll_system();
+        }
+    }
+    return NULL;
+}
+
+static int stop_sampler_thread (void)
+{
+    if (!poller->sampler_on)
+        return 0;
+    poller->sampler_on = 0;
+
+    if (poli_config->sampler_mode == SAMPLER_BUSY)
+    {
+        __atomic_store_n(&system_info->raw_samples->stop, 1, __ATOMIC_RELEASE);
+        pthread_join(poller->sampler_thread, NULL);
+        system_info->energy_lock_on = 0;
+        return 0;
+    }
 
+    uint64_t stop = 1;
+    if (write(poller->stop_fd, &stop, sizeof(stop)) != sizeof(stop))
+        poli_log(ERROR, monitor, "Failed to signal sampler thread: %s", strerror(errno));
+    pthread_join(poller->sampler_thread, NULL);
+    system_info->energy_lock_on = 0;
+
+    close(poller->timer_fd);
+    close(poller->stop_fd);
+    poller->timer_fd = -1;
+    poller->stop_fd = -1;
     return 0;
 }
 
 static int stop_timer (void)
 {
     poller->timer_on = 0;
+    if (poli_config->sampler_mode != SAMPLER_SIGNAL)
+        return stop_sampler_thread();
+
     sigaction(SIGALRM, &poller->sa, NULL);
 
     poller->timer.it_value.tv_sec = 0;
@@ -789,68 +1636,53 @@ static void init_energy_reading (struct energy_reading *reading)
 static void timer_handler (int signum)
 {
     if (poller->timer_on && monitor->imonitor)
-    {
-        if (poller->time_counter < MAX_POLL_SAMPLES)
-        {
-            struct system_poll_info *info = &system_info->system_poll_list[poller->time_counter];
-            info->current_energy = read_current_energy(system_info);
-            info->wtime = get_time();
-            struct energy_reading last_energy = system_info->initial_energy;
+        poll_system();
+    return;
+}
 
-            if (poller->time_counter > 0)
-            {
-                int last_found = 0;
-                int i;
-                for (i = poller->time_counter - 1; i >= 0; i--)
-                {
-                    if (system_info->system_poll_list[i].wtime)
-                    {
-                        last_energy = system_info->system_poll_list[i].current_energy;
-                        //overflow
-                        if (info->wtime < system_info->system_poll_list[i].wtime)
-                            info->time_diff = (double) poli_config->poll_interval; //best approximation
-                        else
-                            info->time_diff = info->wtime - system_info->system_poll_list[i].wtime;
-                        last_found = 1;
-                        break;
-                    }
-                }
-
-                if (!last_found)
-                    info->time_diff = (double) poli_config->poll_interval;
-                
-            }
-            else
-            {
-                info->time_diff = info->wtime - system_info->initial_mpi_wtime;
-            }
+/* poll_system - records one polling sample. called from the sampler thread or the SIGALRM handler */
+static void poll_system (void)
+{
+    unsigned int position;
+    if (ring_reserve_position(&system_info->poll_ring, &position) != 0) //the writer fell behind
+    {
+        system_info->dropped_samples++;
+        notify_polling_writer(poller);
+        return;
+    }
 
-            if (!info->time_diff)
-                info->time_diff = (double) poli_config->poll_interval;
+    int slot = position & system_info->poll_ring.mask;
+    struct poll_columns *columns = &system_info->poll_columns;
+    struct rapl_energy *packages = poll_package_energy(system_info, slot);
+    if (columns->time_error)
+        columns->time_error[slot] = read_energy_at_edge(system_info, &columns->energy[slot], packages, &columns->wtime[slot], 2 * ENERGY_UPDATE_PERIOD);
+    else
+    {
+        columns->energy[slot] = read_package_energy(system_info, packages);
+        columns->wtime[slot] = get_time();
+    }
+    cache_energy_reading(system_info, &columns->energy[slot], packages, columns->wtime[slot]);
+    columns->pcap_ref[slot] = __atomic_load_n(&system_info->num_pcap_events, __ATOMIC_ACQUIRE);
 
-#ifdef _MSR
-            int zone;
-            for (zone = 0; zone < system_info->sysmsr->num_zones; zone++)
-            {
-                info->pcap_info_list[zone] = system_info->current_pcap_list[zone];
-            }
+    ring_commit(&system_info->poll_ring);
+    if (node_power)
+        publish_energy_snapshot(node_power, columns->wtime[slot], &columns->energy[slot], poli_config->power_smoothing);
+#ifdef _POWMGR
+    power_window_add_sample(&system_info->power_window, columns->wtime[slot], &columns->energy[slot]);
 #endif
+    __atomic_store_n(&poller->time_counter, poller->time_counter + 1, __ATOMIC_RELEASE); //only the sampler writes it
 
-            info->counter = poller->time_counter;
-
-            info->pkg_pcap = system_info->current_pcap_list[PACKAGE_INDEX].watts_long;
-            //get_current_frequency_info(system_info, monitor, info, poller);
-            info->last_energy = last_energy;
-
-            compute_current_power(info, info->time_diff, system_info);
-            //poli_log(TRACE, NULL, "%s : current E: %" PRIu64 ", time diff : %f\n", __FUNCTION__, info->current_energy.rapl_energy.package, info->time_diff);
-            info->free_power = info->pkg_pcap - info->computed_power.rapl_power.package;
-            info->power_util = info->computed_power.rapl_power.package / info->pkg_pcap;
-
-            poller->time_counter++;
-        }
+    if (system_info->adaptive_poll.on)
+    {
+        double interval = system_info->adaptive_poll.interval;
+        double next_interval = next_poll_interval(&system_info->adaptive_poll, columns->wtime[slot], &columns->energy[slot],
+            __atomic_load_n(&system_info->tag_events, __ATOMIC_RELAXED));
+        if (next_interval != interval)
+            arm_poll_timer(next_interval, next_interval);
     }
-    return;
+
+    if (ring_count(&system_info->poll_ring) == system_info->poll_ring.size / 2)
+        notify_polling_writer(poller);
 }
 #endif
 
@@ -940,21 +1772,25 @@ static void finalize_power_interfaces (struct system_info_t * system_info)
 
 static int finalize_tags (void)
 {
+    while (system_info->cct.depth > 0)
+    {
+        struct cct_frame *frame = &system_info->cct.frames[system_info->cct.depth - 1];
+        int name_id = system_info->cct.nodes[frame->node].name_id;
+        poli_log(WARNING, monitor, "Tag %s is not finished. It will be closed automatically.", tag_names_get(&system_info->tag_names, name_id));
+        exit_tag_context(name_id);
+    }
+
     if (system_info->num_open_tags + system_info->num_closed_tags == 0)
         return 0;
 
     poli_log(WARNING, monitor, "There are unfinished tags! Attempting to close them...");
 
-    int tag_num;
-
-    for (tag_num = 0; tag_num < system_info->num_poli_tags; tag_num++)
+    //ending a tag removes it from open_tag_ids
+    while (system_info->num_open_tag_ids > 0)
     {
-        struct poli_tag *this_poli_tag = &system_info->poli_tag_list[tag_num];
-        if ( this_poli_tag->closed == 0)
-        {
-            poli_log(WARNING, monitor, "Tag %s is not finished. It will be closed automatically.", this_poli_tag->tag_name);
-            end_existing_poli_tag(this_poli_tag);
-        }
+        struct poli_tag *this_poli_tag = arena_at(&system_info->poli_tag_list, system_info->open_tag_ids[system_info->num_open_tag_ids - 1]);
+        poli_log(WARNING, monitor, "Tag %s is not finished. It will be closed automatically.", tag_names_get(&system_info->tag_names, this_poli_tag->name_id));
+        end_existing_poli_tag(this_poli_tag);
     }
 
     return 0;
@@ -964,7 +1800,7 @@ int poli_finalize(void)
 {
     if (monitor->imonitor)
     {
-        struct poli_tag *app_summary = &system_info->poli_tag_list[0]; //need to close application summary tag which is the first one
+        struct poli_tag *app_summary = arena_at(&system_info->poli_tag_list, 0); //need to close application summary tag which is the first one
         end_existing_poli_tag(app_summary);
     }
     poli_sync();
@@ -993,9 +1829,38 @@ int poli_finalize(void)
 #ifndef _TIMER_OFF
         poli_log(TRACE, monitor, "Stopping timer");
         stop_timer();
+        if (system_info->adaptive_poll.on)
+            poli_log(INFO, monitor, "Adaptive polling took %d samples and detected %ld phase changes",
+                system_info->adaptive_poll.num_samples, system_info->adaptive_poll.phase_changes);
+        poli_log(TRACE, monitor, "Flushing polling records");
+        stop_polling_writer(system_info, monitor, poller);
+#endif
+#ifndef _NOMPI
+        if (system_info->node_tags)
+            drain_node_tag_events(system_info->node_tags, system_info);
+#endif
+        //tag boundaries and thread tag events after the last sample are placed against one final reading
+        struct energy_reading final_energy;
+        double final_wtime = -1;
+#ifndef _TIMER_OFF
+        if (system_info->tag_interpolation)
+        {
+            double time_error = read_energy_at_edge(system_info, &final_energy, NULL, &final_wtime, 2 * ENERGY_UPDATE_PERIOD);
+            interpolate_tag_boundaries(system_info->tag_interpolation, final_wtime, &final_energy, time_error, system_info);
+        }
 #endif
+        if (system_info->thread_tag_buffers)
+        {
+            poli_log(TRACE, monitor, "Attributing energy to thread tags");
+            if (final_wtime < 0)
+            {
+                final_energy = read_current_energy(system_info);
+                final_wtime = get_time();
+            }
+            attribute_thread_tag_events(final_wtime, &final_energy, system_info);
+        }
         poli_log(TRACE, monitor, "Pushing results to file");
-        file_handler(system_info, monitor, poller);
+        file_handler(system_info, monitor);
 
         poli_log(TRACE, monitor,   "Closing frequency file");
         if (system_info->cur_freq_file)
@@ -1004,26 +1869,54 @@ int poli_finalize(void)
         poli_log(TRACE, monitor,   "Cleaning up structures");
 
         /* Cleanup */
-        if (system_info->poli_tag_list)
+        arena_free(&system_info->poli_tag_list);
+        arena_free(&system_info->pcap_tag_list);
+#ifdef _POWMGR
+        arena_free(&system_info->palloc_list);
+#endif
+        if (system_info->open_tag_ids)
         {
-            free(system_info->poli_tag_list);
-            system_info->poli_tag_list = 0;
+            free(system_info->open_tag_ids);
+            system_info->open_tag_ids = 0;
         }
-        if (system_info->pcap_tag_list)
+        tag_table_free(&system_info->open_tag_table);
+        cct_free(&system_info->cct);
+        free_tag_samplers(system_info);
+#ifndef _TIMER_OFF
+        free_tag_power_stats(&system_info->tag_power_stats);
+#endif
+        free_thread_tag_buffers(system_info);
+        tag_names_free(&system_info->tag_names);
+        if (system_info->active_tag_pool)
         {
-            free(system_info->pcap_tag_list);
-            system_info->pcap_tag_list = 0;
+            free(system_info->active_tag_pool);
+            system_info->active_tag_pool = 0;
         }
         if (system_info->current_pcap_list) //this must be done after system reset
         {
             free(system_info->current_pcap_list);
             system_info->current_pcap_list = 0;
         }
+        arena_free(&system_info->pcap_journal);
+        free(system_info->package_energy.poll);
+        free(system_info->package_energy.cache);
+        arena_free(&system_info->package_energy.tags);
 #ifndef _TIMER_OFF
-        if (system_info->system_poll_list)
+        ring_free(&system_info->poll_ring);
+        ring_free(&system_info->marker_ring);
+        free(system_info->poll_columns.wtime);
+        free(system_info->poll_columns.energy);
+        free(system_info->poll_columns.pcap_ref);
+        free(system_info->poll_columns.time_error);
+        if (system_info->tag_interpolation)
         {
-            free(system_info->system_poll_list);
-            system_info->system_poll_list = 0;
+            free_tag_interpolation(system_info->tag_interpolation);
+            free(system_info->tag_interpolation);
+        }
+        if (system_info->raw_samples)
+        {
+            free_raw_samples(system_info->raw_samples);
+            free(system_info->raw_samples);
         }
 #endif
 #ifdef _BENCH
@@ -1044,7 +1937,19 @@ int poli_finalize(void)
 
     }
 
+    if (node_power)
+    {
+        finalize_node_power(node_power, monitor);
+        free(node_power);
+        node_power = 0;
+    }
 #ifndef _NOMPI
+    if (node_tags)
+    {
+        finalize_node_tags(node_tags, monitor);
+        free(node_tags);
+        node_tags = 0;
+    }
     if (!is_finalized())
         MPI_Comm_free(&monitor->mynode_comm);
 #endif
@@ -0,0 +1,81 @@
+#ifndef _TIMER_OFF
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "PoLiMEr.h"
+#include "helpers.h"
+#include "adaptive_poll.h"
+
+void init_adaptive_poll (struct adaptive_poll *adaptive_poll, struct polimer_config_t * poli_config)
+{
+    adaptive_poll->on = poli_config->adaptive_poll;
+    adaptive_poll->interval = poli_config->poll_interval;
+    adaptive_poll->min_interval = poli_config->poll_interval_min;
+    adaptive_poll->max_interval = poli_config->poll_interval_max;
+    adaptive_poll->power_change = poli_config->poll_power_change;
+    if (adaptive_poll->on)
+    {
+        if (adaptive_poll->interval < adaptive_poll->min_interval)
+            adaptive_poll->interval = adaptive_poll->min_interval;
+        if (adaptive_poll->interval > adaptive_poll->max_interval)
+            adaptive_poll->interval = adaptive_poll->max_interval;
+    }
+    adaptive_poll->num_samples = 0;
+    adaptive_poll->phase_changes = 0;
+}
+
+/* true if a and b differ by more than the fraction threshold of the larger one, and by more than floor*/
+static int changed (double a, double b, double threshold, double floor)
+{
+    double reference = (fabs(a) > fabs(b)) ? fabs(a) : fabs(b);
+    return fabs(a - b) > floor && fabs(a - b) > threshold * reference;
+}
+
+double next_poll_interval (struct adaptive_poll *adaptive_poll, double wtime, struct energy_reading *energy, unsigned long tag_events)
+{
+    if (!adaptive_poll->on)
+        return adaptive_poll->interval;
+
+    double elapsed = wtime - adaptive_poll->last_wtime;
+    if (adaptive_poll->num_samples > 0 && elapsed > 0)
+    {
+        double delta[MAX_ENERGY_ZONES];
+        int zone, num_zones = get_energy_zones(delta, energy, &adaptive_poll->last_energy, elapsed);
+        double churn = (tag_events - adaptive_poll->last_tag_events) / elapsed;
+
+        //a phase change needs a rate from the interval before to compare with. only the first zone, the package or else
+        //the node, is compared: the small zones swing by more than the threshold near idle
+        int phase_change = 0;
+        if (adaptive_poll->num_samples > 1)
+        {
+            if (num_zones > 0 && changed(delta[0] / elapsed, adaptive_poll->last_power[0], adaptive_poll->power_change, POLL_POWER_FLOOR))
+                phase_change = 1;
+            if (changed(churn, adaptive_poll->last_churn, POLL_CHURN_CHANGE, POLL_CHURN_FLOOR))
+                phase_change = 1;
+        }
+
+        if (phase_change)
+        {
+            adaptive_poll->interval = adaptive_poll->min_interval;
+            adaptive_poll->phase_changes++;
+        }
+        else
+        {
+            adaptive_poll->interval *= POLL_BACKOFF;
+            if (adaptive_poll->interval > adaptive_poll->max_interval)
+                adaptive_poll->interval = adaptive_poll->max_interval;
+        }
+
+        for (zone = 0; zone < num_zones; zone++)
+            adaptive_poll->last_power[zone] = delta[zone] / elapsed;
+        adaptive_poll->last_churn = churn;
+    }
+
+    adaptive_poll->num_samples++;
+    adaptive_poll->last_wtime = wtime;
+    adaptive_poll->last_energy = *energy;
+    adaptive_poll->last_tag_events = tag_events;
+    return adaptive_poll->interval;
+}
+#endif
@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "arena.h"
+
+int arena_init (struct chunked_arena *arena, size_t elem_size)
+{
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (page_size <= 0)
+        page_size = 4096;
+
+    memset(arena, 0, sizeof(struct chunked_arena));
+    if (elem_size == 0)
+        return 1;
+    arena->elem_size = elem_size;
+
+    //largest power of 2 number of elements fitting into a page, at least one
+    while (((size_t) 2 << arena->first_shift) * elem_size <= (size_t) page_size)
+        arena->first_shift++;
+    return 0;
+}
+
+void arena_free (struct chunked_arena *arena)
+{
+    int i;
+    for (i = 0; i < arena->num_chunks; i++)
+    {
+        munmap(arena->chunks[i], arena->chunk_bytes[i]);
+        arena->chunks[i] = 0;
+    }
+    arena->num_chunks = 0;
+    arena->capacity = 0;
+}
+
+static int add_chunk (struct chunked_arena *arena)
+{
+    int chunk = arena->num_chunks;
+    if (chunk >= ARENA_MAX_CHUNKS)
+        return 1;
+
+    size_t num_elems = (size_t) 1 << (arena->first_shift + chunk);
+    //the capacity must stay representable
+    size_t capacity = ((size_t) 2 << (arena->first_shift + chunk)) - ((size_t) 1 << arena->first_shift);
+    if (capacity > UINT_MAX || num_elems > SIZE_MAX / arena->elem_size)
+        return 1;
+    size_t bytes = num_elems * arena->elem_size;
+    //anonymous mappings are zeroed and only backed by memory once touched
+    void *mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+        return 1;
+
+    arena->chunks[chunk] = mem;
+    arena->chunk_bytes[chunk] = bytes;
+    arena->num_chunks = chunk + 1;
+    //publish the chunk to readers checking the capacity
+    __atomic_store_n(&arena->capacity, (unsigned int) capacity, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void *arena_at (struct chunked_arena *arena, unsigned int index)
+{
+    if (index >= ARENA_MAX_ELEMS)
+        return NULL;
+    while (index >= __atomic_load_n(&arena->capacity, __ATOMIC_ACQUIRE))
+        if (add_chunk(arena) != 0)
+            return NULL;
+
+    //chunk k starts at element first * (2^k - 1)
+    unsigned int q = (index >> arena->first_shift) + 1;
+    int chunk = 31 - __builtin_clz(q);
+    size_t offset = index - ((((size_t) 1 << chunk) - 1) << arena->first_shift);
+    return arena->chunks[chunk] + offset * arena->elem_size;
+}
+
+unsigned int arena_capacity (struct chunked_arena *arena)
+{
+    return __atomic_load_n(&arena->capacity, __ATOMIC_ACQUIRE);
+}
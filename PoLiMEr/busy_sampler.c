@@ -0,0 +1,149 @@
+#ifndef _TIMER_OFF
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "PoLiMEr.h"
+#include "poli_clock.h"
+#include "busy_sampler.h"
+#include "stats_kernels.h"
+
+#ifdef _MSR
+#include "msr_handler.h"
+#endif
+
+int init_raw_samples (struct raw_samples *raw_samples, unsigned int size, glitch_filter_t filter, struct system_info_t * system_info)
+{
+    memset(raw_samples, 0, sizeof(struct raw_samples));
+#ifdef _MSR
+    raw_samples->num_counters = rapl_read_raw_energy(raw_samples->read_counters, raw_samples->units, system_info);
+    raw_samples->last_wtime = get_time();
+#endif
+    if (raw_samples->num_counters == 0)
+        return 1;
+    raw_samples->num_zones = NUM_RAPL_DOMAINS;
+    memcpy(raw_samples->last_counters, raw_samples->read_counters, sizeof(raw_samples->last_counters));
+
+    if (ring_init(&raw_samples->ring, size, 0) != 0)
+        return 1;
+    size = raw_samples->ring.size;
+    raw_samples->wtime = malloc(size * sizeof(double));
+    raw_samples->interval = malloc(size * sizeof(double));
+    int zone, counter, failed = (raw_samples->wtime == NULL || raw_samples->interval == NULL);
+    raw_samples->filter = filter;
+    if (filter != FILTER_NONE)
+    {
+        raw_samples->filtered = malloc(size * sizeof(double));
+        failed |= (raw_samples->filtered == NULL);
+    }
+    for (counter = 0; counter < raw_samples->num_counters; counter++)
+    {
+        raw_samples->counters[counter] = malloc(size * sizeof(uint32_t));
+        failed |= (raw_samples->counters[counter] == NULL);
+    }
+    for (zone = 0; zone < raw_samples->num_zones; zone++)
+    {
+        raw_samples->power[zone] = malloc(size * sizeof(double));
+        failed |= (raw_samples->power[zone] == NULL);
+    }
+    if (failed)
+    {
+        free_raw_samples(raw_samples);
+        return 1;
+    }
+    return 0;
+}
+
+void free_raw_samples (struct raw_samples *raw_samples)
+{
+    int zone, counter;
+    ring_free(&raw_samples->ring);
+    free(raw_samples->wtime);
+    free(raw_samples->interval);
+    free(raw_samples->filtered);
+    raw_samples->filtered = 0;
+    for (counter = 0; counter < raw_samples->num_counters; counter++)
+        free(raw_samples->counters[counter]);
+    for (zone = 0; zone < raw_samples->num_zones; zone++)
+        free(raw_samples->power[zone]);
+    raw_samples->wtime = 0;
+    raw_samples->interval = 0;
+    raw_samples->num_counters = 0;
+    raw_samples->num_zones = 0;
+}
+
+int read_raw_sample (struct raw_samples *raw_samples, struct system_info_t * system_info)
+{
+#ifdef _MSR
+    uint32_t counters[MAX_RAW_COUNTERS];
+    if (rapl_read_raw_energy(counters, NULL, system_info) == 0)
+        return 0;
+    double wtime = get_time();
+    //the counters of a package move together at each update, reads between updates carry nothing new.
+    //packages update at their own pace, so a sample is kept once all of them moved
+    int package;
+    for (package = 0; package < raw_samples->num_counters / NUM_RAPL_DOMAINS; package++)
+        if (memcmp(counters + package * NUM_RAPL_DOMAINS, raw_samples->read_counters + package * NUM_RAPL_DOMAINS, NUM_RAPL_DOMAINS * sizeof(uint32_t)) == 0)
+            return 0;
+    memcpy(raw_samples->read_counters, counters, raw_samples->num_counters * sizeof(uint32_t));
+
+    unsigned int position;
+    if (ring_reserve_position(&raw_samples->ring, &position) != 0) //the writer fell behind
+    {
+        raw_samples->dropped++;
+        return 0;
+    }
+    int counter, slot = position & raw_samples->ring.mask;
+    raw_samples->wtime[slot] = wtime;
+    for (counter = 0; counter < raw_samples->num_counters; counter++)
+        raw_samples->counters[counter][slot] = counters[counter];
+    ring_commit(&raw_samples->ring);
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+void convert_raw_samples (struct raw_samples *raw_samples, unsigned int slot, unsigned int n)
+{
+    if (n == 0)
+        return;
+    //one pass per column over restrict qualified arrays, so the loops vectorize
+    const double *restrict wtime = raw_samples->wtime + slot;
+    double *restrict interval = raw_samples->interval;
+    unsigned int i;
+    interval[0] = wtime[0] - raw_samples->last_wtime;
+    for (i = 1; i < n; i++)
+        interval[i] = wtime[i] - wtime[i - 1];
+
+    int zone, counter;
+    for (zone = 0; zone < raw_samples->num_zones; zone++)
+        memset(raw_samples->power[zone], 0, n * sizeof(double));
+    //the power of a zone is the sum over the packages
+    for (counter = 0; counter < raw_samples->num_counters; counter++)
+    {
+        const uint32_t *restrict counters = raw_samples->counters[counter] + slot;
+        double *restrict power = raw_samples->power[counter % NUM_RAPL_DOMAINS];
+        double unit = raw_samples->units[counter];
+        //unsigned differences stay correct across a wrap of the 32 bit counters
+        power[0] += (double) (uint32_t) (counters[0] - raw_samples->last_counters[counter]) * unit / interval[0];
+        for (i = 1; i < n; i++)
+            power[i] += (double) (uint32_t) (counters[i] - counters[i - 1]) * unit / interval[i];
+        raw_samples->last_counters[counter] = counters[n - 1];
+    }
+    raw_samples->last_wtime = wtime[n - 1];
+
+    //reads racing a counter update show as a drop next to a spike. runs are filtered separately, so their ends are kept
+    for (zone = 0; zone < raw_samples->num_zones && raw_samples->filter != FILTER_NONE; zone++)
+    {
+        double *power = raw_samples->power[zone];
+        if (raw_samples->filter == FILTER_MEDIAN3)
+            stats_median3(power, raw_samples->filtered, n);
+        else
+            stats_hampel(power, raw_samples->filtered, n, HF_HAMPEL_HALF_WINDOW, HF_HAMPEL_THRESHOLD);
+        raw_samples->power[zone] = raw_samples->filtered;
+        raw_samples->filtered = power;
+    }
+}
+#endif
@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "PoLiMEr.h"
+#include "helpers.h"
+#include "cct.h"
+
+#define CCT_INITIAL_NODES 64
+#define CCT_INITIAL_DEPTH 16
+
+/* nodes are keyed by (parent, name), mixing the parent into the precomputed name hash*/
+static uint32_t context_hash (int parent, uint32_t name_hash)
+{
+    return name_hash ^ ((uint32_t) (parent + 1) * 2654435761u);
+}
+
+int cct_init (struct calling_context_tree *cct)
+{
+    memset(cct, 0, sizeof(struct calling_context_tree));
+    cct->first_root = -1;
+    cct->last_root = -1;
+    cct->num_zones = get_num_energy_zones();
+    cct->max_nodes = CCT_INITIAL_NODES;
+    cct->nodes = malloc(cct->max_nodes * sizeof(struct cct_node));
+    cct->max_depth = CCT_INITIAL_DEPTH;
+    cct->frames = malloc(cct->max_depth * sizeof(struct cct_frame));
+    if (cct->nodes == NULL || cct->frames == NULL)
+        return 1;
+    return tag_table_init(&cct->index, 2 * CCT_INITIAL_NODES);
+}
+
+void cct_free (struct calling_context_tree *cct)
+{
+    if (cct->nodes)
+    {
+        free(cct->nodes);
+        cct->nodes = 0;
+    }
+    if (cct->frames)
+    {
+        free(cct->frames);
+        cct->frames = 0;
+    }
+    cct->num_nodes = 0;
+    cct->depth = 0;
+    tag_table_free(&cct->index);
+}
+
+static int find_node (struct calling_context_tree *cct, int parent, int name_id, uint32_t hash)
+{
+    unsigned int position = hash;
+    struct tag_table_entry *entry;
+    while ((entry = tag_table_probe(&cct->index, hash, &position)) != NULL)
+    {
+        struct cct_node *node = &cct->nodes[entry->value];
+        if (node->parent == parent && node->name_id == name_id)
+            return entry->value;
+    }
+    return -1;
+}
+
+static int add_node (struct calling_context_tree *cct, int parent, int name_id, uint32_t hash)
+{
+    if (cct->num_nodes == cct->max_nodes)
+    {
+        struct cct_node *nodes = realloc(cct->nodes, 2 * cct->max_nodes * sizeof(struct cct_node));
+        if (nodes == NULL)
+            return -1;
+        cct->nodes = nodes;
+        cct->max_nodes *= 2;
+    }
+
+    int node_id = cct->num_nodes;
+    if (tag_table_insert(&cct->index, hash, node_id, node_id) != 0)
+        return -1;
+
+    struct cct_node *node = &cct->nodes[node_id];
+    memset(node, 0, sizeof(struct cct_node));
+    node->parent = parent;
+    node->name_id = name_id;
+    node->first_child = -1;
+    node->last_child = -1;
+    node->next_sibling = -1;
+    int zone;
+    for (zone = 0; zone < MAX_ENERGY_ZONES; zone++)
+        node->min_power[zone] = -1.0;
+
+    //children are kept in the order they were first entered
+    int *last = (parent >= 0) ? &cct->nodes[parent].last_child : &cct->last_root;
+    int *first = (parent >= 0) ? &cct->nodes[parent].first_child : &cct->first_root;
+    if (*last >= 0)
+        cct->nodes[*last].next_sibling = node_id;
+    else
+        *first = node_id;
+    *last = node_id;
+
+    cct->num_nodes++;
+    return node_id;
+}
+
+int cct_enter (struct calling_context_tree *cct, int name_id, uint32_t name_hash, struct energy_reading *energy, double time)
+{
+    int parent = (cct->depth > 0) ? cct->frames[cct->depth - 1].node : -1;
+    uint32_t hash = context_hash(parent, name_hash);
+
+    int node_id = find_node(cct, parent, name_id, hash);
+    if (node_id < 0)
+        node_id = add_node(cct, parent, name_id, hash);
+    if (node_id < 0)
+        return 1;
+
+    if (cct->depth == cct->max_depth)
+    {
+        struct cct_frame *frames = realloc(cct->frames, 2 * cct->max_depth * sizeof(struct cct_frame));
+        if (frames == NULL)
+            return 1;
+        cct->frames = frames;
+        cct->max_depth *= 2;
+    }
+
+    struct cct_frame *frame = &cct->frames[cct->depth++];
+    frame->node = node_id;
+    frame->start_energy = *energy;
+    frame->start_time = time;
+    frame->child_time = 0.0;
+    memset(frame->child_energy, 0, sizeof(frame->child_energy));
+    return 0;
+}
+
+int cct_exit (struct calling_context_tree *cct, int name_id, struct energy_reading *energy, double time)
+{
+    int i;
+    //usually the innermost frame, unless tags are interleaved
+    for (i = cct->depth - 1; i >= 0; i--)
+        if (cct->nodes[cct->frames[i].node].name_id == name_id)
+            break;
+    if (i < 0)
+        return 1;
+
+    struct cct_frame *frame = &cct->frames[i];
+    struct cct_node *node = &cct->nodes[frame->node];
+    double elapsed = time - frame->start_time;
+    double zones[MAX_ENERGY_ZONES];
+    int zone;
+
+    get_energy_zones(zones, energy, &frame->start_energy, elapsed);
+
+    node->count++;
+    node->inclusive_time += elapsed;
+    node->exclusive_time += elapsed - frame->child_time;
+    for (zone = 0; zone < cct->num_zones; zone++)
+    {
+        node->inclusive_energy[zone] += zones[zone];
+        node->exclusive_energy[zone] += zones[zone] - frame->child_energy[zone];
+        if (elapsed > 0)
+        {
+            double power = zones[zone] / elapsed;
+            if (node->min_power[zone] < 0 || power < node->min_power[zone])
+                node->min_power[zone] = power;
+            if (power > node->max_power[zone])
+                node->max_power[zone] = power;
+        }
+    }
+
+    //charge this invocation to the enclosing frame
+    if (i > 0)
+    {
+        struct cct_frame *enclosing = &cct->frames[i - 1];
+        enclosing->child_time += elapsed;
+        for (zone = 0; zone < cct->num_zones; zone++)
+            enclosing->child_energy[zone] += zones[zone];
+    }
+
+    memmove(frame, frame + 1, (cct->depth - i - 1) * sizeof(struct cct_frame));
+    cct->depth--;
+    return 0;
+}
@@ -96,7 +96,7 @@ static int read_cpufreq (struct system_info_t * system_info, struct monitor_t *
         int hz = 0;
         if (system_info->cur_freq_file > 0)
         {
-            if (poller->time_counter > 0)
+            if (__atomic_load_n(&poller->time_counter, __ATOMIC_ACQUIRE) > 0)
             {
                 if(lseek(system_info->cur_freq_file, 0, SEEK_SET) < 0)
                 {
@@ -31,26 +31,23 @@
 #include "cray_handler.h"
 #endif
 
-double get_time (void)
-{
-#ifndef _NOMPI
-    return MPI_Wtime();
-#else
-    return (double) time(NULL);
-#endif
-}
-
 void get_initial_time(struct system_info_t * system_info, struct monitor_t * monitor)
 {
     int collective = 1;
+    double stime = get_time();
     if (monitor->num_monitors == 1 || !collective)
-        system_info->initial_mpi_wtime = get_time();
+        system_info->initial_mpi_wtime = stime;
+#ifndef _NOMPI
     else if (collective)
     {
-        double stime = get_time();
-        MPI_Allreduce(&stime, &system_info->initial_mpi_wtime, 1, MPI_DOUBLE, MPI_MIN, monitor->monitors_comm);
+        //monotonic clocks of different nodes start at different origins, the earliest start is found in wall time
+        double wall = clock_to_wall(stime);
+        double earliest_wall;
+        MPI_Allreduce(&wall, &earliest_wall, 1, MPI_DOUBLE, MPI_MIN, monitor->monitors_comm);
+        system_info->initial_mpi_wtime = stime - (wall - earliest_wall);
     }
-    gettimeofday(&system_info->initial_start_time, NULL);
+#endif
+    clock_to_timeval(system_info->initial_mpi_wtime, &system_info->initial_start_time);
     return;
 }
 
@@ -71,19 +68,196 @@ int compute_current_power (struct system_poll_info * info, double time, struct s
 }
 
 struct energy_reading read_current_energy (struct system_info_t * system_info)
+{
+    return read_package_energy(system_info, NULL);
+}
+
+struct energy_reading read_package_energy (struct system_info_t * system_info, struct rapl_energy *packages)
 {
     struct energy_reading current_energy;
+    int num_packages = system_info->package_energy.num_packages;
 #ifdef _MSR
-    rapl_read_energy(&(current_energy.rapl_energy), system_info);
+    //the backends fill all recorded packages
+    struct rapl_energy all_packages[MAX_RECORDED_PACKAGES];
+#endif
+#ifndef _TIMER_OFF
+    //the sampler thread and the application may read counters concurrently
+    int locked = system_info->energy_lock_on;
+    if (locked)
+        pthread_mutex_lock(&system_info->energy_lock);
+#endif
+#ifdef _MSR
+    rapl_read_energy(&(current_energy.rapl_energy), (packages && num_packages) ? all_packages : NULL, system_info);
 #elif _CRAY
     get_cray_measurement(&(current_energy.cray_meas), system_info);
 #elif _BGQ
     init_bgq_measurement(&(current_energy.bgq_meas));
     get_bgq_measurement(&(current_energy.bgq_meas), system_info);
+#endif
+#ifndef _TIMER_OFF
+    if (locked)
+        pthread_mutex_unlock(&system_info->energy_lock);
+#endif
+#ifdef _MSR
+    if (packages && num_packages)
+        memcpy(packages, all_packages, num_packages * sizeof(struct rapl_energy));
+#else
+    (void) num_packages;
 #endif
     return current_energy;
 }
 
+void cache_energy_reading (struct system_info_t * system_info, struct energy_reading *energy, struct rapl_energy *packages, double wtime)
+{
+    struct energy_cache *cache = &system_info->energy_cache;
+    unsigned int sequence = __atomic_load_n(&cache->sequence, __ATOMIC_ACQUIRE);
+    //the sampler and the application may both offer readings, the one which loses the race drops its reading
+    if ((sequence & 1) || !__atomic_compare_exchange_n(&cache->sequence, &sequence, sequence + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        return;
+    if (wtime > cache->wtime)
+    {
+        cache->energy = *energy;
+        cache->wtime = wtime;
+        if (packages && system_info->package_energy.cache)
+            memcpy(system_info->package_energy.cache, packages, system_info->package_energy.num_packages * sizeof(struct rapl_energy));
+    }
+    __atomic_store_n(&cache->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+struct energy_reading read_cached_energy (struct system_info_t * system_info, double *wtime)
+{
+    return read_cached_package_energy(system_info, wtime, NULL);
+}
+
+struct energy_reading read_cached_package_energy (struct system_info_t * system_info, double *wtime, struct rapl_energy *packages)
+{
+    struct energy_cache *cache = &system_info->energy_cache;
+    struct energy_reading energy;
+    struct package_energy_t *package_energy = &system_info->package_energy;
+    struct rapl_energy fresh_packages[MAX_RECORDED_PACKAGES];
+    size_t package_bytes = package_energy->num_packages * sizeof(struct rapl_energy);
+    double now = get_time();
+    if (cache->ttl > 0)
+    {
+        double cached_wtime;
+        unsigned int sequence = __atomic_load_n(&cache->sequence, __ATOMIC_ACQUIRE);
+        if (!(sequence & 1))
+        {
+            energy = cache->energy;
+            cached_wtime = cache->wtime;
+            if (packages && package_energy->cache)
+                memcpy(packages, package_energy->cache, package_bytes);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            //a torn or stale copy falls through to a fresh reading
+            if (sequence == __atomic_load_n(&cache->sequence, __ATOMIC_RELAXED) && cached_wtime >= 0 && now - cached_wtime < cache->ttl)
+            {
+                if (wtime)
+                    *wtime = cached_wtime;
+                return energy;
+            }
+        }
+    }
+
+    //the cache keeps the packages even if the caller doesn't need them
+    energy = read_package_energy(system_info, fresh_packages);
+    if (cache->ttl > 0)
+        cache_energy_reading(system_info, &energy, fresh_packages, now);
+    if (packages)
+        memcpy(packages, fresh_packages, package_bytes);
+    if (wtime)
+        *wtime = now;
+    return energy;
+}
+
+double read_energy_at_edge (struct system_info_t * system_info, struct energy_reading *energy, struct rapl_energy *packages, double *wtime, double max_wait)
+{
+    double delta[MAX_ENERGY_ZONES];
+    struct energy_reading first = read_package_energy(system_info, packages);
+    double start = get_time();
+    double before = start;
+    double now = start;
+    *energy = first;
+    *wtime = start;
+    //without energy zones there is no update to wait for
+    if (get_energy_zones(delta, &first, &first, 0) == 0)
+        return ENERGY_UPDATE_PERIOD;
+
+    while (now - start < max_wait)
+    {
+        *energy = read_package_energy(system_info, packages);
+        now = get_time();
+        get_energy_zones(delta, energy, &first, now - start);
+        if (delta[0] != 0)
+        {
+            //the update happened between the previous read and this one
+            *wtime = now;
+            return now - before;
+        }
+        before = now;
+    }
+    *wtime = now;
+    return ENERGY_UPDATE_PERIOD;
+}
+
+struct rapl_energy *poll_package_energy (struct system_info_t * system_info, int slot)
+{
+    struct package_energy_t *package_energy = &system_info->package_energy;
+    if (package_energy->poll == NULL)
+        return NULL;
+    return &package_energy->poll[slot * package_energy->num_packages];
+}
+
+struct rapl_energy *tag_package_energy (struct system_info_t * system_info, int tag_id, int end)
+{
+    struct package_energy_t *package_energy = &system_info->package_energy;
+    if (package_energy->num_packages == 0)
+        return NULL;
+    struct rapl_energy *tag = arena_at(&package_energy->tags, tag_id);
+    if (tag == NULL)
+        return NULL;
+    return &tag[end * package_energy->num_packages];
+}
+
+#ifndef _TIMER_OFF
+/* get_poll_sample - reconstructs the poll sample recorded at the given counter, with power computed against the sample before it.
+   samples which were not recorded yet, or were overwritten in the poll ring before or while they were read, read as zeros
+   returns: 0 if the sample was found, 1 otherwise*/
+int get_poll_sample (struct system_info_t * system_info, int counter, struct system_poll_info * info)
+{
+    memset(info, 0, sizeof(struct system_poll_info));
+    if (counter < 0 || !ring_holds(&system_info->poll_ring, (unsigned int) counter))
+        return 1;
+
+    struct poll_columns *columns = &system_info->poll_columns;
+    int slot = counter & system_info->poll_ring.mask;
+    info->counter = counter;
+    info->wtime = columns->wtime[slot];
+    info->current_energy = columns->energy[slot];
+
+    double last_wtime = system_info->initial_mpi_wtime;
+    info->last_energy = system_info->initial_energy;
+    if (counter > 0)
+    {
+        if (!ring_holds(&system_info->poll_ring, (unsigned int) (counter - 1)))
+            return 0; //no power without the sample before it
+        int last_slot = (counter - 1) & system_info->poll_ring.mask;
+        last_wtime = columns->wtime[last_slot];
+        info->last_energy = columns->energy[last_slot];
+    }
+    //the sampler may have reused the slots while they were read
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (!ring_holds(&system_info->poll_ring, (unsigned int) (counter > 0 ? counter - 1 : counter)))
+    {
+        memset(info, 0, sizeof(struct system_poll_info));
+        return 1;
+    }
+    info->time_diff = info->wtime - last_wtime;
+    if (info->time_diff > 0)
+        compute_current_power(info, info->time_diff, system_info);
+    return 0;
+}
+#endif
+
 void get_timestamp(double time_from_start, char *time_str_buffer, size_t buff_len,
     struct timeval * initial_start_time)
 {
@@ -162,7 +336,11 @@ int compute_power_from_tag(struct poli_tag *tag, double time)
 {
 #ifdef _MSR
     rapl_compute_total_energy(&(tag->total_energy.rapl_energy), &(tag->end_energy.rapl_energy), &(tag->start_energy.rapl_energy));
-    rapl_compute_total_power(&(tag->total_power.rapl_power), &(tag->total_energy.rapl_energy), time);
+    //both ends of a tag shorter than the energy ttl can be the same cached reading
+    if (time > 0)
+        rapl_compute_total_power(&(tag->total_power.rapl_power), &(tag->total_energy.rapl_energy), time);
+    else
+        memset(&(tag->total_power.rapl_power), 0, sizeof(struct rapl_power));
 #endif
 #ifdef _CRAY
     compute_cray_total_measurements(&(tag->total_energy.cray_meas), &(tag->end_energy.cray_meas), &(tag->start_energy.cray_meas), time);
@@ -171,4 +349,47 @@ int compute_power_from_tag(struct poli_tag *tag, double time)
 #endif
 
     return 0;
-}
\ No newline at end of file
+}
+
+/* BGQ measurements are instantaneous power and are not aggregated as energy*/
+static const char *energy_zone_names[] = {
+#ifdef _MSR
+    "RAPL pkg", "RAPL PP0", "RAPL PP1", "RAPL platform", "RAPL dram",
+#endif
+#ifdef _CRAY
+    "Cray node", "Cray cpu", "Cray memory",
+#endif
+    0
+};
+
+int get_num_energy_zones (void)
+{
+    return sizeof(energy_zone_names) / sizeof(energy_zone_names[0]) - 1;
+}
+
+const char *get_energy_zone_name (int zone)
+{
+    return energy_zone_names[zone];
+}
+
+int get_energy_zones (double *zones, struct energy_reading *end, struct energy_reading *start, double time)
+{
+    int num_zones = 0;
+#ifdef _MSR
+    struct rapl_energy re;
+    rapl_compute_total_energy(&re, &(end->rapl_energy), &(start->rapl_energy));
+    zones[num_zones++] = re.package;
+    zones[num_zones++] = re.pp0;
+    zones[num_zones++] = re.pp1;
+    zones[num_zones++] = re.platform;
+    zones[num_zones++] = re.dram;
+#endif
+#ifdef _CRAY
+    struct cray_measurement cm;
+    compute_cray_total_measurements(&cm, &(end->cray_meas), &(start->cray_meas), time);
+    zones[num_zones++] = cm.node_energy;
+    zones[num_zones++] = cm.cpu_energy;
+    zones[num_zones++] = cm.memory_energy;
+#endif
+    return num_zones;
+}
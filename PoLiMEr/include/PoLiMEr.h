@@ -6,17 +6,25 @@ extern "C"
 {
 #endif
 
+#include <stdio.h>
 #include <sys/types.h>
 #include <sys/time.h>
 #include <stdint.h>
 #include <signal.h>
 #include <time.h>
+#ifndef _TIMER_OFF
+#include <pthread.h>
+#endif
 
 #ifndef _NOMPI
 #include "mpi.h"
 #endif
 
 #include "msr_handler.h"
+#include "ring_buffer.h"
+#include "arena.h"
+#include "tag_table.h"
+#include "poli_clock.h"
 
 #ifdef _CRAY
 #include "cray_handler.h"
@@ -27,13 +35,50 @@ extern "C"
 #endif
 
 
-// Maximum number of user-specified tags
-#define MAX_TAGS     10000
-// Maximum number of polling records
+// Initial room for ids of open tags, grows as needed
+#define OPEN_TAGS_INITIAL 64
+// Maximum number of polling records kept for benchmarking
 #define MAX_POLL_SAMPLES 500000
+// Number of polling records buffered in memory before they are written out
+#define POLL_RING_SIZE 8192
+// Tag events buffered in memory before the polling writer places them among the polling records
+#define MARKER_RING_SIZE 65536
+// Seconds between flushes of the polling records to file
+#define FLUSH_INTERVAL 1.0
+// Raw energy samples buffered in memory in busy polling mode, about a minute at the update rate of RAPL
+#define RAW_RING_SIZE 65536
+// Energy counters read per raw energy sample in busy polling mode: the zones of every package
+#define MAX_RAW_COUNTERS (NUM_RAPL_DOMAINS * MAX_PACKAGES)
+// Hampel filter of the busy polling power: neighbours on either side, and deviations from their median taken as a glitch
+#define HF_HAMPEL_HALF_WINDOW 5
+#define HF_HAMPEL_THRESHOLD 3.0
 #define POLL_INTERVAL 0.2
+// Bounds (s) of the poll interval in adaptive mode
+#define POLL_INTERVAL_MIN 0.01
+#define POLL_INTERVAL_MAX 2.0
+// Relative change of the power between two polls taken as a phase change in adaptive mode
+#define POLL_POWER_CHANGE 0.1
+// Relative change of the rate of tag events between two polls taken as a phase change in adaptive mode
+#define POLL_CHURN_CHANGE 0.5
+// Smallest changes of the power (W) and of the rate of tag events (1/s) taken as a phase change, so that noise near idle isn't
+#define POLL_POWER_FLOOR 5.0
+#define POLL_CHURN_FLOOR 10.0
+// Factor the poll interval grows by after each poll in steady state
+#define POLL_BACKOFF 1.5
 #define INITIAL_TIMER_DELAY 100000
 #define TAG_NAME_LEN 500
+// Tag events each non-monitor rank can hold in node shared memory until the monitor collects them
+#define NODE_TAG_EVENTS 16384
+// Bytes of tag names each non-monitor rank can publish in node shared memory
+#define NODE_TAG_NAME_BYTES 65536
+// Time constant (s) of the moving average of the power published to all ranks
+#define POWER_SMOOTHING 1.0
+// Seconds an energy reading is reused instead of reading the counters again (RAPL updates about every 1 ms)
+#define ENERGY_TTL 0.001
+// Seconds between updates of the energy counters, bounds how stale a reading not aligned to an update can be
+#define ENERGY_UPDATE_PERIOD 0.001
+// Maximum number of energy zones aggregated per calling context
+#define MAX_ENERGY_ZONES 8
 
 struct monitor_t {
     int imonitor;
@@ -68,8 +113,11 @@ struct monitor_t {
     char *my_host;
 };
 
+typedef enum sampler_modes { SAMPLER_SIGNAL, SAMPLER_THREAD, SAMPLER_BUSY } sampler_mode_t;
+typedef enum glitch_filters { FILTER_NONE, FILTER_MEDIAN3, FILTER_HAMPEL } glitch_filter_t;
+
 struct poller_t {
-    int time_counter;
+    volatile int time_counter; //poll samples taken, written by the sampler and read through __atomic builtins
 #ifdef _BENCH
     int time_counter_em;
 #endif
@@ -77,6 +125,15 @@ struct poller_t {
     struct sigaction sa;
     struct itimerval timer;
     volatile int timer_on;
+    pthread_t sampler_thread;
+    int sampler_on; //the sampler thread was started and has to be joined
+    int timer_fd;
+    int stop_fd;
+    double next_poll; //time of the next poll sample in busy polling mode
+    pthread_t writer_thread;
+    int writer_fd; //eventfd waking up the writer
+    volatile int writer_on;
+    FILE *poll_file;
 #endif
 };
 
@@ -109,7 +166,7 @@ struct power_reading {
 
 struct poli_tag {
     int id;
-    char tag_name[TAG_NAME_LEN];
+    int name_id; //into tag_names, the name is only looked up for output
     int monitor_id;
     int monitor_rank;
 
@@ -120,11 +177,182 @@ struct poli_tag {
 
     double start_time;
     double end_time;
-    struct timeval start_timestamp;
-    struct timeval end_timestamp;
     int start_timer_count;
     int end_timer_count;
     int closed;
+    int open_index; //position in open_tag_ids while the tag is open
+    int prev_same_name; //id of the previously opened tag of the same name still open, -1 if none
+};
+
+/* how the invocations of a tag name are recorded, see poli_set_tag_sampling*/
+typedef enum poli_sampling_policies { POLI_SAMPLE_ALL, POLI_SAMPLE_EVERY_N, POLI_SAMPLE_TIME, POLI_SAMPLE_RESERVOIR } poli_sampling_t;
+
+/* an invocation kept in the reservoir of a sampled tag name */
+struct sampled_invocation {
+    double time;
+    double energy[MAX_ENERGY_ZONES];
+};
+
+/* sampling state of one tag name. every invocation is counted, only sampled ones are recorded as poli tags */
+struct tag_sampler {
+    poli_sampling_t policy;
+    double parameter; //N, seconds between sampled invocations, or the reservoir size
+    int configured; //set once the policy was chosen, by the user or from the default
+    long invocations;
+    long sampled;
+    uint64_t open_sampled; //one bit per nesting level of the open invocations, set if that invocation is sampled
+    int open_depth;
+    double last_sample_time;
+    uint64_t random_state;
+    int num_zones;
+    //running mean and sum of squared deviations (Welford) of the sampled invocations
+    double mean_time;
+    double m2_time;
+    double mean_energy[MAX_ENERGY_ZONES];
+    double m2_energy[MAX_ENERGY_ZONES];
+    struct sampled_invocation *reservoir; //uniform sample of all invocations, for POLI_SAMPLE_RESERVOIR
+    int reservoir_len;
+};
+
+/* node of the calling context tree, aggregating all invocations of a tag under the same chain of enclosing tags */
+struct cct_node {
+    int parent; //-1 for top level tags
+    int name_id;
+    int first_child;
+    int last_child;
+    int next_sibling;
+    long count;
+    double inclusive_time;
+    double exclusive_time;
+    double inclusive_energy[MAX_ENERGY_ZONES];
+    double exclusive_energy[MAX_ENERGY_ZONES];
+    double min_power[MAX_ENERGY_ZONES]; //over single invocations, -1 until measured
+    double max_power[MAX_ENERGY_ZONES];
+};
+
+/* open invocation in the calling context tree */
+struct cct_frame {
+    int node;
+    struct energy_reading start_energy;
+    double start_time;
+    double child_time;
+    double child_energy[MAX_ENERGY_ZONES];
+};
+
+struct calling_context_tree {
+    struct cct_node *nodes;
+    int num_nodes;
+    int max_nodes;
+    int first_root;
+    int last_root;
+    struct tag_table index; //(parent, name id) -> node
+    struct cct_frame *frames; //open invocations, innermost last
+    int depth;
+    int max_depth;
+    int num_zones;
+};
+
+typedef enum thread_tag_event_types { THREAD_TAG_START, THREAD_TAG_END } thread_tag_event_t;
+
+/* tag event issued by an OpenMP thread other than the master thread */
+struct thread_tag_event {
+    thread_tag_event_t type;
+    int name_id;
+    double wtime;
+    double energy[MAX_ENERGY_ZONES]; //node energy since poli_init at wtime, interpolated from the poll samples
+};
+
+/* tag events of one thread, appended by that thread only and read by whoever attributes energy to them */
+struct thread_tag_buffer {
+    int thread_id;
+    int rank; //world rank which issued the tags
+    struct chunked_arena events; //of struct thread_tag_event
+    int num_events; //published with release semantics
+    int attributed; //events which already have their energy
+    struct thread_tag_buffer *next;
+};
+
+/* node energy timeline used to attribute energy to thread tag events */
+struct thread_tag_attribution {
+    double last_wtime;
+    struct energy_reading last_energy;
+    double node_energy[MAX_ENERGY_ZONES]; //since poli_init, up to last_wtime
+};
+
+#ifndef _NOMPI
+/* tag event of a non-monitor rank, stored in node shared memory */
+struct node_tag_event {
+    thread_tag_event_t type;
+    int name_offset; //of the tag name within the names of the segment
+    double wtime;
+};
+
+/* header of the segment each rank owns in the node shared memory window. it is followed by a ring of
+   num_events events and name_capacity bytes of tag names. only the owning rank appends events and names,
+   only the monitor consumes events, so neither side takes a lock*/
+struct node_tag_segment {
+    int world_rank;
+    unsigned int head; //next event to be written, published with release semantics
+    unsigned int tail; //next event to be read, released by the monitor
+    unsigned int dropped; //events lost to a full ring or to full names
+    unsigned int name_bytes; //bytes of names published so far
+};
+
+struct node_tags_t {
+    MPI_Win win;
+    unsigned int num_events; //ring slots per segment, power of 2
+    unsigned int name_capacity;
+    //non-monitor rank
+    struct node_tag_segment *segment;
+    struct tag_names names; //tag names of this rank, ids are handed out as tag handles
+    struct chunked_arena name_offsets; //of int, offset of each name id in the segment, -1 if it did not fit
+    int num_published_names;
+    //monitor
+    int num_segments;
+    struct node_tag_segment **segments; //by node rank, NULL for the monitor itself
+    struct tag_table *name_maps; //by node rank, name offset to the name id of the monitor
+    struct thread_tag_buffer **buffers; //by node rank, tags collected from that rank
+    unsigned int lost; //events the monitor could not store
+};
+#endif
+
+/* latest reading of the sampler, readable by every rank of the node without a system call.
+   guarded by a seqlock: sequence is odd while the sampler updates the snapshot*/
+struct energy_snapshot {
+    unsigned int sequence;
+    int num_samples;
+    int num_zones;
+    double wtime;
+    struct energy_reading energy; //raw counters
+    double node_energy[MAX_ENERGY_ZONES]; //since the first sample
+    double power[MAX_ENERGY_ZONES]; //exponential moving average
+    struct clock_calibration clock; //of the monitor, set once by init_node_power
+};
+
+/* most recent energy reading of the monitor, reused while it is younger than ttl.
+   a writer skips its update while another one is in progress, readers retry on a torn copy*/
+struct energy_cache {
+    unsigned int sequence; //odd while being updated
+    double wtime;
+    struct energy_reading energy;
+    double ttl; //0 disables the cache
+};
+
+/* energy of each package on multi-package nodes, kept apart from the node level energy readings.
+   every array holds num_packages entries per reading and nothing is allocated on single package nodes*/
+struct package_energy_t {
+    int num_packages; //packages with their own energy next to the node totals, 0 on single package nodes
+    struct rapl_energy initial[MAX_RECORDED_PACKAGES];
+    struct rapl_energy *poll; //by slot of the poll ring
+    struct rapl_energy *cache; //of the reading in energy_cache, under its sequence
+    struct chunked_arena tags; //start then end of each tag, by tag id
+};
+
+struct node_power_t {
+#ifndef _NOMPI
+    MPI_Win win;
+#endif
+    struct energy_snapshot *snapshot; //in node shared memory owned by the monitor
 };
 
 typedef enum pcap_flags { DEFAULT, USER_SET, SYSTEM_RESET, INTERNAL, INITIAL } pcap_flag_t;
@@ -140,13 +368,31 @@ struct pcap_tag {
     double seconds_short;
     int enabled;
     double wtime;
-    struct timeval timestamp;
     pcap_flag_t pcap_flag; //to have some idea if system reset, user set or controlled by library
-    struct poli_tag active_poli_tags[MAX_TAGS]; //stores all active tags
+    int active_tags_offset; //ids of all active tags are stored in active_tag_pool from here on
     int num_active_poli_tags;
     int start_timer_count;
 };
 
+typedef enum poll_marker_types { TAG_START_MARKER, TAG_END_MARKER, PCAP_MARKER, CONTEXT_ENTER_MARKER, CONTEXT_EXIT_MARKER } poll_marker_t;
+
+/* position of a tag event among the polling records, written out by the polling writer */
+struct poll_marker {
+    poll_marker_t type;
+    int counter;
+    int index; //into poli_tag_list or pcap_tag_list, a tag name id for context markers
+};
+
+/* entry of the power cap journal, appended whenever the power cap of a zone is set or read back from the system */
+struct pcap_event {
+    double wtime;
+    int zone; //index into current_pcap_list
+    double watts_long;
+    double watts_short;
+    double seconds_long;
+    double seconds_short;
+};
+
 struct pcap_info {
     int monitor_id;
     int monitor_rank;
@@ -170,6 +416,31 @@ struct polimer_config_t {
     float poll_interval;
     int log_level;
     int cap_short_window;
+    int aggregate_tags;
+    int node_tag_events;
+    float power_smoothing;
+    float energy_ttl;
+    int precise_tags;
+    int use_tsc;
+    poli_sampling_t tag_sampling; //default for all tag names
+    double tag_sampling_parameter;
+    char *stats_kernels;
+    rapl_backend_t rapl_backend;
+    char *powercap_root; //NULL for the default
+#ifndef _TIMER_OFF
+    sampler_mode_t sampler_mode;
+    int sampler_cpu;
+    int sampler_priority;
+    int ring_size;
+    int marker_ring_size;
+    int raw_ring_size;
+    glitch_filter_t hf_filter;
+    float flush_interval;
+    int adaptive_poll;
+    float poll_interval_min;
+    float poll_interval_max;
+    float poll_power_change;
+#endif
 #ifdef _POWMGR
     int measure_sync_end;
     int simulate_pm;
@@ -202,6 +473,126 @@ struct system_poll_info {
     double time_diff;
 };
 
+/* polling records as stored while the application runs, one column per field indexed by ring slot.
+   everything else in struct system_poll_info is derived from these when the records are written out */
+struct poll_columns {
+    double *wtime;
+    struct energy_reading *energy;
+    int *pcap_ref; //number of entries in pcap_journal when the sample was taken
+    double *time_error; //uncertainty of wtime, only in precise boundary mode
+};
+
+/* P2 estimator of one quantile (Jain and Chlamtac): five markers instead of all observations */
+struct p2_quantile {
+    double p;
+    long count;
+    double height[5];
+    double position[5];
+    double desired[5];
+    double increment[5];
+};
+
+/* statistics of a stream of observations, updated in constant time and memory */
+struct online_stats {
+    long count;
+    double mean;
+    double m2; //sum of squared deviations from the mean (Welford)
+    double min;
+    double max;
+    struct p2_quantile median;
+    struct p2_quantile p95;
+};
+
+/* poll power of one sync window, of all samples and of those within the plausible range of the package */
+struct window_stats {
+    struct online_stats all;
+    struct online_stats plausible;
+    int num_samples; //poll samples taken in the window, which first_energy and last_energy are of
+    struct energy_reading first_energy;
+    struct energy_reading last_energy;
+};
+
+/* the sync window the sampler adds poll power to. the application closes it at sync points by switching the sampler
+   to the other buffer, so neither side takes a lock */
+struct power_window {
+    struct window_stats windows[2];
+    int active; //buffer the sampler adds to
+    unsigned int sequence; //odd while the sampler adds to a buffer
+    double min_plausible;
+    double max_plausible;
+    int primed;
+    double last_wtime;
+    struct energy_reading last_energy;
+};
+
+/* poll power while each poli tag was open, kept by the polling writer from the tag markers */
+struct tag_power_stats {
+    int on;
+    struct chunked_arena stats; //of struct online_stats, by poli tag id
+    int *open; //ids of the poli tags open at the sample being written
+    int num_open;
+    int open_size;
+};
+
+/* energy at a tag boundary, interpolated between the poll samples around it */
+struct boundary_energy {
+    double energy[MAX_ENERGY_ZONES]; //node energy since poli_init
+    double error[MAX_ENERGY_ZONES]; //bound on the interpolation error
+    int resolved;
+};
+
+struct tag_interpolation {
+    struct boundary_energy start;
+    struct boundary_energy end;
+};
+
+/* precise boundary mode: the polling writer places tag boundaries on the energy timeline of the poll samples */
+struct tag_interpolation_t {
+    struct chunked_arena tags; //of struct tag_interpolation, by poli tag id
+    struct chunked_arena pending; //of int, boundaries waiting for the sample after them, tag id * 2 + 1 for an end
+    int num_pending;
+    int next_pending;
+    double last_time_error; //uncertainty of the time of the previous sample
+};
+
+/* busy polling mode: energy counters read at their update rate by a spinning sampler thread, stored unconverted
+   in columns and converted to power when the polling writer flushes them */
+struct raw_samples {
+    struct spsc_ring ring; //positions of the columns, filled by the sampler and drained by the polling writer
+    double *wtime;
+    uint32_t *counters[MAX_RAW_COUNTERS]; //the zones of the first package, then those of the next one
+    int num_counters;
+    int num_zones; //power columns, summed over the packages
+    double units[MAX_RAW_COUNTERS]; //joules per count
+    uint32_t read_counters[MAX_RAW_COUNTERS]; //last counters read by the sampler
+    int dropped;
+    volatile int stop;
+    //owned by the polling writer
+    double last_wtime;
+    uint32_t last_counters[MAX_RAW_COUNTERS];
+    double *interval; //scratch columns of the conversion
+    double *power[MAX_ENERGY_ZONES];
+    glitch_filter_t filter;
+    double *filtered; //scratch column of the filter, swapped with the power column it filters
+    FILE *file;
+};
+
+/* adaptive mode: polls fast while the power or the tag activity changes and backs off in steady state */
+struct adaptive_poll {
+    int on;
+    double interval; //seconds until the next poll
+    double min_interval;
+    double max_interval;
+    double power_change;
+    int num_samples;
+    double last_wtime;
+    struct energy_reading last_energy;
+    double last_power[MAX_ENERGY_ZONES];
+    unsigned long last_tag_events;
+    double last_churn; //tag events per second
+    long phase_changes;
+};
+
 #ifdef _POWMGR
 struct power_manager_t;
 #endif
@@ -215,25 +606,58 @@ struct system_info_t {
     /*record initial energy*/
     struct energy_reading initial_energy;
     struct energy_reading final_energy;
+    struct package_energy_t package_energy;
 
-    struct poli_tag *poli_tag_list;
-    int poli_opentag_tracker;
-    int poli_closetag_tracker;
-    struct pcap_tag *pcap_tag_list;
+    struct chunked_arena poli_tag_list; //of struct poli_tag
+    struct chunked_arena pcap_tag_list; //of struct pcap_tag
     struct pcap_info *current_pcap_list; //stores PACKAGE, CORE, DRAM in that order
+    struct chunked_arena pcap_journal; //of struct pcap_event
+    int num_pcap_events;
 
 #ifndef _TIMER_OFF
-    struct system_poll_info *system_poll_list;
+    struct spsc_ring poll_ring; //positions of poll_columns, filled by the sampler and drained by the polling writer
+    struct poll_columns poll_columns;
+    struct spsc_ring marker_ring; //of struct poll_marker, filled by the application and drained by the polling writer
+    int dropped_samples;
+    pthread_mutex_t energy_lock; //serializes energy reads between the sampler thread and the application
+    int energy_lock_on;
+    struct adaptive_poll adaptive_poll;
+    struct raw_samples *raw_samples; //NULL unless busy polling
+    struct tag_power_stats tag_power_stats;
+#ifdef _POWMGR
+    struct power_window power_window;
+#endif
 #endif
 #ifdef _BENCH
     struct system_poll_info *system_poll_list_em;
 #endif
 
 #ifdef _POWMGR
-    struct power_manager_t *palloc_list;
+    struct chunked_arena palloc_list; //of struct power_manager_t
     int palloc_count;
 #endif
 
+    struct tag_names tag_names;
+    struct tag_table open_tag_table; //currently open tags by name id
+    struct calling_context_tree cct; //user tags when poli_config->aggregate_tags is set
+    struct thread_tag_buffer *thread_tag_buffers; //one per OpenMP thread which issued tags, lock-free list
+    struct thread_tag_attribution thread_tag_attribution;
+    struct energy_cache energy_cache;
+    struct chunked_arena tag_samplers; //of struct tag_sampler, by name id
+    unsigned long tag_events; //tags started and ended on the master thread of the monitor, written by that thread only
+#ifndef _TIMER_OFF
+    struct tag_interpolation_t *tag_interpolation; //NULL unless poli_config->precise_tags
+#endif
+#ifndef _NOMPI
+    struct node_tags_t *node_tags; //tags of the other ranks on this node, NULL if not collected
+#endif
+    int *open_tag_ids; //ids of currently open tags, unordered
+    int num_open_tag_ids;
+    int open_tag_ids_size;
+    int *active_tag_pool; //active tag ids of all pcap tags
+    int active_tag_pool_len;
+    int active_tag_pool_size;
+
     int num_poli_tags;
     int num_open_tags;
     int num_closed_tags;
@@ -277,6 +701,28 @@ int poli_start_tag(char *format_str, ...);
    returns: 0 if no errors, 1 otherwises*/
 int poli_end_tag(char *format_str, ...);
 
+/* poli_register_tag - registers a tag name once, so that tags of this name can be started and ended without any string handling
+   input: tag name
+   returns: handle of the tag name (>= 0) if no errors, -1 otherwise*/
+int poli_register_tag(char *format_str, ...);
+
+/* poli_start_tag_handle - starts an poli tag with a name registered through poli_register_tag
+   input: handle of the tag name
+   returns: 0 if no errors, 1 otherwise*/
+int poli_start_tag_handle(int handle);
+
+/* poli_end_tag_handle - ends the most recently started open poli tag with a name registered through poli_register_tag
+   input: handle of the tag name
+   returns: 0 if no errors, 1 otherwise*/
+int poli_end_tag_handle(int handle);
+
+/* poli_set_tag_sampling - records only a sample of the invocations of a tag name, the others are just counted.
+   totals of all invocations are extrapolated from the sample, with 95% confidence intervals
+   input: handle of the tag name, policy (every Nth invocation, the first invocation after every parameter seconds,
+   or a uniform reservoir of parameter invocations), its parameter
+   returns: 0 if no errors, 1 otherwise*/
+int poli_set_tag_sampling(int handle, poli_sampling_t policy, double parameter);
+
 
 /*                      END OF EMON TAGS                                      */
 
@@ -330,6 +776,28 @@ int poli_print_frequency_info (void);
 
 /*               END OF FREQUENNCY                                            */
 
+/******************************************************************************/
+/*              CURRENT POWER                                                 */
+/******************************************************************************/
+
+/* poli_get_current_power - returns the smoothed power of the node's first energy zone (RAPL package or Cray node),
+   as last sampled by the monitor. can be called by any rank without a system call or MPI message
+   input: pointer to double holding the resulting watts
+   returns: 0 if successful, 1 if no power was sampled yet*/
+int poli_get_current_power (double *watts);
+
+/* poli_get_current_zone_power - same as poli_get_current_power for any energy zone
+   input: the zone index, pointer to double holding the resulting watts
+   returns: 0 if successful, 1 if no power was sampled yet or there is no such zone*/
+int poli_get_current_zone_power (int zone, double *watts);
+
+/* poli_get_node_energy - returns the energy consumed in an energy zone of the node between the first and the last sample
+   input: the zone index, pointers to doubles holding the resulting joules and the time of the last sample
+   returns: 0 if successful, 1 if no power was sampled yet or there is no such zone*/
+int poli_get_node_energy (int zone, double *joules, double *wtime);
+
+/*               END OF CURRENT POWER                                         */
+
 /******************************************************************************/
 /*              HELPERS                                                       */
 /******************************************************************************/
@@ -0,0 +1,27 @@
+#ifndef __ADAPTIVE_POLL_H
+#define __ADAPTIVE_POLL_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "PoLiMEr.h"
+
+#ifndef _TIMER_OFF
+
+/* init_adaptive_poll - sets up the poll interval, adapted between poll_interval_min and poll_interval_max
+   if poli_config->adaptive_poll is set, fixed to poll_interval otherwise*/
+void init_adaptive_poll (struct adaptive_poll *adaptive_poll, struct polimer_config_t * poli_config);
+
+/* next_poll_interval - takes the sample just polled and the number of tag events so far into account
+   returns: seconds until the next poll*/
+double next_poll_interval (struct adaptive_poll *adaptive_poll, double wtime, struct energy_reading *energy, unsigned long tag_events);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
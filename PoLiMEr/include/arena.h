@@ -0,0 +1,45 @@
+#ifndef __ARENA_H
+#define __ARENA_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+
+#define ARENA_MAX_CHUNKS 32
+#define ARENA_MAX_ELEMS (1u << 28) //indices past it are rejected rather than mapped
+
+/* growable array of fixed size elements stored in chunks which never move once allocated.
+   the first chunk spans a page and every further chunk doubles the capacity, so ARENA_MAX_CHUNKS
+   chunks are never exhausted in practice. chunks are mapped on demand and first touched by the
+   thread filling them, which keeps them local to its NUMA node.
+   elements below arena_capacity may be read from other threads once their index has been published */
+struct chunked_arena {
+    char *chunks[ARENA_MAX_CHUNKS];
+    size_t chunk_bytes[ARENA_MAX_CHUNKS];
+    size_t elem_size;
+    unsigned int first_shift; //log2 of the number of elements in the first chunk
+    unsigned int capacity;
+    int num_chunks;
+};
+
+/* arena_init - sets up an empty arena, no memory is allocated until the first element is accessed
+   returns: 0 if successful, 1 otherwise*/
+int arena_init (struct chunked_arena *arena, size_t elem_size);
+
+/* arena_free - releases all chunks at once, pointers into the arena become invalid*/
+void arena_free (struct chunked_arena *arena);
+
+/* arena_at - returns: the zero initialized element at index, allocating chunks up to it if needed,
+   NULL if index is at least ARENA_MAX_ELEMS or memory could not be allocated. only the owning thread may access indices past arena_capacity*/
+void *arena_at (struct chunked_arena *arena, unsigned int index);
+
+unsigned int arena_capacity (struct chunked_arena *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
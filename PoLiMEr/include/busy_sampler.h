@@ -0,0 +1,34 @@
+#ifndef __BUSY_SAMPLER_H
+#define __BUSY_SAMPLER_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "PoLiMEr.h"
+
+#ifndef _TIMER_OFF
+
+/* init_raw_samples - allocates the columns of size raw samples and takes the first reading of the counters.
+   filter is applied to the power of each zone when it is converted
+   returns: 0 if successful, 1 if the energy counters can't be read raw or memory could not be allocated*/
+int init_raw_samples (struct raw_samples *raw_samples, unsigned int size, glitch_filter_t filter, struct system_info_t * system_info);
+void free_raw_samples (struct raw_samples *raw_samples);
+
+/* read_raw_sample - reads the energy counters and stores them if they were updated since the previous read.
+   called by the sampler thread only
+   returns: 1 if a sample was stored, 0 otherwise*/
+int read_raw_sample (struct raw_samples *raw_samples, struct system_info_t * system_info);
+
+/* convert_raw_samples - computes the interval and the power of each zone of n samples stored in consecutive slots from slot,
+   into the scratch columns of raw_samples from index 0, glitches filtered out. called by the polling writer only*/
+void convert_raw_samples (struct raw_samples *raw_samples, unsigned int slot, unsigned int n);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef __CCT_H
+#define __CCT_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+
+struct calling_context_tree;
+struct energy_reading;
+
+/* cct_init - allocates an empty calling context tree
+   returns: 0 if successful, 1 otherwise*/
+int cct_init (struct calling_context_tree *cct);
+void cct_free (struct calling_context_tree *cct);
+
+/* cct_enter - enters the child context name_id of the innermost open context, creating it on first use
+   input: the interned name id and its hash, energy and time at entry
+   returns: 0 if successful, 1 otherwise*/
+int cct_enter (struct calling_context_tree *cct, int name_id, uint32_t name_hash, struct energy_reading *energy, double time);
+
+/* cct_exit - exits the innermost open context named name_id (which need not be the innermost context) and
+   accumulates the invocation into its node
+   returns: 0 if successful, 1 if no context of this name is open*/
+int cct_exit (struct calling_context_tree *cct, int name_id, struct energy_reading *energy, double time);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -9,15 +9,46 @@ extern "C"
 struct system_poll_info;
 struct system_info_t;
 struct monitor_t;
+struct energy_reading;
+struct rapl_energy;
+
+#include "poli_clock.h"
 
-double get_time (void);
 void get_initial_time(struct system_info_t * system_info, struct monitor_t * monitor);
 int compute_current_power (struct system_poll_info * info, double time, struct system_info_t * system_info);
 struct energy_reading read_current_energy (struct system_info_t * system_info);
+/* read_package_energy - reads the node energy like read_current_energy, and the energy of each recorded package
+   into packages if it isn't NULL. packages are only recorded on multi-package nodes*/
+struct energy_reading read_package_energy (struct system_info_t * system_info, struct rapl_energy *packages);
+/* read_cached_energy - returns the most recent reading of the monitor if it is younger than the energy ttl,
+   otherwise reads the counters and caches the result. wtime (may be NULL) is set to the time of the reading*/
+struct energy_reading read_cached_energy (struct system_info_t * system_info, double *wtime);
+/* read_cached_package_energy - read_cached_energy, also copying the package energy of the reading into packages (may be NULL)*/
+struct energy_reading read_cached_package_energy (struct system_info_t * system_info, double *wtime, struct rapl_energy *packages);
+/* cache_energy_reading - offers a reading taken at wtime to the cache, e.g. by the sampler. packages may be NULL
+   on single package nodes only*/
+void cache_energy_reading (struct system_info_t * system_info, struct energy_reading *energy, struct rapl_energy *packages, double wtime);
+/* read_energy_at_edge - reads the energy counters until they change, so that wtime is the moment of a counter update
+   rather than up to an update period after it. gives up after max_wait seconds. packages (may be NULL) are read along
+   returns: the uncertainty (s) of wtime*/
+double read_energy_at_edge (struct system_info_t * system_info, struct energy_reading *energy, struct rapl_energy *packages, double *wtime, double max_wait);
+/* poll_package_energy, tag_package_energy - returns: the package energy of a poll ring slot, or of the start (end 0)
+   or end (end 1) of a tag, NULL on single package nodes*/
+struct rapl_energy *poll_package_energy (struct system_info_t * system_info, int slot);
+struct rapl_energy *tag_package_energy (struct system_info_t * system_info, int tag_id, int end);
+#ifndef _TIMER_OFF
+int get_poll_sample (struct system_info_t * system_info, int counter, struct system_poll_info * info);
+#endif
 void get_timestamp(double time_from_start, char *time_str_buffer, size_t buff_len, struct timeval * initial_start_time);
 FILE * open_file (char *filename, struct monitor_t * monitor);
 int coordsToInt (int *coords, int dim);
 
+/* get_energy_zones - fills zones with the energy (J) consumed between start and end in each measured zone
+   returns: the number of zones*/
+int get_energy_zones (double *zones, struct energy_reading *end, struct energy_reading *start, double time);
+int get_num_energy_zones (void);
+const char *get_energy_zone_name (int zone);
+
 #ifdef __cplusplus
 }
 #endif
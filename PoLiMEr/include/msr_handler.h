@@ -19,9 +19,11 @@ extern "C"
 #include <string.h>
 
 #include <sys/syscall.h>
+#include <sys/ioctl.h>
 #include <linux/perf_event.h>
 
 #define MSR_RAPL_POWER_UNIT     0x606
+#define DEFAULT_RAPL_UNITS 0xA0E03 //of MSR_RAPL_POWER_UNIT: 2^-3 W, 2^-14 J, 2^-10 s
 
 /*
  * Platform specific RAPL Domains.
@@ -81,14 +83,37 @@ extern "C"
 #define CPU_BROADWELL_DE    86
 #define CPU_SKYLAKE     78
 #define CPU_SKYLAKE_HS      94
+#define CPU_SKYLAKE_X       85  // Cascade Lake too
+#define CPU_ICELAKE_X       106
+#define CPU_SAPPHIRERAPIDS_X    143
 #define CPU_KNIGHTS_LANDING 87
 #define CPU_KABYLAKE        142
 #define CPU_KABYLAKE_2      158
 
 #define MAX_CPUS    1024
 #define MAX_PACKAGES    16
+#define MAX_RECORDED_PACKAGES 4 //packages with their own energy next to the node totals, which include all of them
 #define MAX_MSRS 25
 
+/* msr_safe batch interface, accesses any number of msrs with a single ioctl */
+#define MSR_BATCH_DEVICE "/dev/cpu/msr_batch"
+
+struct msr_batch_op {
+    uint16_t cpu; //cpu to run the op on
+    uint16_t isrdmsr; //1 to read, 0 to write
+    int32_t err; //set by the driver, 0 on success else -errno
+    uint32_t msr;
+    uint64_t msrdata; //read into or written from
+    uint64_t wmask; //set by the driver
+};
+
+struct msr_batch_array {
+    uint32_t numops;
+    struct msr_batch_op *ops;
+};
+
+#define X86_IOC_MSR_BATCH _IOWR('c', 0xA2, struct msr_batch_array)
+
 #define DEFAULT_PKG_POW 215.0
 #define DEFAULT_CORE_POW 0.0 //when disabled
 #define DEFAULT_SHORT 258.0
@@ -132,6 +157,25 @@ struct msr_info {
     double maximum_time_window;
 };
 
+typedef enum rapl_backends { RAPL_AUTO, RAPL_MSR, RAPL_POWERCAP, RAPL_PERF } rapl_backend_t;
+
+struct powercap_info;
+struct perf_rapl_info;
+
+struct cpu_model {
+    int model;
+    char *name;
+    int msrs[5][NUM_RAPL_DOMAINS]; //energy, pcap, info, perf and policy msrs, 0 terminated
+    int fixed_dram_units; //DRAM energy is counted in 2^-16 J instead of the unit in MSR_RAPL_POWER_UNIT
+};
+
+/* step of the energy read plan compiled at init, one for each of energy_msrs */
+struct energy_read_step {
+    int package;
+    int zone; //as in energy_zone_index
+    double unit; //joules per count
+};
+
 struct msr_energy {
     int msr;
     int package_id;
@@ -210,6 +254,9 @@ struct system_msr_info {
     int total_packages;
     int package_map[MAX_PACKAGES];
     int package_fd[MAX_PACKAGES];
+    int batch_fd; //msr_safe batch device, -1 to access one msr at a time
+    struct powercap_info *powercap; //RAPL is read through the powercap sysfs instead of the msrs when set
+    struct perf_rapl_info *perf_rapl; //or through the power pmu of perf_event, which can't cap
 
     /* msr units */
     double power_units;
@@ -228,17 +275,35 @@ struct system_msr_info {
     struct msr_perf *perf_msrs;
     struct msr_policy *policy_msrs;
 
+    /* energy read plan */
+    struct energy_read_step energy_plan[MAX_PACKAGES * NUM_RAPL_DOMAINS];
+    struct msr_batch_op energy_ops[MAX_PACKAGES * NUM_RAPL_DOMAINS]; //reads all energy_msrs
+
     int num_zones;
 };
 
-void init_msrs (struct system_info_t *system_info);
+/* init_msrs - sets up RAPL through the msrs or, with backend RAPL_POWERCAP or when RAPL_AUTO can't open the msrs,
+   through the powercap sysfs at powercap_root (POWERCAP_ROOT if NULL). with RAPL_PERF or when RAPL_AUTO can't open
+   either, through perf_event, which only monitors. error_state is set if none works*/
+void init_msrs (struct system_info_t *system_info, rapl_backend_t backend, char *powercap_root);
 int finalize_msrs (struct system_info_t * system_info);
+/* rapl_set_power_cap - caps the node, watts are split evenly over its packages*/
 int rapl_set_power_cap (char *zone_name, double watts_long, double watts_short, double seconds_long, double seconds_short, struct system_info_t * system_info, int enable);
+/* get_power_info - power info of the node: the sums of those of its packages and the shortest time window*/
 int get_power_info(struct power_info *pi, struct system_info_t * system_info);
-int rapl_read_energy (struct rapl_energy * re, struct system_info_t * system_info);
+/* rapl_read_energy - reads the energy counters of all packages one after another, then converts them. re receives the node totals,
+   package_energy, if not NULL, those of the first MAX_RECORDED_PACKAGES packages*/
+int rapl_read_energy (struct rapl_energy * re, struct rapl_energy *package_energy, struct system_info_t * system_info);
+/* rapl_num_packages - returns: the number of packages of the node, at least 1*/
+int rapl_num_packages (struct system_info_t * system_info);
+/* rapl_read_raw_energy - reads the energy counters without converting them, NUM_RAPL_DOMAINS per package in the zone order
+   of the energy zones (package, pp0, pp1, platform, dram). units, if not NULL, receives the joules per count of each counter
+   returns: the number of counters, 0 if they can't be read*/
+int rapl_read_raw_energy (uint32_t *counters, double *units, struct system_info_t * system_info);
 int rapl_compute_total_power (struct rapl_power *rp, struct rapl_energy *energy, double time);
 int rapl_compute_total_energy (struct rapl_energy *re, struct rapl_energy *end, struct rapl_energy *start);
 
+/* rapl_get_power_cap - returns: the cap of the node, the sum of those of its packages. enabled only if it is on all of them*/
 int rapl_get_power_cap (struct msr_pcap *pcap, char *zone_name, struct system_info_t * system_info);
 int rapl_get_power_cap_info(char *zone_name, double *min, double *max,
     double *thermal_spec, double *max_time_window, struct system_info_t * system_info);
@@ -0,0 +1,31 @@
+#ifndef __NODE_POWER_H
+#define __NODE_POWER_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "PoLiMEr.h"
+
+/* init_node_power - sets up the energy snapshot of the node, in node shared memory owned by the monitor.
+   collective over the node communicator
+   returns: 0 if successful, 1 otherwise*/
+int init_node_power (struct node_power_t * node_power, struct monitor_t * monitor);
+
+/* publish_energy_snapshot - stores a new reading of the sampler and updates the smoothed power.
+   must only be called by the sampler, safe to call from a signal handler*/
+void publish_energy_snapshot (struct node_power_t * node_power, double wtime, struct energy_reading *energy, float smoothing);
+
+/* read_energy_snapshot - copies a consistent snapshot, retrying while the sampler updates it
+   returns: 0 if successful, 1 if nothing was published yet*/
+int read_energy_snapshot (struct node_power_t * node_power, struct energy_snapshot *snapshot);
+
+/* finalize_node_power - frees the snapshot. collective over the node communicator*/
+void finalize_node_power (struct node_power_t * node_power, struct monitor_t * monitor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef __NODE_TAGS_H
+#define __NODE_TAGS_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "PoLiMEr.h"
+
+#ifndef _NOMPI
+
+/* init_node_tags - allocates the node shared memory window holding the tag events of all non-monitor ranks.
+   collective over the node communicator
+   returns: 0 if successful, 1 otherwise*/
+int init_node_tags (struct node_tags_t * node_tags, struct monitor_t * monitor, struct polimer_config_t * poli_config);
+
+/* record_node_tag_event - appends a tag event of a non-monitor rank to its segment. uses neither MPI nor system calls,
+   must only be called by the master thread of that rank
+   returns: 0 if successful, 1 if the event was dropped*/
+int record_node_tag_event (struct node_tags_t * node_tags, thread_tag_event_t type, int name_id);
+
+/* drain_node_tag_events - moves the published events of all non-monitor ranks into thread tag buffers of the monitor,
+   where energy is attributed to them like to the tags of OpenMP threads. must only be called by one thread at a time*/
+void drain_node_tag_events (struct node_tags_t * node_tags, struct system_info_t * system_info);
+
+/* finalize_node_tags - reports dropped events and frees the window. collective over the node communicator*/
+void finalize_node_tags (struct node_tags_t * node_tags, struct monitor_t * monitor);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef __ONLINE_STATS_H
+#define __ONLINE_STATS_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "PoLiMEr.h"
+
+void online_stats_init (struct online_stats *stats);
+void online_stats_add (struct online_stats *stats, double x);
+/* online_stats_variance - returns: the sample variance, 0 for less than two observations*/
+double online_stats_variance (struct online_stats *stats);
+/* p2_quantile_value - returns: the estimated quantile, exact up to five observations, 0 for none*/
+double p2_quantile_value (struct p2_quantile *quantile);
+
+/* init_power_window - sets up an empty sync window. samples of package power outside [min_plausible, max_plausible]
+   are left out of the plausible statistics*/
+void init_power_window (struct power_window *window, double min_plausible, double max_plausible);
+
+/* power_window_add_sample - adds the power since the previous sample to the open window. called by the sampler only*/
+void power_window_add_sample (struct power_window *window, double wtime, struct energy_reading *energy);
+
+/* close_power_window - hands the statistics of the open window to closed, if not NULL, and opens a new window.
+   called by the application thread only*/
+void close_power_window (struct power_window *window, struct window_stats *closed);
+
+#ifndef _TIMER_OFF
+/* init_tag_power_stats - returns: 0 if successful, 1 otherwise*/
+int init_tag_power_stats (struct tag_power_stats *tag_power_stats);
+void free_tag_power_stats (struct tag_power_stats *tag_power_stats);
+/* tag_power_stats_start/tag_power_stats_end - the poli tag tag_id opened or closed before the next sample.
+   tag_power_stats_add - adds the power of a sample to all open poli tags.
+   called by the polling writer only*/
+void tag_power_stats_start (struct tag_power_stats *tag_power_stats, int tag_id);
+void tag_power_stats_end (struct tag_power_stats *tag_power_stats, int tag_id);
+void tag_power_stats_add (struct tag_power_stats *tag_power_stats, double power);
+/* get_tag_power_stats - returns: the poll power statistics of poli tag tag_id, NULL if none were kept*/
+struct online_stats *get_tag_power_stats (struct tag_power_stats *tag_power_stats, int tag_id);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -6,12 +6,15 @@ extern "C"
 {
 #endif
 
+#include "PoLiMEr.h"
+
 struct system_info_t;
 struct monitor_t;
 struct poli_tag;
 struct pcap_tag;
 struct poller_t;
 struct system_poll_info;
+struct polimer_config_t;
 
 #ifdef _MSR
 struct rapl_energy;
@@ -25,10 +28,17 @@ struct cray_measurement;
 struct bgq_measurement;
 #endif
 
-int file_handler (struct system_info_t * system_info, struct monitor_t * monitor, struct poller_t * poller);
+int file_handler (struct system_info_t * system_info, struct monitor_t * monitor);
 int poli_tags_to_file (struct system_info_t * system_info, struct monitor_t * monitor);
 int pcap_tags_to_file (struct system_info_t * system_info, struct monitor_t * monitor);
-int polling_info_to_file (struct system_info_t * system_info, struct monitor_t * monitor, struct poller_t * poller);
+int thread_tags_to_file (struct system_info_t * system_info, struct monitor_t * monitor);
+
+#ifndef _TIMER_OFF
+int start_polling_writer (struct system_info_t * system_info, struct monitor_t * monitor, struct poller_t * poller, struct polimer_config_t * poli_config);
+int stop_polling_writer (struct system_info_t * system_info, struct monitor_t * monitor, struct poller_t * poller);
+void notify_polling_writer (struct poller_t * poller);
+void push_poll_marker (poll_marker_t type, int index, struct system_info_t * system_info, struct poller_t * poller);
+#endif
 
 
 #ifdef __cplusplus
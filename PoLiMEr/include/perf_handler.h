@@ -0,0 +1,47 @@
+#ifndef __PERF_HANDLER_H
+#define __PERF_HANDLER_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+
+#include "msr_handler.h"
+
+#define PERF_POWER_PMU "/sys/bus/event_source/devices/power"
+#define PERF_RAW_UNIT 6.103515625e-05 //joules per count of the raw counters, as for the msrs
+
+/* the power pmu events of one package, opened as a group so one read returns all of them */
+struct perf_rapl_package {
+    int cpu;
+    int group_fd; //leader of the group, -1 if no event could be opened
+    int num_events;
+    int fds[NUM_RAPL_DOMAINS];
+    int zones[NUM_RAPL_DOMAINS]; //energy zone of each event, in the order of the group read
+    double scales[NUM_RAPL_DOMAINS]; //joules per count of each event
+    uint64_t last_values[NUM_RAPL_DOMAINS]; //of the energy readings, kept when a read fails
+};
+
+struct perf_rapl_info {
+    int num_packages;
+    struct perf_rapl_package packages[MAX_PACKAGES];
+};
+
+/* init_perf_rapl - opens the energy events of the power pmu on one cpu of each package. the platform (psys) event
+   is only opened on package 0
+   returns: the events, NULL if the pmu is missing or no event can be opened*/
+struct perf_rapl_info *init_perf_rapl (void);
+void finalize_perf_rapl (struct perf_rapl_info *pr);
+
+/* perf_rapl_read_energy, perf_rapl_read_raw_energy - do what rapl_read_energy and rapl_read_raw_energy in msr_handler.h do,
+   with one read per package. the kernel accumulates the counters in 64 bits, so there are no overflows to account*/
+int perf_rapl_read_energy (struct rapl_energy *re, struct rapl_energy *package_energy, struct perf_rapl_info *pr);
+int perf_rapl_read_raw_energy (uint32_t *counters, double *units, struct perf_rapl_info *pr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef __POLI_CLOCK_H
+#define __POLI_CLOCK_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <sys/time.h>
+
+/* the calibration get_time converts the time stamp counter with. the ranks of a node all take the one of the monitor,
+   so that their timestamps are on one timeline*/
+struct clock_calibration {
+    int tsc_on;
+    uint64_t tsc_base;
+    double tsc_base_time; //monotonic time at tsc_base
+    double tsc_period; //seconds per tick
+};
+
+/* init_clock - calibrates the time stamp counter against CLOCK_MONOTONIC_RAW and anchors the clock to wall time.
+   without an invariant time stamp counter (or with use_tsc 0) the clock reads CLOCK_MONOTONIC_RAW directly
+   returns: 1 if the time stamp counter is used, 0 otherwise*/
+int init_clock (int use_tsc);
+
+/* get_time - returns: monotonic time in seconds, the one timeline all timestamps of PoLiMEr are taken on*/
+double get_time (void);
+
+/* clock_to_wall - converts a time returned by get_time to seconds since the epoch*/
+double clock_to_wall (double wtime);
+void clock_to_timeval (double wtime, struct timeval *tv);
+
+void get_clock_calibration (struct clock_calibration *calibration);
+/* set_clock_calibration - takes over the calibration of another process on the same node*/
+void set_clock_calibration (struct clock_calibration *calibration);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -6,7 +6,6 @@ extern "C"
 {
 #endif
 
-#define MAX_PM_LOGS 500000
 #define MEASURABLE_POWER_UPPER 258
 #define MEASURABLE_POWER_LOWER 80
 
@@ -98,6 +97,7 @@ struct power_manager_t {
 
     struct rapl_power total_poll_power;
     struct rapl_energy total_poll_energy;
+    struct window_stats poll_stats; //poll power since the previous sync
     double time_sum;
     double power_sum;
 
@@ -114,7 +114,7 @@ struct power_manager_t {
     int simulate;
     char *policy;
     char *pm_algorithm;
-    struct pm_log_t *logs;
+    struct chunked_arena *logs; //of struct pm_log_t
     int SeeSAw;
     int SLURMLike;
     int GEOPMLike;
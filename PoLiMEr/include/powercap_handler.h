@@ -0,0 +1,60 @@
+#ifndef __POWERCAP_HANDLER_H
+#define __POWERCAP_HANDLER_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+
+#include "msr_handler.h"
+
+#define POWERCAP_ROOT "/sys/class/powercap" //POLIMER_POWERCAP_ROOT overrides it, e.g. with a fake tree
+#define POWERCAP_PATH_LEN 512
+#define MAX_POWERCAP_ZONES 128 //zones and subzones over all packages and their dies
+
+/* energy accounted for the wraps of energy_uj, in uj */
+struct powercap_counter {
+    uint64_t last_energy;
+    uint64_t total_energy;
+};
+
+struct powercap_zone {
+    int package;
+    int zone; //index of the energy zone (package, pp0, pp1, platform, dram)
+    int energy_fd; //energy_uj, kept open
+    char path[POWERCAP_PATH_LEN];
+    uint64_t max_energy_range; //uj
+    int long_constraint; //index of the long_term constraint, -1 if there is none
+    int short_constraint; //index of the short_term constraint, -1 if there is none
+    struct powercap_counter energy; //of the energy readings
+    struct powercap_counter raw; //of the raw readings, which the sampler thread takes concurrently
+};
+
+struct powercap_info {
+    int num_packages;
+    int num_zones;
+    struct powercap_zone zones[MAX_POWERCAP_ZONES];
+};
+
+/* init_powercap - finds the intel-rapl zones under root and opens their energy counters. the dies of a package
+   (package-N-die-M) add up to it, the platform (psys) zone is counted on package 0. root is POWERCAP_ROOT if NULL
+   returns: the zones, NULL if there are no package zones*/
+struct powercap_info *init_powercap (char *root);
+void finalize_powercap (struct powercap_info *pc);
+
+/* the following do what their rapl_ counterparts in msr_handler.h do, through the powercap sysfs.
+   caps set with powercap_set_power_cap are per package, and split evenly across its dies*/
+int powercap_read_energy (struct rapl_energy *re, struct rapl_energy *package_energy, struct powercap_info *pc);
+int powercap_read_raw_energy (uint32_t *counters, double *units, struct powercap_info *pc);
+int powercap_set_power_cap (char *zone_name, double watts_long, double watts_short, double seconds_long, double seconds_short, int enable, struct powercap_info *pc);
+int powercap_get_power_cap (struct msr_pcap *pcap, char *zone_name, struct powercap_info *pc);
+int powercap_get_power_cap_info (char *zone_name, double *min, double *max, double *thermal_spec, double *max_time_window, struct powercap_info *pc);
+int powercap_get_power_info (struct power_info *pi, struct powercap_info *pc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
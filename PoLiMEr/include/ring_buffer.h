@@ -0,0 +1,50 @@
+#ifndef __RING_BUFFER_H
+#define __RING_BUFFER_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+
+/* single-producer single-consumer ring of fixed size slots.
+   head and tail are free running positions, the slot of position i is i & mask.
+   a ring initialized with slot_size 0 only manages positions, for data stored in caller owned columns */
+struct spsc_ring {
+    char *slots;
+    size_t slot_size;
+    unsigned int size; //power of 2
+    unsigned int mask;
+    unsigned int head; //next position to be written, only moved by the producer
+    unsigned int tail; //next position to be read, only moved by the consumer
+};
+
+/* ring_init - allocates a ring holding at least size slots (rounded up to a power of 2)
+   returns: 0 if successful, 1 otherwise*/
+int ring_init (struct spsc_ring *ring, unsigned int size, size_t slot_size);
+void ring_free (struct spsc_ring *ring);
+
+/* producer side: ring_reserve_position gets the position at head, returns 1 if the ring is full.
+   ring_commit publishes it to the consumer */
+int ring_reserve_position (struct spsc_ring *ring, unsigned int *position);
+void *ring_reserve (struct spsc_ring *ring);
+void ring_commit (struct spsc_ring *ring);
+
+/* consumer side: ring_peek_position gets the position at tail, returns 1 if the ring is empty.
+   ring_release hands it back to the producer */
+int ring_peek_position (struct spsc_ring *ring, unsigned int *position);
+void *ring_peek (struct spsc_ring *ring);
+void ring_release (struct spsc_ring *ring);
+
+unsigned int ring_count (struct spsc_ring *ring);
+
+/* ring_holds - returns 1 if position was committed and has not been overwritten yet, 0 otherwise */
+int ring_holds (struct spsc_ring *ring, unsigned int position);
+void *ring_at (struct spsc_ring *ring, unsigned int position);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef __STATS_KERNELS_H
+#define __STATS_KERNELS_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* count, sum, min and max of the values of an array within a range */
+struct range_summary {
+    long count;
+    double sum;
+    double min; //INFINITY if count is 0
+    double max; //-INFINITY if count is 0
+};
+
+/* stats_summarize - summarizes the x[i] with lo < x[i] < hi. pass -INFINITY and INFINITY to summarize all of x*/
+void stats_summarize (const double *x, long n, double lo, double hi, struct range_summary *summary);
+
+/* stats_max_index - returns: the index of the first maximum of x, -1 if n is 0*/
+long stats_max_index (const double *x, long n);
+
+/* stats_select - moves the k-th smallest value of x (k from 0) to x[k], smaller ones before it and larger ones after it
+   returns: x[k]*/
+double stats_select (double *x, long n, long k);
+
+/* stats_percentile - p-th percentile of x (p in [0, 1]), interpolated between the closest ranks. reorders x
+   returns: the percentile, 0 if n is 0*/
+double stats_percentile (double *x, long n, double p);
+
+/* stats_median_index - returns: the index in x of the median, the upper one for even n, -1 if n is 0. x is not modified*/
+long stats_median_index (const double *x, long n);
+
+/* stats_median3 - writes the median of each value and its two neighbours to out, end values are copied. out must not overlap x*/
+void stats_median3 (const double *x, double *out, long n);
+
+/* stats_hampel - writes x to out, replacing the values further than threshold scaled median absolute deviations
+   from the median of the half_window values on either side of them by that median. out must not overlap x
+   returns: the number of values replaced*/
+long stats_hampel (const double *x, double *out, long n, int half_window, double threshold);
+
+/* stats_use_kernels - picks the kernels by name: "avx512", "avx2" or "scalar". "auto" picks the widest one the cpu supports
+   returns: 0 if successful, 1 if the cpu or the compiler does not support them*/
+int stats_use_kernels (const char *name);
+
+/* stats_kernels_name - returns: the name of the kernels in use*/
+const char *stats_kernels_name (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
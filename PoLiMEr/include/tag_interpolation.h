@@ -0,0 +1,35 @@
+#ifndef __TAG_INTERPOLATION_H
+#define __TAG_INTERPOLATION_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "PoLiMEr.h"
+
+#ifndef _TIMER_OFF
+
+/* init_tag_interpolation - sets up an empty precise boundary state
+   returns: 0 if successful, 1 otherwise*/
+int init_tag_interpolation (struct tag_interpolation_t * tag_interpolation);
+void free_tag_interpolation (struct tag_interpolation_t * tag_interpolation);
+
+/* queue_tag_boundary - queues the start or end of a poli tag, in the order the boundaries happened*/
+void queue_tag_boundary (struct tag_interpolation_t * tag_interpolation, int tag_id, int is_end);
+
+/* interpolate_tag_boundaries - resolves all queued boundaries up to a new sample from the previous sample on the
+   thread tag energy timeline. must be called before that timeline is extended to the new sample*/
+void interpolate_tag_boundaries (struct tag_interpolation_t * tag_interpolation, double wtime, struct energy_reading *energy,
+    double time_error, struct system_info_t * system_info);
+
+/* get_tag_interpolation - returns: the interpolated boundaries of a poli tag, NULL if there are none*/
+struct tag_interpolation *get_tag_interpolation (struct tag_interpolation_t * tag_interpolation, int tag_id);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef __TAG_SAMPLING_H
+#define __TAG_SAMPLING_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "PoLiMEr.h"
+
+/* get_tag_sampler - returns the sampler of a tag name, set up with the default policy on first use,
+   NULL if memory could not be allocated*/
+struct tag_sampler *get_tag_sampler (int name_id, struct system_info_t * system_info, struct polimer_config_t * poli_config);
+
+/* set_tag_sampler_policy - changes the policy of a sampler while none of its invocations is open
+   returns: 0 if successful, 1 otherwise*/
+int set_tag_sampler_policy (struct tag_sampler *sampler, poli_sampling_t policy, double parameter);
+
+/* sampler_start_invocation - counts a starting invocation
+   returns: 1 if it is to be recorded, 0 otherwise*/
+int sampler_start_invocation (struct tag_sampler *sampler);
+
+/* sampler_end_invocation - returns: 1 if the ending invocation was recorded, 0 if not, -1 if none is open*/
+int sampler_end_invocation (struct tag_sampler *sampler);
+
+/* sampler_add_invocation - adds the time and energy of a recorded invocation to the statistics of its sampler*/
+void sampler_add_invocation (struct tag_sampler *sampler, struct poli_tag *tag);
+
+/* get_sampler_estimate - extrapolates the total over all invocations from the sampled ones.
+   value 0 is the time, value z + 1 the energy of zone z
+   returns: 0 if successful, 1 if nothing was sampled*/
+int get_sampler_estimate (struct tag_sampler *sampler, int value, double *total, double *ci95);
+
+const char *get_sampling_policy_name (poli_sampling_t policy);
+
+void free_tag_samplers (struct system_info_t * system_info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef __TAG_TABLE_H
+#define __TAG_TABLE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "arena.h"
+
+/* open addressing (linear probing) hash table mapping an integer key with a precomputed hash to a value.
+   used for the interned tag names (key and value are the name id) and for the currently open tags
+   (key is the name id, value the most recently opened tag of that name) */
+struct tag_table_entry {
+    uint32_t hash;
+    int key; //-1 if the entry is empty
+    int value;
+};
+
+struct tag_table {
+    struct tag_table_entry *entries;
+    unsigned int size; //power of 2
+    unsigned int mask;
+    unsigned int count;
+};
+
+struct tag_name_entry {
+    char *name;
+    uint32_t hash;
+};
+
+/* interned tag names, registered once and referred to by id afterwards.
+   entries never move, so any thread may read the entry of a known id while names are added.
+   interning and looking up names is serialized by lock */
+struct tag_names {
+    struct chunked_arena entries; //of struct tag_name_entry
+    int num_names;
+    struct tag_table index;
+    pthread_mutex_t lock;
+};
+
+/* tag_name_hash - FNV-1a hash of a tag name*/
+uint32_t tag_name_hash (const char *tag_name);
+
+/* tag_table_init - allocates a table with at least size entries (rounded up to a power of 2)
+   returns: 0 if successful, 1 otherwise*/
+int tag_table_init (struct tag_table *table, unsigned int size);
+void tag_table_free (struct tag_table *table);
+
+/* tag_table_find - returns the entry for key, NULL if there is none*/
+struct tag_table_entry *tag_table_find (struct tag_table *table, uint32_t hash, int key);
+
+/* tag_table_probe - returns the next entry with this hash along the probe run starting at *position
+   (set *position to hash beforehand), NULL once the run ends*/
+struct tag_table_entry *tag_table_probe (struct tag_table *table, uint32_t hash, unsigned int *position);
+
+/* tag_table_insert - adds an entry for a key which is not in the table yet, grows the table past half load
+   returns: 0 if successful, 1 otherwise*/
+int tag_table_insert (struct tag_table *table, uint32_t hash, int key, int value);
+
+/* tag_table_remove - removes an entry returned by tag_table_find, entries further along its probe run are shifted back*/
+void tag_table_remove (struct tag_table *table, struct tag_table_entry *entry);
+
+/* tag_names_init - sets up an empty name table
+   returns: 0 if successful, 1 otherwise*/
+int tag_names_init (struct tag_names *tag_names);
+void tag_names_free (struct tag_names *tag_names);
+
+/* tag_names_lookup - returns: the id of tag_name, -1 if it was never interned*/
+int tag_names_lookup (struct tag_names *tag_names, const char *tag_name);
+
+/* tag_names_intern - returns: the id of tag_name, interning it first if needed, -1 if memory could not be allocated*/
+int tag_names_intern (struct tag_names *tag_names, const char *tag_name);
+
+/* tag_names_get, tag_names_hash - return the name and hash of an interned name id*/
+char *tag_names_get (struct tag_names *tag_names, int name_id);
+uint32_t tag_names_hash (struct tag_names *tag_names, int name_id);
+int tag_names_count (struct tag_names *tag_names);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef __THREAD_TAGS_H
+#define __THREAD_TAGS_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "PoLiMEr.h"
+
+/* record_thread_tag_event - appends a tag event to the buffer of the calling thread, creating the buffer on first use.
+   lock-free, may be called from any number of threads concurrently
+   returns: 0 if successful, 1 otherwise*/
+int record_thread_tag_event (thread_tag_event_t type, int name_id, int thread_id, int rank, struct system_info_t * system_info);
+
+/* add_thread_tag_buffer - creates an empty buffer for the tags of thread_id on rank and adds it to the buffers
+   returns: the buffer, NULL if memory could not be allocated*/
+struct thread_tag_buffer *add_thread_tag_buffer (int thread_id, int rank, struct system_info_t * system_info);
+
+/* append_thread_tag_event - appends an event to a buffer, must only be called by the one writer of that buffer
+   returns: 0 if successful, 1 otherwise*/
+int append_thread_tag_event (struct thread_tag_buffer *buffer, thread_tag_event_t type, int name_id, double wtime);
+
+/* init_thread_tag_attribution - starts the energy timeline at the initial energy reading*/
+void init_thread_tag_attribution (struct system_info_t * system_info);
+
+/* attribute_thread_tag_events - extends the energy timeline to a new reading and attributes energy to all
+   published thread tag events up to wtime. must only be called from one thread at a time*/
+void attribute_thread_tag_events (double wtime, struct energy_reading *energy, struct system_info_t * system_info);
+
+void free_thread_tag_buffers (struct system_info_t * system_info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -19,6 +19,8 @@
 #include "PoLiMEr.h"
 #include "PoLiLog.h"
 #include "msr_handler.h"
+#include "powercap_handler.h"
+#include "perf_handler.h"
 
 static int short_term_supported (int msr);
 static int verify_power_limits(double watts, int enable);
@@ -26,22 +28,30 @@ static int get_msr_for_zone_name(char *zone_name, int get_pcap);
 
 static int detect_cpu(void);
 static int verify_model(int model);
+static const struct cpu_model *find_cpu_model (int model);
 static int detect_packages (struct system_info_t *system_info);
+static void open_msr_interface (struct system_info_t * system_info);
+static void close_msr_interface (struct system_info_t * system_info);
+static void open_powercap_interface (struct system_info_t * system_info, char *root);
+static void open_perf_interface (struct system_info_t * system_info);
 
 static void get_msr_units(struct system_info_t *system_info, int package);
 
 static int open_msr(int core);
-static uint64_t read_msr(int fd, int msr_address);
+static int read_msr(int fd, int msr_address, uint64_t *data);
 
 static int read_msr_info (struct msr_info *msr_info, struct system_info_t *system_info, int package_id);
-static int read_msr_pcap (struct msr_pcap *msr_pcap, struct system_info_t *system_info, int package_id);
-static int read_msr_perf (struct msr_perf *msr_perf, struct system_info_t *system_info, int package_id);
-static int read_msr_policy (struct msr_policy *msr_policy, struct system_info_t *system_info, int package_id);
-static int read_msr_energy (struct msr_energy *msr_energy, struct system_info_t * system_info, int package_id);
-
-static int set_msr_pcap(struct msr_pcap *pcap, struct system_info_t * system_info, int package_id);
+static void init_msr_op (struct msr_batch_op *op, int cpu, int isrdmsr, int msr, uint64_t data);
+static int run_msr_ops (struct msr_batch_op *ops, int num_ops, struct system_info_t * system_info);
+static int read_energy_msrs (struct msr_batch_op *ops, struct system_info_t * system_info);
+static void update_msr_energy (struct msr_energy *msr_energy, uint64_t data, double unit);
+static void set_zone_energies (struct rapl_energy *re, double *zones);
+static void add_power_info (struct msr_info *pimsr, double *thermal_spec, double *minimum_power, double *maximum_power, double *maximum_time_window, int first);
+static int energy_zone_index (int msr);
+
+static int set_msr_pcap(struct msr_pcap *pcap, struct system_info_t * system_info);
+static int pcap_packages (int msr, struct system_info_t * system_info);
 static uint64_t to_msr_power(double watts, double power_units);
-static int write_msr(int fd, int msr_address, uint64_t data);
 static uint64_t replace_bits(uint64_t msrval, uint64_t data, uint8_t first, uint8_t last);
 static uint64_t get_bits(uint64_t msrval, uint8_t first, uint8_t last);
 static uint64_t to_msr_time(double seconds, double time_units);
@@ -52,106 +62,132 @@ static int short_term_supported (int msr);
 static uint64_t log2_u64(uint64_t y);
 static uint64_t pow2_u64(uint64_t y);
 
-int sandybridge_energy_msrs[3] = {MSR_PKG_ENERGY_STATUS, MSR_PP0_ENERGY_STATUS, MSR_PP1_ENERGY_STATUS};
-int sandybridge_pcap_msrs[3] = {MSR_PKG_POWER_LIMIT, MSR_PP0_POWER_LIMIT, MSR_PP1_POWER_LIMIT};
-int sandybridge_perf_msrs[1] = {-1};
-int sandybridge_info_msrs[1] = {MSR_PKG_POWER_INFO};
-int sandybridge_policy_msrs[2] = {MSR_PP0_POLICY, MSR_PP1_POLICY};
-int sandybridge_msr_nums[5] = {3,3,1,0,2};
-
-int sandybridge_ep_energy_msrs[4] = {MSR_DRAM_ENERGY_STATUS, MSR_PKG_ENERGY_STATUS, MSR_PP0_ENERGY_STATUS, MSR_PP1_ENERGY_STATUS};
-int sandybridge_ep_pcap_msrs[4] = {MSR_DRAM_POWER_LIMIT, MSR_PKG_POWER_LIMIT, MSR_PP0_POWER_LIMIT, MSR_PP1_POWER_LIMIT};
-int sandybridge_ep_perf_msrs[2] = {MSR_PKG_PERF_STATUS, MSR_DRAM_PERF_STATUS};
-int sandybridge_ep_info_msrs[2] = {MSR_PKG_POWER_INFO, MSR_DRAM_POWER_INFO};
-int sandybridge_ep_policy_msrs[2] = {MSR_PP0_POLICY, MSR_PP1_POLICY};
-int sandybridge_ep_msr_nums[5] = {4,4,2,2,2};
-
-int ivybridge_energy_msrs[3] = {MSR_PKG_ENERGY_STATUS, MSR_PP0_ENERGY_STATUS, MSR_PP1_ENERGY_STATUS};
-int ivybridge_pcap_msrs[3] = {MSR_PKG_POWER_LIMIT, MSR_PP0_POWER_LIMIT, MSR_PP1_POWER_LIMIT};
-int ivybridge_perf_msrs[1] = {-1};
-int ivybridge_info_msrs[1] = {MSR_PKG_POWER_INFO};
-int ivybridge_policy_msrs[2] = {MSR_PP0_POLICY, MSR_PP1_POLICY};
-int ivybridge_msr_nums[5] = {3,3,1,0,2};
-
-int ivybridge_ep_energy_msrs[4] = {MSR_DRAM_ENERGY_STATUS, MSR_PKG_ENERGY_STATUS, MSR_PP0_ENERGY_STATUS, MSR_PP1_ENERGY_STATUS};
-int ivybridge_ep_pcap_msrs[4] = {MSR_DRAM_POWER_LIMIT, MSR_PKG_POWER_LIMIT, MSR_PP0_POWER_LIMIT, MSR_PP1_POWER_LIMIT};
-int ivybridge_ep_perf_msrs[1] = {MSR_PKG_PERF_STATUS};
-int ivybridge_ep_info_msrs[2] = {MSR_PKG_POWER_INFO, MSR_DRAM_POWER_INFO};
-int ivybridge_ep_policy_msrs[2] = {MSR_PP0_POLICY, MSR_PP1_POLICY};
-int ivybridge_ep_msr_nums[5] = {4,4,2,1,2};
-
-int haswell_energy_msrs[4] = {MSR_DRAM_ENERGY_STATUS, MSR_PKG_ENERGY_STATUS, MSR_PP0_ENERGY_STATUS, MSR_PP1_ENERGY_STATUS};
-int haswell_pcap_msrs[3] = {MSR_PKG_POWER_LIMIT, MSR_PP0_POWER_LIMIT, MSR_PP1_POWER_LIMIT};
-int haswell_perf_msrs[2] = {MSR_PKG_PERF_STATUS, MSR_DRAM_PERF_STATUS};
-int haswell_info_msrs[1] = {MSR_PKG_POWER_INFO};
-int haswell_policy_msrs[2] = {MSR_PP0_POLICY, MSR_PP1_POLICY};
-int haswell_msr_nums[5] = {4,3,1,2,2};
-
-int haswell_ep_energy_msrs[4] = {MSR_DRAM_ENERGY_STATUS, MSR_PKG_ENERGY_STATUS, MSR_PP0_ENERGY_STATUS, MSR_PP1_ENERGY_STATUS};
-int haswell_ep_pcap_msrs[4] = {MSR_DRAM_POWER_LIMIT, MSR_PKG_POWER_LIMIT, MSR_PP0_POWER_LIMIT, MSR_PP1_POWER_LIMIT};
-int haswell_ep_perf_msrs[2] = {MSR_DRAM_PERF_STATUS};
-int haswell_ep_info_msrs[2] = {MSR_PKG_POWER_INFO, MSR_DRAM_POWER_INFO};
-int haswell_ep_policy_msrs[2] = {MSR_PP0_POLICY, MSR_PP1_POLICY};
-int haswell_ep_msr_nums[5] = {4,4,2,1,2};
-
-int broadwell_energy_msrs[4] = {MSR_DRAM_ENERGY_STATUS, MSR_PKG_ENERGY_STATUS, MSR_PP0_ENERGY_STATUS, MSR_PP1_ENERGY_STATUS};
-int broadwell_pcap_msrs[4] = {MSR_DRAM_POWER_LIMIT, MSR_PKG_POWER_LIMIT, MSR_PP0_POWER_LIMIT, MSR_PP1_POWER_LIMIT};
-int broadwell_perf_msrs[2] = {MSR_PKG_PERF_STATUS, MSR_DRAM_PERF_STATUS};
-int broadwell_info_msrs[2] = {MSR_PKG_POWER_INFO, MSR_DRAM_POWER_INFO};
-int broadwell_policy_msrs[2] = {MSR_PP0_POLICY, MSR_PP1_POLICY};
-int broadwell_msr_nums[5] = {4,4,2,2,2};
-
-int broadwell_ep_energy_msrs[4] = {MSR_DRAM_ENERGY_STATUS, MSR_PKG_ENERGY_STATUS, MSR_PP0_ENERGY_STATUS, MSR_PP1_ENERGY_STATUS};
-int broadwell_ep_pcap_msrs[4] = {MSR_DRAM_POWER_LIMIT, MSR_PKG_POWER_LIMIT, MSR_PP0_POWER_LIMIT, MSR_PP1_POWER_LIMIT};
-int broadwell_ep_perf_msrs[2] = {MSR_PKG_PERF_STATUS, MSR_DRAM_PERF_STATUS};
-int broadwell_ep_info_msrs[2] = {MSR_PKG_POWER_INFO, MSR_DRAM_POWER_INFO};
-int broadwell_ep_policy_msrs[2] = {MSR_PP0_POLICY, MSR_PP1_POLICY};
-int broadwell_ep_msr_nums[5] = {4,4,2,2,2};
-
-int broadwell_de_energy_msrs[4] = {MSR_DRAM_ENERGY_STATUS, MSR_PKG_ENERGY_STATUS, MSR_PP0_ENERGY_STATUS, MSR_PP1_ENERGY_STATUS};
-int broadwell_de_pcap_msrs[4] = {MSR_DRAM_POWER_LIMIT, MSR_PKG_POWER_LIMIT, MSR_PP0_POWER_LIMIT, MSR_PP1_POWER_LIMIT};
-int broadwell_de_perf_msrs[2] = {MSR_PKG_PERF_STATUS, MSR_DRAM_PERF_STATUS};
-int broadwell_de_info_msrs[2] = {MSR_PKG_POWER_INFO, MSR_DRAM_POWER_INFO};
-int broadwell_de_policy_msrs[2] = {MSR_PP0_POLICY, MSR_PP1_POLICY};
-int broadwell_de_msr_nums[5] = {4,4,2,2,2};
-
-int skylake_energy_msrs[5] = {MSR_PLATFORM_ENERGY_COUNTER, MSR_DRAM_ENERGY_STATUS, MSR_PKG_ENERGY_STATUS, MSR_PP0_ENERGY_STATUS, MSR_PP1_ENERGY_STATUS};
-int skylake_pcap_msrs[5] = {MSR_PLATFORM_POWER_LIMIT, MSR_DRAM_POWER_LIMIT, MSR_PKG_POWER_LIMIT, MSR_PP0_POWER_LIMIT, MSR_PP1_POWER_LIMIT};
-int skylake_perf_msrs[2] = {MSR_PKG_PERF_STATUS, MSR_DRAM_PERF_STATUS};
-int skylake_info_msrs[2] = {MSR_PKG_POWER_INFO, MSR_DRAM_POWER_INFO};
-int skylake_policy_msrs[2] = {MSR_PP0_POLICY, MSR_PP1_POLICY};
-int skylake_msr_nums[5] = {5,5,2,2,2};
-
-int skylake_hs_energy_msrs[5] = {MSR_PLATFORM_ENERGY_COUNTER, MSR_DRAM_ENERGY_STATUS, MSR_PKG_ENERGY_STATUS, MSR_PP0_ENERGY_STATUS, MSR_PP1_ENERGY_STATUS};
-int skylake_hs_pcap_msrs[5] = {MSR_PLATFORM_POWER_LIMIT, MSR_DRAM_POWER_LIMIT, MSR_PKG_POWER_LIMIT, MSR_PP0_POWER_LIMIT, MSR_PP1_POWER_LIMIT};
-int skylake_hs_perf_msrs[2] = {MSR_PKG_PERF_STATUS, MSR_DRAM_PERF_STATUS};
-int skylake_hs_info_msrs[2] = {MSR_PKG_POWER_INFO, MSR_DRAM_POWER_INFO};
-int skylake_hs_policy_msrs[2] = {MSR_PP0_POLICY, MSR_PP1_POLICY};
-int skylake_hs_msr_nums[5] = {5,5,2,2,2};
-
-int kabylake_energy_msrs[5] = {MSR_PLATFORM_ENERGY_COUNTER, MSR_DRAM_ENERGY_STATUS, MSR_PKG_ENERGY_STATUS, MSR_PP0_ENERGY_STATUS, MSR_PP1_ENERGY_STATUS};
-int kabylake_pcap_msrs[5] = {MSR_PLATFORM_POWER_LIMIT, MSR_DRAM_POWER_LIMIT, MSR_PKG_POWER_LIMIT, MSR_PP0_POWER_LIMIT, MSR_PP1_POWER_LIMIT};
-int kabylake_perf_msrs[2] = {MSR_PKG_PERF_STATUS, MSR_DRAM_PERF_STATUS};
-int kabylake_info_msrs[2] = {MSR_PKG_POWER_INFO, MSR_DRAM_POWER_INFO};
-int kabylake_policy_msrs[2] = {MSR_PP0_POLICY, MSR_PP1_POLICY};
-int kabylake_msr_nums[5] = {5,5,2,2,2};
-
-int kabylake_2_energy_msrs[5] = {MSR_PLATFORM_ENERGY_COUNTER, MSR_DRAM_ENERGY_STATUS, MSR_PKG_ENERGY_STATUS, MSR_PP0_ENERGY_STATUS, MSR_PP1_ENERGY_STATUS};
-int kabylake_2_pcap_msrs[5] = {MSR_PLATFORM_POWER_LIMIT, MSR_DRAM_POWER_LIMIT, MSR_PKG_POWER_LIMIT, MSR_PP0_POWER_LIMIT, MSR_PP1_POWER_LIMIT};
-int kabylake_2_perf_msrs[2] = {MSR_PKG_PERF_STATUS, MSR_DRAM_PERF_STATUS};
-int kabylake_2_info_msrs[2] = {MSR_PKG_POWER_INFO, MSR_DRAM_POWER_INFO};
-int kabylake_2_policy_msrs[2] = {MSR_PP0_POLICY, MSR_PP1_POLICY};
-int kabylake_2_msr_nums[5] = {5,5,2,2,2};
-
-
-int knights_landing_energy_msrs[2] = {MSR_PKG_ENERGY_STATUS, MSR_DRAM_ENERGY_STATUS}; //MSR_PP0_ENERGY_STATUS, MSR_DRAM_ENERGY_STATUS};
-int knights_landing_pcap_msrs[2] = {MSR_DRAM_POWER_LIMIT, MSR_PKG_POWER_LIMIT};//, MSR_PP0_POWER_LIMIT};
-int knights_landing_perf_msrs[2] = {MSR_PKG_PERF_STATUS, MSR_DRAM_PERF_STATUS};
-int knights_landing_info_msrs[2] = {MSR_PKG_POWER_INFO, MSR_DRAM_POWER_INFO};
-int knights_landing_policy_msrs[1] = {-1};
-int knights_landing_msr_nums[5] = {2,2,2,2,0};
-
-void init_msrs (struct system_info_t * system_info)
+/* supported models. each lists its energy, pcap, info, perf and policy msrs, in the order they are set up */
+static const struct cpu_model cpu_models[] = {
+    {CPU_SANDYBRIDGE, "Sandy Bridge",
+        {{MSR_PKG_ENERGY_STATUS, MSR_PP0_ENERGY_STATUS, MSR_PP1_ENERGY_STATUS},
+         {MSR_PKG_POWER_LIMIT, MSR_PP0_POWER_LIMIT, MSR_PP1_POWER_LIMIT},
+         {MSR_PKG_POWER_INFO},
+         {0},
+         {MSR_PP0_POLICY, MSR_PP1_POLICY}},
+        0},
+    {CPU_SANDYBRIDGE_EP, "Sandy Bridge-EP",
+        {{MSR_DRAM_ENERGY_STATUS, MSR_PKG_ENERGY_STATUS, MSR_PP0_ENERGY_STATUS, MSR_PP1_ENERGY_STATUS},
+         {MSR_DRAM_POWER_LIMIT, MSR_PKG_POWER_LIMIT, MSR_PP0_POWER_LIMIT, MSR_PP1_POWER_LIMIT},
+         {MSR_PKG_POWER_INFO, MSR_DRAM_POWER_INFO},
+         {MSR_PKG_PERF_STATUS, MSR_DRAM_PERF_STATUS},
+         {MSR_PP0_POLICY, MSR_PP1_POLICY}},
+        0},
+    {CPU_IVYBRIDGE, "Ivy Bridge",
+        {{MSR_PKG_ENERGY_STATUS, MSR_PP0_ENERGY_STATUS, MSR_PP1_ENERGY_STATUS},
+         {MSR_PKG_POWER_LIMIT, MSR_PP0_POWER_LIMIT, MSR_PP1_POWER_LIMIT},
+         {MSR_PKG_POWER_INFO},
+         {0},
+         {MSR_PP0_POLICY, MSR_PP1_POLICY}},
+        0},
+    {CPU_IVYBRIDGE_EP, "Ivy Bridge-EP",
+        {{MSR_DRAM_ENERGY_STATUS, MSR_PKG_ENERGY_STATUS, MSR_PP0_ENERGY_STATUS, MSR_PP1_ENERGY_STATUS},
+         {MSR_DRAM_POWER_LIMIT, MSR_PKG_POWER_LIMIT, MSR_PP0_POWER_LIMIT, MSR_PP1_POWER_LIMIT},
+         {MSR_PKG_POWER_INFO, MSR_DRAM_POWER_INFO},
+         {MSR_PKG_PERF_STATUS},
+         {MSR_PP0_POLICY, MSR_PP1_POLICY}},
+        0},
+    {CPU_HASWELL, "Haswell",
+        {{MSR_DRAM_ENERGY_STATUS, MSR_PKG_ENERGY_STATUS, MSR_PP0_ENERGY_STATUS, MSR_PP1_ENERGY_STATUS},
+         {MSR_PKG_POWER_LIMIT, MSR_PP0_POWER_LIMIT, MSR_PP1_POWER_LIMIT},
+         {MSR_PKG_POWER_INFO},
+         {MSR_PKG_PERF_STATUS, MSR_DRAM_PERF_STATUS},
+         {MSR_PP0_POLICY, MSR_PP1_POLICY}},
+        0},
+    {CPU_HASWELL_EP, "Haswell-EP",
+        {{MSR_DRAM_ENERGY_STATUS, MSR_PKG_ENERGY_STATUS, MSR_PP0_ENERGY_STATUS, MSR_PP1_ENERGY_STATUS},
+         {MSR_DRAM_POWER_LIMIT, MSR_PKG_POWER_LIMIT, MSR_PP0_POWER_LIMIT, MSR_PP1_POWER_LIMIT},
+         {MSR_PKG_POWER_INFO, MSR_DRAM_POWER_INFO},
+         {MSR_DRAM_PERF_STATUS},
+         {MSR_PP0_POLICY, MSR_PP1_POLICY}},
+        1},
+    {CPU_BROADWELL, "Broadwell",
+        {{MSR_DRAM_ENERGY_STATUS, MSR_PKG_ENERGY_STATUS, MSR_PP0_ENERGY_STATUS, MSR_PP1_ENERGY_STATUS},
+         {MSR_DRAM_POWER_LIMIT, MSR_PKG_POWER_LIMIT, MSR_PP0_POWER_LIMIT, MSR_PP1_POWER_LIMIT},
+         {MSR_PKG_POWER_INFO, MSR_DRAM_POWER_INFO},
+         {MSR_PKG_PERF_STATUS, MSR_DRAM_PERF_STATUS},
+         {MSR_PP0_POLICY, MSR_PP1_POLICY}},
+        0},
+    {CPU_BROADWELL_EP, "Broadwell-EP",
+        {{MSR_DRAM_ENERGY_STATUS, MSR_PKG_ENERGY_STATUS, MSR_PP0_ENERGY_STATUS, MSR_PP1_ENERGY_STATUS},
+         {MSR_DRAM_POWER_LIMIT, MSR_PKG_POWER_LIMIT, MSR_PP0_POWER_LIMIT, MSR_PP1_POWER_LIMIT},
+         {MSR_PKG_POWER_INFO, MSR_DRAM_POWER_INFO},
+         {MSR_PKG_PERF_STATUS, MSR_DRAM_PERF_STATUS},
+         {MSR_PP0_POLICY, MSR_PP1_POLICY}},
+        1},
+    {CPU_BROADWELL_DE, "Broadwell-DE",
+        {{MSR_DRAM_ENERGY_STATUS, MSR_PKG_ENERGY_STATUS, MSR_PP0_ENERGY_STATUS, MSR_PP1_ENERGY_STATUS},
+         {MSR_DRAM_POWER_LIMIT, MSR_PKG_POWER_LIMIT, MSR_PP0_POWER_LIMIT, MSR_PP1_POWER_LIMIT},
+         {MSR_PKG_POWER_INFO, MSR_DRAM_POWER_INFO},
+         {MSR_PKG_PERF_STATUS, MSR_DRAM_PERF_STATUS},
+         {MSR_PP0_POLICY, MSR_PP1_POLICY}},
+        1},
+    {CPU_SKYLAKE, "Skylake",
+        {{MSR_PLATFORM_ENERGY_COUNTER, MSR_DRAM_ENERGY_STATUS, MSR_PKG_ENERGY_STATUS, MSR_PP0_ENERGY_STATUS, MSR_PP1_ENERGY_STATUS},
+         {MSR_PLATFORM_POWER_LIMIT, MSR_DRAM_POWER_LIMIT, MSR_PKG_POWER_LIMIT, MSR_PP0_POWER_LIMIT, MSR_PP1_POWER_LIMIT},
+         {MSR_PKG_POWER_INFO, MSR_DRAM_POWER_INFO},
+         {MSR_PKG_PERF_STATUS, MSR_DRAM_PERF_STATUS},
+         {MSR_PP0_POLICY, MSR_PP1_POLICY}},
+        0},
+    {CPU_SKYLAKE_HS, "Skylake-H/S",
+        {{MSR_PLATFORM_ENERGY_COUNTER, MSR_DRAM_ENERGY_STATUS, MSR_PKG_ENERGY_STATUS, MSR_PP0_ENERGY_STATUS, MSR_PP1_ENERGY_STATUS},
+         {MSR_PLATFORM_POWER_LIMIT, MSR_DRAM_POWER_LIMIT, MSR_PKG_POWER_LIMIT, MSR_PP0_POWER_LIMIT, MSR_PP1_POWER_LIMIT},
+         {MSR_PKG_POWER_INFO, MSR_DRAM_POWER_INFO},
+         {MSR_PKG_PERF_STATUS, MSR_DRAM_PERF_STATUS},
+         {MSR_PP0_POLICY, MSR_PP1_POLICY}},
+        0},
+    {CPU_SKYLAKE_X, "Skylake-SP/Cascade Lake",
+        {{MSR_DRAM_ENERGY_STATUS, MSR_PKG_ENERGY_STATUS, MSR_PP0_ENERGY_STATUS},
+         {MSR_DRAM_POWER_LIMIT, MSR_PKG_POWER_LIMIT},
+         {MSR_PKG_POWER_INFO, MSR_DRAM_POWER_INFO},
+         {MSR_PKG_PERF_STATUS, MSR_DRAM_PERF_STATUS},
+         {0}},
+        1},
+    {CPU_KABYLAKE, "Kaby Lake",
+        {{MSR_PLATFORM_ENERGY_COUNTER, MSR_DRAM_ENERGY_STATUS, MSR_PKG_ENERGY_STATUS, MSR_PP0_ENERGY_STATUS, MSR_PP1_ENERGY_STATUS},
+         {MSR_PLATFORM_POWER_LIMIT, MSR_DRAM_POWER_LIMIT, MSR_PKG_POWER_LIMIT, MSR_PP0_POWER_LIMIT, MSR_PP1_POWER_LIMIT},
+         {MSR_PKG_POWER_INFO, MSR_DRAM_POWER_INFO},
+         {MSR_PKG_PERF_STATUS, MSR_DRAM_PERF_STATUS},
+         {MSR_PP0_POLICY, MSR_PP1_POLICY}},
+        0},
+    {CPU_KABYLAKE_2, "Kaby Lake",
+        {{MSR_PLATFORM_ENERGY_COUNTER, MSR_DRAM_ENERGY_STATUS, MSR_PKG_ENERGY_STATUS, MSR_PP0_ENERGY_STATUS, MSR_PP1_ENERGY_STATUS},
+         {MSR_PLATFORM_POWER_LIMIT, MSR_DRAM_POWER_LIMIT, MSR_PKG_POWER_LIMIT, MSR_PP0_POWER_LIMIT, MSR_PP1_POWER_LIMIT},
+         {MSR_PKG_POWER_INFO, MSR_DRAM_POWER_INFO},
+         {MSR_PKG_PERF_STATUS, MSR_DRAM_PERF_STATUS},
+         {MSR_PP0_POLICY, MSR_PP1_POLICY}},
+        0},
+    {CPU_ICELAKE_X, "Ice Lake-SP",
+        {{MSR_DRAM_ENERGY_STATUS, MSR_PKG_ENERGY_STATUS, MSR_PP0_ENERGY_STATUS},
+         {MSR_DRAM_POWER_LIMIT, MSR_PKG_POWER_LIMIT},
+         {MSR_PKG_POWER_INFO, MSR_DRAM_POWER_INFO},
+         {MSR_PKG_PERF_STATUS, MSR_DRAM_PERF_STATUS},
+         {0}},
+        1},
+    {CPU_SAPPHIRERAPIDS_X, "Sapphire Rapids",
+        {{MSR_DRAM_ENERGY_STATUS, MSR_PKG_ENERGY_STATUS, MSR_PP0_ENERGY_STATUS},
+         {MSR_DRAM_POWER_LIMIT, MSR_PKG_POWER_LIMIT},
+         {MSR_PKG_POWER_INFO, MSR_DRAM_POWER_INFO},
+         {MSR_PKG_PERF_STATUS, MSR_DRAM_PERF_STATUS},
+         {0}},
+        1},
+    {CPU_KNIGHTS_LANDING, "Knights Landing",
+        {{MSR_PKG_ENERGY_STATUS, MSR_DRAM_ENERGY_STATUS},
+         {MSR_DRAM_POWER_LIMIT, MSR_PKG_POWER_LIMIT},
+         {MSR_PKG_POWER_INFO, MSR_DRAM_POWER_INFO},
+         {MSR_PKG_PERF_STATUS, MSR_DRAM_PERF_STATUS},
+         {0}},
+        1},
+};
+
+#define NUM_CPU_MODELS (sizeof(cpu_models) / sizeof(cpu_models[0]))
+
+void init_msrs (struct system_info_t * system_info, rapl_backend_t backend, char *powercap_root)
 {
     poli_log(TRACE, NULL, "Entering %s", __FUNCTION__);
 
@@ -165,6 +201,31 @@ void init_msrs (struct system_info_t * system_info)
     system_info->sysmsr->perf_msrs = 0;
     system_info->sysmsr->policy_msrs = 0;
     system_info->sysmsr->num_zones = 0;
+    system_info->sysmsr->total_packages = 0;
+    system_info->sysmsr->batch_fd = -1;
+    system_info->sysmsr->powercap = NULL;
+    system_info->sysmsr->perf_rapl = NULL;
+
+    int package;
+    for (package = 0; package < MAX_PACKAGES; package++)
+        system_info->sysmsr->package_fd[package] = -1;
+
+    if (backend == RAPL_AUTO || backend == RAPL_MSR)
+        open_msr_interface(system_info);
+
+    //without access to the msrs, RAPL is read through the powercap sysfs, or else perf_event which can't cap
+    if (backend == RAPL_POWERCAP || (backend == RAPL_AUTO && system_info->sysmsr->error_state))
+        open_powercap_interface(system_info, powercap_root);
+    if (backend == RAPL_PERF || (backend == RAPL_AUTO && system_info->sysmsr->error_state))
+        open_perf_interface(system_info);
+
+    poli_log(TRACE, NULL, "Finishing %s", __FUNCTION__);
+}
+
+/* open_msr_interface - sets up the msrs of the cpu model and opens them on every package. sets error_state if that fails*/
+static void open_msr_interface (struct system_info_t * system_info)
+{
+    poli_log(TRACE, NULL, "Entering %s", __FUNCTION__);
 
     system_info->sysmsr->cpu_model = detect_cpu();
 
@@ -178,222 +239,20 @@ void init_msrs (struct system_info_t * system_info)
 
     detect_packages(system_info);
 
+    const struct cpu_model *cpu = find_cpu_model(system_info->sysmsr->cpu_model);
+    poli_log(DEBUG, NULL, "Found a %s CPU with %d packages", cpu->name, system_info->sysmsr->total_packages);
+
+    //the power cap zones are those named in the power cap handler
+    system_info->sysmsr->num_zones = 2;
+
     int i, j;
     for (i = 0; i < 5; i++)
     {
+        system_info->sysmsr->msr_nums[i] = 0;
         for (j = 0; j < MAX_MSRS; j++)
             system_info->sysmsr->msrs[i][j] = 0;
-    }
-
-
-
-    //TODO
-    system_info->sysmsr->num_zones = 3;
-
-    switch (system_info->sysmsr->cpu_model)
-    {
-        case CPU_SANDYBRIDGE:
-            for (i = 0; i < 5; i++)
-                system_info->sysmsr->msr_nums[i] = sandybridge_msr_nums[i];
-            for (j = 0; j < system_info->sysmsr->msr_nums[0]; j++)
-                system_info->sysmsr->msrs[0][j] = sandybridge_energy_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[1]; j++)
-                system_info->sysmsr->msrs[1][j] = sandybridge_pcap_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[2]; j++)
-                system_info->sysmsr->msrs[2][j] = sandybridge_info_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[4]; j++)
-                system_info->sysmsr->msrs[4][j] = sandybridge_policy_msrs[j];
-
-            system_info->sysmsr->msrs[3][0] = sandybridge_perf_msrs[0];
-            break;
-        case CPU_SANDYBRIDGE_EP:
-            for (i = 0; i < 5; i++)
-                system_info->sysmsr->msr_nums[i] = sandybridge_ep_msr_nums[i];
-            for (j = 0; j < system_info->sysmsr->msr_nums[0]; j++)
-                system_info->sysmsr->msrs[0][j] = sandybridge_ep_energy_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[1]; j++)
-                system_info->sysmsr->msrs[1][j] = sandybridge_ep_pcap_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[2]; j++)
-                system_info->sysmsr->msrs[2][j] = sandybridge_ep_info_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[3]; j++)
-                system_info->sysmsr->msrs[3][j] = sandybridge_ep_perf_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[4]; j++)
-                system_info->sysmsr->msrs[4][j] = sandybridge_ep_policy_msrs[j];
-            break;
-        case CPU_IVYBRIDGE:
-            for (i = 0; i < 5; i++)
-                system_info->sysmsr->msr_nums[i] = ivybridge_msr_nums[i];
-            for (j = 0; j < system_info->sysmsr->msr_nums[0]; j++)
-                system_info->sysmsr->msrs[0][j] = ivybridge_energy_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[1]; j++)
-                system_info->sysmsr->msrs[1][j] = ivybridge_pcap_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[2]; j++)
-                system_info->sysmsr->msrs[2][j] = ivybridge_info_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[4]; j++)
-                system_info->sysmsr->msrs[4][j] = ivybridge_policy_msrs[j];
-
-            system_info->sysmsr->msrs[3][0] = ivybridge_perf_msrs[0];
-            break;
-        case CPU_IVYBRIDGE_EP:
-            for (i = 0; i < 5; i++)
-                system_info->sysmsr->msr_nums[i] = ivybridge_ep_msr_nums[i];
-            for (j = 0; j < system_info->sysmsr->msr_nums[0]; j++)
-                system_info->sysmsr->msrs[0][j] = ivybridge_ep_energy_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[1]; j++)
-                system_info->sysmsr->msrs[1][j] = ivybridge_ep_pcap_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[2]; j++)
-                system_info->sysmsr->msrs[2][j] = ivybridge_ep_info_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[3]; j++)
-                system_info->sysmsr->msrs[3][j] = ivybridge_ep_perf_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[4]; j++)
-                system_info->sysmsr->msrs[4][j] = ivybridge_ep_policy_msrs[j];
-            break;
-        case CPU_HASWELL:
-            for (i = 0; i < 5; i++)
-                system_info->sysmsr->msr_nums[i] = haswell_msr_nums[i];
-            for (j = 0; j < system_info->sysmsr->msr_nums[0]; j++)
-                system_info->sysmsr->msrs[0][j] = haswell_energy_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[1]; j++)
-                system_info->sysmsr->msrs[1][j] = haswell_pcap_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[2]; j++)
-                system_info->sysmsr->msrs[2][j] = haswell_info_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[3]; j++)
-                system_info->sysmsr->msrs[3][j] = haswell_perf_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[4]; j++)
-                system_info->sysmsr->msrs[4][j] = haswell_policy_msrs[j];
-            break;
-        case CPU_HASWELL_EP:
-            for (i = 0; i < 5; i++)
-                system_info->sysmsr->msr_nums[i] = haswell_ep_msr_nums[i];
-            for (j = 0; j < system_info->sysmsr->msr_nums[0]; j++)
-                system_info->sysmsr->msrs[0][j] = haswell_ep_energy_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[1]; j++)
-                system_info->sysmsr->msrs[1][j] = haswell_ep_pcap_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[2]; j++)
-                system_info->sysmsr->msrs[2][j] = haswell_ep_info_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[3]; j++)
-                system_info->sysmsr->msrs[3][j] = haswell_ep_perf_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[4]; j++)
-                system_info->sysmsr->msrs[4][j] = haswell_ep_policy_msrs[j];
-            break;
-        case CPU_BROADWELL:
-            for (i = 0; i < 5; i++)
-                system_info->sysmsr->msr_nums[i] = broadwell_msr_nums[i];
-            for (j = 0; j < system_info->sysmsr->msr_nums[0]; j++)
-                system_info->sysmsr->msrs[0][j] = broadwell_energy_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[1]; j++)
-                system_info->sysmsr->msrs[1][j] = broadwell_pcap_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[2]; j++)
-                system_info->sysmsr->msrs[2][j] = broadwell_info_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[3]; j++)
-                system_info->sysmsr->msrs[3][j] = broadwell_perf_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[4]; j++)
-                system_info->sysmsr->msrs[4][j] = broadwell_policy_msrs[j];
-            break;
-        case CPU_BROADWELL_EP:
-            for (i = 0; i < 5; i++)
-                system_info->sysmsr->msr_nums[i] = broadwell_ep_msr_nums[i];
-            for (j = 0; j < system_info->sysmsr->msr_nums[0]; j++)
-                system_info->sysmsr->msrs[0][j] = broadwell_ep_energy_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[1]; j++)
-                system_info->sysmsr->msrs[1][j] = broadwell_ep_pcap_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[2]; j++)
-                system_info->sysmsr->msrs[2][j] = broadwell_ep_info_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[3]; j++)
-                system_info->sysmsr->msrs[3][j] = broadwell_ep_perf_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[4]; j++)
-                system_info->sysmsr->msrs[4][j] = broadwell_ep_policy_msrs[j];
-            break;
-        case CPU_BROADWELL_DE:
-            for (i = 0; i < 5; i++)
-                system_info->sysmsr->msr_nums[i] = broadwell_de_msr_nums[i];
-            for (j = 0; j < system_info->sysmsr->msr_nums[0]; j++)
-                system_info->sysmsr->msrs[0][j] = broadwell_de_energy_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[1]; j++)
-                system_info->sysmsr->msrs[1][j] = broadwell_de_pcap_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[2]; j++)
-                system_info->sysmsr->msrs[2][j] = broadwell_de_info_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[3]; j++)
-                system_info->sysmsr->msrs[3][j] = broadwell_de_perf_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[4]; j++)
-                system_info->sysmsr->msrs[4][j] = broadwell_de_policy_msrs[j];
-            break;
-        case CPU_SKYLAKE:
-            for (i = 0; i < 5; i++)
-                system_info->sysmsr->msr_nums[i] = skylake_msr_nums[i];
-            for (j = 0; j < system_info->sysmsr->msr_nums[0]; j++)
-                system_info->sysmsr->msrs[0][j] = skylake_energy_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[1]; j++)
-                system_info->sysmsr->msrs[1][j] = skylake_pcap_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[2]; j++)
-                system_info->sysmsr->msrs[2][j] = skylake_info_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[3]; j++)
-                system_info->sysmsr->msrs[3][j] = skylake_perf_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[4]; j++)
-                system_info->sysmsr->msrs[4][j] = skylake_policy_msrs[j];
-            break;
-        case CPU_SKYLAKE_HS:
-            for (i = 0; i < 5; i++)
-                system_info->sysmsr->msr_nums[i] = skylake_hs_msr_nums[i];
-            for (j = 0; j < system_info->sysmsr->msr_nums[0]; j++)
-                system_info->sysmsr->msrs[0][j] = skylake_hs_energy_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[1]; j++)
-                system_info->sysmsr->msrs[1][j] = skylake_hs_pcap_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[2]; j++)
-                system_info->sysmsr->msrs[2][j] = skylake_hs_info_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[3]; j++)
-                system_info->sysmsr->msrs[3][j] = skylake_hs_perf_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[4]; j++)
-                system_info->sysmsr->msrs[4][j] = skylake_hs_policy_msrs[j];
-            break;
-        case CPU_KABYLAKE:
-            for (i = 0; i < 5; i++)
-                system_info->sysmsr->msr_nums[i] = kabylake_msr_nums[i];
-            for (j = 0; j < system_info->sysmsr->msr_nums[0]; j++)
-                system_info->sysmsr->msrs[0][j] = kabylake_energy_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[1]; j++)
-                system_info->sysmsr->msrs[1][j] = kabylake_pcap_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[2]; j++)
-                system_info->sysmsr->msrs[2][j] = kabylake_info_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[3]; j++)
-                system_info->sysmsr->msrs[3][j] = kabylake_perf_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[4]; j++)
-                system_info->sysmsr->msrs[4][j] = kabylake_policy_msrs[j];
-            break;
-        case CPU_KABYLAKE_2:
-            for (i = 0; i < 5; i++)
-                system_info->sysmsr->msr_nums[i] = kabylake_2_msr_nums[i];
-            for (j = 0; j < system_info->sysmsr->msr_nums[0]; j++)
-                system_info->sysmsr->msrs[0][j] = kabylake_2_energy_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[1]; j++)
-                system_info->sysmsr->msrs[1][j] = kabylake_2_pcap_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[2]; j++)
-                system_info->sysmsr->msrs[2][j] = kabylake_2_info_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[3]; j++)
-                system_info->sysmsr->msrs[3][j] = kabylake_2_perf_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[4]; j++)
-                system_info->sysmsr->msrs[4][j] = kabylake_2_policy_msrs[j];
-            break;
-        case CPU_KNIGHTS_LANDING:
-            for (i = 0; i < 5; i++)
-                system_info->sysmsr->msr_nums[i] = knights_landing_msr_nums[i];
-
-            for (j = 0; j < system_info->sysmsr->msr_nums[0]; j++)
-                system_info->sysmsr->msrs[0][j] = knights_landing_energy_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[1]; j++)
-                system_info->sysmsr->msrs[1][j] = knights_landing_pcap_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[2]; j++)
-                system_info->sysmsr->msrs[2][j] = knights_landing_info_msrs[j];
-            for (j = 0; j < system_info->sysmsr->msr_nums[3]; j++)
-                system_info->sysmsr->msrs[3][j] = knights_landing_perf_msrs[j];
-
-            system_info->sysmsr->msrs[4][0] = knights_landing_policy_msrs[0];
-
-            system_info->sysmsr->num_zones = 2;
-
-            break;
-        default:
-            break;
+        for (j = 0; j < NUM_RAPL_DOMAINS && cpu->msrs[i][j]; j++)
+            system_info->sysmsr->msrs[i][system_info->sysmsr->msr_nums[i]++] = cpu->msrs[i][j];
     }
 
     system_info->sysmsr->energy_msrs = calloc(system_info->sysmsr->msr_nums[0] * system_info->sysmsr->total_packages, sizeof(struct msr_energy));
@@ -435,6 +294,12 @@ void init_msrs (struct system_info_t * system_info)
             emsr->num_overflows = 0;
             emsr->cpu_energy_units = system_info->sysmsr->cpu_energy_units[package];
             emsr->dram_energy_units = system_info->sysmsr->dram_energy_units[package];
+
+            struct energy_read_step *step = &system_info->sysmsr->energy_plan[msr + (package * system_info->sysmsr->msr_nums[0])];
+            step->package = package;
+            step->zone = energy_zone_index(emsr->msr);
+            step->unit = (emsr->msr == MSR_DRAM_ENERGY_STATUS) ? emsr->dram_energy_units : emsr->cpu_energy_units;
+            init_msr_op(&system_info->sysmsr->energy_ops[msr + (package * system_info->sysmsr->msr_nums[0])], cpu_id, 1, emsr->msr, 0);
         }
 
         for (msr = 0; msr < system_info->sysmsr->msr_nums[1]; msr++)
@@ -484,21 +349,73 @@ void init_msrs (struct system_info_t * system_info)
         }
     }
 
+    system_info->sysmsr->batch_fd = open(MSR_BATCH_DEVICE, O_RDWR);
+    if (system_info->sysmsr->batch_fd < 0)
+        poli_log(DEBUG, NULL, "Couldn't open %s: %s. MSRs will be accessed one at a time.", MSR_BATCH_DEVICE, strerror(errno));
+
     poli_log(TRACE, NULL, "Finishing %s", __FUNCTION__);
 }
 
-int finalize_msrs (struct system_info_t * system_info)
+static void close_msr_interface (struct system_info_t * system_info)
 {
-    poli_log(TRACE, NULL, "Entering %s", __FUNCTION__);
+    int package;
+    for (package = 0; package < MAX_PACKAGES; package++)
+    {
+        if (system_info->sysmsr->package_fd[package] >= 0)
+            close(system_info->sysmsr->package_fd[package]);
+        system_info->sysmsr->package_fd[package] = -1;
+    }
+    if (system_info->sysmsr->batch_fd >= 0)
+        close(system_info->sysmsr->batch_fd);
+    system_info->sysmsr->batch_fd = -1;
+}
+
+/* open_powercap_interface - reads RAPL through the powercap sysfs at root instead of the msrs. sets error_state if that fails*/
+static void open_powercap_interface (struct system_info_t * system_info, char *root)
+{
+    close_msr_interface(system_info);
 
-    if (!system_info->sysmsr->error_state)
+    system_info->sysmsr->powercap = init_powercap(root);
+    if (system_info->sysmsr->powercap == NULL)
     {
-        int package;
-        for (package = 0; package < system_info->sysmsr->total_packages; package++)
-            if (system_info->sysmsr->package_fd[package])
-                close(system_info->sysmsr->package_fd[package]);
+        poli_log(ERROR, NULL, "Couldn't read RAPL through the powercap sysfs.");
+        system_info->sysmsr->error_state = 1;
+        system_info->sysmsr->total_packages = 0;
+        return;
+    }
+
+    system_info->sysmsr->error_state = 0;
+    system_info->sysmsr->total_packages = system_info->sysmsr->powercap->num_packages;
+    system_info->sysmsr->num_zones = 2;
+}
+
+/* open_perf_interface - reads RAPL through the power pmu of perf_event instead of the msrs. sets error_state if that fails*/
+static void open_perf_interface (struct system_info_t * system_info)
+{
+    close_msr_interface(system_info);
+
+    system_info->sysmsr->perf_rapl = init_perf_rapl();
+    if (system_info->sysmsr->perf_rapl == NULL)
+    {
+        poli_log(ERROR, NULL, "Couldn't read RAPL through perf_event. There won't be any measurements using RAPL.");
+        system_info->sysmsr->error_state = 1;
+        system_info->sysmsr->total_packages = 0;
+        return;
     }
 
+    system_info->sysmsr->error_state = 0;
+    system_info->sysmsr->total_packages = system_info->sysmsr->perf_rapl->num_packages;
+    system_info->sysmsr->num_zones = 2;
+}
+
+int finalize_msrs (struct system_info_t * system_info)
+{
+    poli_log(TRACE, NULL, "Entering %s", __FUNCTION__);
+
+    close_msr_interface(system_info);
+    finalize_powercap(system_info->sysmsr->powercap);
+    finalize_perf_rapl(system_info->sysmsr->perf_rapl);
+
     if(system_info->sysmsr)
         free(system_info->sysmsr);
 
@@ -524,42 +441,67 @@ int get_power_info(struct power_info *pi, struct system_info_t * system_info)
         return 0;
     }
 
-    //TODO
-    int i, package_id = 0; //fixing package to be 0, this needs to be changed for other platforms
+    if (system_info->sysmsr->powercap)
+        return powercap_get_power_info(pi, system_info->sysmsr->powercap);
+    //the power pmu has no power info
+    if (system_info->sysmsr->perf_rapl)
+        return 0;
+
+    //the power of the node is that of all of its packages
+    int i, package_id;
     int num_msrs = system_info->sysmsr->msr_nums[2];
 
-    for (i = 0; i < num_msrs; i++)
+    for (package_id = 0; package_id < system_info->sysmsr->total_packages; package_id++)
     {
-        struct msr_info *pimsr = &system_info->sysmsr->info_msrs[package_id * num_msrs + i];
-        read_msr_info(pimsr, system_info, 0);
-        if (pimsr->msr == MSR_PKG_POWER_INFO)
-        {
-            pi->package_thermal_spec = pimsr->thermal_spec_power;
-            pi->package_minimum_power = pimsr->minimum_power;
-            pi->package_maximum_power = pimsr->maximum_power;
-            pi->package_maximum_time_window = pimsr->maximum_time_window;
-        }
-        else if (pimsr->msr == MSR_DRAM_POWER_INFO)
+        for (i = 0; i < num_msrs; i++)
         {
-            pi->dram_thermal_spec = pimsr->thermal_spec_power;
-            pi->dram_minimum_power = pimsr->minimum_power;
-            pi->dram_maximum_power = pimsr->maximum_power;
-            pi->dram_maximum_time_window = pimsr->maximum_time_window;
+            struct msr_info *pimsr = &system_info->sysmsr->info_msrs[package_id * num_msrs + i];
+            read_msr_info(pimsr, system_info, package_id);
+            if (pimsr->msr == MSR_PKG_POWER_INFO)
+                add_power_info(pimsr, &pi->package_thermal_spec, &pi->package_minimum_power, &pi->package_maximum_power,
+                    &pi->package_maximum_time_window, package_id == 0);
+            else if (pimsr->msr == MSR_DRAM_POWER_INFO)
+                add_power_info(pimsr, &pi->dram_thermal_spec, &pi->dram_minimum_power, &pi->dram_maximum_power,
+                    &pi->dram_maximum_time_window, package_id == 0);
+            else
+                poli_log(ERROR, NULL, "%s: Unrecognized power info MSR %#010X", __FUNCTION__, pimsr->msr);
         }
-        else
-            poli_log(ERROR, NULL, "%s: Unrecognized power info MSR %#010X", __FUNCTION__, pimsr->msr);
     }
 
     return 0;
 }
 
-int rapl_read_energy(struct rapl_energy *re, struct system_info_t * system_info)
+/* add_power_info - adds the power info of one package to that of the node. the time window is the shortest of the packages*/
+static void add_power_info (struct msr_info *pimsr, double *thermal_spec, double *minimum_power, double *maximum_power, double *maximum_time_window, int first)
 {
-    re->package = 0;
-    re->pp0 = 0;
-    re->pp1 = 0;
-    re->dram = 0;
-    re->platform = 0;
+    if (first)
+    {
+        *thermal_spec = 0;
+        *minimum_power = 0;
+        *maximum_power = 0;
+        *maximum_time_window = pimsr->maximum_time_window;
+    }
+    *thermal_spec += pimsr->thermal_spec_power;
+    *minimum_power += pimsr->minimum_power;
+    *maximum_power += pimsr->maximum_power;
+    if (pimsr->maximum_time_window < *maximum_time_window)
+        *maximum_time_window = pimsr->maximum_time_window;
+}
+
+int rapl_num_packages (struct system_info_t * system_info)
+{
+    if (system_info->sysmsr->total_packages < 1)
+        return 1;
+    return system_info->sysmsr->total_packages;
+}
+
+int rapl_read_energy(struct rapl_energy *re, struct rapl_energy *package_energy, struct system_info_t * system_info)
+{
+    struct rapl_energy zero = {0};
+    int i, package_id;
+    *re = zero;
+    for (package_id = 0; package_energy && package_id < MAX_RECORDED_PACKAGES; package_id++)
+        package_energy[package_id] = zero;
 
     if (system_info->sysmsr->error_state)
     {
@@ -567,31 +509,130 @@ int rapl_read_energy(struct rapl_energy *re, struct system_info_t * system_info)
         return 0;
     }
 
-    //TODO
-    int i, package_id = 0; //fixing package to be 0, this needs to be changed for other platforms
-    int num_energy_msrs = system_info->sysmsr->msr_nums[0];
+    if (system_info->sysmsr->powercap)
+        return powercap_read_energy(re, package_energy, system_info->sysmsr->powercap);
+    if (system_info->sysmsr->perf_rapl)
+        return perf_rapl_read_energy(re, package_energy, system_info->sysmsr->perf_rapl);
 
-    for (i = 0; i < num_energy_msrs; i++)
+    int num_steps = system_info->sysmsr->msr_nums[0] * system_info->sysmsr->total_packages;
+    struct msr_batch_op ops[MAX_PACKAGES * NUM_RAPL_DOMAINS];
+    double zones[MAX_PACKAGES + 1][NUM_RAPL_DOMAINS] = {{0}}; //the packages, then the node
+
+    //all counters are read before any is converted, so the packages are sampled as close together as possible
+    if (read_energy_msrs(ops, system_info) != 0)
     {
-        struct msr_energy *emsr = &system_info->sysmsr->energy_msrs[package_id * num_energy_msrs + i];
-        read_msr_energy(emsr, system_info, 0);
-        if (emsr->msr == MSR_PKG_ENERGY_STATUS)
-            re->package = emsr->total_energy;
-        else if (emsr->msr == MSR_PP0_ENERGY_STATUS)
-            re->pp0 = emsr->total_energy;
-        else if (emsr->msr == MSR_PP1_ENERGY_STATUS)
-            re->pp1 = emsr->total_energy;
-        else if (emsr->msr == MSR_DRAM_ENERGY_STATUS)
-            re->dram = emsr->total_energy;
-        else if (emsr->msr == MSR_PLATFORM_ENERGY_COUNTER)
-            re->platform = emsr->total_energy;
-        else
-            poli_log(ERROR, NULL, "%s: Unrecognized energy MSR %#010X", __FUNCTION__, emsr->msr);
+        for (i = 0; i < num_steps; i++)
+            if (ops[i].err)
+                poli_log(ERROR, NULL, "%s: Couldn't read MSR at address %d of package %d", __FUNCTION__, ops[i].msr, system_info->sysmsr->energy_plan[i].package);
+    }
+
+    for (i = 0; i < num_steps; i++)
+    {
+        struct energy_read_step *step = &system_info->sysmsr->energy_plan[i];
+        struct msr_energy *emsr = &system_info->sysmsr->energy_msrs[i];
+        //a counter which couldn't be read keeps its last total
+        if (!ops[i].err)
+            update_msr_energy(emsr, ops[i].msrdata, step->unit);
+        zones[step->package][step->zone] += emsr->total_energy;
+        zones[MAX_PACKAGES][step->zone] += emsr->total_energy;
     }
 
+    set_zone_energies(re, zones[MAX_PACKAGES]);
+    for (package_id = 0; package_energy && package_id < MAX_RECORDED_PACKAGES; package_id++)
+        set_zone_energies(&package_energy[package_id], zones[package_id]);
+
     return 0;
 }
 
+/* set_zone_energies - sets the zones of re from energies indexed as in energy_zone_index*/
+static void set_zone_energies (struct rapl_energy *re, double *zones)
+{
+    re->package = zones[0];
+    re->pp0 = zones[1];
+    re->pp1 = zones[2];
+    re->platform = zones[3];
+    re->dram = zones[4];
+}
+
+/* read_energy_msrs - reads the energy counters of all packages into ops with the batch compiled at init, in the order of energy_msrs
+   returns: 0 if all of them were read, else 1*/
+static int read_energy_msrs (struct msr_batch_op *ops, struct system_info_t * system_info)
+{
+    int num_ops = system_info->sysmsr->total_packages * system_info->sysmsr->msr_nums[0];
+    memcpy(ops, system_info->sysmsr->energy_ops, num_ops * sizeof(struct msr_batch_op));
+    return run_msr_ops(ops, num_ops, system_info);
+}
+
+static void init_msr_op (struct msr_batch_op *op, int cpu, int isrdmsr, int msr, uint64_t data)
+{
+    op->cpu = (uint16_t) cpu;
+    op->isrdmsr = (uint16_t) isrdmsr;
+    op->err = 0;
+    op->msr = (uint32_t) msr;
+    op->msrdata = data;
+    op->wmask = 0;
+}
+
+/* run_msr_ops - runs ops in order, in a single ioctl of the msr_safe batch device if there is one, else with one pread or pwrite each
+   returns: 0 if all of them succeeded, else 1 and err is set on those which failed*/
+static int run_msr_ops (struct msr_batch_op *ops, int num_ops, struct system_info_t * system_info)
+{
+    int i, failed = 0;
+    if (system_info->sysmsr->batch_fd >= 0)
+    {
+        struct msr_batch_array batch;
+        batch.numops = (uint32_t) num_ops;
+        batch.ops = ops;
+        if (ioctl(system_info->sysmsr->batch_fd, X86_IOC_MSR_BATCH, &batch) == 0)
+            return 0;
+        //whether the other ops of a rejected batch ran is up to the driver, so they all run again one at a time
+        poli_log(WARNING, NULL, "%s: The msr_safe batch failed: %s. MSRs will be accessed one at a time.", __FUNCTION__, strerror(errno));
+        close(system_info->sysmsr->batch_fd);
+        system_info->sysmsr->batch_fd = -1;
+    }
+
+    for (i = 0; i < num_ops; i++)
+    {
+        int package, fd = -1;
+        for (package = 0; package < system_info->sysmsr->total_packages; package++)
+            if (system_info->sysmsr->package_map[package] == ops[i].cpu)
+                fd = system_info->sysmsr->package_fd[package];
+        ssize_t done = ops[i].isrdmsr ? pread(fd, &ops[i].msrdata, sizeof(uint64_t), ops[i].msr) : pwrite(fd, &ops[i].msrdata, sizeof(uint64_t), ops[i].msr);
+        ops[i].err = (done == sizeof(uint64_t)) ? 0 : -errno;
+        failed |= (ops[i].err != 0);
+    }
+    return failed;
+}
+
+int rapl_read_raw_energy (uint32_t *counters, double *units, struct system_info_t * system_info)
+{
+    if (system_info->sysmsr->error_state)
+        return 0;
+    if (system_info->sysmsr->powercap)
+        return powercap_read_raw_energy(counters, units, system_info->sysmsr->powercap);
+    if (system_info->sysmsr->perf_rapl)
+        return perf_rapl_read_raw_energy(counters, units, system_info->sysmsr->perf_rapl);
+
+    int i;
+    int num_packages = system_info->sysmsr->total_packages;
+    int num_steps = system_info->sysmsr->msr_nums[0] * num_packages;
+    struct msr_batch_op ops[MAX_PACKAGES * NUM_RAPL_DOMAINS];
+    memset(counters, 0, num_packages * NUM_RAPL_DOMAINS * sizeof(uint32_t));
+    if (units)
+        memset(units, 0, num_packages * NUM_RAPL_DOMAINS * sizeof(double));
+
+    if (read_energy_msrs(ops, system_info) != 0)
+        return 0;
+    for (i = 0; i < num_steps; i++)
+    {
+        struct energy_read_step *step = &system_info->sysmsr->energy_plan[i];
+        counters[step->package * NUM_RAPL_DOMAINS + step->zone] = (uint32_t) ops[i].msrdata;
+        if (units)
+            units[step->package * NUM_RAPL_DOMAINS + step->zone] = step->unit;
+    }
+    return num_packages * NUM_RAPL_DOMAINS;
+}
+
 static int verify_power_limits(double watts, int enable)
 {
     double minwatts = MIN_WATTS;
@@ -753,10 +794,23 @@ int rapl_set_power_cap(char *zone_name, double watts_long, double watts_short, d
         poli_log(WARNING, NULL, "RAPL Interface couldn't be set up. Setting power cap is not possible.");
         return ret;
     }
+    if (system_info->sysmsr->perf_rapl)
+    {
+        poli_log(WARNING, NULL, "Power capping is not possible through perf_event.");
+        return ret;
+    }
+
+    //the cap is that of the node, split evenly over its packages. the platform has one system wide limit
+    if (strcmp(zone_name, "PLATFORM") != 0)
+    {
+        int num_packages = rapl_num_packages(system_info);
+        watts_long /= num_packages;
+        watts_short /= num_packages;
+    }
 
     if (!verify_power_limits(watts_long, enable) || !verify_power_limits(watts_short, enable))
     {
-        poli_log(WARNING, NULL, "%s: The requested power cap (%f long, %f short) is invalid. Will reset system to default values...", __FUNCTION__, watts_long, watts_short);
+        poli_log(WARNING, NULL, "%s: The requested power cap (%f long, %f short per package) is invalid. Will reset system to default values...", __FUNCTION__, watts_long, watts_short);
         if (strcmp(zone_name, "PACKAGE") == 0)
         {
             watts_long = DEFAULT_PKG_POW;
@@ -778,13 +832,19 @@ int rapl_set_power_cap(char *zone_name, double watts_long, double watts_short, d
     else if (enable < 0)
         enable = 0;
 
+    if (system_info->sysmsr->powercap)
+    {
+        ret = powercap_set_power_cap(zone_name, watts_long, watts_short, seconds_long, seconds_short, enable, system_info->sysmsr->powercap);
+        if (ret != 0)
+            poli_log(ERROR, NULL, "Something went wrong with setting a power cap!");
+        return ret;
+    }
+
     struct msr_pcap pcap;
 
     if (rapl_init_power_cap(&pcap, zone_name, watts_long, watts_short, seconds_long, seconds_short, enable) == 0)
     {
-        int package = 0; //TODO figure out what to do with multiple packages
-        pcap.package_id = package;
-        ret = set_msr_pcap(&pcap, system_info, package);
+        ret = set_msr_pcap(&pcap, system_info);
         if (ret != 0)
             poli_log(ERROR, NULL, "Something went wrong with setting a power cap!");
     }
@@ -819,6 +879,14 @@ int rapl_get_power_cap_info(char *zone_name, double *min, double *max,
         poli_log(WARNING, NULL, "RAPL Interface couldn't be set up. Getting power cap info is not possible.");
         return 1;
     }
+    if (system_info->sysmsr->perf_rapl)
+    {
+        poli_log(WARNING, NULL, "Power capping is not possible through perf_event.");
+        return 1;
+    }
+
+    if (system_info->sysmsr->powercap)
+        return powercap_get_power_cap_info(zone_name, min, max, thermal_spec, max_time_window, system_info->sysmsr->powercap);
 
     int msr_address = get_msr_for_zone_name(zone_name, 0);
     int ret = 0;
@@ -829,20 +897,23 @@ int rapl_get_power_cap_info(char *zone_name, double *min, double *max,
     }
     else if (msr_address != -1)
     {
-        int package = 0; //TODO
+        int package;
+        struct msr_batch_op ops[MAX_PACKAGES];
+        for (package = 0; package < system_info->sysmsr->total_packages; package++)
+            init_msr_op(&ops[package], system_info->sysmsr->package_map[package], 1, msr_address, 0);
+        ret = run_msr_ops(ops, system_info->sysmsr->total_packages, system_info);
+        if (ret)
+            poli_log(ERROR, NULL, "%s: Something went wrong with getting power cap info for msr %#010X", __FUNCTION__, msr_address);
 
-        uint64_t data;
-        if (pread(system_info->sysmsr->package_fd[package], &data, sizeof(uint64_t), msr_address) != sizeof(uint64_t))
+        for (package = 0; package < system_info->sysmsr->total_packages && !ret; package++)
         {
-            poli_log(ERROR, NULL, "%s: Something went wrong with getting power cap info for msr %#010X : %s", __FUNCTION__, msr_address, strerror(errno));
-            ret = 1;
-        }
-        else
-        {
-            *thermal_spec = system_info->sysmsr->power_units * (double) (data & 0x7fff);
-            *min = system_info->sysmsr->power_units * (double) ((data >> 16) & 0x7fff);
-            *max = system_info->sysmsr->power_units * (double) ((data >> 32) & 0x7fff);
-            *max_time_window = system_info->sysmsr->time_units * (double) ((data >> 48) & 0x7fff);
+            struct msr_info info;
+            uint64_t data = ops[package].msrdata;
+            info.thermal_spec_power = system_info->sysmsr->power_units * (double) (data & 0x7fff);
+            info.minimum_power = system_info->sysmsr->power_units * (double) ((data >> 16) & 0x7fff);
+            info.maximum_power = system_info->sysmsr->power_units * (double) ((data >> 32) & 0x7fff);
+            info.maximum_time_window = system_info->sysmsr->time_units * (double) ((data >> 48) & 0x7fff);
+            add_power_info(&info, thermal_spec, min, max, max_time_window, package == 0);
         }
     }
 
@@ -864,58 +935,83 @@ int rapl_get_power_cap(struct msr_pcap *pcap, char *zone_name, struct system_inf
         poli_log(WARNING, NULL, "RAPL Interface couldn't be set up. Setting power cap is not possible.");
         return 1;
     }
+    if (system_info->sysmsr->perf_rapl)
+    {
+        poli_log(WARNING, NULL, "Power capping is not possible through perf_event.");
+        return 1;
+    }
 
     int msr_address = get_msr_for_zone_name(zone_name, 1);
     int ret = 0;
+    if (system_info->sysmsr->powercap)
+    {
+        pcap->msr = msr_address;
+        return powercap_get_power_cap(pcap, zone_name, system_info->sysmsr->powercap);
+    }
     if (msr_address != -1)
     {
         pcap->msr = msr_address;
-        int package = 0; //TODO
-
-        uint64_t data;
-        if (pread(system_info->sysmsr->package_fd[package], &data, sizeof(uint64_t), pcap->msr) != sizeof(uint64_t))
+        //the cap of the node is the sum of those of its packages, enabled only if it is on all of them
+        int package, num_packages = pcap_packages(pcap->msr, system_info);
+        double total_watts_long = 0, total_watts_short = 0;
+        int all_enabled_long = 1, all_enabled_short = 1;
+        struct msr_batch_op ops[MAX_PACKAGES];
+
+        for (package = 0; package < num_packages; package++)
+            init_msr_op(&ops[package], system_info->sysmsr->package_map[package], 1, pcap->msr, 0);
+        ret = run_msr_ops(ops, num_packages, system_info);
+        if (ret)
+            poli_log(ERROR, NULL, "%s: Something went wrong with getting power cap for msr %#010X", __FUNCTION__, pcap->msr);
+
+        for (package = 0; package < num_packages && !ret; package++)
         {
-            poli_log(ERROR, NULL, "%s: Something went wrong with getting power cap for msr %#010X : %s", __FUNCTION__, pcap->msr, strerror(errno));
-            ret = 1;
-        }
-        else
-        {
-            if (msr_address == MSR_PKG_POWER_LIMIT)
-                pcap->zone_label = PACKAGE;
-            else if (msr_address == MSR_PP0_POWER_LIMIT)
-                pcap->zone_label = CORE;
-            else if (msr_address == MSR_PP1_POWER_LIMIT)
-                pcap->zone_label = UNCORE;
-            else if (msr_address == MSR_PLATFORM_POWER_LIMIT)
-                pcap->zone_label = PLATFORM;
-            else if (msr_address == MSR_DRAM_POWER_LIMIT)
-                pcap->zone_label = DRAM;
-
-            // for now clamping will be forced to be the same as enabled bit
-            uint64_t enabled_long = get_bits(data, ENABLED_LONG_START_BITS, ENABLED_LONG_END_BITS);
-            pcap->enabled_long = (enabled_long == 0x3) ? 1 : 0;
-            pcap->clamped_long = pcap->enabled_long;
-            pcap->watts_long = get_bits(data, WATTS_LONG_START_BITS, WATTS_LONG_END_BITS) * system_info->sysmsr->power_units;
-            pcap->seconds_long = from_msr_time(get_bits(data, SECONDS_LONG_START_BITS, SECONDS_LONG_END_BITS - 2),
-                get_bits(data, SECONDS_LONG_END_BITS - 1, SECONDS_LONG_END_BITS), system_info->sysmsr->time_units);
-
-            if (!short_term_supported(pcap->msr))
-            {
-                pcap->enabled_short = 0;
-                pcap->clamped_short = 0;
-                pcap->watts_short = 0;
-                pcap->seconds_short = 0;
-            }
-            else
+            uint64_t data = ops[package].msrdata;
             {
-                uint64_t enabled_short = get_bits(data, ENABLED_SHORT_START_BITS, ENABLED_SHORT_END_BITS);
-                pcap->enabled_short = (enabled_short == 0x3) ? 1 : 0;
-                pcap->clamped_short = pcap->enabled_short;
-                pcap->watts_short = get_bits(data, WATTS_SHORT_START_BITS, WATTS_SHORT_END_BITS) * system_info->sysmsr->power_units;
-                pcap->seconds_short = from_msr_time(get_bits(data, SECONDS_SHORT_START_BITS, SECONDS_SHORT_END_BITS - 2),
-                    get_bits(data, SECONDS_SHORT_END_BITS - 1, SECONDS_SHORT_END_BITS), system_info->sysmsr->time_units);
+                if (msr_address == MSR_PKG_POWER_LIMIT)
+                    pcap->zone_label = PACKAGE;
+                else if (msr_address == MSR_PP0_POWER_LIMIT)
+                    pcap->zone_label = CORE;
+                else if (msr_address == MSR_PP1_POWER_LIMIT)
+                    pcap->zone_label = UNCORE;
+                else if (msr_address == MSR_PLATFORM_POWER_LIMIT)
+                    pcap->zone_label = PLATFORM;
+                else if (msr_address == MSR_DRAM_POWER_LIMIT)
+                    pcap->zone_label = DRAM;
+
+                // for now clamping will be forced to be the same as enabled bit
+                uint64_t enabled_long = get_bits(data, ENABLED_LONG_START_BITS, ENABLED_LONG_END_BITS);
+                pcap->enabled_long = (enabled_long == 0x3) ? 1 : 0;
+                pcap->clamped_long = pcap->enabled_long;
+                pcap->watts_long = get_bits(data, WATTS_LONG_START_BITS, WATTS_LONG_END_BITS) * system_info->sysmsr->power_units;
+                pcap->seconds_long = from_msr_time(get_bits(data, SECONDS_LONG_START_BITS, SECONDS_LONG_END_BITS - 2),
+                    get_bits(data, SECONDS_LONG_END_BITS - 1, SECONDS_LONG_END_BITS), system_info->sysmsr->time_units);
+
+                if (!short_term_supported(pcap->msr))
+                {
+                    pcap->enabled_short = 0;
+                    pcap->clamped_short = 0;
+                    pcap->watts_short = 0;
+                    pcap->seconds_short = 0;
+                }
+                else
+                {
+                    uint64_t enabled_short = get_bits(data, ENABLED_SHORT_START_BITS, ENABLED_SHORT_END_BITS);
+                    pcap->enabled_short = (enabled_short == 0x3) ? 1 : 0;
+                    pcap->clamped_short = pcap->enabled_short;
+                    pcap->watts_short = get_bits(data, WATTS_SHORT_START_BITS, WATTS_SHORT_END_BITS) * system_info->sysmsr->power_units;
+                    pcap->seconds_short = from_msr_time(get_bits(data, SECONDS_SHORT_START_BITS, SECONDS_SHORT_END_BITS - 2),
+                        get_bits(data, SECONDS_SHORT_END_BITS - 1, SECONDS_SHORT_END_BITS), system_info->sysmsr->time_units);
+                }
             }
+            total_watts_long += pcap->watts_long;
+            total_watts_short += pcap->watts_short;
+            all_enabled_long &= pcap->enabled_long;
+            all_enabled_short &= pcap->enabled_short;
         }
+        pcap->watts_long = total_watts_long;
+        pcap->watts_short = total_watts_short;
+        pcap->enabled_long = pcap->clamped_long = all_enabled_long;
+        pcap->enabled_short = pcap->clamped_short = all_enabled_short;
     }
 
     return ret;
@@ -985,16 +1081,21 @@ static void get_msr_units(struct system_info_t *system_info, int package)
 {
     poli_log(TRACE, NULL, "Entering %s", __FUNCTION__);
     /* Calculate the units used */
-    uint64_t result = read_msr(system_info->sysmsr->package_fd[package], MSR_RAPL_POWER_UNIT);
+    uint64_t result;
+    if (read_msr(system_info->sysmsr->package_fd[package], MSR_RAPL_POWER_UNIT, &result) != 0)
+    {
+        poli_log(WARNING, NULL, "Couldn't read the RAPL units of package %d. Assuming the usual 1/8 W, 61 uJ and 976 us", package);
+        result = DEFAULT_RAPL_UNITS;
+    }
 
     system_info->sysmsr->power_units = 1.0 / pow2_u64(result & 0xf);
     system_info->sysmsr->time_units = 1.0 / pow2_u64((result >> 16) & 0xf);
 
-    system_info->sysmsr->cpu_energy_units[package] = 1.0 / ( 1 << ((result >> 8) & 0xf1) );//1.0 / pow2_u64((result >> 8) & 0x1f);
+    system_info->sysmsr->cpu_energy_units[package] = 1.0 / pow2_u64((result >> 8) & 0x1f);
 
-    /* On Haswell EP and Knights Landing */
+    /* On server parts and Knights Landing */
     /* The DRAM units differ from the CPU ones */
-    if ((system_info->sysmsr->cpu_model == CPU_HASWELL_EP) || (system_info->sysmsr->cpu_model == CPU_KNIGHTS_LANDING))
+    if (find_cpu_model(system_info->sysmsr->cpu_model)->fixed_dram_units)
         system_info->sysmsr->dram_energy_units[package] = 1.0 / pow2_u64(16);
     else
         system_info->sysmsr->dram_energy_units[package] = system_info->sysmsr->cpu_energy_units[package];
@@ -1002,55 +1103,71 @@ static void get_msr_units(struct system_info_t *system_info, int package)
     poli_log(TRACE, NULL, "Finishing %s", __FUNCTION__);
 }
 
-static int write_msr (int fd, int msr_address, uint64_t data)
+/* pcap_packages - returns: the number of packages holding the limit of msr. the system wide platform limit
+   is kept on package 0 only, as in the powercap sysfs*/
+static int pcap_packages (int msr, struct system_info_t * system_info)
 {
-    off_t msr = (off_t) msr_address;
-    assert(msr >= 0);
-    if (pwrite(fd, &data, sizeof(uint64_t), msr) == sizeof(uint64_t))
-        return 0;
-    poli_log(ERROR, NULL, "Something went wrong with writing to msr %#010X : %s", msr_address, strerror(errno));
-    return 1;
+    if (msr == MSR_PLATFORM_POWER_LIMIT)
+        return 1;
+    return system_info->sysmsr->total_packages;
 }
 
-
-static int set_msr_pcap(struct msr_pcap *pcap, struct system_info_t * system_info, int package_id)
+/* set_msr_pcap - sets pcap on every package holding it. one batch reads the limits of all packages, one writes them back*/
+static int set_msr_pcap(struct msr_pcap *pcap, struct system_info_t * system_info)
 {
     poli_log(TRACE, NULL, "Entering %s", __FUNCTION__);
 
-    uint64_t msrval;
+    int package, num_packages = pcap_packages(pcap->msr, system_info);
+    struct msr_batch_op reads[MAX_PACKAGES];
+    struct msr_batch_op writes[2 * MAX_PACKAGES];
 
-    if (pread(system_info->sysmsr->package_fd[package_id], &msrval, sizeof(uint64_t), pcap->msr) != sizeof(uint64_t) )
+    for (package = 0; package < num_packages; package++)
+        init_msr_op(&reads[package], system_info->sysmsr->package_map[package], 1, pcap->msr, 0);
+    if (run_msr_ops(reads, num_packages, system_info) != 0)
     {
         poli_log(ERROR, NULL, "%s: Couldn't read MSR at address %#010X", __FUNCTION__, pcap->msr);
-        return 0;
+        return 1;
     }
 
     const uint64_t enabled_long_bits = (pcap->enabled_long) ? 0x3 : 0x0;
     const uint64_t enabled_short_bits = (pcap->enabled_short) ? 0x3 : 0x0;
 
-    msrval = replace_bits(msrval, enabled_long_bits, ENABLED_LONG_START_BITS, ENABLED_LONG_END_BITS);
+    for (package = 0; package < num_packages; package++)
+    {
+        uint64_t msrval = reads[package].msrdata;
+        int cpu = reads[package].cpu;
 
-    if (pcap->enabled_short)
-        msrval = replace_bits(msrval, enabled_short_bits, ENABLED_SHORT_START_BITS, ENABLED_SHORT_END_BITS);
+        msrval = replace_bits(msrval, enabled_long_bits, ENABLED_LONG_START_BITS, ENABLED_LONG_END_BITS);
 
-    if (write_msr(system_info->sysmsr->package_fd[package_id], pcap->msr, msrval))
-        poli_log(ERROR, NULL, "%s: Something went wrong with enabling the MSR", __FUNCTION__);
+        if (pcap->enabled_short)
+            msrval = replace_bits(msrval, enabled_short_bits, ENABLED_SHORT_START_BITS, ENABLED_SHORT_END_BITS);
 
-    msrval = replace_bits(msrval, to_msr_power(pcap->watts_long, system_info->sysmsr->power_units), WATTS_LONG_START_BITS, WATTS_LONG_END_BITS);
+        //the limits are enabled before they are changed
+        init_msr_op(&writes[2 * package], cpu, 0, pcap->msr, msrval);
 
-    if (pcap->seconds_long > 0)
-        msrval = replace_bits(msrval, to_msr_time(pcap->seconds_long, system_info->sysmsr->time_units), SECONDS_LONG_START_BITS, SECONDS_LONG_END_BITS);
+        msrval = replace_bits(msrval, to_msr_power(pcap->watts_long, system_info->sysmsr->power_units), WATTS_LONG_START_BITS, WATTS_LONG_END_BITS);
 
-    if (pcap->enabled_short && pcap->clamped_short)
-    {
-        msrval = replace_bits(msrval, to_msr_power(pcap->watts_short, system_info->sysmsr->power_units), WATTS_SHORT_START_BITS, WATTS_SHORT_END_BITS);
-        if (pcap->seconds_short > 0)
-            msrval = replace_bits(msrval, to_msr_time(pcap->seconds_short, system_info->sysmsr->time_units), SECONDS_SHORT_START_BITS, SECONDS_SHORT_END_BITS);
+        if (pcap->seconds_long > 0)
+            msrval = replace_bits(msrval, to_msr_time(pcap->seconds_long, system_info->sysmsr->time_units), SECONDS_LONG_START_BITS, SECONDS_LONG_END_BITS);
+
+        if (pcap->enabled_short && pcap->clamped_short)
+        {
+            msrval = replace_bits(msrval, to_msr_power(pcap->watts_short, system_info->sysmsr->power_units), WATTS_SHORT_START_BITS, WATTS_SHORT_END_BITS);
+            if (pcap->seconds_short > 0)
+                msrval = replace_bits(msrval, to_msr_time(pcap->seconds_short, system_info->sysmsr->time_units), SECONDS_SHORT_START_BITS, SECONDS_SHORT_END_BITS);
+        }
+
+        init_msr_op(&writes[2 * package + 1], cpu, 0, pcap->msr, msrval);
     }
 
+    int ret = run_msr_ops(writes, 2 * num_packages, system_info);
+    for (package = 0; package < 2 * num_packages; package++)
+        if (writes[package].err)
+            poli_log(ERROR, NULL, "Something went wrong with writing to msr %#010X of cpu %d : %s", pcap->msr, writes[package].cpu, strerror(-writes[package].err));
+
     poli_log(TRACE, NULL, "Finishing %s", __FUNCTION__);
 
-    return write_msr(system_info->sysmsr->package_fd[package_id], pcap->msr, msrval);
+    return ret;
 }
 
 
@@ -1118,20 +1235,21 @@ static uint64_t to_msr_time(double seconds, double time_units)
 }
 
 
-static uint64_t read_msr (int fd, int msr_address)
+/* read_msr - reads the msr at msr_address of the package opened at fd into data
+   returns: 0 if successful, 1 otherwise*/
+static int read_msr (int fd, int msr_address, uint64_t *data)
 {
     poli_log(TRACE, NULL, "Entering %s", __FUNCTION__);
 
-    uint64_t data;
-    if ( pread(fd, &data, sizeof(uint64_t), msr_address) != sizeof(uint64_t) )
+    if ( pread(fd, data, sizeof(uint64_t), msr_address) != sizeof(uint64_t) )
     {
         poli_log(ERROR, NULL, "Couldn't read MSR at address %#010X: %s", msr_address, strerror(errno));
-        return -1;
+        return 1;
     }
 
     poli_log(TRACE, NULL, "Finishing %s", __FUNCTION__);
 
-    return data;
+    return 0;
 }
 
 
@@ -1145,8 +1263,8 @@ static int read_msr_info (struct msr_info *msr_info, struct system_info_t *syste
         return 1;
     }
 
-    uint64_t result = read_msr(system_info->sysmsr->package_fd[package_id], msr_info->msr);
-    if (!result)
+    uint64_t result;
+    if (read_msr(system_info->sysmsr->package_fd[package_id], msr_info->msr, &result) != 0)
     {
         poli_log(ERROR, NULL, "Something went wrong with reading the info msr %#010X", msr_info->msr);
         return 1;
@@ -1160,126 +1278,33 @@ static int read_msr_info (struct msr_info *msr_info, struct system_info_t *syste
     return 0;
 }
 
-static int read_msr_pcap (struct msr_pcap *msr_pcap, struct system_info_t *system_info, int package_id)
-{
-    poli_log(TRACE, NULL, "Entering %s", __FUNCTION__);
-
-    if ((msr_pcap->msr != MSR_PKG_POWER_LIMIT) && (msr_pcap->msr != MSR_PP0_POWER_LIMIT)
-        && (msr_pcap->msr != MSR_PP1_POWER_LIMIT) && (msr_pcap->msr != MSR_DRAM_POWER_LIMIT) &&
-        (msr_pcap->msr != MSR_PLATFORM_POWER_LIMIT))
-    {
-        poli_log(ERROR, NULL, "%s: The requested msr at address %#010X is not valid!", __FUNCTION__, msr_pcap->msr);
-        return 1;
-    }
-
-    uint64_t result = read_msr(system_info->sysmsr->package_fd[package_id], msr_pcap->msr);
-    if (result < 0)
-    {
-        poli_log(ERROR, NULL, "%s: Something went wrong with reading the power limit msr %#010X", __FUNCTION__, msr_pcap->msr);
-        return 1;
-    }
-
-    msr_pcap->watts_long = system_info->sysmsr->power_units * (double) ((result >> WATTS_LONG_START_BITS) & 0x7FFF);
-    msr_pcap->seconds_long = system_info->sysmsr->time_units * (double) ((result >> SECONDS_LONG_START_BITS) & 0x007F);
-    msr_pcap->enabled_long = (int) (result & (1LL << ENABLED_LONG_START_BITS));
-    msr_pcap->clamped_long = (int) (result & (1LL << ENABLED_LONG_END_BITS));
-
-    if (short_term_supported(msr_pcap->msr))
-    {
-        msr_pcap->watts_short = system_info->sysmsr->power_units * (double) ((result >> WATTS_SHORT_START_BITS) & 0x7FFF);
-        msr_pcap->seconds_short = system_info->sysmsr->time_units * (double) ((result >> SECONDS_SHORT_START_BITS) & 0x007F);
-        msr_pcap->enabled_short = (int) (result & (1LL << ENABLED_SHORT_START_BITS));
-        msr_pcap->clamped_short = (int) (result & (1LL << ENABLED_SHORT_END_BITS));
-    }
-    else
-    {
-        msr_pcap->watts_short = 0.0;
-        msr_pcap->seconds_short = 0.0;
-        msr_pcap->enabled_short = 0.0;
-        msr_pcap->clamped_short = 0.0;
-    }
-
-    poli_log(TRACE, NULL, "Finishing %s", __FUNCTION__);
-    return 0;
-}
-
-static int read_msr_perf (struct msr_perf *msr_perf, struct system_info_t *system_info, int package_id)
+/* update_msr_energy - accounts a value read from the energy counter of msr_energy for its overflows and converts it to joules with unit*/
+static void update_msr_energy (struct msr_energy *msr_energy, uint64_t data, double unit)
 {
-    poli_log(TRACE, NULL, "Entering %s", __FUNCTION__);
-
-    if ((msr_perf->msr != MSR_PKG_PERF_STATUS) && (msr_perf->msr != MSR_DRAM_PERF_STATUS) &&
-        (msr_perf->msr != MSR_PP0_PERF_STATUS))
-    {
-        poli_log(ERROR, NULL, "%s: The requested msr at address %#010X is not valid!", __FUNCTION__, msr_perf->msr);
-        return 1;
-    }
-
-    uint64_t result = read_msr(system_info->sysmsr->package_fd[package_id], msr_perf->msr);
-    if (!result)
-    {
-        poli_log(ERROR, NULL, "Something went wrong with reading the perf msr %#010X", msr_perf->msr);
-        return 1;
-    }
-    msr_perf->throttled_time = ((double) result) * system_info->sysmsr->time_units;
-
-    poli_log(TRACE, NULL, "Finishing %s", __FUNCTION__);
-
-    return 0;
-}
-
-static int read_msr_policy (struct msr_policy *msr_policy, struct system_info_t *system_info, int package_id)
-{
-    poli_log(TRACE, NULL, "Entering %s", __FUNCTION__);
-
-    if ((msr_policy->msr != MSR_PP0_POLICY) && (msr_policy->msr != MSR_PP1_POLICY))
-    {
-        poli_log(ERROR, NULL, "%s: The requested msr at address %d is not valid!", __FUNCTION__, msr_policy->msr);
-        return 1;
-    }
-    uint64_t result = read_msr(system_info->sysmsr->package_fd[package_id], msr_policy->msr);
-    if (!result)
-    {
-        poli_log(ERROR, NULL, "Something went wrong with reading the power limit msr");
-        return 1;
-    }
-    msr_policy->policy = (int) result & 0x001f;
-
-    poli_log(TRACE, NULL, "Finishing %s", __FUNCTION__);
-
-    return 0;
+    data &= 0xFFFFFFFF;
+    msr_energy->num_overflows += (data < msr_energy->last_energy);
+    msr_energy->last_energy = data;
+    msr_energy->total_energy = (data + (msr_energy->num_overflows << 32)) * unit;
 }
 
-static int read_msr_energy (struct msr_energy *msr_energy, struct system_info_t * system_info, int package_id)
+/* energy_zone_index - returns: the index of the energy zone counted by msr, -1 if it counts none*/
+static int energy_zone_index (int msr)
 {
-    if ((msr_energy->msr != MSR_PKG_ENERGY_STATUS) && (msr_energy->msr != MSR_PP0_ENERGY_STATUS) &&
-        (msr_energy->msr != MSR_PP1_ENERGY_STATUS) && (msr_energy->msr != MSR_DRAM_ENERGY_STATUS) &&
-        (msr_energy->msr != MSR_PLATFORM_ENERGY_COUNTER))
-    {
-        poli_log(ERROR, NULL, "%s: The requested msr at address %d is not valid!", __FUNCTION__, msr_energy->msr);
-        return 1;
-    }
-    int fd = system_info->sysmsr->package_fd[package_id];
-    uint64_t data;
-    if (pread(fd, &data, sizeof(uint64_t), msr_energy->msr) != sizeof(uint64_t))
+    switch (msr)
     {
-        poli_log(ERROR, NULL, "%s: Couldn't read MSR at address %d", __FUNCTION__, msr_energy->msr);
-        return 0;
+        case MSR_PKG_ENERGY_STATUS:
+            return 0;
+        case MSR_PP0_ENERGY_STATUS:
+            return 1;
+        case MSR_PP1_ENERGY_STATUS:
+            return 2;
+        case MSR_PLATFORM_ENERGY_COUNTER:
+            return 3;
+        case MSR_DRAM_ENERGY_STATUS:
+            return 4;
+        default:
+            return -1;
     }
-
-    data &= 0xFFFFFFFF;
-
-    if (data < msr_energy->last_energy)
-        ++msr_energy->num_overflows;
-
-    msr_energy->last_energy = data;
-    uint64_t subfield_max = ((1ULL << 32) - 1);
-    if (msr_energy->msr == MSR_DRAM_ENERGY_STATUS)
-        msr_energy->total_energy = (data + msr_energy->num_overflows * (uint64_t) UINT32_MAX) * 1.5258789063e-05; //msr_energy->dram_energy_units;
-    else
-        msr_energy->total_energy = (data + ((subfield_max + 1) * msr_energy->num_overflows)) * 6.103515625e-05;
-        //msr_energy->total_energy = (data + msr_energy->num_overflows * (uint64_t) UINT32_MAX) * msr_energy->cpu_energy_units * 1000000;
-
-    return 0;
 }
 
 static int detect_cpu(void)
@@ -1369,36 +1394,10 @@ static int verify_model(int model)
 {
     poli_log(TRACE, NULL, "Entering %s", __FUNCTION__);
 
-    switch(model)
+    if (!find_cpu_model(model))
     {
-        case CPU_SANDYBRIDGE:
-            break;
-        case CPU_SANDYBRIDGE_EP:
-            break;
-        case CPU_IVYBRIDGE:
-            break;
-        case CPU_IVYBRIDGE_EP:
-            break;
-        case CPU_HASWELL:
-            break;
-        case CPU_HASWELL_EP:
-            break;
-        case CPU_BROADWELL:
-            break;
-        case CPU_SKYLAKE:
-            break;
-        case CPU_SKYLAKE_HS:
-            break;
-        case CPU_KABYLAKE:
-            break;
-        case CPU_KABYLAKE_2:
-            break;
-        case CPU_KNIGHTS_LANDING:
-            break;
-        default:
-            poli_log(ERROR, NULL, "Unsupported model %d",model);
-            model = 0;
-            break;
+        poli_log(ERROR, NULL, "Unsupported model %d",model);
+        model = 0;
     }
 
     poli_log(TRACE, NULL, "Finishing %s", __FUNCTION__);
@@ -1406,6 +1405,16 @@ static int verify_model(int model)
     return model;
 }
 
+/* find_cpu_model - returns: the entry of model in cpu_models, NULL if it isn't supported*/
+static const struct cpu_model *find_cpu_model (int model)
+{
+    size_t i;
+    for (i = 0; i < NUM_CPU_MODELS; i++)
+        if (cpu_models[i].model == model)
+            return &cpu_models[i];
+    return NULL;
+}
+
 static int detect_packages (struct system_info_t *system_info)
 {
     poli_log(TRACE, NULL, "Entering %s", __FUNCTION__);
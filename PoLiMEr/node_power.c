@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "PoLiMEr.h"
+#include "PoLiLog.h"
+#include "helpers.h"
+#include "node_power.h"
+
+#ifndef _NOMPI
+#include <mpi.h>
+#include "mpi_handler.h"
+#endif
+
+int init_node_power (struct node_power_t * node_power, struct monitor_t * monitor)
+{
+    node_power->snapshot = 0;
+#ifndef _NOMPI
+    MPI_Aint size = monitor->imonitor ? sizeof(struct energy_snapshot) : 0;
+    void *base;
+    if (MPI_Win_allocate_shared(size, sizeof(double), MPI_INFO_NULL, monitor->mynode_comm, &base, &node_power->win) != MPI_SUCCESS)
+    {
+        poli_log(ERROR, monitor, "Failed to allocate node shared memory for the energy snapshot");
+        return 1;
+    }
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, node_power->win);
+    if (monitor->imonitor)
+    {
+        memset(base, 0, size);
+        get_clock_calibration(&((struct energy_snapshot *) base)->clock);
+    }
+    MPI_Win_sync(node_power->win);
+    MPI_Barrier(monitor->mynode_comm);
+
+    int disp_unit;
+    MPI_Win_shared_query(node_power->win, 0, &size, &disp_unit, &node_power->snapshot);
+    //the tags of the other ranks are attributed against the poll samples of the monitor, so they take its clock
+    MPI_Win_sync(node_power->win);
+    if (!monitor->imonitor)
+        set_clock_calibration(&node_power->snapshot->clock);
+#else
+    (void) monitor;
+    node_power->snapshot = calloc(1, sizeof(struct energy_snapshot));
+    if (node_power->snapshot == NULL)
+        return 1;
+#endif
+    return 0;
+}
+
+void publish_energy_snapshot (struct node_power_t * node_power, double wtime, struct energy_reading *energy, float smoothing)
+{
+    struct energy_snapshot *snapshot = node_power->snapshot;
+    unsigned int sequence = snapshot->sequence;
+
+    __atomic_store_n(&snapshot->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    int zone;
+    double elapsed = wtime - snapshot->wtime;
+    if (snapshot->num_samples > 0 && elapsed > 0)
+    {
+        double delta[MAX_ENERGY_ZONES];
+        snapshot->num_zones = get_energy_zones(delta, energy, &snapshot->energy, elapsed);
+        //exponential moving average with time constant smoothing, so that irregular intervals weigh correctly
+        double weight = (snapshot->num_samples == 1 || smoothing <= 0) ? 1.0 : 1.0 - exp(-elapsed / smoothing);
+        for (zone = 0; zone < snapshot->num_zones; zone++)
+        {
+            snapshot->node_energy[zone] += delta[zone];
+            snapshot->power[zone] += weight * (delta[zone] / elapsed - snapshot->power[zone]);
+        }
+    }
+    snapshot->wtime = wtime;
+    snapshot->energy = *energy;
+    snapshot->num_samples++;
+
+    __atomic_store_n(&snapshot->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+int read_energy_snapshot (struct node_power_t * node_power, struct energy_snapshot *snapshot)
+{
+    struct energy_snapshot *shared = node_power->snapshot;
+    unsigned int sequence;
+    do {
+        sequence = __atomic_load_n(&shared->sequence, __ATOMIC_ACQUIRE);
+        if (sequence & 1)
+            continue;
+        memcpy(snapshot, shared, sizeof(struct energy_snapshot));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((sequence & 1) || sequence != __atomic_load_n(&shared->sequence, __ATOMIC_RELAXED));
+
+    return snapshot->num_samples < 2;
+}
+
+void finalize_node_power (struct node_power_t * node_power, struct monitor_t * monitor)
+{
+    (void) monitor;
+#ifndef _NOMPI
+    if (!is_finalized())
+    {
+        MPI_Win_unlock_all(node_power->win);
+        MPI_Win_free(&node_power->win);
+    }
+#else
+    free(node_power->snapshot);
+#endif
+    node_power->snapshot = 0;
+}
@@ -0,0 +1,222 @@
+#ifndef _NOMPI
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+
+#include "PoLiMEr.h"
+#include "PoLiLog.h"
+#include "helpers.h"
+#include "mpi_handler.h"
+#include "thread_tags.h"
+#include "node_tags.h"
+
+/* a segment is the header, the ring of events (aligned for their doubles) and then the names*/
+static size_t events_offset (void)
+{
+    return (sizeof(struct node_tag_segment) + sizeof(double) - 1) / sizeof(double) * sizeof(double);
+}
+
+static struct node_tag_event *segment_events (struct node_tag_segment *segment)
+{
+    return (struct node_tag_event *) ((char *) segment + events_offset());
+}
+
+static char *segment_names (struct node_tag_segment *segment, unsigned int num_events)
+{
+    return (char *) (segment_events(segment) + num_events);
+}
+
+static uint32_t offset_hash (int name_offset)
+{
+    return (uint32_t) name_offset * 2654435761u;
+}
+
+int init_node_tags (struct node_tags_t * node_tags, struct monitor_t * monitor, struct polimer_config_t * poli_config)
+{
+    node_tags->num_events = 1;
+    while (node_tags->num_events < (unsigned int) poli_config->node_tag_events)
+        node_tags->num_events <<= 1;
+    node_tags->name_capacity = NODE_TAG_NAME_BYTES;
+    node_tags->segment = 0;
+    node_tags->num_published_names = 0;
+    node_tags->num_segments = 0;
+    node_tags->segments = 0;
+    node_tags->name_maps = 0;
+    node_tags->buffers = 0;
+    node_tags->lost = 0;
+
+    //the monitor records its own tags directly, it only reads the segments of the others
+    MPI_Aint size = 0;
+    if (!monitor->imonitor)
+        size = events_offset() + node_tags->num_events * sizeof(struct node_tag_event) + node_tags->name_capacity;
+    void *base;
+    if (MPI_Win_allocate_shared(size, 1, MPI_INFO_NULL, monitor->mynode_comm, &base, &node_tags->win) != MPI_SUCCESS)
+    {
+        poli_log(ERROR, monitor, "Failed to allocate node shared memory for tags");
+        return 1;
+    }
+    //one passive epoch for the lifetime of the window, all accesses are plain loads and stores
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, node_tags->win);
+
+    if (!monitor->imonitor)
+    {
+        node_tags->segment = base;
+        memset(node_tags->segment, 0, size);
+        node_tags->segment->world_rank = monitor->world_rank;
+        if (tag_names_init(&node_tags->names) != 0)
+            poli_log(ERROR, monitor, "Failed to allocate tag name table");
+        arena_init(&node_tags->name_offsets, sizeof(int));
+    }
+    else
+    {
+        node_tags->segments = calloc(monitor->node_size, sizeof(struct node_tag_segment *));
+        node_tags->name_maps = calloc(monitor->node_size, sizeof(struct tag_table));
+        node_tags->buffers = calloc(monitor->node_size, sizeof(struct thread_tag_buffer *));
+        if (!node_tags->segments || !node_tags->name_maps || !node_tags->buffers)
+            poli_log(ERROR, monitor, "Failed to allocate memory for the tags of %d ranks", monitor->node_size);
+        else
+            node_tags->num_segments = monitor->node_size;
+    }
+
+    MPI_Win_sync(node_tags->win);
+    MPI_Barrier(monitor->mynode_comm);
+
+    int rank;
+    for (rank = 0; rank < node_tags->num_segments; rank++)
+    {
+        if (rank == monitor->node_rank)
+            continue;
+        MPI_Aint segment_size;
+        int disp_unit;
+        MPI_Win_shared_query(node_tags->win, rank, &segment_size, &disp_unit, &node_tags->segments[rank]);
+        if (tag_table_init(&node_tags->name_maps[rank], 64) != 0)
+        {
+            poli_log(ERROR, monitor, "Failed to allocate name map for node rank %d, its tags will be omitted", rank);
+            node_tags->segments[rank] = 0;
+        }
+    }
+
+    return 0;
+}
+
+/* copies a name of this rank into the segment so that the monitor can resolve its offset*/
+static void publish_name (struct node_tags_t * node_tags, int name_id)
+{
+    struct node_tag_segment *segment = node_tags->segment;
+    int *name_offset = arena_at(&node_tags->name_offsets, name_id);
+    if (name_offset == NULL)
+        return;
+    char *name = tag_names_get(&node_tags->names, name_id);
+    unsigned int len = strlen(name) + 1;
+    unsigned int name_bytes = segment->name_bytes;
+    if (name_bytes + len > node_tags->name_capacity)
+    {
+        *name_offset = -1;
+        return;
+    }
+    memcpy(segment_names(segment, node_tags->num_events) + name_bytes, name, len);
+    *name_offset = name_bytes;
+    __atomic_store_n(&segment->name_bytes, name_bytes + len, __ATOMIC_RELEASE);
+}
+
+int record_node_tag_event (struct node_tags_t * node_tags, thread_tag_event_t type, int name_id)
+{
+    struct node_tag_segment *segment = node_tags->segment;
+    //names may be interned by any thread, they are published by the one thread recording events
+    while (node_tags->num_published_names <= name_id)
+        publish_name(node_tags, node_tags->num_published_names++);
+
+    int *name_offset = arena_at(&node_tags->name_offsets, name_id);
+    unsigned int head = segment->head;
+    if (name_offset == NULL || *name_offset < 0 || head - __atomic_load_n(&segment->tail, __ATOMIC_ACQUIRE) >= node_tags->num_events)
+    {
+        __atomic_store_n(&segment->dropped, segment->dropped + 1, __ATOMIC_RELAXED);
+        return 1;
+    }
+
+    struct node_tag_event *event = &segment_events(segment)[head & (node_tags->num_events - 1)];
+    event->type = type;
+    event->name_offset = *name_offset;
+    event->wtime = get_time();
+    __atomic_store_n(&segment->head, head + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* returns the name id of the monitor for a name offset of a node rank, interning the name on first sight*/
+static int map_name (struct node_tags_t * node_tags, int rank, int name_offset, struct system_info_t * system_info)
+{
+    struct tag_table *name_map = &node_tags->name_maps[rank];
+    struct tag_table_entry *entry = tag_table_find(name_map, offset_hash(name_offset), name_offset);
+    if (entry != NULL)
+        return entry->value;
+
+    struct node_tag_segment *segment = node_tags->segments[rank];
+    if (name_offset < 0 || (unsigned int) name_offset >= __atomic_load_n(&segment->name_bytes, __ATOMIC_ACQUIRE))
+        return -1;
+    int name_id = tag_names_intern(&system_info->tag_names, segment_names(segment, node_tags->num_events) + name_offset);
+    if (name_id >= 0)
+        tag_table_insert(name_map, offset_hash(name_offset), name_offset, name_id);
+    return name_id;
+}
+
+void drain_node_tag_events (struct node_tags_t * node_tags, struct system_info_t * system_info)
+{
+    int rank;
+    for (rank = 0; rank < node_tags->num_segments; rank++)
+    {
+        struct node_tag_segment *segment = node_tags->segments[rank];
+        if (segment == NULL)
+            continue;
+
+        unsigned int head = __atomic_load_n(&segment->head, __ATOMIC_ACQUIRE);
+        unsigned int tail = segment->tail;
+        if (tail == head)
+            continue;
+        if (node_tags->buffers[rank] == NULL)
+            node_tags->buffers[rank] = add_thread_tag_buffer(0, segment->world_rank, system_info);
+
+        for (; tail != head; tail++)
+        {
+            struct node_tag_event *event = &segment_events(segment)[tail & (node_tags->num_events - 1)];
+            int name_id = map_name(node_tags, rank, event->name_offset, system_info);
+            if (name_id < 0 || node_tags->buffers[rank] == NULL
+                || append_thread_tag_event(node_tags->buffers[rank], event->type, name_id, event->wtime) != 0)
+                node_tags->lost++;
+        }
+        __atomic_store_n(&segment->tail, tail, __ATOMIC_RELEASE);
+    }
+}
+
+void finalize_node_tags (struct node_tags_t * node_tags, struct monitor_t * monitor)
+{
+    if (monitor->imonitor)
+    {
+        unsigned int dropped = node_tags->lost;
+        int rank;
+        for (rank = 0; rank < node_tags->num_segments; rank++)
+        {
+            if (node_tags->segments[rank] == NULL)
+                continue;
+            dropped += __atomic_load_n(&node_tags->segments[rank]->dropped, __ATOMIC_RELAXED);
+            tag_table_free(&node_tags->name_maps[rank]);
+        }
+        if (dropped > 0)
+            poli_log(WARNING, monitor, "%u tag events of other ranks on this node were dropped. Consider raising POLIMER_NODE_TAG_EVENTS", dropped);
+        free(node_tags->segments);
+        free(node_tags->name_maps);
+        free(node_tags->buffers);
+    }
+    else
+    {
+        tag_names_free(&node_tags->names);
+        arena_free(&node_tags->name_offsets);
+    }
+
+    if (!is_finalized())
+    {
+        MPI_Win_unlock_all(node_tags->win);
+        MPI_Win_free(&node_tags->win);
+    }
+}
+#endif
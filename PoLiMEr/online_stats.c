@@ -0,0 +1,271 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "PoLiMEr.h"
+#include "helpers.h"
+#include "online_stats.h"
+
+static void p2_init (struct p2_quantile *quantile, double p)
+{
+    memset(quantile, 0, sizeof(struct p2_quantile));
+    quantile->p = p;
+}
+
+static int compare_doubles (const void *a, const void *b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/* piecewise parabolic prediction of marker i moved by d, falling back to linear if it leaves the neighbouring markers*/
+static double p2_adjusted_height (struct p2_quantile *quantile, int i, int d)
+{
+    double *q = quantile->height;
+    double *n = quantile->position;
+    double parabolic = q[i] + d / (n[i + 1] - n[i - 1])
+        * ((n[i] - n[i - 1] + d) * (q[i + 1] - q[i]) / (n[i + 1] - n[i]) + (n[i + 1] - n[i] - d) * (q[i] - q[i - 1]) / (n[i] - n[i - 1]));
+    if (q[i - 1] < parabolic && parabolic < q[i + 1])
+        return parabolic;
+    return q[i] + d * (q[i + d] - q[i]) / (n[i + d] - n[i]);
+}
+
+static void p2_add (struct p2_quantile *quantile, double x)
+{
+    double *q = quantile->height;
+    double *n = quantile->position;
+    int i, k;
+    if (quantile->count < 5)
+    {
+        q[quantile->count++] = x;
+        if (quantile->count == 5)
+        {
+            double p = quantile->p;
+            qsort(q, 5, sizeof(double), compare_doubles);
+            for (i = 0; i < 5; i++)
+                n[i] = i + 1;
+            quantile->desired[0] = 1;
+            quantile->desired[1] = 1 + 2 * p;
+            quantile->desired[2] = 1 + 4 * p;
+            quantile->desired[3] = 3 + 2 * p;
+            quantile->desired[4] = 5;
+            quantile->increment[0] = 0;
+            quantile->increment[1] = p / 2;
+            quantile->increment[2] = p;
+            quantile->increment[3] = (1 + p) / 2;
+            quantile->increment[4] = 1;
+        }
+        return;
+    }
+
+    //cell of x among the markers, extending the extremes if needed
+    if (x < q[0])
+    {
+        q[0] = x;
+        k = 0;
+    }
+    else if (x >= q[4])
+    {
+        q[4] = x;
+        k = 3;
+    }
+    else
+        for (k = 0; k < 3 && x >= q[k + 1]; k++)
+            ;
+    for (i = k + 1; i < 5; i++)
+        n[i]++;
+    for (i = 0; i < 5; i++)
+        quantile->desired[i] += quantile->increment[i];
+    quantile->count++;
+
+    for (i = 1; i < 4; i++)
+    {
+        double d = quantile->desired[i] - n[i];
+        if ((d >= 1 && n[i + 1] - n[i] > 1) || (d <= -1 && n[i - 1] - n[i] < -1))
+        {
+            int step = (d > 0) ? 1 : -1;
+            q[i] = p2_adjusted_height(quantile, i, step);
+            n[i] += step;
+        }
+    }
+}
+
+double p2_quantile_value (struct p2_quantile *quantile)
+{
+    if (quantile->count == 0)
+        return 0.0;
+    if (quantile->count > 5)
+        return quantile->height[2];
+
+    //the markers are still the observations, interpolate between them
+    double sorted[5];
+    int count = (int) quantile->count;
+    memcpy(sorted, quantile->height, count * sizeof(double));
+    qsort(sorted, count, sizeof(double), compare_doubles);
+    double rank = quantile->p * (count - 1);
+    int below = (int) rank;
+    if (below >= count - 1)
+        return sorted[count - 1];
+    return sorted[below] + (rank - below) * (sorted[below + 1] - sorted[below]);
+}
+
+void online_stats_init (struct online_stats *stats)
+{
+    stats->count = 0;
+    stats->mean = 0.0;
+    stats->m2 = 0.0;
+    stats->min = INFINITY;
+    stats->max = -INFINITY;
+    p2_init(&stats->median, 0.5);
+    p2_init(&stats->p95, 0.95);
+}
+
+void online_stats_add (struct online_stats *stats, double x)
+{
+    stats->count++;
+    double delta = x - stats->mean;
+    stats->mean += delta / stats->count;
+    stats->m2 += delta * (x - stats->mean);
+    if (x < stats->min)
+        stats->min = x;
+    if (x > stats->max)
+        stats->max = x;
+    p2_add(&stats->median, x);
+    p2_add(&stats->p95, x);
+}
+
+double online_stats_variance (struct online_stats *stats)
+{
+    if (stats->count < 2)
+        return 0.0;
+    return stats->m2 / (stats->count - 1);
+}
+
+void init_power_window (struct power_window *window, double min_plausible, double max_plausible)
+{
+    int i;
+    for (i = 0; i < 2; i++)
+    {
+        online_stats_init(&window->windows[i].all);
+        online_stats_init(&window->windows[i].plausible);
+        window->windows[i].num_samples = 0;
+    }
+    window->active = 0;
+    window->sequence = 0;
+    window->min_plausible = min_plausible;
+    window->max_plausible = max_plausible;
+    window->primed = 0;
+}
+
+void power_window_add_sample (struct power_window *window, double wtime, struct energy_reading *energy)
+{
+    double elapsed = wtime - window->last_wtime;
+    double delta[MAX_ENERGY_ZONES];
+    int num_zones = window->primed ? get_energy_zones(delta, energy, &window->last_energy, elapsed) : 0;
+    window->primed = 1;
+    window->last_wtime = wtime;
+    window->last_energy = *energy;
+
+    __atomic_store_n(&window->sequence, window->sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    struct window_stats *stats = &window->windows[__atomic_load_n(&window->active, __ATOMIC_ACQUIRE)];
+    if (stats->num_samples++ == 0)
+        stats->first_energy = *energy;
+    stats->last_energy = *energy;
+    //the first zone is the package, or the whole node where there is no package zone
+    if (num_zones > 0 && elapsed > 0)
+    {
+        double power = delta[0] / elapsed;
+        online_stats_add(&stats->all, power);
+        if (power > window->min_plausible && power < window->max_plausible)
+            online_stats_add(&stats->plausible, power);
+    }
+    __atomic_store_n(&window->sequence, window->sequence + 1, __ATOMIC_RELEASE);
+}
+
+void close_power_window (struct power_window *window, struct window_stats *closed)
+{
+    int old = window->active;
+    __atomic_store_n(&window->active, 1 - old, __ATOMIC_SEQ_CST);
+    //a sampler which picked the old buffer before the switch is done with it once the sequence is even
+    while (__atomic_load_n(&window->sequence, __ATOMIC_SEQ_CST) & 1)
+        ;
+    if (closed)
+        *closed = window->windows[old];
+    online_stats_init(&window->windows[old].all);
+    online_stats_init(&window->windows[old].plausible);
+    window->windows[old].num_samples = 0;
+}
+
+#ifndef _TIMER_OFF
+int init_tag_power_stats (struct tag_power_stats *tag_power_stats)
+{
+    tag_power_stats->on = 0;
+    tag_power_stats->num_open = 0;
+    tag_power_stats->open_size = 16;
+    tag_power_stats->open = malloc(tag_power_stats->open_size * sizeof(int));
+    if (tag_power_stats->open == NULL)
+        return 1;
+    if (arena_init(&tag_power_stats->stats, sizeof(struct online_stats)) != 0)
+    {
+        free(tag_power_stats->open);
+        tag_power_stats->open = 0;
+        return 1;
+    }
+    return 0;
+}
+
+void free_tag_power_stats (struct tag_power_stats *tag_power_stats)
+{
+    free(tag_power_stats->open);
+    tag_power_stats->open = 0;
+    arena_free(&tag_power_stats->stats);
+}
+
+void tag_power_stats_start (struct tag_power_stats *tag_power_stats, int tag_id)
+{
+    struct online_stats *stats = arena_at(&tag_power_stats->stats, tag_id);
+    if (stats == NULL)
+        return;
+    if (tag_power_stats->num_open == tag_power_stats->open_size)
+    {
+        int *open = realloc(tag_power_stats->open, 2 * tag_power_stats->open_size * sizeof(int));
+        if (open == NULL)
+            return;
+        tag_power_stats->open = open;
+        tag_power_stats->open_size *= 2;
+    }
+    online_stats_init(stats);
+    tag_power_stats->open[tag_power_stats->num_open++] = tag_id;
+}
+
+void tag_power_stats_end (struct tag_power_stats *tag_power_stats, int tag_id)
+{
+    int i;
+    for (i = 0; i < tag_power_stats->num_open; i++)
+    {
+        if (tag_power_stats->open[i] == tag_id)
+        {
+            tag_power_stats->open[i] = tag_power_stats->open[--tag_power_stats->num_open];
+            return;
+        }
+    }
+}
+
+void tag_power_stats_add (struct tag_power_stats *tag_power_stats, double power)
+{
+    int i;
+    for (i = 0; i < tag_power_stats->num_open; i++)
+        online_stats_add(arena_at(&tag_power_stats->stats, tag_power_stats->open[i]), power);
+}
+
+struct online_stats *get_tag_power_stats (struct tag_power_stats *tag_power_stats, int tag_id)
+{
+    if (!tag_power_stats->on || tag_id >= (int) arena_capacity(&tag_power_stats->stats))
+        return NULL;
+    struct online_stats *stats = arena_at(&tag_power_stats->stats, tag_id);
+    return (stats->count > 0) ? stats : NULL;
+}
+#endif
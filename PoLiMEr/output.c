@@ -10,10 +10,22 @@
 #include <math.h>
 #include <assert.h>
 #include <stdarg.h>
+#ifndef _TIMER_OFF
+#include <sched.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#endif
 
 #include "PoLiLog.h"
 #include "output.h"
 #include "helpers.h"
+#include "thread_tags.h"
+#include "node_tags.h"
+#include "tag_interpolation.h"
+#include "tag_sampling.h"
+#include "busy_sampler.h"
+#include "online_stats.h"
 
 #ifdef _POWMGR
 #include "power_manager.h"
@@ -32,19 +44,44 @@
 #include "bgq_handler.h"
 #endif
 
-static void get_poli_tags_for_time_counter(FILE *fp, int counter, struct system_info_t * system_info, struct monitor_t * monitor);
-static void get_pcap_tag_for_time_counter(FILE *fp, int counter, struct system_info_t * system_info, struct monitor_t * monitor);
+#ifndef _TIMER_OFF
+struct polling_writer_args {
+    struct system_info_t *system_info;
+    struct poller_t *poller;
+    int timeout; //ms
+    float poll_interval;
+    /* state carried from one written record to the next */
+    double last_wtime;
+    struct energy_reading last_energy;
+    struct rapl_energy last_packages[MAX_RECORDED_PACKAGES];
+    int applied_pcaps;
+    struct pcap_info pcap_state[NUM_ZONES];
+};
+static struct polling_writer_args writer_args;
+
+static void write_polling_header (FILE *fp, struct system_info_t * system_info);
+static void write_poll_sample (FILE *fp, struct system_poll_info *info, struct rapl_energy *packages, struct system_info_t * system_info);
+static void write_poll_marker (FILE *fp, struct poll_marker *marker, struct system_info_t * system_info);
+static void consume_poll_marker (FILE *fp, struct poll_marker *marker, struct system_info_t * system_info);
+static void drain_polling_rings (struct system_info_t * system_info, struct poller_t * poller, int final);
+static void flush_raw_samples (struct raw_samples *raw_samples, double initial_wtime);
+static int expand_poll_sample (unsigned int position, struct system_poll_info *info, struct system_info_t * system_info);
+static void *polling_writer_loop (void *arg);
+#endif
+#ifdef _MSR
+static int socket_columns (struct system_info_t * system_info);
+#endif
+
+static int cct_to_file (struct system_info_t * system_info, struct monitor_t * monitor);
+static int sampled_tags_to_file (struct system_info_t * system_info, struct monitor_t * monitor);
+static int compare_thread_tag_intervals (const void *a, const void *b);
+static void write_cct_path (FILE *fp, int node_id, struct system_info_t * system_info);
 
-int file_handler (struct system_info_t * system_info, struct monitor_t * monitor, struct poller_t * poller)
+int file_handler (struct system_info_t * system_info, struct monitor_t * monitor)
 {
     int ret = 0;
     if (monitor->imonitor)
     {
-        if (polling_info_to_file(system_info, monitor, poller) != 0)
-        {
-            ret = 1;
-            poli_log(ERROR, monitor,   "Something went wrong with writing polling output to file");
-        }
         if (system_info->num_poli_tags > 0)
         {
             if (poli_tags_to_file(system_info, monitor) != 0)
@@ -61,48 +98,16 @@ int file_handler (struct system_info_t * system_info, struct monitor_t * monitor
                 poli_log(ERROR, monitor,   "Something went wrong with \n");
             }
         }
-    }
-    return ret;
-}
-
-static void get_pcap_tag_for_time_counter(FILE *fp, int counter, struct system_info_t * system_info, struct monitor_t * monitor)
-{
-    if (monitor->imonitor)
-    {
-        int i;
-        for (i = 0; i < system_info->num_pcap_tags; i++)
-        {
-            struct pcap_tag * tag = &system_info->pcap_tag_list[i];
-            if (tag->start_timer_count == counter)
-            {
-                fprintf(fp, "*** SET POWER CAP TAG %d TO: %s, %lf\n",
-                        tag->id, tag->zone, tag->watts_long);
-            }
-        }
-    }
-    return;
-}
-
-static void get_poli_tags_for_time_counter(FILE *fp, int counter, struct system_info_t * system_info, struct monitor_t * monitor)
-{
-    if (monitor->imonitor)
-    {
-        int i;
-        for (i = 0; i < system_info->num_poli_tags; i++)
+        if (system_info->thread_tag_buffers)
         {
-            struct poli_tag *this_poli_tag = &system_info->poli_tag_list[i];
-            if (this_poli_tag->start_timer_count == counter && this_poli_tag->end_timer_count == counter)
+            if (thread_tags_to_file(system_info, monitor) != 0)
             {
-                fprintf(fp, "--- TAG START: %s\n", this_poli_tag->tag_name);
-                fprintf(fp, "--- TAG END: %s\n", this_poli_tag->tag_name);
+                ret = (ret || 1);
+                poli_log(ERROR, monitor,   "Something went wrong with writing thread tags to file\n");
             }
-            else if (this_poli_tag->start_timer_count == counter)
-                fprintf(fp, "--- TAG START: %s\n", this_poli_tag->tag_name);
-            else if (this_poli_tag->end_timer_count == counter)
-                fprintf(fp, "--- TAG END: %s\n", this_poli_tag->tag_name);
         }
     }
-    return;
+    return ret;
 }
 
 int poli_tags_to_file (struct system_info_t * system_info, struct monitor_t * monitor)
@@ -112,6 +117,9 @@ int poli_tags_to_file (struct system_info_t * system_info, struct monitor_t * mo
         FILE *fp = open_file("PoLiMEr_energy-tags", monitor);
         if (fp == NULL)
             return 1;
+#ifndef _TIMER_OFF
+        int zone;
+#endif
 
 #ifdef _POWMGR
         int iamsimulation = -1;
@@ -124,6 +132,10 @@ int poli_tags_to_file (struct system_info_t * system_info, struct monitor_t * mo
         {
             fprintf(fp, "Total RAPL pkg E (J)\tTotal RAPL PP0 E (J)\tTotal RAPL PP1 E (J)\tTotal RAPL platform E (J)\tTotal RAPL dram E (J)\t");
             fprintf(fp, "Total RAPL pkg P (W)\tTotal RAPL PP0 P (W)\tTotal RAPL PP1 P (W)\tTotal RAPL platform P (W)\tTotal RAPL dram P (W)");
+            int socket;
+            for (socket = 0; socket < socket_columns(system_info); socket++)
+                fprintf(fp, "\tTotal Socket %d pkg E (J)\tTotal Socket %d dram E (J)\tTotal Socket %d pkg P (W)\tTotal Socket %d dram P (W)",
+                    socket, socket, socket, socket);
         }
 #endif
 #ifdef _CRAY
@@ -133,6 +145,16 @@ int poli_tags_to_file (struct system_info_t * system_info, struct monitor_t * mo
 #endif
 #ifdef _BGQ
         write_bgq_header(&fp);
+#endif
+#ifndef _TIMER_OFF
+        if (system_info->tag_interpolation)
+            for (zone = 0; zone < get_num_energy_zones(); zone++)
+                fprintf(fp, "\tInterpolated %s E (J)\t%s E Error (J)", get_energy_zone_name(zone), get_energy_zone_name(zone));
+        if (system_info->tag_power_stats.on)
+        {
+            const char *name = get_energy_zone_name(0);
+            fprintf(fp, "\tPoll Samples\tMean %s P (W)\tStd %s P (W)\tMin %s P (W)\tMax %s P (W)\tMedian %s P (W)\tP95 %s P (W)", name, name, name, name, name, name);
+        }
 #endif
         fprintf(fp, "\tRank\tNode");
         fprintf(fp, "\n");
@@ -140,11 +162,12 @@ int poli_tags_to_file (struct system_info_t * system_info, struct monitor_t * mo
         int tag_num;
         for (tag_num = 0; tag_num < system_info->num_poli_tags; tag_num++)
         {
-            struct poli_tag *tag = &system_info->poli_tag_list[tag_num];
+            struct poli_tag *tag = arena_at(&system_info->poli_tag_list, tag_num);
+            char *tag_name = tag_names_get(&system_info->tag_names, tag->name_id);
 
             double total_time = tag->end_time - tag->start_time;
             double start_offset, end_offset = 0.0;
-            if (strcmp(tag->tag_name, "application_summary") == 0 && total_time < 0)
+            if (strcmp(tag_name, "application_summary") == 0 && total_time < 0)
             {
                 total_time = get_time() - system_info->initial_mpi_wtime;
                 end_offset = total_time;
@@ -153,16 +176,16 @@ int poli_tags_to_file (struct system_info_t * system_info, struct monitor_t * mo
 #ifdef _POWMGR
             if (monitor->sa_master && iamsimulation == -1)
             {
-                if (strncmp(tag->tag_name, "S-", 2) == 0)
+                if (strncmp(tag_name, "S-", 2) == 0)
                     iamsimulation = 1;
-                if (strncmp(tag->tag_name, "A-", 2) == 0)
+                if (strncmp(tag_name, "A-", 2) == 0)
                     iamsimulation = 0;
             }
 #endif
 
             compute_power_from_tag(tag, total_time);
 
-            if (strcmp(tag->tag_name, "application_summary") == 0)
+            if (strcmp(tag_name, "application_summary") == 0)
             {
                 start_offset = 0.0;
                 if (end_offset == 0.0)
@@ -177,7 +200,7 @@ int poli_tags_to_file (struct system_info_t * system_info, struct monitor_t * mo
             char time_str_buffer[20];
             get_timestamp(start_offset, time_str_buffer, sizeof(time_str_buffer), &system_info->initial_start_time);
 
-            fprintf(fp, "%s\t%s\t%lf\t%lf\t%lf\t", tag->tag_name, time_str_buffer, start_offset, end_offset, total_time);
+            fprintf(fp, "%s\t%s\t%lf\t%lf\t%lf\t", tag_name, time_str_buffer, start_offset, end_offset, total_time);
 
 #ifdef _MSR
             if (!system_info->sysmsr->error_state)
@@ -187,6 +210,21 @@ int poli_tags_to_file (struct system_info_t * system_info, struct monitor_t * mo
                 //fprintf(fp, "%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t", total_energy.package, total_energy.pp0, total_energy.pp1, total_energy.platform, total_energy.dram);
                 fprintf(fp, "%lf\t%lf\t%lf\t%lf\t%lf\t", total_energy.package, total_energy.pp0, total_energy.pp1, total_energy.platform, total_energy.dram);
                 fprintf(fp, "%lf\t%lf\t%lf\t%lf\t%lf\t", total_power.package, total_power.pp0, total_power.pp1, total_power.platform, total_power.dram);
+                int socket;
+                struct rapl_energy *start_packages = tag_package_energy(system_info, tag_num, 0);
+                struct rapl_energy *end_packages = tag_package_energy(system_info, tag_num, 1);
+                for (socket = 0; socket < socket_columns(system_info); socket++)
+                {
+                    struct rapl_energy socket_energy = {0};
+                    struct rapl_power socket_power = {0};
+                    if (start_packages && end_packages)
+                    {
+                        rapl_compute_total_energy(&socket_energy, &end_packages[socket], &start_packages[socket]);
+                        if (total_time > 0)
+                            rapl_compute_total_power(&socket_power, &socket_energy, total_time);
+                    }
+                    fprintf(fp, "%lf\t%lf\t%lf\t%lf\t", socket_energy.package, socket_energy.dram, socket_power.package, socket_power.dram);
+                }
             }
 #endif
 #ifdef _CRAY
@@ -207,16 +245,268 @@ int poli_tags_to_file (struct system_info_t * system_info, struct monitor_t * mo
             printf("%lf\n", bgq_meas.sram);
             write_bgq_output(&fp, &bgq_meas);
 #endif
+#endif
+#ifndef _TIMER_OFF
+            if (system_info->tag_interpolation)
+            {
+                struct tag_interpolation *interpolation = get_tag_interpolation(system_info->tag_interpolation, tag_num);
+                for (zone = 0; zone < get_num_energy_zones(); zone++)
+                {
+                    //boundaries never placed on the timeline are reported as unknown
+                    if (interpolation != NULL && interpolation->start.resolved && interpolation->end.resolved)
+                        fprintf(fp, "%lf\t%lf\t", interpolation->end.energy[zone] - interpolation->start.energy[zone],
+                            interpolation->start.error[zone] + interpolation->end.error[zone]);
+                    else
+                        fprintf(fp, "nan\tnan\t");
+                }
+            }
+            if (system_info->tag_power_stats.on)
+            {
+                //power of the poll samples taken while the tag was open
+                struct online_stats *stats = get_tag_power_stats(&system_info->tag_power_stats, tag_num);
+                if (stats != NULL)
+                    fprintf(fp, "%ld\t%lf\t%lf\t%lf\t%lf\t%lf\t%lf\t", stats->count, stats->mean, sqrt(online_stats_variance(stats)),
+                        stats->min, stats->max, p2_quantile_value(&stats->median), p2_quantile_value(&stats->p95));
+                else
+                    fprintf(fp, "0\tnan\tnan\tnan\tnan\tnan\tnan\t");
+            }
 #endif
             fprintf(fp, "%d\t%d\n", tag->monitor_rank, tag->monitor_id);
         }
 
         fclose(fp);
+
+        int ret = sampled_tags_to_file(system_info, monitor);
+        if (system_info->cct.num_nodes > 0)
+            ret |= cct_to_file(system_info, monitor);
+        return ret;
     }
 
     return 0;
 }
 
+/* a thread tag from its start to its end event*/
+struct thread_tag_interval {
+    int thread_id;
+    int rank;
+    struct thread_tag_event *start;
+    struct thread_tag_event *end;
+};
+
+static int compare_thread_tag_intervals (const void *a, const void *b)
+{
+    double start_a = ((const struct thread_tag_interval *) a)->start->wtime;
+    double start_b = ((const struct thread_tag_interval *) b)->start->wtime;
+    return (start_a > start_b) - (start_a < start_b);
+}
+
+/* thread_tags_to_file - pairs up the start and end events of every thread by name and writes
+   the resulting tags of all threads and ranks merged by start time*/
+int thread_tags_to_file (struct system_info_t * system_info, struct monitor_t * monitor)
+{
+    struct thread_tag_buffer *buffer;
+    int num_events = 0;
+    for (buffer = system_info->thread_tag_buffers; buffer != NULL; buffer = buffer->next)
+        num_events += buffer->num_events;
+
+    struct thread_tag_interval *intervals = malloc((num_events / 2 + 1) * sizeof(struct thread_tag_interval));
+    int *open_events = malloc((num_events + 1) * sizeof(int));
+    if (intervals == NULL || open_events == NULL)
+    {
+        free(intervals);
+        free(open_events);
+        return 1;
+    }
+
+    int num_intervals = 0;
+    for (buffer = system_info->thread_tag_buffers; buffer != NULL; buffer = buffer->next)
+    {
+        int i, j, num_open = 0;
+        for (i = 0; i < buffer->num_events; i++)
+        {
+            struct thread_tag_event *event = arena_at(&buffer->events, i);
+            if (event->type == THREAD_TAG_START)
+            {
+                open_events[num_open++] = i;
+                continue;
+            }
+            //close the most recently started open tag of this name
+            for (j = num_open - 1; j >= 0; j--)
+                if (((struct thread_tag_event *) arena_at(&buffer->events, open_events[j]))->name_id == event->name_id)
+                    break;
+            if (j < 0)
+            {
+                poli_log(WARNING, monitor, "Thread %d of rank %d closed tag %s, which was not open. This tag will be omitted",
+                    buffer->thread_id, buffer->rank, tag_names_get(&system_info->tag_names, event->name_id));
+                continue;
+            }
+            struct thread_tag_interval *interval = &intervals[num_intervals++];
+            interval->thread_id = buffer->thread_id;
+            interval->rank = buffer->rank;
+            interval->start = arena_at(&buffer->events, open_events[j]);
+            interval->end = event;
+            memmove(&open_events[j], &open_events[j + 1], (num_open - j - 1) * sizeof(int));
+            num_open--;
+        }
+        for (j = 0; j < num_open; j++)
+            poli_log(WARNING, monitor, "Thread %d of rank %d did not finish tag %s. This tag will be omitted", buffer->thread_id, buffer->rank,
+                tag_names_get(&system_info->tag_names, ((struct thread_tag_event *) arena_at(&buffer->events, open_events[j]))->name_id));
+    }
+    free(open_events);
+
+    qsort(intervals, num_intervals, sizeof(struct thread_tag_interval), compare_thread_tag_intervals);
+
+    FILE *fp = open_file("PoLiMEr_thread-tags", monitor);
+    if (fp == NULL)
+    {
+        free(intervals);
+        return 1;
+    }
+
+    int zone, num_zones = get_num_energy_zones();
+#ifndef _HEADER_OFF
+    fprintf(fp, "Tag Name\tThread\tStart Time (s)\tEnd Time (s)\tTotal Time (s)");
+    for (zone = 0; zone < num_zones; zone++)
+        fprintf(fp, "\tNode %s E (J)\tNode %s P (W)", get_energy_zone_name(zone), get_energy_zone_name(zone));
+    fprintf(fp, "\tRank\tNode\n");
+#endif
+
+    int i;
+    for (i = 0; i < num_intervals; i++)
+    {
+        struct thread_tag_interval *interval = &intervals[i];
+        double total_time = interval->end->wtime - interval->start->wtime;
+        fprintf(fp, "%s\t%d\t%lf\t%lf\t%lf", tag_names_get(&system_info->tag_names, interval->start->name_id), interval->thread_id,
+            interval->start->wtime - system_info->initial_mpi_wtime, interval->end->wtime - system_info->initial_mpi_wtime, total_time);
+        for (zone = 0; zone < num_zones; zone++)
+        {
+            double energy = interval->end->energy[zone] - interval->start->energy[zone];
+            fprintf(fp, "\t%lf\t%lf", energy, (total_time > 0) ? energy / total_time : 0.0);
+        }
+        fprintf(fp, "\t%d\t%d\n", interval->rank, monitor->color);
+    }
+
+    fclose(fp);
+    free(intervals);
+    return 0;
+}
+
+/* writes the path of a calling context, from the top level tag down to node_id*/
+static void write_cct_path (FILE *fp, int node_id, struct system_info_t * system_info)
+{
+    struct cct_node *node = &system_info->cct.nodes[node_id];
+    if (node->parent >= 0)
+    {
+        write_cct_path(fp, node->parent, system_info);
+        fprintf(fp, "/");
+    }
+    fprintf(fp, "%s", tag_names_get(&system_info->tag_names, node->name_id));
+}
+
+static int cct_to_file (struct system_info_t * system_info, struct monitor_t * monitor)
+{
+    struct calling_context_tree *cct = &system_info->cct;
+    FILE *fp = open_file("PoLiMEr_energy-cct", monitor);
+    if (fp == NULL)
+        return 1;
+
+    int zone;
+#ifndef _HEADER_OFF
+    fprintf(fp, "Context\tCount\tInclusive Time (s)\tExclusive Time (s)");
+    for (zone = 0; zone < cct->num_zones; zone++)
+    {
+        const char *zone_name = get_energy_zone_name(zone);
+        fprintf(fp, "\tInclusive %s E (J)\tExclusive %s E (J)\tMean %s P (W)\tMin %s P (W)\tMax %s P (W)",
+            zone_name, zone_name, zone_name, zone_name, zone_name);
+    }
+    fprintf(fp, "\tRank\tNode\n");
+#endif
+
+    //depth first, children in the order they were first entered
+    int node_id = cct->first_root;
+    while (node_id >= 0)
+    {
+        struct cct_node *node = &cct->nodes[node_id];
+        write_cct_path(fp, node_id, system_info);
+        fprintf(fp, "\t%ld\t%lf\t%lf", node->count, node->inclusive_time, node->exclusive_time);
+        for (zone = 0; zone < cct->num_zones; zone++)
+        {
+            double mean_power = (node->inclusive_time > 0) ? node->inclusive_energy[zone] / node->inclusive_time : 0.0;
+            double min_power = (node->min_power[zone] < 0) ? 0.0 : node->min_power[zone];
+            fprintf(fp, "\t%lf\t%lf\t%lf\t%lf\t%lf", node->inclusive_energy[zone], node->exclusive_energy[zone],
+                mean_power, min_power, node->max_power[zone]);
+        }
+        fprintf(fp, "\t%d\t%d\n", monitor->world_rank, monitor->color);
+
+        if (node->first_child >= 0)
+            node_id = node->first_child;
+        else
+        {
+            while (node_id >= 0 && cct->nodes[node_id].next_sibling < 0)
+                node_id = cct->nodes[node_id].parent;
+            if (node_id >= 0)
+                node_id = cct->nodes[node_id].next_sibling;
+        }
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+/* totals of sampled tag names, extrapolated from the sampled invocations with their 95% confidence intervals*/
+static int sampled_tags_to_file (struct system_info_t * system_info, struct monitor_t * monitor)
+{
+    unsigned int name_id, num_samplers = arena_capacity(&system_info->tag_samplers);
+    int any_sampled = 0;
+    for (name_id = 0; name_id < num_samplers; name_id++)
+    {
+        struct tag_sampler *sampler = arena_at(&system_info->tag_samplers, name_id);
+        if (sampler->configured && sampler->policy != POLI_SAMPLE_ALL)
+            any_sampled = 1;
+    }
+    if (!any_sampled)
+        return 0;
+
+    FILE *fp = open_file("PoLiMEr_sampled-tags", monitor);
+    if (fp == NULL)
+        return 1;
+
+    int zone, num_zones = get_num_energy_zones();
+#ifndef _HEADER_OFF
+    fprintf(fp, "Tag Name\tPolicy\tInvocations\tSampled\tTotal Time (s)\tTime CI95 (s)");
+    for (zone = 0; zone < num_zones; zone++)
+        fprintf(fp, "\tTotal %s E (J)\t%s E CI95 (J)", get_energy_zone_name(zone), get_energy_zone_name(zone));
+    fprintf(fp, "\tRank\tNode\n");
+#endif
+
+    for (name_id = 0; name_id < num_samplers; name_id++)
+    {
+        struct tag_sampler *sampler = arena_at(&system_info->tag_samplers, name_id);
+        if (!sampler->configured || sampler->policy == POLI_SAMPLE_ALL)
+            continue;
+        fprintf(fp, "%s\t%s:%g\t%ld\t%ld", tag_names_get(&system_info->tag_names, name_id),
+            get_sampling_policy_name(sampler->policy), sampler->parameter, sampler->invocations, sampler->sampled);
+        int value;
+        for (value = 0; value <= num_zones; value++)
+        {
+            double total, ci95;
+            if (get_sampler_estimate(sampler, value, &total, &ci95) != 0)
+                fprintf(fp, "\tnan\tnan");
+            else
+                fprintf(fp, "\t%lf\t%lf", total, ci95);
+        }
+        fprintf(fp, "\t%d\t%d\n", monitor->world_rank, monitor->color);
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+static int compare_tag_ids (const void *a, const void *b)
+{
+    return (*(const int *) a) - (*(const int *) b);
+}
+
 int pcap_tags_to_file (struct system_info_t * system_info, struct monitor_t * monitor)
 {
 #ifdef _MSR
@@ -233,7 +523,7 @@ int pcap_tags_to_file (struct system_info_t * system_info, struct monitor_t * mo
         int tag_num;
         for (tag_num = 0; tag_num < system_info->num_pcap_tags; tag_num++)
         {
-            struct pcap_tag *tag = &system_info->pcap_tag_list[tag_num];
+            struct pcap_tag *tag = arena_at(&system_info->pcap_tag_list, tag_num);
             double start_offset = tag->wtime - system_info->initial_mpi_wtime;
 
             char time_str_buffer[20];
@@ -244,14 +534,17 @@ int pcap_tags_to_file (struct system_info_t * system_info, struct monitor_t * mo
                 tag->seconds_long, tag->seconds_short, start_offset,
                 tag->pcap_flag, tag->num_active_poli_tags);
 
+            //list active tags in the order they were started
+            int *active_ids = &system_info->active_tag_pool[tag->active_tags_offset];
+            qsort(active_ids, tag->num_active_poli_tags, sizeof(int), compare_tag_ids);
             int i;
             for (i = 0; i < tag->num_active_poli_tags; i++)
             {
-                struct poli_tag etag = tag->active_poli_tags[i];
+                struct poli_tag *etag = arena_at(&system_info->poli_tag_list, active_ids[i]);
                 if (i < tag->num_active_poli_tags - 1)
-                    fprintf(fp, "%s__", etag.tag_name);
+                    fprintf(fp, "%s__", tag_names_get(&system_info->tag_names, etag->name_id));
                 else
-                    fprintf(fp, "%s", etag.tag_name);
+                    fprintf(fp, "%s", tag_names_get(&system_info->tag_names, etag->name_id));
             }
             fprintf(fp, "\n");
         }
@@ -261,119 +554,440 @@ int pcap_tags_to_file (struct system_info_t * system_info, struct monitor_t * mo
     return 0;
 }
 
-int polling_info_to_file (struct system_info_t * system_info, struct monitor_t * monitor, struct poller_t * poller)
+#ifndef _TIMER_OFF
+/* start_polling_writer - opens the polling output file and starts the thread streaming polling records into it.
+   records are drained from the poll ring every POLIMER_FLUSH_INTERVAL seconds or when the ring is half full
+   returns: 0 if successful, 1 otherwise*/
+int start_polling_writer (struct system_info_t * system_info, struct monitor_t * monitor, struct poller_t * poller, struct polimer_config_t * poli_config)
 {
-    if (monitor->imonitor)
-    {
-        if (poller->time_counter <= 0)
-            return 0;
+    poller->writer_on = 0;
+    poller->poll_file = open_file("PoLiMEr", monitor);
+    if (poller->poll_file == NULL)
+        return 1;
 
-#ifndef _TIMER_OFF
+    write_polling_header(poller->poll_file, system_info);
+    fflush(poller->poll_file);
+    system_info->tag_power_stats.on = (get_num_energy_zones() > 0 && system_info->tag_power_stats.open != NULL);
 
-        FILE *fp = open_file("PoLiMEr", monitor);
-        if (fp == NULL)
+    struct raw_samples *raw_samples = system_info->raw_samples;
+    if (raw_samples != NULL)
+    {
+        raw_samples->file = open_file("PoLiMEr_hf-power", monitor);
+        if (raw_samples->file == NULL)
             return 1;
+#ifndef _HEADER_OFF
+        int zone;
+        fprintf(raw_samples->file, "Time Since Start (s)\tInterval (s)");
+        for (zone = 0; zone < raw_samples->num_zones; zone++)
+            fprintf(raw_samples->file, "\t%s P (W)", get_energy_zone_name(zone));
+        fprintf(raw_samples->file, "\n");
+#endif
+    }
+
+    poller->writer_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (poller->writer_fd < 0)
+    {
+        poli_log(ERROR, monitor, "Failed to create eventfd for polling writer: %s", strerror(errno));
+        return 1;
+    }
+
+    writer_args.system_info = system_info;
+    writer_args.poller = poller;
+    writer_args.timeout = (int) (poli_config->flush_interval * 1000);
+    if (writer_args.timeout <= 0)
+        writer_args.timeout = (int) (FLUSH_INTERVAL * 1000);
+    writer_args.poll_interval = poli_config->poll_interval;
+    writer_args.last_wtime = system_info->initial_mpi_wtime;
+    writer_args.last_energy = system_info->initial_energy;
+    memcpy(writer_args.last_packages, system_info->package_energy.initial, sizeof(writer_args.last_packages));
+    writer_args.applied_pcaps = system_info->num_pcap_events;
+    memcpy(writer_args.pcap_state, system_info->current_pcap_list, NUM_ZONES * sizeof(struct pcap_info));
+
+    poller->writer_on = 1;
+    int status = pthread_create(&poller->writer_thread, NULL, polling_writer_loop, &writer_args);
+    if (status != 0)
+    {
+        poli_log(ERROR, monitor, "Failed to create polling writer thread: %s", strerror(status));
+        poller->writer_on = 0;
+        close(poller->writer_fd);
+        return 1;
+    }
+    return 0;
+}
+
+/* stop_polling_writer - writes out all remaining polling records and closes the polling output file.
+   does nothing if start_polling_writer wasn't called. must be called after the timer is stopped*/
+int stop_polling_writer (struct system_info_t * system_info, struct monitor_t * monitor, struct poller_t * poller)
+{
+    if (!poller->writer_on && poller->poll_file == NULL)
+        return 0;
+
+    if (poller->writer_on)
+    {
+        __atomic_store_n(&poller->writer_on, 0, __ATOMIC_RELEASE);
+        uint64_t wake = 1;
+        if (write(poller->writer_fd, &wake, sizeof(wake)) != sizeof(wake))
+            poli_log(ERROR, monitor, "Failed to wake polling writer: %s", strerror(errno));
+        pthread_join(poller->writer_thread, NULL);
+        close(poller->writer_fd);
+    }
+    else if (poller->poll_file != NULL)
+        drain_polling_rings(system_info, poller, 1);
+
+    if (poller->poll_file != NULL)
+    {
+        fclose(poller->poll_file);
+        poller->poll_file = NULL;
+    }
+    if (system_info->raw_samples != NULL && system_info->raw_samples->file != NULL)
+    {
+        fclose(system_info->raw_samples->file);
+        system_info->raw_samples->file = NULL;
+        if (system_info->raw_samples->dropped > 0)
+            poli_log(WARNING, monitor, "%d raw samples were dropped because the polling writer fell behind. Consider increasing POLIMER_RAW_RING_SIZE", system_info->raw_samples->dropped);
+    }
+
+    if (system_info->dropped_samples > 0)
+        poli_log(WARNING, monitor, "%d poll samples were dropped because the polling writer fell behind. Consider increasing POLIMER_RING_SIZE", system_info->dropped_samples);
+    return 0;
+}
+
+/* notify_polling_writer - wakes up the polling writer. async-signal-safe*/
+void notify_polling_writer (struct poller_t * poller)
+{
+    if (poller->writer_on)
+    {
+        uint64_t wake = 1;
+        ssize_t ret = write(poller->writer_fd, &wake, sizeof(wake));
+        (void) ret;
+    }
+}
+
+/* push_poll_marker - records the position of a tag event among the polling records. does nothing unless the polling writer runs.
+   called by the application thread only*/
+void push_poll_marker (poll_marker_t type, int index, struct system_info_t * system_info, struct poller_t * poller)
+{
+    if (system_info->marker_ring.slots == NULL || !poller->writer_on)
+        return;
+
+    struct poll_marker *marker = ring_reserve(&system_info->marker_ring);
+    while (marker == NULL)
+    {
+        if (!poller->writer_on)
+            return; //nobody will write it out
+        notify_polling_writer(poller);
+        sched_yield();
+        marker = ring_reserve(&system_info->marker_ring);
+    }
+    marker->type = type;
+    marker->counter = __atomic_load_n(&poller->time_counter, __ATOMIC_ACQUIRE);
+    marker->index = index;
+    ring_commit(&system_info->marker_ring);
+    if (ring_count(&system_info->marker_ring) == system_info->marker_ring.size / 2)
+        notify_polling_writer(poller);
+}
+
+static void *polling_writer_loop (void *arg)
+{
+    struct polling_writer_args *args = (struct polling_writer_args *) arg;
+    struct poller_t *poller = args->poller;
+
+    //leave all signals to the application threads
+    sigset_t sigset;
+    sigfillset(&sigset);
+    pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+    struct pollfd pfd;
+    pfd.fd = poller->writer_fd;
+    pfd.events = POLLIN;
+
+    while (1)
+    {
+        int on = __atomic_load_n(&poller->writer_on, __ATOMIC_ACQUIRE);
+        drain_polling_rings(args->system_info, poller, !on);
+        if (!on)
+            break;
+        if (poll(&pfd, 1, args->timeout) > 0)
+        {
+            uint64_t wakeups;
+            ssize_t ret = read(poller->writer_fd, &wakeups, sizeof(wakeups));
+            (void) ret;
+        }
+    }
+    return NULL;
+}
+
+/* drain_polling_rings - writes out all committed polling records, each preceded by the markers recorded before it,
+   then the markers recorded since the last of them, which no later record can precede. when final is set, all markers are written*/
+static void drain_polling_rings (struct system_info_t * system_info, struct poller_t * poller, int final)
+{
+    FILE *fp = poller->poll_file;
+    struct system_poll_info info;
+    struct rapl_energy packages[MAX_RECORDED_PACKAGES];
+    size_t package_bytes = system_info->package_energy.num_packages * sizeof(struct rapl_energy);
+    struct poll_marker *marker;
+    unsigned int position;
+
+    while (ring_peek_position(&system_info->poll_ring, &position) == 0)
+    {
+        while ((marker = ring_peek(&system_info->marker_ring)) != NULL && marker->counter <= (int) position)
+        {
+            consume_poll_marker(fp, marker, system_info);
+            ring_release(&system_info->marker_ring);
+        }
+        //back to back samples have no power of their own, only the one computed over the poll interval instead
+        int measured = expand_poll_sample(position, &info, system_info);
+        if (system_info->tag_power_stats.on && measured)
+        {
+            double energy[MAX_ENERGY_ZONES];
+            get_energy_zones(energy, &info.current_energy, &info.last_energy, info.time_diff);
+            tag_power_stats_add(&system_info->tag_power_stats, energy[0] / info.time_diff);
+        }
+        double time_error = ENERGY_UPDATE_PERIOD;
+        if (system_info->poll_columns.time_error)
+            time_error = system_info->poll_columns.time_error[position & system_info->poll_ring.mask];
+        struct rapl_energy *slot_packages = poll_package_energy(system_info, position & system_info->poll_ring.mask);
+        if (slot_packages)
+            memcpy(packages, slot_packages, package_bytes);
+        ring_release(&system_info->poll_ring);
+        write_poll_sample(fp, &info, slot_packages ? packages : NULL, system_info);
+        if (slot_packages)
+            memcpy(writer_args.last_packages, packages, package_bytes);
+#ifndef _NOMPI
+        if (system_info->node_tags)
+            drain_node_tag_events(system_info->node_tags, system_info);
+#endif
+        if (system_info->tag_interpolation)
+            interpolate_tag_boundaries(system_info->tag_interpolation, info.wtime, &info.current_energy, time_error, system_info);
+        attribute_thread_tag_events(info.wtime, &info.current_energy, system_info);
+    }
+    //the next polling record will be at position tail, so markers up to its counter are in place already
+    position = system_info->poll_ring.tail;
+    while ((marker = ring_peek(&system_info->marker_ring)) != NULL && (final || marker->counter <= (int) position))
+    {
+        consume_poll_marker(fp, marker, system_info);
+        ring_release(&system_info->marker_ring);
+    }
+    fflush(fp);
+    if (system_info->raw_samples != NULL && system_info->raw_samples->file != NULL)
+        flush_raw_samples(system_info->raw_samples, system_info->initial_mpi_wtime);
+}
+
+/* flush_raw_samples - converts all committed raw samples to power and writes them out, in runs of consecutive slots*/
+static void flush_raw_samples (struct raw_samples *raw_samples, double initial_wtime)
+{
+    FILE *fp = raw_samples->file;
+    unsigned int position, count = ring_count(&raw_samples->ring);
+    while (count > 0 && ring_peek_position(&raw_samples->ring, &position) == 0)
+    {
+        unsigned int slot = position & raw_samples->ring.mask;
+        unsigned int n = raw_samples->ring.size - slot;
+        if (n > count)
+            n = count;
+        convert_raw_samples(raw_samples, slot, n);
 
+        unsigned int i;
         int zone;
-#ifndef _HEADER_OFF
-        fprintf(fp, "Count\tTimestamp\tTime since start (s)\tPoll Time Diff (s)\t");
-#ifdef _MSR
-        if (!system_info->sysmsr->error_state)
+        for (i = 0; i < n; i++)
         {
-            fprintf(fp, "RAPL pkg E (J)\tRAPL pp0 E (J)\tRAPL pp1 E (J)\tRAPL platform E (J)\tRAPL dram E (J)\t");
-            fprintf(fp, "RAPL pkg E since start (J)\tRAPL pp0 E since start (J)\tRAPL pp1 E(J) since start\tRAPL platform E (J) since start\tRAPL dram E (J) since start\t");
-            fprintf(fp, "RAPL pkg P (W)\tRAPL pp0 P (W)\tRAPL pp1 P (W)\tRAPL platform P (W)\tRAPL dram P (W)");
+            fprintf(fp, "%lf\t%lf", raw_samples->wtime[slot + i] - initial_wtime, raw_samples->interval[i]);
+            for (zone = 0; zone < raw_samples->num_zones; zone++)
+                fprintf(fp, "\t%lf", raw_samples->power[zone][i]);
+            fprintf(fp, "\n");
+            ring_release(&raw_samples->ring);
         }
+        count -= n;
+    }
+    fflush(fp);
+}
+
+/* expand_poll_sample - derives a full polling record from the stored columns and the previously written record.
+   where no time passed since that record, the power is computed over the poll interval
+   returns: 1 if the power is over the time since the previous record, 0 if it is over the poll interval*/
+static int expand_poll_sample (unsigned int position, struct system_poll_info *info, struct system_info_t * system_info)
+{
+    struct poll_columns *columns = &system_info->poll_columns;
+    int slot = position & system_info->poll_ring.mask;
+
+    memset(info, 0, sizeof(struct system_poll_info));
+    info->counter = position;
+    info->wtime = columns->wtime[slot];
+    info->current_energy = columns->energy[slot];
+    info->last_energy = writer_args.last_energy;
+
+    //no time since the previous record after an overflow or for back to back samples
+    int measured = info->wtime > writer_args.last_wtime;
+    if (measured)
+        info->time_diff = info->wtime - writer_args.last_wtime;
+    else
+        info->time_diff = (double) writer_args.poll_interval; //best approximation
+
+    compute_current_power(info, info->time_diff, system_info);
+
+#ifdef _MSR
+    //replay the power cap journal up to this record
+    int pcap_ref = columns->pcap_ref[slot];
+    for (; writer_args.applied_pcaps < pcap_ref; writer_args.applied_pcaps++)
+    {
+        struct pcap_event *event = arena_at(&system_info->pcap_journal, writer_args.applied_pcaps);
+        struct pcap_info *state = &writer_args.pcap_state[event->zone];
+        state->watts_long = event->watts_long;
+        state->watts_short = event->watts_short;
+        state->seconds_long = event->seconds_long;
+        state->seconds_short = event->seconds_short;
+    }
+    memcpy(info->pcap_info_list, writer_args.pcap_state, NUM_ZONES * sizeof(struct pcap_info));
+    info->pkg_pcap = info->pcap_info_list[PACKAGE_INDEX].watts_long;
+    info->free_power = info->pkg_pcap - info->computed_power.rapl_power.package;
+    info->power_util = info->computed_power.rapl_power.package / info->pkg_pcap;
+#endif
+
+    writer_args.last_wtime = info->wtime;
+    writer_args.last_energy = info->current_energy;
+    return measured;
+}
+
+/* writes a marker and queues the poli tag boundary it stands for when tag boundaries are interpolated*/
+static void consume_poll_marker (FILE *fp, struct poll_marker *marker, struct system_info_t * system_info)
+{
+    write_poll_marker(fp, marker, system_info);
+    if (system_info->tag_power_stats.on && marker->type == TAG_START_MARKER)
+        tag_power_stats_start(&system_info->tag_power_stats, marker->index);
+    else if (system_info->tag_power_stats.on && marker->type == TAG_END_MARKER)
+        tag_power_stats_end(&system_info->tag_power_stats, marker->index);
+    if (system_info->tag_interpolation && (marker->type == TAG_START_MARKER || marker->type == TAG_END_MARKER))
+        queue_tag_boundary(system_info->tag_interpolation, marker->index, marker->type == TAG_END_MARKER);
+}
+
+static void write_poll_marker (FILE *fp, struct poll_marker *marker, struct system_info_t * system_info)
+{
+    if (marker->type == PCAP_MARKER)
+    {
+        struct pcap_tag *tag = arena_at(&system_info->pcap_tag_list, marker->index);
+        fprintf(fp, "*** SET POWER CAP TAG %d TO: %s, %lf\n", tag->id, tag->zone, tag->watts_long);
+    }
+    else if (marker->type == TAG_START_MARKER || marker->type == TAG_END_MARKER)
+    {
+        struct poli_tag *tag = arena_at(&system_info->poli_tag_list, marker->index);
+        fprintf(fp, "--- TAG %s: %s\n", (marker->type == TAG_START_MARKER) ? "START" : "END", tag_names_get(&system_info->tag_names, tag->name_id));
+    }
+    else if (marker->type == CONTEXT_ENTER_MARKER)
+        fprintf(fp, "--- TAG START: %s\n", tag_names_get(&system_info->tag_names, marker->index));
+    else
+        fprintf(fp, "--- TAG END: %s\n", tag_names_get(&system_info->tag_names, marker->index));
+}
+
+static void write_polling_header (FILE *fp, struct system_info_t * system_info)
+{
+    int zone;
+#ifndef _HEADER_OFF
+    fprintf(fp, "Count\tTimestamp\tTime since start (s)\tPoll Time Diff (s)\t");
+#ifdef _MSR
+    if (!system_info->sysmsr->error_state)
+    {
+        fprintf(fp, "RAPL pkg E (J)\tRAPL pp0 E (J)\tRAPL pp1 E (J)\tRAPL platform E (J)\tRAPL dram E (J)\t");
+        fprintf(fp, "RAPL pkg E since start (J)\tRAPL pp0 E since start (J)\tRAPL pp1 E(J) since start\tRAPL platform E (J) since start\tRAPL dram E (J) since start\t");
+        fprintf(fp, "RAPL pkg P (W)\tRAPL pp0 P (W)\tRAPL pp1 P (W)\tRAPL platform P (W)\tRAPL dram P (W)");
+        int socket;
+        for (socket = 0; socket < socket_columns(system_info); socket++)
+            fprintf(fp, "\tSocket %d pkg P (W)\tSocket %d dram P (W)", socket, socket);
+    }
 #endif
 #ifdef _CRAY
-        fprintf(fp, "\tCray node E (J)\tCray cpu E (J)\tCray memory E (J)\t");
-        fprintf(fp, "Cray node E since start (J)\tCray cpu E since start (J)\tCray memory E since start (J)\t");
-        fprintf(fp, "Cray node P (W)\tCray cpu P (W)\tCray memory P (W)\t");
-        fprintf(fp, "Cray node P calc (W)\tCray cpu P calc (W)\tCray memory P calc (W)\t");
-        fprintf(fp, "Cpufreq frequency (MHz)\tCray frequency (MHz)\t");
+    fprintf(fp, "\tCray node E (J)\tCray cpu E (J)\tCray memory E (J)\t");
+    fprintf(fp, "Cray node E since start (J)\tCray cpu E since start (J)\tCray memory E since start (J)\t");
+    fprintf(fp, "Cray node P (W)\tCray cpu P (W)\tCray memory P (W)\t");
+    fprintf(fp, "Cray node P calc (W)\tCray cpu P calc (W)\tCray memory P calc (W)\t");
+    fprintf(fp, "Cpufreq frequency (MHz)\tCray frequency (MHz)\t");
 #else
 #ifdef _BGQ
-        write_bgq_header(&fp);
-        write_bgq_ediff_header(&fp);
+    write_bgq_header(&fp);
+    write_bgq_ediff_header(&fp);
 #endif
-        fprintf(fp, "\tCpufreq frequency (MHz)\t");
+    fprintf(fp, "\tCpufreq frequency (MHz)\t");
 #endif
 #ifdef _MSR
-        if (!system_info->sysmsr->error_state)
+    if (!system_info->sysmsr->error_state)
+    {
+        for (zone = 0; zone < system_info->sysmsr->num_zones - 1; zone++)
         {
-            for (zone = 0; zone < system_info->sysmsr->num_zones - 1; zone++)
-            {
-                fprintf(fp, "%s power cap long (W)\t", get_zone_name_by_index(zone));
-                fprintf(fp, "%s power cap short (W)\t", get_zone_name_by_index(zone));
-            }
-            fprintf(fp, "%s power cap long (W)\t", get_zone_name_by_index(system_info->sysmsr->num_zones - 1));
-            fprintf(fp, "%s power cap short (W)\n", get_zone_name_by_index(system_info->sysmsr->num_zones - 1));
+            fprintf(fp, "%s power cap long (W)\t", get_zone_name_by_index(zone));
+            fprintf(fp, "%s power cap short (W)\t", get_zone_name_by_index(zone));
         }
+        fprintf(fp, "%s power cap long (W)\t", get_zone_name_by_index(system_info->sysmsr->num_zones - 1));
+        fprintf(fp, "%s power cap short (W)\n", get_zone_name_by_index(system_info->sysmsr->num_zones - 1));
+    }
 #endif
 #endif
-        int counter;
-        for (counter = 0; counter < poller->time_counter; counter++)
-        {
-            if (system_info->num_poli_tags > 0)
-                get_poli_tags_for_time_counter(fp, counter, system_info, monitor);
-
-            if (system_info->num_pcap_tags > 0)
-            {
-                get_pcap_tag_for_time_counter(fp, counter, system_info, monitor);
-            }
-
-            struct system_poll_info *info = &system_info->system_poll_list[counter];
+}
 
-            double time_from_start = info->wtime - system_info->initial_mpi_wtime;
+/* write_poll_sample - writes a polling record. packages are the package energies of the record, NULL if there are none*/
+static void write_poll_sample (FILE *fp, struct system_poll_info *info, struct rapl_energy *packages, struct system_info_t * system_info)
+{
+    int zone;
+    double time_from_start = info->wtime - system_info->initial_mpi_wtime;
 
-            char time_str_buffer[20];
-            get_timestamp(time_from_start, time_str_buffer, sizeof(time_str_buffer), &system_info->initial_start_time);
+    char time_str_buffer[20];
+    get_timestamp(time_from_start, time_str_buffer, sizeof(time_str_buffer), &system_info->initial_start_time);
 
-            fprintf(fp, "%d\t%s\t%lf\t%lf\t", info->counter, time_str_buffer, time_from_start, info->time_diff);
+    fprintf(fp, "%d\t%s\t%lf\t%lf\t", info->counter, time_str_buffer, time_from_start, info->time_diff);
 
 #ifdef _MSR
-            if (!system_info->sysmsr->error_state)
+    if (!system_info->sysmsr->error_state)
+    {
+        struct rapl_energy *energy_j = &(info->current_energy.rapl_energy);
+        struct rapl_power *watts = &(info->computed_power.rapl_power);
+
+        //fprintf(fp, "%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t", energy_j->package, energy_j->pp0, energy_j->pp1, energy_j->platform, energy_j->dram);
+        //fprintf(fp, "%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t", (energy_j->package - system_info->initial_energy.rapl_energy.package), (energy_j->pp0 - system_info->initial_energy.rapl_energy.pp0), (energy_j->pp1 - system_info->initial_energy.rapl_energy.pp1), (energy_j->platform - system_info->initial_energy.rapl_energy.platform), (energy_j->dram - system_info->initial_energy.rapl_energy.dram));
+        fprintf(fp, "%lf\t%lf\t%lf\t%lf\t%lf\t", energy_j->package, energy_j->pp0, energy_j->pp1, energy_j->platform, energy_j->dram);
+        fprintf(fp, "%lf\t%lf\t%lf\t%lf\t%lf\t", (energy_j->package - system_info->initial_energy.rapl_energy.package), (energy_j->pp0 - system_info->initial_energy.rapl_energy.pp0), (energy_j->pp1 - system_info->initial_energy.rapl_energy.pp1), (energy_j->platform - system_info->initial_energy.rapl_energy.platform), (energy_j->dram - system_info->initial_energy.rapl_energy.dram));
+        fprintf(fp, "%lf\t%lf\t%lf\t%lf\t%lf\t", watts->package, watts->pp0, watts->pp1, watts->platform, watts->dram);
+        int socket;
+        for (socket = 0; socket < socket_columns(system_info); socket++)
+        {
+            struct rapl_energy socket_energy = {0};
+            struct rapl_power socket_power = {0};
+            if (packages)
             {
-                struct rapl_energy *energy_j = &(info->current_energy.rapl_energy);
-                struct rapl_power *watts = &(info->computed_power.rapl_power);
-
-                //fprintf(fp, "%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t", energy_j->package, energy_j->pp0, energy_j->pp1, energy_j->platform, energy_j->dram);
-                //fprintf(fp, "%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t", (energy_j->package - system_info->initial_energy.rapl_energy.package), (energy_j->pp0 - system_info->initial_energy.rapl_energy.pp0), (energy_j->pp1 - system_info->initial_energy.rapl_energy.pp1), (energy_j->platform - system_info->initial_energy.rapl_energy.platform), (energy_j->dram - system_info->initial_energy.rapl_energy.dram));
-                fprintf(fp, "%lf\t%lf\t%lf\t%lf\t%lf\t", energy_j->package, energy_j->pp0, energy_j->pp1, energy_j->platform, energy_j->dram);
-                fprintf(fp, "%lf\t%lf\t%lf\t%lf\t%lf\t", (energy_j->package - system_info->initial_energy.rapl_energy.package), (energy_j->pp0 - system_info->initial_energy.rapl_energy.pp0), (energy_j->pp1 - system_info->initial_energy.rapl_energy.pp1), (energy_j->platform - system_info->initial_energy.rapl_energy.platform), (energy_j->dram - system_info->initial_energy.rapl_energy.dram));
-                fprintf(fp, "%lf\t%lf\t%lf\t%lf\t%lf\t", watts->package, watts->pp0, watts->pp1, watts->platform, watts->dram);
+                rapl_compute_total_energy(&socket_energy, &packages[socket], &writer_args.last_packages[socket]);
+                rapl_compute_total_power(&socket_power, &socket_energy, info->time_diff);
             }
+            fprintf(fp, "%lf\t%lf\t", socket_power.package, socket_power.dram);
+        }
+    }
 #endif
 #ifdef _CRAY
-            struct cray_measurement *cmeasurement = &(info->current_energy.cray_meas);
-            struct cray_measurement *cpower = &(info->computed_power.cray_meas);
-
-            fprintf(fp, "%lf\t%lf\t%lf\t", cmeasurement->node_energy, cmeasurement->cpu_energy, cmeasurement->memory_energy);
-            fprintf(fp, "%lf\t%lf\t%lf\t", (cmeasurement->node_energy - system_info->initial_energy.cray_meas.node_energy), (cmeasurement->cpu_energy - system_info->initial_energy.cray_meas.cpu_energy), (cmeasurement->memory_energy - system_info->initial_energy.cray_meas.memory_energy));
-            fprintf(fp, "%lf\t%lf\t%lf\t", cmeasurement->node_power, cmeasurement->cpu_power, cmeasurement->memory_power);
-            fprintf(fp, "%lf\t%lf\t%lf\t", cpower->node_measured_power, cpower->cpu_measured_power, cpower->memory_measured_power);
-            fprintf(fp, "%lf\t%lf\t", info->freq.freq, info->freq.cray_freq);
+    struct cray_measurement *cmeasurement = &(info->current_energy.cray_meas);
+    struct cray_measurement *cpower = &(info->computed_power.cray_meas);
+
+    fprintf(fp, "%lf\t%lf\t%lf\t", cmeasurement->node_energy, cmeasurement->cpu_energy, cmeasurement->memory_energy);
+    fprintf(fp, "%lf\t%lf\t%lf\t", (cmeasurement->node_energy - system_info->initial_energy.cray_meas.node_energy), (cmeasurement->cpu_energy - system_info->initial_energy.cray_meas.cpu_energy), (cmeasurement->memory_energy - system_info->initial_energy.cray_meas.memory_energy));
+    fprintf(fp, "%lf\t%lf\t%lf\t", cmeasurement->node_power, cmeasurement->cpu_power, cmeasurement->memory_power);
+    fprintf(fp, "%lf\t%lf\t%lf\t", cpower->node_measured_power, cpower->cpu_measured_power, cpower->memory_measured_power);
+    fprintf(fp, "%lf\t%lf\t", info->freq.freq, info->freq.cray_freq);
 #else
 #ifdef _BGQ
-            struct bgq_measurement *bgq_meas = &(info->current_energy.bgq_meas);
-            write_bgq_output(&fp, bgq_meas);
-            write_bgq_ediff(&fp, bgq_meas, &(system_info->initial_energy.bgq_meas));
-#endif
-            fprintf(fp, "%lf\t", info->freq.freq);
+    struct bgq_measurement *bgq_meas = &(info->current_energy.bgq_meas);
+    write_bgq_output(&fp, bgq_meas);
+    write_bgq_ediff(&fp, bgq_meas, &(system_info->initial_energy.bgq_meas));
 #endif
-            for (zone = 0; zone < system_info->sysmsr->num_zones - 1; zone++)
-            {
-                fprintf(fp, "%lf\t", info->pcap_info_list[zone].watts_long);
-                fprintf(fp, "%lf\t", info->pcap_info_list[zone].watts_short);
-            }
-            fprintf(fp, "%lf\t", info->pcap_info_list[system_info->sysmsr->num_zones - 1].watts_long);
-            fprintf(fp, "%lf\n", info->pcap_info_list[system_info->sysmsr->num_zones - 1].watts_short);
-        }
-        fclose(fp);
-#else //_TIMER_OFF is set
-        return 0;
+    fprintf(fp, "%lf\t", info->freq.freq);
 #endif
+    for (zone = 0; zone < system_info->sysmsr->num_zones - 1; zone++)
+    {
+        fprintf(fp, "%lf\t", info->pcap_info_list[zone].watts_long);
+        fprintf(fp, "%lf\t", info->pcap_info_list[zone].watts_short);
     }
+    fprintf(fp, "%lf\t", info->pcap_info_list[system_info->sysmsr->num_zones - 1].watts_long);
+    fprintf(fp, "%lf\n", info->pcap_info_list[system_info->sysmsr->num_zones - 1].watts_short);
+}
+#endif
 
-    return 0;
-}
\ No newline at end of file
+#ifdef _MSR
+/* socket_columns - returns: the number of packages written out on their own next to the node totals, 0 on single package nodes*/
+static int socket_columns (struct system_info_t * system_info)
+{
+    return system_info->package_energy.num_packages;
+}
+#endif
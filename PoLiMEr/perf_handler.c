@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "PoLiMEr.h"
+#include "PoLiLog.h"
+#include "perf_handler.h"
+
+/* power pmu events, at the index of the energy zone they count */
+static char *event_names[NUM_RAPL_DOMAINS] = {"energy-pkg", "energy-cores", "energy-gpu", "energy-psys", "energy-ram"};
+
+static int read_pmu_file (char *file, char *buf, int len);
+static int parse_cpumask (char *mask, int *cpus, int max_cpus);
+static int read_groups (uint64_t values[][NUM_RAPL_DOMAINS], struct perf_rapl_info *pr);
+static void set_zone_energies (struct rapl_energy *re, double *zones);
+
+struct perf_rapl_info *init_perf_rapl (void)
+{
+    poli_log(TRACE, NULL, "Entering %s", __FUNCTION__);
+
+    char buf[BUFSIZE];
+    if (read_pmu_file("type", buf, BUFSIZE) != 0)
+    {
+        poli_log(ERROR, NULL, "Couldn't find the power pmu at %s: %s", PERF_POWER_PMU, strerror(errno));
+        return NULL;
+    }
+    int type = atoi(buf);
+
+    //the pmu's cpumask has one cpu of each package
+    int cpus[MAX_PACKAGES];
+    int num_cpus = 0;
+    if (read_pmu_file("cpumask", buf, BUFSIZE) == 0)
+        num_cpus = parse_cpumask(buf, cpus, MAX_PACKAGES);
+    if (num_cpus == 0)
+    {
+        poli_log(ERROR, NULL, "Couldn't get the cpus of the power pmu");
+        return NULL;
+    }
+
+    struct perf_rapl_info *pr = calloc(1, sizeof(struct perf_rapl_info));
+    if (pr == NULL)
+        return NULL;
+
+    int package, zone, num_opened = 0;
+    for (package = 0; package < num_cpus; package++)
+    {
+        struct perf_rapl_package *pp = &pr->packages[package];
+        pp->cpu = cpus[package];
+        pp->group_fd = -1;
+
+        for (zone = 0; zone < NUM_RAPL_DOMAINS; zone++)
+        {
+            char file[BUFSIZE];
+            unsigned int config;
+            //the platform counts the whole system
+            if (zone == 3 && package > 0)
+                continue;
+            snprintf(file, BUFSIZE, "events/%s", event_names[zone]);
+            if (read_pmu_file(file, buf, BUFSIZE) != 0 || sscanf(buf, "event=%x", &config) != 1)
+                continue;
+            snprintf(file, BUFSIZE, "events/%s.scale", event_names[zone]);
+            if (read_pmu_file(file, buf, BUFSIZE) != 0)
+                continue;
+            double scale = atof(buf);
+
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(struct perf_event_attr));
+            attr.type = type;
+            attr.size = sizeof(struct perf_event_attr);
+            attr.config = config;
+            attr.read_format = PERF_FORMAT_GROUP;
+
+            int fd = syscall(__NR_perf_event_open, &attr, -1, pp->cpu, pp->group_fd, 0);
+            if (fd < 0)
+            {
+                poli_log(DEBUG, NULL, "%s: Couldn't open %s on cpu %d: %s", __FUNCTION__, event_names[zone], pp->cpu, strerror(errno));
+                continue;
+            }
+            if (pp->group_fd < 0)
+                pp->group_fd = fd;
+            pp->fds[pp->num_events] = fd;
+            pp->zones[pp->num_events] = zone;
+            pp->scales[pp->num_events] = scale;
+            pp->num_events++;
+            num_opened++;
+        }
+    }
+    pr->num_packages = num_cpus;
+
+    if (num_opened == 0)
+    {
+        poli_log(ERROR, NULL, "Couldn't open any event of the power pmu. Check perf_event_paranoid.");
+        finalize_perf_rapl(pr);
+        return NULL;
+    }
+
+    poli_log(DEBUG, NULL, "Reading RAPL of %d packages through perf_event", pr->num_packages);
+    poli_log(TRACE, NULL, "Finishing %s", __FUNCTION__);
+
+    return pr;
+}
+
+void finalize_perf_rapl (struct perf_rapl_info *pr)
+{
+    if (pr == NULL)
+        return;
+    int package, event;
+    for (package = 0; package < pr->num_packages; package++)
+        for (event = 0; event < pr->packages[package].num_events; event++)
+            close(pr->packages[package].fds[event]);
+    free(pr);
+}
+
+/* read_pmu_file - reads file of the power pmu into buf
+   returns: 0 if successful, else 1*/
+static int read_pmu_file (char *file, char *buf, int len)
+{
+    char filename[BUFSIZE];
+    snprintf(filename, BUFSIZE, "%s/%s", PERF_POWER_PMU, file);
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return 1;
+    ssize_t n = read(fd, buf, len - 1);
+    close(fd);
+    if (n <= 0)
+        return 1;
+    buf[n] = '\0';
+    return 0;
+}
+
+/* parse_cpumask - parses a cpu list such as 0,24 or 0-1 into cpus
+   returns: the number of cpus*/
+static int parse_cpumask (char *mask, int *cpus, int max_cpus)
+{
+    int num_cpus = 0;
+    char *token = strtok(mask, ",\n");
+    while (token != NULL && num_cpus < max_cpus)
+    {
+        int first, last;
+        int n = sscanf(token, "%d-%d", &first, &last);
+        if (n == 1)
+            last = first;
+        for (; n >= 1 && first <= last && num_cpus < max_cpus; first++)
+            cpus[num_cpus++] = first;
+        token = strtok(NULL, ",\n");
+    }
+    return num_cpus;
+}
+
+/* read_groups - reads the group of each package, one read each, into values in the order of its events
+   returns: 0 if all of them were read, else 1*/
+static int read_groups (uint64_t values[][NUM_RAPL_DOMAINS], struct perf_rapl_info *pr)
+{
+    int package, ret = 0;
+    for (package = 0; package < pr->num_packages; package++)
+    {
+        struct perf_rapl_package *pp = &pr->packages[package];
+        uint64_t buf[1 + NUM_RAPL_DOMAINS];
+        if (pp->group_fd < 0)
+            continue;
+        ssize_t size = (1 + pp->num_events) * sizeof(uint64_t);
+        if (read(pp->group_fd, buf, size) != size || buf[0] != (uint64_t) pp->num_events)
+        {
+            poli_log(ERROR, NULL, "%s: Couldn't read the power events of cpu %d: %s", __FUNCTION__, pp->cpu, strerror(errno));
+            ret = 1;
+            continue;
+        }
+        memcpy(values[package], &buf[1], pp->num_events * sizeof(uint64_t));
+    }
+    return ret;
+}
+
+int perf_rapl_read_energy (struct rapl_energy *re, struct rapl_energy *package_energy, struct perf_rapl_info *pr)
+{
+    int package, event;
+    uint64_t values[MAX_PACKAGES][NUM_RAPL_DOMAINS];
+    double zones[MAX_PACKAGES + 1][NUM_RAPL_DOMAINS] = {{0}}; //the packages, then the node
+
+    //a group which couldn't be read keeps its last values
+    for (package = 0; package < pr->num_packages; package++)
+        memcpy(values[package], pr->packages[package].last_values, sizeof(values[package]));
+    read_groups(values, pr);
+
+    for (package = 0; package < pr->num_packages; package++)
+    {
+        struct perf_rapl_package *pp = &pr->packages[package];
+        memcpy(pp->last_values, values[package], sizeof(values[package]));
+        for (event = 0; event < pp->num_events; event++)
+        {
+            double energy = values[package][event] * pp->scales[event];
+            zones[package][pp->zones[event]] += energy;
+            zones[MAX_PACKAGES][pp->zones[event]] += energy;
+        }
+    }
+
+    set_zone_energies(re, zones[MAX_PACKAGES]);
+    for (package = 0; package_energy && package < MAX_RECORDED_PACKAGES; package++)
+        set_zone_energies(&package_energy[package], zones[package]);
+
+    return 0;
+}
+
+int perf_rapl_read_raw_energy (uint32_t *counters, double *units, struct perf_rapl_info *pr)
+{
+    int package, event;
+    uint64_t values[MAX_PACKAGES][NUM_RAPL_DOMAINS];
+    memset(counters, 0, pr->num_packages * NUM_RAPL_DOMAINS * sizeof(uint32_t));
+    if (units)
+        memset(units, 0, pr->num_packages * NUM_RAPL_DOMAINS * sizeof(double));
+
+    if (read_groups(values, pr) != 0)
+        return 0;
+
+    //the events count in units of 2^-32 J, which would wrap 32 bits many times a second
+    for (package = 0; package < pr->num_packages; package++)
+    {
+        struct perf_rapl_package *pp = &pr->packages[package];
+        for (event = 0; event < pp->num_events; event++)
+        {
+            counters[package * NUM_RAPL_DOMAINS + pp->zones[event]] = (uint32_t) (uint64_t) (values[package][event] * pp->scales[event] / PERF_RAW_UNIT);
+            if (units)
+                units[package * NUM_RAPL_DOMAINS + pp->zones[event]] = PERF_RAW_UNIT;
+        }
+    }
+    return pr->num_packages * NUM_RAPL_DOMAINS;
+}
+
+static void set_zone_energies (struct rapl_energy *re, double *zones)
+{
+    re->package = zones[0];
+    re->pp0 = zones[1];
+    re->pp1 = zones[2];
+    re->platform = zones[3];
+    re->dram = zones[4];
+}
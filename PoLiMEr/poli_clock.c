@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <sys/time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define HAVE_TSC
+#endif
+
+#include "poli_clock.h"
+
+// Seconds the time stamp counter is calibrated for
+#define CLOCK_CALIBRATION 0.02
+
+static int tsc_on = 0;
+static uint64_t tsc_base = 0;
+static double tsc_base_time = 0.0; //monotonic time at tsc_base
+static double tsc_period = 0.0; //seconds per tick
+static double wall_offset = 0.0; //wall time minus monotonic time
+
+static double monotonic_now (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#ifdef HAVE_TSC
+static int has_invariant_tsc (void)
+{
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (__get_cpuid_max(0x80000000, NULL) < 0x80000007)
+        return 0;
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+        return 0;
+    return (edx >> 8) & 1;
+}
+
+static uint64_t read_tsc (void)
+{
+    unsigned int aux;
+    return __rdtscp(&aux);
+}
+
+/* reads the counter between two monotonic reads, keeping the tightest of a few tries*/
+static void read_tsc_pair (uint64_t *tsc, double *time)
+{
+    double best_window = -1;
+    int i;
+    for (i = 0; i < 5; i++)
+    {
+        double before = monotonic_now();
+        uint64_t ticks = read_tsc();
+        double after = monotonic_now();
+        if (best_window < 0 || after - before < best_window)
+        {
+            best_window = after - before;
+            *tsc = ticks;
+            *time = (before + after) / 2;
+        }
+    }
+}
+#endif
+
+int init_clock (int use_tsc)
+{
+    tsc_on = 0;
+#ifdef HAVE_TSC
+    if (use_tsc && has_invariant_tsc())
+    {
+        uint64_t start_tsc, end_tsc;
+        double start_time, end_time;
+        read_tsc_pair(&start_tsc, &start_time);
+        while (monotonic_now() - start_time < CLOCK_CALIBRATION)
+            ;
+        read_tsc_pair(&end_tsc, &end_time);
+        if (end_tsc > start_tsc)
+        {
+            tsc_period = (end_time - start_time) / (double) (end_tsc - start_tsc);
+            tsc_base = end_tsc;
+            tsc_base_time = end_time;
+            tsc_on = 1;
+        }
+    }
+#endif
+    struct timespec wall;
+    double now = monotonic_now();
+    clock_gettime(CLOCK_REALTIME, &wall);
+    wall_offset = (wall.tv_sec + wall.tv_nsec * 1e-9) - now;
+    return tsc_on;
+}
+
+double get_time (void)
+{
+#ifdef HAVE_TSC
+    if (tsc_on)
+        return tsc_base_time + (double) (int64_t) (read_tsc() - tsc_base) * tsc_period;
+#endif
+    return monotonic_now();
+}
+
+void get_clock_calibration (struct clock_calibration *calibration)
+{
+    calibration->tsc_on = tsc_on;
+    calibration->tsc_base = tsc_base;
+    calibration->tsc_base_time = tsc_base_time;
+    calibration->tsc_period = tsc_period;
+}
+
+void set_clock_calibration (struct clock_calibration *calibration)
+{
+#ifdef HAVE_TSC
+    tsc_on = calibration->tsc_on;
+    tsc_base = calibration->tsc_base;
+    tsc_base_time = calibration->tsc_base_time;
+    tsc_period = calibration->tsc_period;
+#else
+    (void) calibration;
+#endif
+}
+
+double clock_to_wall (double wtime)
+{
+    return wtime + wall_offset;
+}
+
+void clock_to_timeval (double wtime, struct timeval *tv)
+{
+    double intpart;
+    double frac = modf(clock_to_wall(wtime), &intpart);
+    tv->tv_sec = (time_t) intpart;
+    tv->tv_usec = (suseconds_t) (frac * 1e6);
+}
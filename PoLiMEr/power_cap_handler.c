@@ -19,6 +19,7 @@
 //#include "PoLiMEr.h"
 #include "power_cap_handler.h"
 #include "helpers.h"
+#include "output.h"
 
 #ifdef _MSR
 #include "msr_handler.h"
@@ -34,6 +35,7 @@ static int init_pcap_tag (char *zone, double watts_long, double watts_short, dou
     double seconds_short, pcap_flag_t pcap_flag, struct system_info_t * system_info,
     struct monitor_t * monitor, struct poller_t * poller);
 static int get_system_power_cap_for_zone (int zone_index, struct system_info_t * system_info, struct monitor_t * monitor);
+static void log_pcap_event (int zone_index, struct system_info_t * system_info, struct monitor_t * monitor);
 
 int get_zone_index (char *zone_name, char * zone_names[], int zone_names_len[], struct system_info_t * system_info)
 {
@@ -64,7 +66,12 @@ static int init_pcap_tag (char *zone, double watts_long, double watts_short, dou
             return 1;
         }
 
-        struct pcap_tag *new_pcap_tag = &system_info->pcap_tag_list[system_info->num_pcap_tags];
+        struct pcap_tag *new_pcap_tag = arena_at(&system_info->pcap_tag_list, system_info->num_pcap_tags);
+        if (new_pcap_tag == NULL)
+        {
+            poli_log(ERROR, monitor, "%s: Failed to allocate power cap tag", __FUNCTION__);
+            return 1;
+        }
 
         new_pcap_tag->id = system_info->num_pcap_tags;
         new_pcap_tag->monitor_id = monitor->color;
@@ -79,25 +86,40 @@ static int init_pcap_tag (char *zone, double watts_long, double watts_short, dou
         new_pcap_tag->seconds_short = seconds_short;
 
         new_pcap_tag->wtime = get_time();
-        gettimeofday(&(new_pcap_tag->timestamp), NULL);
 
-        new_pcap_tag->start_timer_count = poller->time_counter;
+        new_pcap_tag->start_timer_count = __atomic_load_n(&poller->time_counter, __ATOMIC_ACQUIRE);
         new_pcap_tag->pcap_flag = pcap_flag;
 
-        int found_num = 0;
-        int tag_num;
-
-        for (tag_num = 0; tag_num < system_info->num_poli_tags; tag_num++)
+        /* remember which tags are open, names are resolved when writing the output */
+        int num_open = system_info->num_open_tag_ids;
+        if (system_info->active_tag_pool_len + num_open > system_info->active_tag_pool_size)
         {
-            struct poli_tag current_poli_tag = system_info->poli_tag_list[tag_num];
-            if (current_poli_tag.closed == 0)
+            int new_size = 2 * system_info->active_tag_pool_size;
+            if (new_size < system_info->active_tag_pool_len + num_open)
+                new_size = system_info->active_tag_pool_len + num_open;
+            if (new_size < OPEN_TAGS_INITIAL)
+                new_size = OPEN_TAGS_INITIAL;
+            int *pool = realloc(system_info->active_tag_pool, new_size * sizeof(int));
+            if (pool == NULL)
             {
-                new_pcap_tag->active_poli_tags[found_num] = current_poli_tag;
-                found_num++;
+                poli_log(ERROR, monitor, "%s: Failed to grow active tag list. Active tags will not be recorded for this power cap tag", __FUNCTION__);
+                num_open = 0;
+            }
+            else
+            {
+                system_info->active_tag_pool = pool;
+                system_info->active_tag_pool_size = new_size;
             }
         }
 
-        new_pcap_tag->num_active_poli_tags = found_num;
+        new_pcap_tag->active_tags_offset = system_info->active_tag_pool_len;
+        if (num_open > 0)
+            memcpy(&system_info->active_tag_pool[new_pcap_tag->active_tags_offset], system_info->open_tag_ids, num_open * sizeof(int));
+        system_info->active_tag_pool_len += num_open;
+        new_pcap_tag->num_active_poli_tags = num_open;
+#ifndef _TIMER_OFF
+        push_poll_marker(PCAP_MARKER, new_pcap_tag->id, system_info, poller);
+#endif
 
         system_info->num_pcap_tags++;
 
@@ -122,9 +144,10 @@ int set_power_cap (double watts, struct system_info_t * system_info,
     if (poli_config->cap_short_window)
         return set_power_cap_with_params(zone_names[PACKAGE_INDEX], watts, watts,
         DEFAULT_SECONDS_LONG, DEFAULT_SECONDS_SHORT, system_info, monitor, poller);
-    else
-        return set_power_cap_with_params(zone_names[PACKAGE_INDEX], watts, DEFAULT_SHORT,
-            DEFAULT_SECONDS_LONG, DEFAULT_SECONDS_SHORT, system_info, monitor, poller);
+    //the default is per package, caps are per node. only the monitor knows the packages
+    double watts_short = monitor->imonitor ? DEFAULT_SHORT * rapl_num_packages(system_info) : DEFAULT_SHORT;
+    return set_power_cap_with_params(zone_names[PACKAGE_INDEX], watts, watts_short,
+        DEFAULT_SECONDS_LONG, DEFAULT_SECONDS_SHORT, system_info, monitor, poller);
 #else
     return 0;
 #endif
@@ -189,6 +212,7 @@ int set_power_cap_with_params(char *zone_name, double watts_long, double watts_s
         info->watts_short = watts_short;
         info->seconds_long = seconds_long;
         info->seconds_short = seconds_short;
+        log_pcap_event(i, system_info, monitor);
 
         poli_log(TRACE, monitor, "Finishing %s", __FUNCTION__);
     }
@@ -205,7 +229,9 @@ int reset_system (struct system_info_t * system_info, struct monitor_t * monitor
 
         //if (rapl_set_power_cap("PACKAGE", (double) DEFAULT_PKG_POW, (double) DEFAULT_SHORT, (double) DEFAULT_SECONDS_LONG, (double) DEFAULT_SECONDS_SHORT, system_info, 1) ||
         //    rapl_set_power_cap("CORE", (double) DEFAULT_CORE_POW, 0, (double) DEFAULT_CORE_SECONDS, 0, system_info, 0))
-        if (rapl_set_power_cap("PACKAGE", (double) DEFAULT_PKG_POW, (double) DEFAULT_SHORT, (double) DEFAULT_SECONDS_LONG, (double) DEFAULT_SECONDS_SHORT, system_info, 1))
+        //the defaults are per package, caps are per node
+        double num_packages = (double) rapl_num_packages(system_info);
+        if (rapl_set_power_cap("PACKAGE", DEFAULT_PKG_POW * num_packages, DEFAULT_SHORT * num_packages, (double) DEFAULT_SECONDS_LONG, (double) DEFAULT_SECONDS_SHORT, system_info, 1))
         {
             poli_log(ERROR, monitor,   "%s: Something went wrong with setting power caps. Returning...\n", __FUNCTION__);
             return 1;
@@ -214,7 +240,7 @@ int reset_system (struct system_info_t * system_info, struct monitor_t * monitor
         /* Set up new pcap tags to indicate change in power caps */
         //if (init_pcap_tag("PACKAGE", (double) DEFAULT_PKG_POW, (double) DEFAULT_SHORT, (double) DEFAULT_SECONDS_LONG, (double) DEFAULT_SECONDS_SHORT, SYSTEM_RESET) != 0 ||
         //   init_pcap_tag("CORE", (double) DEFAULT_CORE_POW, 0, (double) DEFAULT_SECONDS_LONG, 0, SYSTEM_RESET) != 0)
-        if (init_pcap_tag("PACKAGE", (double) DEFAULT_PKG_POW, (double) DEFAULT_SHORT, 
+        if (init_pcap_tag("PACKAGE", DEFAULT_PKG_POW * num_packages, DEFAULT_SHORT * num_packages,
             (double) DEFAULT_SECONDS_LONG, (double) DEFAULT_SECONDS_SHORT, SYSTEM_RESET,
             system_info, monitor, poller) != 0)
         {
@@ -342,11 +368,36 @@ static int get_system_power_cap_for_zone (int zone_index, struct system_info_t *
         info->enabled_short = pcap.enabled_short;
         info->clamped_long = pcap.clamped_long;
         info->clamped_short = pcap.clamped_short;
+        log_pcap_event(zone_index, system_info, monitor);
     }
 #endif
     return 0;
 }
 
+/* log_pcap_event - appends the current power cap of a zone to the power cap journal.
+   poll samples only keep the journal length, the polling writer replays the journal to get the caps*/
+static void log_pcap_event (int zone_index, struct system_info_t * system_info, struct monitor_t * monitor)
+{
+    int n = system_info->num_pcap_events;
+    struct pcap_event *event = arena_at(&system_info->pcap_journal, n);
+    if (event == NULL)
+    {
+        poli_log(ERROR, monitor, "Failed to grow the power cap journal. This power cap change will not show up in the polling output");
+        return;
+    }
+
+    struct pcap_info *info = &system_info->current_pcap_list[zone_index];
+    event->wtime = get_time();
+    event->zone = zone_index;
+    event->watts_long = info->watts_long;
+    event->watts_short = info->watts_short;
+    event->seconds_long = info->seconds_long;
+    event->seconds_short = info->seconds_short;
+
+    //publish only once the entry is complete, the sampler references it
+    __atomic_store_n(&system_info->num_pcap_events, n + 1, __ATOMIC_RELEASE);
+}
+
 int get_system_power_caps (struct system_info_t * system_info, struct monitor_t * monitor)
 {
 #ifdef _MSR
@@ -9,6 +9,8 @@
 #include "power_manager.h"
 #include "helpers.h"
 #include "output.h"
+#include "online_stats.h"
+#include "stats_kernels.h"
 
 struct power_manager_t *power_manager = 0;
 MPI_Comm SA_allcomm;
@@ -17,10 +19,7 @@ double *last_sync_runtimes;
 double *current_runtimes;
 
 static void get_past_time_and_power (struct system_info_t * system_info, double * time, double * power);
-static void get_past_power_from_poller(struct system_info_t * system_info, double *time, double *power, int use_average, int use_median, int use_max);
-static double torben(double m[], int n);
-static double median (int n, double x[], int * position);
-static void median_energy (int n, uint64_t x[], int * position);
+static void get_past_power_from_poller(struct system_info_t * system_info, double *time, double *power, int use_median, int use_max);
 static void record_allocated_time (struct system_info_t * system_info, struct monitor_t * monitor);
 static void max_power_policy (struct system_info_t * system_info, double * time, double * power);
 static void median_policy (struct system_info_t * system_info, double * time, double * power);
@@ -61,12 +60,15 @@ void init_power_manager (struct system_info_t * system_info, struct monitor_t *
         power_manager->delta = START_DELTA;
     power_manager->target_met = 0;
     set_pm_algorithm(1, 0, 0);
+    if (monitor->imonitor) //over and close to 300 is unrealistic so such poll samples are not plausible
+        init_power_window(&system_info->power_window, 0.3 * system_info->power_info.package_minimum_power, 1.3 * system_info->power_info.package_maximum_power);
     last_sync_runtimes[monitor->node_rank] = power_manager->last_sync_time;
     if (monitor->imonitor)
     {
-        power_manager->logs = calloc(MAX_PM_LOGS, sizeof(struct pm_log_t));
+        power_manager->logs = malloc(sizeof(struct chunked_arena));
+        arena_init(power_manager->logs, sizeof(struct pm_log_t));
         power_manager->last_sync_time = system_info->initial_mpi_wtime;
-        struct power_manager_t *palloc_entry = &system_info->palloc_list[0];
+        struct power_manager_t *palloc_entry = arena_at(&system_info->palloc_list, 0);
         palloc_entry->count = power_manager->count;
         palloc_entry->my_last_sync_time = system_info->initial_mpi_wtime;
         palloc_entry->last_sync_time = power_manager->last_sync_time;
@@ -80,135 +82,122 @@ void init_power_manager (struct system_info_t * system_info, struct monitor_t *
     }
 }
 
-static void median_policy (struct system_info_t * system_info, double * time, double * power)
+/* gathers key, time and power of the syncs first to last whose key is nonzero, with the time and power of the sync
+   or the poll average if poll_average is set. key is 0 for the time, 1 for the energy and 2 for the poll energy
+   returns: the number of syncs gathered*/
+static int gather_sync_window (struct system_info_t * system_info, int first, int last, int key, int poll_average,
+    double * keys, double * times, double * powers)
 {
-    double times[power_manager->freq], powers[power_manager->freq];
     int count = 0;
     int i;
-    for (i = power_manager->count - (power_manager->freq) + 1; i <= power_manager->count; i++)
+    for (i = first; i <= last; i++)
     {
-        struct power_manager_t *palloc_entry = &system_info->palloc_list[i];
+        struct power_manager_t *palloc_entry = arena_at(&system_info->palloc_list, i);
+        if (palloc_entry == NULL)
+            continue;
         double total_time = (palloc_entry->current_time - palloc_entry->last_sync_time);
-        if (total_time)
+        double value = total_time;
+        if (key == 1)
+            value = palloc_entry->total_energy.rapl_energy.package;
+        else if (key == 2)
+            value = palloc_entry->average_poll_energy;
+        if (value)
         {
+            keys[count] = value;
             times[count] = total_time;
-            powers[count] = palloc_entry->total_power.rapl_power.package;
+            powers[count] = poll_average ? palloc_entry->average_poll_power : palloc_entry->total_power.rapl_power.package;
             count++;
         }
     }
-
-    int position;
-    *time = median(count, times, &position); //torben(times, count);
-    *power = powers[position];
+    return count;
 }
 
-static void median_energy_policy (struct system_info_t * system_info, double * time, double * power)
+/* picks time and power of the sync at index of the gathered window, zeros if there is none*/
+static void pick_sync (long index, double * times, double * powers, double * time, double * power)
 {
-    double energy_list[power_manager->freq];
-    double times[power_manager->freq], powers[power_manager->freq];
-    int count = 0;
-    int i;
-    for (i = power_manager->count - (power_manager->freq + 1); i <= power_manager->count; i++)
+    if (index < 0)
     {
-        struct power_manager_t *palloc_entry = &system_info->palloc_list[i];
-        double total_energy = palloc_entry->total_energy.rapl_energy.package;
-        if (total_energy)
-        {
-            energy_list[count] = total_energy;
-            times[count] = (palloc_entry->current_time - palloc_entry->last_sync_time);
-            powers[count] = palloc_entry->total_power.rapl_power.package;
-            count++;
-        }
+        *time = 0.0;
+        *power = 0.0;
+        return;
     }
+    *time = times[index];
+    *power = powers[index];
+}
 
-    int position;
-    median(count, energy_list, &position); //torben(times, count);
-    *time = times[position];
-    *power = powers[position];
+static void median_policy (struct system_info_t * system_info, double * time, double * power)
+{
+    int first = power_manager->count - power_manager->freq + 1;
+    int len = power_manager->count - first + 1;
+    double keys[len], times[len], powers[len];
+    int count = gather_sync_window(system_info, first, power_manager->count, 0, 0, keys, times, powers);
+    pick_sync(stats_median_index(keys, count), times, powers, time, power);
 }
 
-static void median_energy_from_poll_averages_policy (struct system_info_t * system_info, double * time, double * power)
+static void median_energy_policy (struct system_info_t * system_info, double * time, double * power)
 {
-    double energy_list[power_manager->freq];
-    double times[power_manager->freq], powers[power_manager->freq];
-    int count = 0;
-    int i;
-    for (i = power_manager->count - (power_manager->freq + 1); i <= power_manager->count; i++)
-    {
-        struct power_manager_t *palloc_entry = &system_info->palloc_list[i];
-        if (palloc_entry->average_poll_energy)
-        {
-            energy_list[count] = palloc_entry->average_poll_energy;
-            times[count] = (palloc_entry->current_time - palloc_entry->last_sync_time);
-            powers[count] = palloc_entry->average_poll_power;
-            count++;
-        }
-    }
+    int first = power_manager->count - (power_manager->freq + 1);
+    if (first < 0) //the first window has one sync less
+        first = 0;
+    int len = power_manager->count - first + 1;
+    double keys[len], times[len], powers[len];
+    int count = gather_sync_window(system_info, first, power_manager->count, 1, 0, keys, times, powers);
+    pick_sync(stats_median_index(keys, count), times, powers, time, power);
+}
 
-    int position;
-    median(count, energy_list, &position); //torben(times, count);
-    *time = times[position];
-    *power = powers[position];
+static void median_energy_from_poll_averages_policy (struct system_info_t * system_info, double * time, double * power)
+{
+    int first = power_manager->count - (power_manager->freq + 1);
+    if (first < 0) //the first window has one sync less
+        first = 0;
+    int len = power_manager->count - first + 1;
+    double keys[len], times[len], powers[len];
+    int count = gather_sync_window(system_info, first, power_manager->count, 2, 1, keys, times, powers);
+    pick_sync(stats_median_index(keys, count), times, powers, time, power);
 }
 
 static void max_power_policy (struct system_info_t * system_info, double * time, double * power)
 {
-    struct power_manager_t *first = &system_info->palloc_list[power_manager->count - power_manager->freq];
-    struct power_manager_t *second = &system_info->palloc_list[power_manager->count - 1];
-    double max_power = first->total_power.rapl_power.package;
-    if (second->total_power.rapl_power.package > max_power)
-    {
-        *time = second->current_time - second->last_sync_time;
-        *power = second->total_power.rapl_power.package;
-    }
-    else
-    {   
-        *time = first->current_time - first->last_sync_time;
-        *power = first->total_power.rapl_power.package;
-    }
+    int first = power_manager->count - power_manager->freq;
+    int len = power_manager->freq;
+    double keys[len], times[len], powers[len];
+    int count = gather_sync_window(system_info, first, power_manager->count - 1, 0, 0, keys, times, powers);
+    pick_sync(stats_max_index(powers, count), times, powers, time, power);
 }
 
 static void max_energy_policy (struct system_info_t * system_info, double * time, double * power)
 {
-    struct power_manager_t *first = &system_info->palloc_list[power_manager->count - power_manager->freq];
-    struct power_manager_t *second = &system_info->palloc_list[power_manager->count - 1];
-    double max_energy = first->total_energy.rapl_energy.package;
-    if (second->total_energy.rapl_energy.package > max_energy)
-    {
-        *time = second->current_time - second->last_sync_time;
-        *power = second->total_power.rapl_power.package;
-    }
-    else
-    {   
-        *time = first->current_time - first->last_sync_time;
-        *power = first->total_power.rapl_power.package;
-    }
+    int first = power_manager->count - power_manager->freq;
+    int len = power_manager->freq;
+    double keys[len], times[len], powers[len];
+    int count = gather_sync_window(system_info, first, power_manager->count - 1, 1, 0, keys, times, powers);
+    pick_sync(stats_max_index(keys, count), times, powers, time, power);
 }
 
 static void last_sync_poller_average (struct system_info_t * system_info, double * time, double * power)
 {
-    struct power_manager_t *palloc_entry = &system_info->palloc_list[power_manager->count];
+    struct power_manager_t *palloc_entry = arena_at(&system_info->palloc_list, power_manager->count);
     *time = palloc_entry->current_time - palloc_entry->last_sync_time;
     *power = palloc_entry->average_poll_power;
 }
 
 static void last_sync_poller_median (struct system_info_t * system_info, double * time, double * power)
 {
-    struct power_manager_t *palloc_entry = &system_info->palloc_list[power_manager->count];
+    struct power_manager_t *palloc_entry = arena_at(&system_info->palloc_list, power_manager->count);
     *time = palloc_entry->current_time - palloc_entry->last_sync_time;
     *power = palloc_entry->median_poll_power;
 }
 
 static void last_sync_poller_max (struct system_info_t * system_info, double * time, double * power)
 {
-    struct power_manager_t *palloc_entry = &system_info->palloc_list[power_manager->count];
+    struct power_manager_t *palloc_entry = arena_at(&system_info->palloc_list, power_manager->count);
     *time = palloc_entry->current_time - palloc_entry->last_sync_time;
     *power = palloc_entry->max_poll_power;
 }
 
 static void last_sync_poller_total (struct system_info_t * system_info, double * time, double * power)
 {
-    struct power_manager_t *palloc_entry = &system_info->palloc_list[power_manager->count];
+    struct power_manager_t *palloc_entry = arena_at(&system_info->palloc_list, power_manager->count);
     *time = palloc_entry->current_time - palloc_entry->last_sync_time;
     *power = palloc_entry->total_poll_power.package;
 }
@@ -216,7 +205,7 @@ static void last_sync_poller_total (struct system_info_t * system_info, double *
 
 static void last_sync_power (struct system_info_t * system_info, double * time, double * power)
 {
-    struct power_manager_t *palloc_entry = &system_info->palloc_list[power_manager->count];
+    struct power_manager_t *palloc_entry = arena_at(&system_info->palloc_list, power_manager->count);
     *time = palloc_entry->current_time - palloc_entry->last_sync_time;
     *power = palloc_entry->total_power.rapl_power.package;
 }
@@ -228,51 +217,22 @@ static void average_sync_measurement_policy (double * time, double * power)
     *power = power_manager->power_sum / (double) power_manager->freq;
 }
 
-static void get_past_power_from_poller(struct system_info_t * system_info, double *time, double *power, int use_average, int use_median, int use_max)
+/* the mean poll power of the last sync window, or its median or maximum*/
+static void get_past_power_from_poller(struct system_info_t * system_info, double *time, double *power, int use_median, int use_max)
 {
-    struct power_manager_t *palloc_entry = &system_info->palloc_list[power_manager->count];
+    struct power_manager_t *palloc_entry = arena_at(&system_info->palloc_list, power_manager->count);
     *time = palloc_entry->current_time - palloc_entry->last_sync_time;
 
-    int num_poller_entries = power_manager->sync_begin - power_manager->last_sync + 1;
-    if (num_poller_entries == 0)
-    {
+    //kept by the sampler as it polled, without the implausible samples
+    struct online_stats *stats = &palloc_entry->poll_stats.plausible;
+    if (stats->count == 0)
         *power = 0.0;
-        return;
-    }
-    double max_power = 0.0;
-    double power_sum = 0.0;
-    double powers[num_poller_entries];
-    int i;
-    int count = 0;
-    for (i = power_manager->last_sync; i <= power_manager->sync_begin; i++)
-    {
-        double current_power = system_info->system_poll_list[i].computed_power.rapl_power.package;
-        if (current_power > 0.3 * system_info->power_info.package_minimum_power && current_power < 1.3 * system_info->power_info.package_maximum_power) //over and close to 300 is unrealistic so skip it
-        {
-            if (current_power >= max_power)
-                max_power = current_power;
-            power_sum += current_power;
-            powers[count] = current_power;
-            count++;
-        }
-        //else
-        //    num_poller_entries--;
-
-        //if (num_poller_entries > 0)
-        //    max_power = power_sum / (double) (num_poller_entries - (start - power_manager->last_sync));
-    }
-    if (use_average)
-        *power = power_sum / (double) count;
     else if (use_median)
-    {
-        int position;
-        *power = median(count, powers, &position);
-    }
+        *power = p2_quantile_value(&stats->median);
     else if (use_max)
-        *power = max_power;
+        *power = stats->max;
     else
-        *power = power_sum / (double) count;
-        
+        *power = stats->mean;
 }
 
 static void default_policy (struct system_info_t * system_info, double * time, double * power)
@@ -298,11 +258,11 @@ static void get_past_time_and_power (struct system_info_t * system_info, double
     else if (strcmp(power_manager->policy, "AVERAGE_SYNC_MEASUREMENTS") == 0)
         average_sync_measurement_policy(time, power);
     else if (strcmp(power_manager->policy, "AVERAGE_POLL_POWER") == 0)
-        get_past_power_from_poller(system_info, time, power, 1, 0, 0);
+        get_past_power_from_poller(system_info, time, power, 0, 0);
     else if (strcmp(power_manager->policy, "MAX_POLL_POWER") == 0)
-        get_past_power_from_poller(system_info, time, power, 0, 0, 1);
+        get_past_power_from_poller(system_info, time, power, 0, 1);
     else if (strcmp(power_manager->policy, "MEDIAN_POLL_POWER") == 0)
-        get_past_power_from_poller(system_info, time, power, 0, 1, 0);
+        get_past_power_from_poller(system_info, time, power, 1, 0);
     else if (strcmp(power_manager->policy, "MAX_ENERGY") == 0)
         max_energy_policy(system_info, time, power);
     else if (strcmp(power_manager->policy, "MEDIAN_ENERGY") == 0)
@@ -452,7 +412,7 @@ int SeeSAw(double power_cap, struct system_info_t * system_info, struct monitor_
             end_time - system_info->initial_mpi_wtime, 
             measured_time, max_power_sa_nodes);
 
-        struct pm_log_t *log = &power_manager->logs[power_manager->log_count];
+        struct pm_log_t *log = arena_at(power_manager->logs, power_manager->log_count);
         log->palloc_count = system_info->palloc_count;
         log->pm_count = power_manager->count;
         log->my_alpha = my_alpha;
@@ -591,7 +551,7 @@ int SLURMLike (double power_cap, struct system_info_t * system_info, struct moni
                 power_manager->new_power_node = my_power_cap;
         }
 
-        struct pm_log_t *log = &power_manager->logs[power_manager->log_count];
+        struct pm_log_t *log = arena_at(power_manager->logs, power_manager->log_count);
         log->palloc_count = system_info->palloc_count;
         log->pm_count = power_manager->count;
         log->world_rank = monitor->world_rank;
@@ -641,7 +601,8 @@ int GEOPMLike (double power_cap, struct system_info_t * system_info, struct moni
             send_buff[i] = 0.0;
         send_buff[monitor->node_rank] = current_runtimes[monitor->node_rank] - last_sync_runtimes[monitor->node_rank];
         MPI_Allreduce(&send_buff, &receive_buff, monitor->node_size, MPI_DOUBLE, MPI_SUM, monitor->mynode_comm);
-        median_node_runtime = median(monitor->node_size, receive_buff, &median_runtime_rank);
+        median_runtime_rank = (int) stats_median_index(receive_buff, monitor->node_size);
+        median_node_runtime = receive_buff[median_runtime_rank];
         MPI_Allreduce(&median_node_runtime, &longest_runtime, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
     }
 
@@ -722,7 +683,7 @@ int GEOPMLike (double power_cap, struct system_info_t * system_info, struct moni
         // if (power_manager->new_power_node > power_cap)
         //     power_manager->new_power_node = power_cap;
 
-        struct pm_log_t *log = &power_manager->logs[power_manager->log_count];
+        struct pm_log_t *log = arena_at(power_manager->logs, power_manager->log_count);
         log->palloc_count = system_info->palloc_count;
         log->pm_count = power_manager->count;
         log->world_rank = monitor->world_rank;
@@ -767,9 +728,9 @@ int allocate_power_min_collectives (double power_cap, struct system_info_t * sys
     if ((power_manager->count > 0 && power_manager->count % power_manager->freq != 0) || power_manager->count == 0)
         return ret;
 
-    int last_before_sync = poller->time_counter;
+    int last_before_sync = __atomic_load_n(&poller->time_counter, __ATOMIC_ACQUIRE);
     power_manager->current_time = get_time();
-    power_manager->current_energy = read_current_energy(system_info);
+    power_manager->current_energy = read_cached_energy(system_info, NULL);
 
     //poli_set_power_cap(power_cap); //want to make sure the sync period is also under power cap
 
@@ -798,9 +759,12 @@ int allocate_power_min_collectives (double power_cap, struct system_info_t * sys
     if (last_before_sync > power_manager->last_sync) //If enough time has passed use the poller information
     {
         int time;
+        struct system_poll_info info;
         for (time = power_manager->last_sync; time < last_before_sync; time++)
         {
-            double current_power = system_info->system_poll_list[time].computed_power.rapl_power.package;
+            if (get_poll_sample(system_info, time, &info) != 0)
+                continue; //no longer in the poll ring
+            double current_power = info.computed_power.rapl_power.package;
             if (current_power >= max_power)
                 max_power = current_power;
         }
@@ -1030,7 +994,7 @@ static void record_allocated_time (struct system_info_t * system_info, struct mo
         int log_count = power_manager->log_count;
         if (log_count > 0)
             log_count = log_count - 1;
-        struct pm_log_t *log = &power_manager->logs[log_count];
+        struct pm_log_t *log = arena_at(power_manager->logs, log_count);
         log->time_allocated = get_time();
         if (log->time_allocated >= system_info->initial_mpi_wtime)
             log->time_allocated = log->time_allocated - system_info->initial_mpi_wtime;
@@ -1065,22 +1029,19 @@ void sync_step_end(struct monitor_t * monitor, struct system_info_t * system_inf
             if (!power_manager->simulate)
                 poli_set_power_cap(power_manager->new_power_node);
         }
-        if (!power_manager->use_sync_window && power_manager->count + 1 < MAX_POLL_SAMPLES)
+        if (!power_manager->use_sync_window)
         {
             sync_end_measurements(system_info, monitor, poller);
             //MPI_Barrier(MPI_COMM_WORLD);
         }
     }
 
-    if (power_manager->count + 1 < MAX_POLL_SAMPLES)
+    if (power_manager->use_sync_window || power_manager->count == 0)
     {
-        if (power_manager->use_sync_window || power_manager->count == 0)
-        {
-            sync_end_measurements(system_info, monitor, poller);
-            //MPI_Barrier(MPI_COMM_WORLD);
-        }
-        power_manager->count++;
+        sync_end_measurements(system_info, monitor, poller);
+        //MPI_Barrier(MPI_COMM_WORLD);
     }
+    power_manager->count++;
 
     if (monitor->imonitor)
         poli_log(TRACE, monitor, " finished %s, count : %d, timestep: %d\n", __FUNCTION__, power_manager->count, power_manager->timestep);
@@ -1129,7 +1090,7 @@ void sync_start_measurements(struct system_info_t * system_info, struct monitor_
     int time_counter = -1;
     if (monitor->imonitor)
     {
-        time_counter = poller->time_counter;
+        time_counter = __atomic_load_n(&poller->time_counter, __ATOMIC_ACQUIRE);
         poli_log(TRACE, monitor, " %d entered %s, count : %d\n", monitor->world_rank, __FUNCTION__, power_manager->count);
     }
     double current_time, reduced_time_sa_nodes;
@@ -1142,11 +1103,12 @@ void sync_start_measurements(struct system_info_t * system_info, struct monitor_
 
     if (monitor->imonitor)
     {
-        palloc_entry = &system_info->palloc_list[count];
-        palloc_entry->current_energy = read_current_energy(system_info); //read energy now before waiting for allreduce
+        palloc_entry = arena_at(&system_info->palloc_list, count);
+        palloc_entry->current_energy = read_cached_energy(system_info, NULL); //read energy now before waiting for allreduce
 
         palloc_entry->my_current_time = current_time;
         palloc_entry->sync_begin = time_counter;
+        close_power_window(&system_info->power_window, &palloc_entry->poll_stats);
     }
 
     MPI_Allreduce(&current_time, &reduced_time_sa_nodes, 1, MPI_DOUBLE, MPI_MAX, SA_allcomm);
@@ -1174,7 +1136,7 @@ void sync_start_measurements(struct system_info_t * system_info, struct monitor_
             {
                 if (count > 0)
                 {
-                    struct power_manager_t *previous_entry = &system_info->palloc_list[count - 1];
+                    struct power_manager_t *previous_entry = arena_at(&system_info->palloc_list, count - 1);
                     palloc_entry->total_power = previous_entry->total_power;
                     palloc_entry->total_energy = previous_entry->total_energy;
                 }
@@ -1185,45 +1147,34 @@ void sync_start_measurements(struct system_info_t * system_info, struct monitor_
                 }
             }
 
-            int num_poller_entries = palloc_entry->sync_begin - palloc_entry->last_sync + 1;
-            double max_power = 0.0;
-            if (num_poller_entries > 0)
+            struct online_stats *stats = &palloc_entry->poll_stats.all;
+            if (stats->count > 0)
             {
-                
-                double poller_powers[num_poller_entries];
-                int i, position;
-                int count = 0;
-                double power_sum = 0.0;
-                for (i = palloc_entry->last_sync; i <= palloc_entry->sync_begin; i++)
-                {
-                    struct system_poll_info *info = &system_info->system_poll_list[i];
-                    power_sum += info->computed_power.rapl_power.package;
-                    poller_powers[count] = info->computed_power.rapl_power.package;
-                    if (info->computed_power.rapl_power.package > max_power)
-                        max_power = info->computed_power.rapl_power.package;
-                    count++;
-                }
-
-                palloc_entry->average_poll_power = power_sum / (double) num_poller_entries;
+                palloc_entry->average_poll_power = stats->mean;
                 palloc_entry->average_poll_energy = palloc_entry->average_poll_power * total_time;
-                palloc_entry->median_poll_power = median(count, poller_powers, &position);
+                palloc_entry->median_poll_power = p2_quantile_value(&stats->median);
+                palloc_entry->max_poll_power = stats->max;
             }
             else
             {
                 palloc_entry->average_poll_power = 0.0;
                 palloc_entry->median_poll_power = 0.0;
                 palloc_entry->average_poll_energy = 0.0;
+                palloc_entry->max_poll_power = 0.0;
             }
-            palloc_entry->max_poll_power = max_power;
         }
-        int current = 0;
-        if (palloc_entry->sync_begin > 0)
-            current = palloc_entry->sync_begin - 1;
-
-        struct rapl_energy energy_end = system_info->system_poll_list[current].current_energy.rapl_energy;
-        struct rapl_energy energy_start = system_info->system_poll_list[palloc_entry->last_sync].current_energy.rapl_energy;
-        rapl_compute_total_energy(&(palloc_entry->total_poll_energy), &(energy_end), &(energy_start));
-        rapl_compute_total_power(&(palloc_entry->total_poll_power), &(palloc_entry->total_poll_energy), palloc_entry->my_current_time - palloc_entry->my_last_sync_time);
+        //from the first to the last poll sample of the sync window, as the sampler handed them to the power window
+        struct window_stats *window = &palloc_entry->poll_stats;
+        if (window->num_samples > 0)
+        {
+            rapl_compute_total_energy(&(palloc_entry->total_poll_energy), &(window->last_energy.rapl_energy), &(window->first_energy.rapl_energy));
+            rapl_compute_total_power(&(palloc_entry->total_poll_power), &(palloc_entry->total_poll_energy), palloc_entry->my_current_time - palloc_entry->my_last_sync_time);
+        }
+        else
+        {
+            memset(&palloc_entry->total_poll_energy, 0, sizeof(struct rapl_energy));
+            memset(&palloc_entry->total_poll_power, 0, sizeof(struct rapl_power));
+        }
 
         power_manager->sync_begin = palloc_entry->sync_begin;
         power_manager->current_energy = palloc_entry->current_energy;
@@ -1262,8 +1213,8 @@ void sync_end_measurements(struct system_info_t * system_info, struct monitor_t
     struct power_manager_t *palloc_entry, *previous_entry;
     if (monitor->imonitor)
     {
-        palloc_entry = &system_info->palloc_list[count];
-        previous_entry = &system_info->palloc_list[count - 1];
+        palloc_entry = arena_at(&system_info->palloc_list, count);
+        previous_entry = arena_at(&system_info->palloc_list, count - 1);
         palloc_entry->time_after_alloc = current_time;
         palloc_entry->last_energy = previous_entry->current_energy;
         palloc_entry->my_last_sync_time = previous_entry->my_current_time;
@@ -1271,9 +1222,10 @@ void sync_end_measurements(struct system_info_t * system_info, struct monitor_t
         palloc_entry->last_sync_time = previous_entry->current_time;
         if (power_manager->measure_sync_end)
         {
-            palloc_entry->last_energy = read_current_energy(system_info); //read energy now before waiting for allreduce
-            palloc_entry->last_sync = poller->time_counter;
+            palloc_entry->last_energy = read_cached_energy(system_info, NULL); //read energy now before waiting for allreduce
+            palloc_entry->last_sync = __atomic_load_n(&poller->time_counter, __ATOMIC_ACQUIRE);
             palloc_entry->my_last_sync_time = current_time;
+            close_power_window(&system_info->power_window, NULL); //the window starts at the end of this sync instead
         }
     }
 
@@ -1319,156 +1271,6 @@ void sync_end_measurements(struct system_info_t * system_info, struct monitor_t
 
 }
 
-static double torben(double m[], int n)
-{
-    int i, less, greater, equal;
-    double  min, max, guess, maxltguess, mingtguess;
-
-    min = max = m[0] ;
-    for (i=1 ; i<n ; i++) {
-        if (m[i]<min) min=m[i];
-        if (m[i]>max) max=m[i];
-    }
-
-    while (1) {
-        guess = (min+max)/2;
-        less = 0; greater = 0; equal = 0;
-        maxltguess = min ;
-        mingtguess = max ;
-        for (i=0; i<n; i++) {
-            if (m[i]<guess) {
-                less++;
-                if (m[i]>maxltguess) maxltguess = m[i] ;
-            } else if (m[i]>guess) {
-                greater++;
-                if (m[i]<mingtguess) mingtguess = m[i] ;
-            } else equal++;
-        }
-        if (less <= (n+1)/2 && greater <= (n+1)/2) break ;
-        else if (less>greater) max = maxltguess ;
-        else min = mingtguess;
-    }
-    if (less >= (n+1)/2) return maxltguess;
-    else if (less+equal >= (n+1)/2) return guess;
-    else return mingtguess;
-}
-
-
-static double median (int n, double x[], int * position)
-{
-    double temp;
-    int i, j;
-    // the following two loops sort the array x in ascending order
-    if (n == 0)
-    {
-        *position = 0;
-        return 0;
-    }
-    if (n == 1)
-    {
-        *position = 0;
-        return x[0];
-    }
-    for (i = 0; i < n - 1; i++) {
-        for (j = i + 1; j < n; j++) {
-            if (x[j] < x[i])
-            {
-                // swap elements
-                temp = x[i];
-                x[i] = x[j];
-                x[j] = temp;
-            }
-        }
-    }
-    double max;
-    if (n == 2)
-    {
-        *position = 0;
-        max = x[0];
-        if (x[1] > max)
-        {
-            *position = 1;
-            max = x[1];
-        }
-        return max;
-    }
-
-    *position = n / 2;
-    if (n % 2 == 0) {
-        max = x[n / 2];
-        if (x[(n / 2) - 1] > max)
-        {
-            max = x[(n / 2) - 1];
-            *position = (n / 2) - 1;
-        }
-        if (x[(n / 2) + 1] > max)
-        {
-            max = x[(n / 2) + 1];
-            *position = (n / 2) + 1;
-        }
-        return max;
-    } else {
-        // else return the element in the middle
-        return x[n / 2];
-    }
-}
-
-static void median_energy (int n, uint64_t x[], int * position)
-{
-    uint64_t temp;
-    int i, j;
-    // the following two loops sort the array x in ascending order
-    if (n == 0)
-    {
-        *position = 0;
-        return;
-    }
-    if (n == 1)
-    {
-        *position = 0;
-        return;
-    }
-    for (i = 0; i < n - 1; i++) {
-        for (j = i + 1; j < n; j++) {
-            if (x[j] < x[i])
-            {
-                // swap elements
-                temp = x[i];
-                x[i] = x[j];
-                x[j] = temp;
-            }
-        }
-    }
-    uint64_t max;
-    if (n == 2)
-    {
-        *position = 0;
-        max = x[0];
-        if (x[1] > max)
-        {
-            *position = 1;
-            max = x[1];
-        }
-        return;
-    }
-
-    *position = n / 2;
-    if (n % 2 == 0) {
-        max = x[n / 2];
-        if (x[(n / 2) - 1] > max)
-        {
-            max = x[(n / 2) - 1];
-            *position = (n / 2) - 1;
-        }
-        if (x[(n / 2) + 1] > max)
-        {
-            max = x[(n / 2) + 1];
-            *position = (n / 2) + 1;
-        }
-        return;
-    }
-}
-
 void finalize_SeeSAw (struct system_info_t * system_info, struct monitor_t * monitor)
 {
     if (monitor->imonitor)
@@ -1491,7 +1293,7 @@ void finalize_SeeSAw (struct system_info_t * system_info, struct monitor_t * mon
             
             for (i = 0; i < power_manager->log_count; i++)
             {
-                struct pm_log_t *log = &power_manager->logs[i];
+                struct pm_log_t *log = arena_at(power_manager->logs, i);
                 fprintf(fp, "%d\t%d\t%d\t%d\t", log->pm_count, log->palloc_count, log->timestep, log->world_rank);
                 fprintf(fp, "%lf\t%lf\t%lf\t%lf\t%lf\t%lf\t", log->my_alpha, log->other_alpha, log->ratio, log->adjusted_opt_power, log->my_opt_power, log->other_opt_power);
                 fprintf(fp, "%lf\t%lf\t%lf\t", log->allocated_power, log->new_power_per_node, log->previous_total_power);
@@ -1528,7 +1330,7 @@ void finalize_sync_measurements (struct system_info_t * system_info, struct moni
 
             for (i = 0; i < power_manager->count; i++)
             {
-                struct power_manager_t *palloc_entry = &system_info->palloc_list[i];
+                struct power_manager_t *palloc_entry = arena_at(&system_info->palloc_list, i);
                 fprintf(fp, "%d\t%d\t%d\t%d\t%d\t", i, palloc_entry->last_sync, palloc_entry->sync_begin, palloc_entry->rank, palloc_entry->node);
                 fprintf(fp, "%lf\t%lf\t%lf\t", palloc_entry->my_last_sync_time - system_info->initial_mpi_wtime, palloc_entry->my_current_time - system_info->initial_mpi_wtime, palloc_entry->my_current_time - palloc_entry->my_last_sync_time);
                 fprintf(fp, "%lf\t", palloc_entry->time_after_alloc - system_info->initial_mpi_wtime);
@@ -1564,7 +1366,7 @@ void finalize_SLURMLike (struct system_info_t * system_info, struct monitor_t *
             
             for (i = 0; i < power_manager->log_count; i++)
             {
-                struct pm_log_t *log = &power_manager->logs[i];
+                struct pm_log_t *log = arena_at(power_manager->logs, i);
                 fprintf(fp, "%d\t%d\t%d\t%d\t", log->pm_count, log->palloc_count, log->timestep, log->world_rank);
                 fprintf(fp, "%lf\t%lf\t%lf\t", log->new_power_per_node, log->slack_power, log->pcap_all_nodes);
                 fprintf(fp, "%d\t%lf\t", log->at_pcap, log->max_observed_power);
@@ -1596,7 +1398,7 @@ void finalize_GEOPMLike (struct system_info_t * system_info, struct monitor_t *
             
             for (i = 0; i < power_manager->log_count; i++)
             {
-                struct pm_log_t *log = &power_manager->logs[i];
+                struct pm_log_t *log = arena_at(power_manager->logs, i);
                 fprintf(fp, "%d\t%d\t%d\t%d\t", log->pm_count, log->palloc_count, log->timestep, log->world_rank);
                 fprintf(fp, "%lf\t%lf\t%lf\t", log->new_power_per_node, log->slack_power, log->extra_power);
                 fprintf(fp, "%lf\t%lf\t%lf\t%d\t", log->average_time, log->median_node_runtime, log->target_runtime, log->median_runtime_rank);
@@ -1619,5 +1421,12 @@ void finalize_power_manager (struct system_info_t * system_info, struct monitor_
 
     finalize_sync_measurements(system_info, monitor);
 
+    if (monitor->imonitor)
+    {
+        arena_free(power_manager->logs);
+        free(power_manager->logs);
+        power_manager->logs = 0;
+    }
+
     return;
 }
\ No newline at end of file
@@ -0,0 +1,539 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#include "PoLiMEr.h"
+#include "PoLiLog.h"
+#include "powercap_handler.h"
+
+#define MAX_TOP_ZONES 64 //intel-rapl:N zones looked at
+#define MAX_CONSTRAINTS 4
+
+static void add_zone (struct powercap_info *pc, int package, int zone, char *root, char *dir_name);
+static int open_zone (struct powercap_zone *zone, char *root, char *dir_name);
+static int read_string (char *path, char *file, char *buf, int len);
+static int read_value (char *path, char *file, uint64_t *value);
+static int write_value (char *path, char *file, uint64_t value);
+static int read_energy_uj (struct powercap_zone *zone, uint64_t *value);
+static void update_counter (struct powercap_counter *counter, uint64_t value, uint64_t max_energy_range);
+static int zone_index (char *name);
+static int zone_name_index (char *zone_name);
+static void set_zone_energies (struct rapl_energy *re, double *zones);
+static void add_zone_info (double value, double *total, int first);
+static void count_zones (struct powercap_info *pc, int zone, int *count);
+
+struct powercap_info *init_powercap (char *root)
+{
+    poli_log(TRACE, NULL, "Entering %s", __FUNCTION__);
+
+    if (root == NULL)
+        root = POWERCAP_ROOT;
+
+    DIR *dir = opendir(root);
+    if (dir == NULL)
+    {
+        poli_log(ERROR, NULL, "Couldn't open the powercap sysfs at %s: %s", root, strerror(errno));
+        return NULL;
+    }
+
+    struct powercap_info *pc = calloc(1, sizeof(struct powercap_info));
+    if (pc == NULL)
+    {
+        closedir(dir);
+        return NULL;
+    }
+
+    int package, zone;
+
+    //the package of each intel-rapl:N zone, which its subzones intel-rapl:N:M belong to
+    int top_package[MAX_TOP_ZONES];
+    for (zone = 0; zone < MAX_TOP_ZONES; zone++)
+        top_package[zone] = -1;
+
+    struct dirent *entry;
+    char name[BUFSIZE];
+    int top, sub, end;
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        end = 0;
+        if (sscanf(entry->d_name, "intel-rapl:%d%n", &top, &end) != 1 || entry->d_name[end] != '\0' || top < 0 || top >= MAX_TOP_ZONES)
+            continue;
+        char path[POWERCAP_PATH_LEN];
+        snprintf(path, POWERCAP_PATH_LEN, "%s/%s", root, entry->d_name);
+        if (read_string(path, "name", name, BUFSIZE) != 0)
+            continue;
+
+        //on packages of several dies there is a package-N-die-M zone for each, which are added up
+        if (sscanf(name, "package-%d", &package) == 1)
+        {
+            if (package < 0 || package >= MAX_PACKAGES)
+            {
+                poli_log(WARNING, NULL, "%s: Skipping powercap zone %s (%s), PoLiMEr reads at most %d packages", __FUNCTION__, entry->d_name, name, MAX_PACKAGES);
+                continue;
+            }
+            top_package[top] = package;
+            add_zone(pc, package, 0, root, entry->d_name);
+            if (package >= pc->num_packages)
+                pc->num_packages = package + 1;
+        }
+        else if (strcmp(name, "psys") == 0)
+            add_zone(pc, 0, 3, root, entry->d_name);
+    }
+
+    rewinddir(dir);
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (sscanf(entry->d_name, "intel-rapl:%d:%d", &top, &sub) != 2 || top < 0 || top >= MAX_TOP_ZONES || top_package[top] < 0)
+            continue;
+        char path[POWERCAP_PATH_LEN];
+        snprintf(path, POWERCAP_PATH_LEN, "%s/%s", root, entry->d_name);
+        if (read_string(path, "name", name, BUFSIZE) != 0)
+            continue;
+        zone = zone_index(name);
+        if (zone > 0)
+            add_zone(pc, top_package[top], zone, root, entry->d_name);
+    }
+    closedir(dir);
+
+    if (pc->num_packages == 0)
+    {
+        poli_log(ERROR, NULL, "No intel-rapl package zones found in %s", root);
+        finalize_powercap(pc);
+        return NULL;
+    }
+
+    poli_log(DEBUG, NULL, "Reading RAPL of %d packages in %d zones from %s", pc->num_packages, pc->num_zones, root);
+    poli_log(TRACE, NULL, "Finishing %s", __FUNCTION__);
+
+    return pc;
+}
+
+void finalize_powercap (struct powercap_info *pc)
+{
+    if (pc == NULL)
+        return;
+    int i;
+    for (i = 0; i < pc->num_zones; i++)
+        close(pc->zones[i].energy_fd);
+    free(pc);
+}
+
+/* add_zone - adds the zone in directory dir_name of root as energy zone zone of package, if its counter can be read*/
+static void add_zone (struct powercap_info *pc, int package, int zone, char *root, char *dir_name)
+{
+    if (pc->num_zones >= MAX_POWERCAP_ZONES)
+    {
+        poli_log(WARNING, NULL, "%s: Skipping powercap zone %s, PoLiMEr reads at most %d zones", __FUNCTION__, dir_name, MAX_POWERCAP_ZONES);
+        return;
+    }
+    struct powercap_zone *pz = &pc->zones[pc->num_zones];
+    pz->package = package;
+    pz->zone = zone;
+    if (open_zone(pz, root, dir_name) == 0)
+        pc->num_zones++;
+}
+
+/* open_zone - opens the energy counter of the zone in directory dir_name of root and finds its constraints
+   returns: 0 if successful, else 1*/
+static int open_zone (struct powercap_zone *zone, char *root, char *dir_name)
+{
+    char file[POWERCAP_PATH_LEN + 32];
+    if (snprintf(zone->path, POWERCAP_PATH_LEN, "%s/%s", root, dir_name) >= POWERCAP_PATH_LEN)
+    {
+        poli_log(ERROR, NULL, "%s: The path of powercap zone %s is too long", __FUNCTION__, dir_name);
+        return 1;
+    }
+
+    snprintf(file, sizeof(file), "%s/energy_uj", zone->path);
+    zone->energy_fd = open(file, O_RDONLY);
+    if (zone->energy_fd < 0)
+    {
+        poli_log(ERROR, NULL, "Couldn't open %s: %s", file, strerror(errno));
+        return 1;
+    }
+
+    zone->long_constraint = -1;
+    zone->short_constraint = -1;
+
+    if (read_value(zone->path, "max_energy_range_uj", &zone->max_energy_range) != 0)
+        zone->max_energy_range = UINT32_MAX;
+
+    int constraint;
+    char name[BUFSIZE];
+    for (constraint = 0; constraint < MAX_CONSTRAINTS; constraint++)
+    {
+        snprintf(file, sizeof(file), "constraint_%d_name", constraint);
+        if (read_string(zone->path, file, name, BUFSIZE) != 0)
+            break;
+        if (strcmp(name, "long_term") == 0)
+            zone->long_constraint = constraint;
+        else if (strcmp(name, "short_term") == 0)
+            zone->short_constraint = constraint;
+    }
+
+    uint64_t value = 0;
+    read_energy_uj(zone, &value);
+    zone->energy.last_energy = zone->energy.total_energy = value;
+    zone->raw = zone->energy;
+    return 0;
+}
+
+/* read_string - reads file of the zone at path into buf, without the trailing newline
+   returns: 0 if successful, else 1*/
+static int read_string (char *path, char *file, char *buf, int len)
+{
+    char filename[POWERCAP_PATH_LEN + BUFSIZE];
+    snprintf(filename, sizeof(filename), "%s/%s", path, file);
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return 1;
+    ssize_t n = read(fd, buf, len - 1);
+    close(fd);
+    if (n <= 0)
+        return 1;
+    buf[n] = '\0';
+    buf[strcspn(buf, "\n")] = '\0';
+    return 0;
+}
+
+static int read_value (char *path, char *file, uint64_t *value)
+{
+    char buf[BUFSIZE];
+    if (read_string(path, file, buf, BUFSIZE) != 0)
+        return 1;
+    *value = strtoull(buf, NULL, 10);
+    return 0;
+}
+
+static int write_value (char *path, char *file, uint64_t value)
+{
+    char filename[POWERCAP_PATH_LEN + BUFSIZE];
+    char buf[32];
+    snprintf(filename, sizeof(filename), "%s/%s", path, file);
+    int fd = open(filename, O_WRONLY | O_TRUNC);
+    int n = snprintf(buf, sizeof(buf), "%" PRIu64, value);
+    if (fd < 0 || write(fd, buf, n) != n)
+    {
+        poli_log(ERROR, NULL, "Something went wrong with writing %s to %s: %s", buf, filename, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return 1;
+    }
+    close(fd);
+    return 0;
+}
+
+/* read_energy_uj - reads the energy counter of zone from its open fd
+   returns: 0 if successful, else 1*/
+static int read_energy_uj (struct powercap_zone *zone, uint64_t *value)
+{
+    char buf[32];
+    ssize_t n = pread(zone->energy_fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0)
+        return 1;
+    buf[n] = '\0';
+    *value = strtoull(buf, NULL, 10);
+    return 0;
+}
+
+static void update_counter (struct powercap_counter *counter, uint64_t value, uint64_t max_energy_range)
+{
+    //energy_uj wraps at max_energy_range_uj
+    if (value < counter->last_energy)
+        counter->total_energy += max_energy_range - counter->last_energy + value;
+    else
+        counter->total_energy += value - counter->last_energy;
+    counter->last_energy = value;
+}
+
+int powercap_read_energy (struct rapl_energy *re, struct rapl_energy *package_energy, struct powercap_info *pc)
+{
+    int i, package;
+    uint64_t values[MAX_POWERCAP_ZONES];
+    int valid[MAX_POWERCAP_ZONES];
+    double zones[MAX_PACKAGES + 1][NUM_RAPL_DOMAINS] = {{0}}; //the packages, then the node
+
+    //all counters are read before any is converted, so the packages are sampled as close together as possible
+    for (i = 0; i < pc->num_zones; i++)
+        valid[i] = read_energy_uj(&pc->zones[i], &values[i]) == 0;
+
+    for (i = 0; i < pc->num_zones; i++)
+    {
+        struct powercap_zone *pz = &pc->zones[i];
+        //a counter which couldn't be read keeps its last total
+        if (valid[i])
+            update_counter(&pz->energy, values[i], pz->max_energy_range);
+        else
+            poli_log(ERROR, NULL, "%s: Couldn't read %s/energy_uj", __FUNCTION__, pz->path);
+        zones[pz->package][pz->zone] += pz->energy.total_energy * 1e-6;
+        zones[MAX_PACKAGES][pz->zone] += pz->energy.total_energy * 1e-6;
+    }
+
+    set_zone_energies(re, zones[MAX_PACKAGES]);
+    for (package = 0; package_energy && package < MAX_RECORDED_PACKAGES; package++)
+        set_zone_energies(&package_energy[package], zones[package]);
+
+    return 0;
+}
+
+int powercap_read_raw_energy (uint32_t *counters, double *units, struct powercap_info *pc)
+{
+    int i;
+    memset(counters, 0, pc->num_packages * NUM_RAPL_DOMAINS * sizeof(uint32_t));
+    if (units)
+        memset(units, 0, pc->num_packages * NUM_RAPL_DOMAINS * sizeof(double));
+
+    for (i = 0; i < pc->num_zones; i++)
+    {
+        struct powercap_zone *pz = &pc->zones[i];
+        int counter = pz->package * NUM_RAPL_DOMAINS + pz->zone;
+        uint64_t value;
+        if (read_energy_uj(pz, &value) != 0)
+            return 0;
+        //the wraps are accounted here, so the counters only wrap at 32 bits as the msrs do. the dies of a package add up
+        update_counter(&pz->raw, value, pz->max_energy_range);
+        counters[counter] += (uint32_t) pz->raw.total_energy;
+        if (units)
+            units[counter] = 1e-6;
+    }
+    return pc->num_packages * NUM_RAPL_DOMAINS;
+}
+
+int powercap_set_power_cap (char *zone_name, double watts_long, double watts_short, double seconds_long, double seconds_short, int enable, struct powercap_info *pc)
+{
+    poli_log(TRACE, NULL, "Entering %s", __FUNCTION__);
+
+    int zone = zone_name_index(zone_name);
+    if (zone < 0)
+        return 1;
+
+    int i, found = 0, ret = 0;
+    int dies[MAX_PACKAGES];
+    char file[BUFSIZE];
+    count_zones(pc, zone, dies);
+    for (i = 0; i < pc->num_zones; i++)
+    {
+        struct powercap_zone *pz = &pc->zones[i];
+        if (pz->zone != zone || pz->long_constraint < 0)
+            continue;
+        found = 1;
+
+        if (enable)
+        {
+            //each die of the package gets an even share of its cap
+            double share = 1.0 / dies[pz->package];
+            snprintf(file, BUFSIZE, "constraint_%d_power_limit_uw", pz->long_constraint);
+            ret |= write_value(pz->path, file, (uint64_t) (watts_long * share * 1e6));
+            if (seconds_long > 0)
+            {
+                snprintf(file, BUFSIZE, "constraint_%d_time_window_us", pz->long_constraint);
+                ret |= write_value(pz->path, file, (uint64_t) (seconds_long * 1e6));
+            }
+            if (pz->short_constraint >= 0 && watts_short > 0)
+            {
+                snprintf(file, BUFSIZE, "constraint_%d_power_limit_uw", pz->short_constraint);
+                ret |= write_value(pz->path, file, (uint64_t) (watts_short * share * 1e6));
+                if (seconds_short > 0)
+                {
+                    snprintf(file, BUFSIZE, "constraint_%d_time_window_us", pz->short_constraint);
+                    ret |= write_value(pz->path, file, (uint64_t) (seconds_short * 1e6));
+                }
+            }
+        }
+        ret |= write_value(pz->path, "enabled", enable ? 1 : 0);
+    }
+
+    if (!found)
+    {
+        poli_log(ERROR, NULL, "%s: There is no powercap zone to cap for %s", __FUNCTION__, zone_name);
+        return 1;
+    }
+
+    poli_log(TRACE, NULL, "Finishing %s", __FUNCTION__);
+
+    return ret;
+}
+
+int powercap_get_power_cap (struct msr_pcap *pcap, char *zone_name, struct powercap_info *pc)
+{
+    int zone = zone_name_index(zone_name);
+    if (zone < 0)
+        return 1;
+
+    //the cap of the node is the sum of those of its packages and their dies, enabled only if it is on all of them
+    int i, found = 0, ret = 0, all_enabled = 1, has_short = 1;
+    double total_watts_long = 0, total_watts_short = 0;
+    char file[BUFSIZE];
+    uint64_t value = 0;
+
+    pcap->zone_label = (zone_label_t) zone;
+    pcap->seconds_long = 0;
+    pcap->seconds_short = 0;
+
+    for (i = 0; i < pc->num_zones; i++)
+    {
+        struct powercap_zone *pz = &pc->zones[i];
+        if (pz->zone != zone || pz->long_constraint < 0)
+            continue;
+        found = 1;
+
+        if (read_value(pz->path, "enabled", &value) == 0)
+            all_enabled &= (value != 0);
+        else
+            ret = 1;
+
+        snprintf(file, BUFSIZE, "constraint_%d_power_limit_uw", pz->long_constraint);
+        ret |= read_value(pz->path, file, &value);
+        total_watts_long += value * 1e-6;
+        snprintf(file, BUFSIZE, "constraint_%d_time_window_us", pz->long_constraint);
+        if (read_value(pz->path, file, &value) == 0)
+            pcap->seconds_long = value * 1e-6;
+
+        has_short &= (pz->short_constraint >= 0);
+        if (pz->short_constraint >= 0)
+        {
+            snprintf(file, BUFSIZE, "constraint_%d_power_limit_uw", pz->short_constraint);
+            ret |= read_value(pz->path, file, &value);
+            total_watts_short += value * 1e-6;
+            snprintf(file, BUFSIZE, "constraint_%d_time_window_us", pz->short_constraint);
+            if (read_value(pz->path, file, &value) == 0)
+                pcap->seconds_short = value * 1e-6;
+        }
+    }
+
+    if (!found || ret)
+    {
+        poli_log(ERROR, NULL, "%s: Something went wrong with getting the power cap of %s", __FUNCTION__, zone_name);
+        return 1;
+    }
+
+    pcap->watts_long = total_watts_long;
+    pcap->enabled_long = pcap->clamped_long = all_enabled;
+    if (!has_short)
+    {
+        total_watts_short = 0;
+        pcap->seconds_short = 0;
+    }
+    pcap->watts_short = total_watts_short;
+    pcap->enabled_short = pcap->clamped_short = all_enabled && has_short;
+
+    return 0;
+}
+
+int powercap_get_power_cap_info (char *zone_name, double *min, double *max, double *thermal_spec, double *max_time_window, struct powercap_info *pc)
+{
+    int zone = zone_name_index(zone_name);
+    int i, found = 0;
+    char file[BUFSIZE];
+    uint64_t value;
+
+    *thermal_spec = -1;
+    *min = -1;
+    *max = -1;
+    *max_time_window = -1;
+
+    if (zone != 0 && zone != 4)
+    {
+        poli_log(ERROR, NULL, "Power capping info is only allowed for PACKAGE and DRAM zones!");
+        return 1;
+    }
+
+    //the info of the node is that of its packages and their dies added up, with the shortest time window. -1 where the sysfs doesn't tell
+    for (i = 0; i < pc->num_zones; i++)
+    {
+        struct powercap_zone *pz = &pc->zones[i];
+        if (pz->zone != zone || pz->long_constraint < 0)
+            continue;
+
+        snprintf(file, BUFSIZE, "constraint_%d_max_power_uw", pz->long_constraint);
+        add_zone_info(read_value(pz->path, file, &value) == 0 ? value * 1e-6 : -1, thermal_spec, !found);
+        snprintf(file, BUFSIZE, "constraint_%d_min_power_uw", pz->long_constraint);
+        add_zone_info(read_value(pz->path, file, &value) == 0 ? value * 1e-6 : -1, min, !found);
+        snprintf(file, BUFSIZE, "constraint_%d_max_power_uw", pz->short_constraint);
+        add_zone_info(pz->short_constraint >= 0 && read_value(pz->path, file, &value) == 0 ? value * 1e-6 : -1, max, !found);
+
+        snprintf(file, BUFSIZE, "constraint_%d_max_time_window_us", pz->long_constraint);
+        if (read_value(pz->path, file, &value) == 0 && (*max_time_window < 0 || value * 1e-6 < *max_time_window))
+            *max_time_window = value * 1e-6;
+        found = 1;
+    }
+
+    return !found;
+}
+
+int powercap_get_power_info (struct power_info *pi, struct powercap_info *pc)
+{
+    powercap_get_power_cap_info("PACKAGE", &pi->package_minimum_power, &pi->package_maximum_power,
+        &pi->package_thermal_spec, &pi->package_maximum_time_window, pc);
+    powercap_get_power_cap_info("DRAM", &pi->dram_minimum_power, &pi->dram_maximum_power,
+        &pi->dram_thermal_spec, &pi->dram_maximum_time_window, pc);
+    return 0;
+}
+
+/* zone_index - returns: the index of the energy zone of the powercap subzone called name, -1 if it is none*/
+static int zone_index (char *name)
+{
+    if (strcmp(name, "core") == 0)
+        return 1;
+    if (strcmp(name, "uncore") == 0)
+        return 2;
+    if (strcmp(name, "dram") == 0)
+        return 4;
+    return -1;
+}
+
+/* zone_name_index - returns: the index of the energy zone of the power cap zone called zone_name, -1 if it is none*/
+static int zone_name_index (char *zone_name)
+{
+    if (!strcmp(zone_name, "PACKAGE"))
+        return 0;
+    if (!strcmp(zone_name, "CORE"))
+        return 1;
+    if (!strcmp(zone_name, "UNCORE"))
+        return 2;
+    if (!strcmp(zone_name, "PLATFORM"))
+        return 3;
+    if (!strcmp(zone_name, "DRAM"))
+        return 4;
+    poli_log(ERROR, NULL, "%s: Unsupported zone for power capping: %s", __FUNCTION__, zone_name);
+    return -1;
+}
+
+static void set_zone_energies (struct rapl_energy *re, double *zones)
+{
+    re->package = zones[0];
+    re->pp0 = zones[1];
+    re->pp1 = zones[2];
+    re->platform = zones[3];
+    re->dram = zones[4];
+}
+
+/* add_zone_info - adds value of one package to total, which is -1 once any package's is unknown*/
+static void add_zone_info (double value, double *total, int first)
+{
+    if (first)
+        *total = value;
+    else if (value < 0 || *total < 0)
+        *total = -1;
+    else
+        *total += value;
+}
+
+/* count_zones - counts the zones of energy zone zone with a long_term constraint in each package, at least 1*/
+static void count_zones (struct powercap_info *pc, int zone, int *count)
+{
+    int i;
+    for (i = 0; i < MAX_PACKAGES; i++)
+        count[i] = 0;
+    for (i = 0; i < pc->num_zones; i++)
+        if (pc->zones[i].zone == zone && pc->zones[i].long_constraint >= 0)
+            count[pc->zones[i].package]++;
+    for (i = 0; i < MAX_PACKAGES; i++)
+        if (count[i] == 0)
+            count[i] = 1;
+}
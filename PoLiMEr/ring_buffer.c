@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ring_buffer.h"
+
+int ring_init (struct spsc_ring *ring, unsigned int size, size_t slot_size)
+{
+    unsigned int pow2 = 1;
+    while (pow2 < size)
+        pow2 <<= 1;
+
+    ring->slots = 0;
+    ring->size = 0;
+    ring->mask = 0;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->slot_size = slot_size;
+
+    if (slot_size > 0)
+    {
+        ring->slots = calloc(pow2, slot_size);
+        if (ring->slots == NULL)
+            return 1;
+    }
+    ring->size = pow2;
+    ring->mask = pow2 - 1;
+    return 0;
+}
+
+void ring_free (struct spsc_ring *ring)
+{
+    if (ring->slots)
+    {
+        free(ring->slots);
+        ring->slots = 0;
+    }
+    ring->size = 0;
+    ring->mask = 0;
+}
+
+int ring_reserve_position (struct spsc_ring *ring, unsigned int *position)
+{
+    unsigned int tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (ring->head - tail >= ring->size)
+        return 1;
+    *position = ring->head;
+    return 0;
+}
+
+void *ring_reserve (struct spsc_ring *ring)
+{
+    unsigned int position;
+    if (ring->slots == NULL || ring_reserve_position(ring, &position) != 0)
+        return NULL;
+    return ring->slots + (size_t) (position & ring->mask) * ring->slot_size;
+}
+
+void ring_commit (struct spsc_ring *ring)
+{
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+int ring_peek_position (struct spsc_ring *ring, unsigned int *position)
+{
+    unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (head == ring->tail)
+        return 1;
+    *position = ring->tail;
+    return 0;
+}
+
+void *ring_peek (struct spsc_ring *ring)
+{
+    unsigned int position;
+    if (ring->slots == NULL || ring_peek_position(ring, &position) != 0)
+        return NULL;
+    return ring->slots + (size_t) (position & ring->mask) * ring->slot_size;
+}
+
+void ring_release (struct spsc_ring *ring)
+{
+    __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+}
+
+unsigned int ring_count (struct spsc_ring *ring)
+{
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+int ring_holds (struct spsc_ring *ring, unsigned int position)
+{
+    unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    //the slot at head - size is the next one to be overwritten by the producer
+    if (ring->size < 2 || head - position - 1 >= ring->size - 1)
+        return 0;
+    return 1;
+}
+
+void *ring_at (struct spsc_ring *ring, unsigned int position)
+{
+    if (ring->slots == NULL || !ring_holds(ring, position))
+        return NULL;
+    return ring->slots + (size_t) (position & ring->mask) * ring->slot_size;
+}
@@ -0,0 +1,384 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(_BGQ)
+#include <immintrin.h>
+#define HAVE_SIMD_KERNELS
+#endif
+
+#include "stats_kernels.h"
+
+// Arrays up to this length are copied to the stack rather than the heap
+#define STATS_STACK_SIZE 256
+// Bound on the half window of the Hampel filter
+#define MAX_HAMPEL_HALF_WINDOW 32
+// Scales the median absolute deviation to the standard deviation of normally distributed values
+#define MAD_SCALE 1.4826
+// Floor of the deviation relative to the median, windows of mostly equal values otherwise flag every other value
+#define MIN_RELATIVE_DEVIATION 0.01
+
+/* the kernels which differ between instruction sets*/
+struct stats_kernel_table {
+    const char *name;
+    void (*summarize) (const double *x, long n, double lo, double hi, struct range_summary *summary);
+    long (*find) (const double *x, long n, double value); //index of the first x[i] == value, -1 if none
+    void (*median3) (const double *x, double *out, long n);
+};
+
+static inline double median_of_3 (double a, double b, double c)
+{
+    double low = (a < b) ? a : b;
+    double high = (a < b) ? b : a;
+    return (c < high) ? ((c > low) ? c : low) : high;
+}
+
+static void scalar_summarize (const double *x, long n, double lo, double hi, struct range_summary *summary)
+{
+    long i, count = 0;
+    double sum = 0.0, min = INFINITY, max = -INFINITY;
+    for (i = 0; i < n; i++)
+    {
+        if (x[i] > lo && x[i] < hi)
+        {
+            count++;
+            sum += x[i];
+            if (x[i] < min)
+                min = x[i];
+            if (x[i] > max)
+                max = x[i];
+        }
+    }
+    summary->count = count;
+    summary->sum = sum;
+    summary->min = min;
+    summary->max = max;
+}
+
+static long scalar_find (const double *x, long n, double value)
+{
+    long i;
+    for (i = 0; i < n; i++)
+        if (x[i] == value)
+            return i;
+    return -1;
+}
+
+static void scalar_median3 (const double *x, double *out, long n)
+{
+    long i;
+    for (i = 1; i < n - 1; i++)
+        out[i] = median_of_3(x[i - 1], x[i], x[i + 1]);
+}
+
+static const struct stats_kernel_table scalar_kernels = { "scalar", scalar_summarize, scalar_find, scalar_median3 };
+
+#ifdef HAVE_SIMD_KERNELS
+__attribute__((target("avx2")))
+static void avx2_summarize (const double *x, long n, double lo, double hi, struct range_summary *summary)
+{
+    __m256d low = _mm256_set1_pd(lo);
+    __m256d high = _mm256_set1_pd(hi);
+    __m256d none_min = _mm256_set1_pd(INFINITY);
+    __m256d none_max = _mm256_set1_pd(-INFINITY);
+    __m256d sum = _mm256_setzero_pd();
+    __m256d min = none_min;
+    __m256d max = none_max;
+    __m256i count = _mm256_setzero_si256();
+    long i;
+    for (i = 0; i + 4 <= n; i += 4)
+    {
+        __m256d v = _mm256_loadu_pd(x + i);
+        __m256d in = _mm256_and_pd(_mm256_cmp_pd(v, low, _CMP_GT_OQ), _mm256_cmp_pd(v, high, _CMP_LT_OQ));
+        sum = _mm256_add_pd(sum, _mm256_and_pd(in, v));
+        min = _mm256_min_pd(min, _mm256_blendv_pd(none_min, v, in));
+        max = _mm256_max_pd(max, _mm256_blendv_pd(none_max, v, in));
+        //lanes in range are all ones, -1 as integers
+        count = _mm256_sub_epi64(count, _mm256_castpd_si256(in));
+    }
+
+    double sums[4], mins[4], maxs[4];
+    long long counts[4];
+    _mm256_storeu_pd(sums, sum);
+    _mm256_storeu_pd(mins, min);
+    _mm256_storeu_pd(maxs, max);
+    _mm256_storeu_si256((__m256i *) counts, count);
+    scalar_summarize(x + i, n - i, lo, hi, summary);
+    int lane;
+    for (lane = 0; lane < 4; lane++)
+    {
+        summary->count += counts[lane];
+        summary->sum += sums[lane];
+        if (mins[lane] < summary->min)
+            summary->min = mins[lane];
+        if (maxs[lane] > summary->max)
+            summary->max = maxs[lane];
+    }
+}
+
+__attribute__((target("avx2")))
+static long avx2_find (const double *x, long n, double value)
+{
+    __m256d target = _mm256_set1_pd(value);
+    long i;
+    for (i = 0; i + 4 <= n; i += 4)
+    {
+        int equal = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(x + i), target, _CMP_EQ_OQ));
+        if (equal)
+            return i + __builtin_ctz(equal);
+    }
+    long found = scalar_find(x + i, n - i, value);
+    return (found < 0) ? -1 : i + found;
+}
+
+__attribute__((target("avx2")))
+static void avx2_median3 (const double *x, double *out, long n)
+{
+    long i;
+    for (i = 1; i + 4 <= n - 1; i += 4)
+    {
+        __m256d a = _mm256_loadu_pd(x + i - 1);
+        __m256d b = _mm256_loadu_pd(x + i);
+        __m256d c = _mm256_loadu_pd(x + i + 1);
+        __m256d low = _mm256_min_pd(a, b);
+        __m256d high = _mm256_max_pd(a, b);
+        _mm256_storeu_pd(out + i, _mm256_max_pd(low, _mm256_min_pd(high, c)));
+    }
+    for (; i < n - 1; i++)
+        out[i] = median_of_3(x[i - 1], x[i], x[i + 1]);
+}
+
+static const struct stats_kernel_table avx2_kernels = { "avx2", avx2_summarize, avx2_find, avx2_median3 };
+
+__attribute__((target("avx512f")))
+static void avx512_summarize (const double *x, long n, double lo, double hi, struct range_summary *summary)
+{
+    __m512d low = _mm512_set1_pd(lo);
+    __m512d high = _mm512_set1_pd(hi);
+    __m512d sum = _mm512_setzero_pd();
+    __m512d min = _mm512_set1_pd(INFINITY);
+    __m512d max = _mm512_set1_pd(-INFINITY);
+    long count = 0;
+    long i;
+    for (i = 0; i < n; i += 8)
+    {
+        //the last iteration loads only the values left
+        __mmask8 valid = (n - i >= 8) ? 0xff : (__mmask8) ((1u << (n - i)) - 1);
+        __m512d v = _mm512_maskz_loadu_pd(valid, x + i);
+        __mmask8 in = valid & _mm512_cmp_pd_mask(v, low, _CMP_GT_OQ) & _mm512_cmp_pd_mask(v, high, _CMP_LT_OQ);
+        sum = _mm512_mask_add_pd(sum, in, sum, v);
+        min = _mm512_mask_min_pd(min, in, min, v);
+        max = _mm512_mask_max_pd(max, in, max, v);
+        count += __builtin_popcount(in);
+    }
+    summary->count = count;
+    summary->sum = _mm512_reduce_add_pd(sum);
+    summary->min = _mm512_reduce_min_pd(min);
+    summary->max = _mm512_reduce_max_pd(max);
+}
+
+__attribute__((target("avx512f")))
+static long avx512_find (const double *x, long n, double value)
+{
+    __m512d target = _mm512_set1_pd(value);
+    long i;
+    for (i = 0; i < n; i += 8)
+    {
+        __mmask8 valid = (n - i >= 8) ? 0xff : (__mmask8) ((1u << (n - i)) - 1);
+        __mmask8 equal = _mm512_mask_cmp_pd_mask(valid, _mm512_maskz_loadu_pd(valid, x + i), target, _CMP_EQ_OQ);
+        if (equal)
+            return i + __builtin_ctz(equal);
+    }
+    return -1;
+}
+
+__attribute__((target("avx512f")))
+static void avx512_median3 (const double *x, double *out, long n)
+{
+    long i;
+    for (i = 1; i + 8 <= n - 1; i += 8)
+    {
+        __m512d a = _mm512_loadu_pd(x + i - 1);
+        __m512d b = _mm512_loadu_pd(x + i);
+        __m512d c = _mm512_loadu_pd(x + i + 1);
+        __m512d low = _mm512_min_pd(a, b);
+        __m512d high = _mm512_max_pd(a, b);
+        _mm512_storeu_pd(out + i, _mm512_max_pd(low, _mm512_min_pd(high, c)));
+    }
+    for (; i < n - 1; i++)
+        out[i] = median_of_3(x[i - 1], x[i], x[i + 1]);
+}
+
+static const struct stats_kernel_table avx512_kernels = { "avx512", avx512_summarize, avx512_find, avx512_median3 };
+#endif
+
+static const struct stats_kernel_table *kernels = 0;
+
+static const struct stats_kernel_table *get_kernels (void)
+{
+    if (kernels == NULL)
+        stats_use_kernels("auto");
+    return kernels;
+}
+
+int stats_use_kernels (const char *name)
+{
+    int is_auto = (name == NULL || strcmp(name, "auto") == 0);
+#ifdef HAVE_SIMD_KERNELS
+    __builtin_cpu_init();
+    int has_avx512 = __builtin_cpu_supports("avx512f");
+    int has_avx2 = __builtin_cpu_supports("avx2");
+    if ((is_auto && has_avx512) || (name != NULL && strcmp(name, "avx512") == 0))
+    {
+        if (!has_avx512)
+            return 1;
+        kernels = &avx512_kernels;
+        return 0;
+    }
+    if ((is_auto && has_avx2) || (name != NULL && strcmp(name, "avx2") == 0))
+    {
+        if (!has_avx2)
+            return 1;
+        kernels = &avx2_kernels;
+        return 0;
+    }
+#endif
+    if (is_auto || strcmp(name, "scalar") == 0)
+    {
+        kernels = &scalar_kernels;
+        return 0;
+    }
+    return 1;
+}
+
+const char *stats_kernels_name (void)
+{
+    return get_kernels()->name;
+}
+
+void stats_summarize (const double *x, long n, double lo, double hi, struct range_summary *summary)
+{
+    get_kernels()->summarize(x, n, lo, hi, summary);
+}
+
+long stats_max_index (const double *x, long n)
+{
+    if (n <= 0)
+        return -1;
+    struct range_summary summary;
+    get_kernels()->summarize(x, n, -INFINITY, INFINITY, &summary);
+    if (summary.count == 0) //only infinities and nans
+        return 0;
+    return get_kernels()->find(x, n, summary.max);
+}
+
+double stats_select (double *x, long n, long k)
+{
+    long left = 0, right = n - 1;
+    while (left < right)
+    {
+        //median of three pivot, so sorted windows take linear time too
+        double pivot = median_of_3(x[left], x[left + (right - left) / 2], x[right]);
+        long i = left, j = right;
+        do
+        {
+            while (x[i] < pivot)
+                i++;
+            while (pivot < x[j])
+                j--;
+            if (i <= j)
+            {
+                double temp = x[i];
+                x[i] = x[j];
+                x[j] = temp;
+                i++;
+                j--;
+            }
+        } while (i <= j);
+        if (j < k)
+            left = i;
+        if (k < i)
+            right = j;
+    }
+    return x[k];
+}
+
+double stats_percentile (double *x, long n, double p)
+{
+    if (n <= 0)
+        return 0.0;
+    if (p < 0)
+        p = 0;
+    if (p > 1)
+        p = 1;
+    double rank = p * (n - 1);
+    long below = (long) rank;
+    double value = stats_select(x, n, below);
+    if (below + 1 >= n || rank == below)
+        return value;
+
+    //the next rank is the smallest of the values after the selected one
+    struct range_summary above;
+    get_kernels()->summarize(x + below + 1, n - below - 1, -INFINITY, INFINITY, &above);
+    if (above.count == 0)
+        return value;
+    return value + (rank - below) * (above.min - value);
+}
+
+long stats_median_index (const double *x, long n)
+{
+    if (n <= 0)
+        return -1;
+    double stack_copy[STATS_STACK_SIZE];
+    double *copy = (n <= STATS_STACK_SIZE) ? stack_copy : malloc(n * sizeof(double));
+    if (copy == NULL)
+        return -1;
+    memcpy(copy, x, n * sizeof(double));
+    double median = stats_select(copy, n, n / 2);
+    if (copy != stack_copy)
+        free(copy);
+    long index = get_kernels()->find(x, n, median);
+    return (index < 0) ? n / 2 : index; //a nan median matches nothing
+}
+
+void stats_median3 (const double *x, double *out, long n)
+{
+    if (n <= 0)
+        return;
+    out[0] = x[0];
+    out[n - 1] = x[n - 1];
+    if (n > 2)
+        get_kernels()->median3(x, out, n);
+}
+
+long stats_hampel (const double *x, double *out, long n, int half_window, double threshold)
+{
+    double window[2 * MAX_HAMPEL_HALF_WINDOW + 1];
+    long i, j, replaced = 0;
+    if (half_window > MAX_HAMPEL_HALF_WINDOW)
+        half_window = MAX_HAMPEL_HALF_WINDOW;
+    if (half_window < 1)
+        half_window = 1;
+    for (i = 0; i < n; i++)
+    {
+        long start = (i < half_window) ? 0 : i - half_window;
+        long end = (i + half_window >= n) ? n - 1 : i + half_window;
+        long len = end - start + 1;
+        memcpy(window, x + start, len * sizeof(double));
+        double median = stats_select(window, len, len / 2);
+        for (j = 0; j < len; j++)
+            window[j] = fabs(window[j] - median);
+        double deviation = MAD_SCALE * stats_select(window, len, len / 2);
+        if (deviation < MIN_RELATIVE_DEVIATION * fabs(median))
+            deviation = MIN_RELATIVE_DEVIATION * fabs(median);
+        if (fabs(x[i] - median) > threshold * deviation)
+        {
+            out[i] = median;
+            replaced++;
+        }
+        else
+            out[i] = x[i];
+    }
+    return replaced;
+}
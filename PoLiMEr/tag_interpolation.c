@@ -0,0 +1,85 @@
+#ifndef _TIMER_OFF
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "PoLiMEr.h"
+#include "helpers.h"
+#include "tag_interpolation.h"
+
+int init_tag_interpolation (struct tag_interpolation_t * tag_interpolation)
+{
+    if (arena_init(&tag_interpolation->tags, sizeof(struct tag_interpolation)) != 0)
+        return 1;
+    if (arena_init(&tag_interpolation->pending, sizeof(int)) != 0)
+    {
+        arena_free(&tag_interpolation->tags);
+        return 1;
+    }
+    tag_interpolation->num_pending = 0;
+    tag_interpolation->next_pending = 0;
+    tag_interpolation->last_time_error = ENERGY_UPDATE_PERIOD;
+    return 0;
+}
+
+void free_tag_interpolation (struct tag_interpolation_t * tag_interpolation)
+{
+    arena_free(&tag_interpolation->tags);
+    arena_free(&tag_interpolation->pending);
+}
+
+void queue_tag_boundary (struct tag_interpolation_t * tag_interpolation, int tag_id, int is_end)
+{
+    int *boundary = arena_at(&tag_interpolation->pending, tag_interpolation->num_pending);
+    if (boundary == NULL)
+        return;
+    *boundary = tag_id * 2 + is_end;
+    tag_interpolation->num_pending++;
+}
+
+void interpolate_tag_boundaries (struct tag_interpolation_t * tag_interpolation, double wtime, struct energy_reading *energy,
+    double time_error, struct system_info_t * system_info)
+{
+    struct thread_tag_attribution *timeline = &system_info->thread_tag_attribution;
+    double elapsed = wtime - timeline->last_wtime;
+    if (elapsed <= 0)
+        return;
+    double delta[MAX_ENERGY_ZONES];
+    int zone, num_zones = get_energy_zones(delta, energy, &timeline->last_energy, elapsed);
+    //the times of both samples are only known up to their time errors
+    double sample_error = (time_error > tag_interpolation->last_time_error) ? time_error : tag_interpolation->last_time_error;
+
+    while (tag_interpolation->next_pending < tag_interpolation->num_pending)
+    {
+        int boundary_id = *(int *) arena_at(&tag_interpolation->pending, tag_interpolation->next_pending);
+        struct poli_tag *tag = arena_at(&system_info->poli_tag_list, boundary_id / 2);
+        double boundary_time = (boundary_id % 2) ? tag->end_time : tag->start_time;
+        if (boundary_time > wtime)
+            break;
+
+        struct tag_interpolation *interpolation = arena_at(&tag_interpolation->tags, boundary_id / 2);
+        if (interpolation != NULL)
+        {
+            struct boundary_energy *boundary = (boundary_id % 2) ? &interpolation->end : &interpolation->start;
+            double fraction = (boundary_time > timeline->last_wtime) ? (boundary_time - timeline->last_wtime) / elapsed : 0.0;
+            for (zone = 0; zone < num_zones; zone++)
+            {
+                boundary->energy[zone] = timeline->node_energy[zone] + fraction * delta[zone];
+                //the counters only grow, so the energy at the boundary lies between the two samples
+                double spread = ((fraction > 0.5) ? fraction : 1.0 - fraction) * delta[zone];
+                boundary->error[zone] = spread + delta[zone] / elapsed * sample_error;
+            }
+            boundary->resolved = 1;
+        }
+        tag_interpolation->next_pending++;
+    }
+    tag_interpolation->last_time_error = time_error;
+}
+
+struct tag_interpolation *get_tag_interpolation (struct tag_interpolation_t * tag_interpolation, int tag_id)
+{
+    if (tag_id >= (int) arena_capacity(&tag_interpolation->tags))
+        return NULL;
+    return arena_at(&tag_interpolation->tags, tag_id);
+}
+#endif
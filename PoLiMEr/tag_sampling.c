@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "PoLiMEr.h"
+#include "helpers.h"
+#include "tag_sampling.h"
+
+// Bound on the nesting of open invocations of one sampled name, deeper invocations are only counted
+#define MAX_SAMPLED_DEPTH 64
+// Two sided 95% quantile of the normal distribution
+#define Z_95 1.959964
+
+static uint64_t next_random (struct tag_sampler *sampler)
+{
+    //xorshift64*
+    uint64_t x = sampler->random_state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    sampler->random_state = x;
+    return x * 2685821657736338717ULL;
+}
+
+struct tag_sampler *get_tag_sampler (int name_id, struct system_info_t * system_info, struct polimer_config_t * poli_config)
+{
+    struct tag_sampler *sampler = arena_at(&system_info->tag_samplers, name_id);
+    if (sampler != NULL && !sampler->configured)
+    {
+        sampler->random_state = 0x9e3779b97f4a7c15ULL ^ (uint64_t) (name_id + 1);
+        if (set_tag_sampler_policy(sampler, poli_config->tag_sampling, poli_config->tag_sampling_parameter) != 0)
+            set_tag_sampler_policy(sampler, POLI_SAMPLE_ALL, 0);
+    }
+    return sampler;
+}
+
+int set_tag_sampler_policy (struct tag_sampler *sampler, poli_sampling_t policy, double parameter)
+{
+    if (sampler->open_depth > 0)
+        return 1;
+    if (policy == POLI_SAMPLE_EVERY_N && parameter < 1)
+        return 1;
+    if (policy == POLI_SAMPLE_TIME && parameter < 0)
+        return 1;
+    if (policy == POLI_SAMPLE_RESERVOIR && parameter < 2)
+        return 1;
+
+    struct sampled_invocation *reservoir = 0;
+    if (policy == POLI_SAMPLE_RESERVOIR)
+    {
+        reservoir = calloc((size_t) parameter, sizeof(struct sampled_invocation));
+        if (reservoir == NULL)
+            return 1;
+    }
+    free(sampler->reservoir);
+
+    //statistics of a previous policy no longer describe the sample
+    uint64_t random_state = sampler->random_state;
+    memset(sampler, 0, sizeof(struct tag_sampler));
+    sampler->random_state = random_state;
+    sampler->policy = policy;
+    sampler->parameter = parameter;
+    sampler->reservoir = reservoir;
+    sampler->configured = 1;
+    return 0;
+}
+
+int sampler_start_invocation (struct tag_sampler *sampler)
+{
+    sampler->invocations++;
+    int depth = sampler->open_depth++;
+    if (depth >= MAX_SAMPLED_DEPTH)
+        return 0;
+
+    int sampled = 0;
+    switch (sampler->policy)
+    {
+        case POLI_SAMPLE_ALL:
+            sampled = 1;
+            break;
+        case POLI_SAMPLE_EVERY_N:
+            sampled = ((sampler->invocations - 1) % (long) sampler->parameter) == 0;
+            break;
+        case POLI_SAMPLE_TIME:
+        {
+            double now = get_time();
+            if (sampler->sampled == 0 || now - sampler->last_sample_time >= sampler->parameter)
+            {
+                sampler->last_sample_time = now;
+                sampled = 1;
+            }
+            break;
+        }
+        case POLI_SAMPLE_RESERVOIR:
+            //invocation i enters a reservoir of k with probability k / i
+            sampled = sampler->invocations <= (long) sampler->parameter
+                || (next_random(sampler) % (uint64_t) sampler->invocations) < (uint64_t) sampler->parameter;
+            break;
+    }
+
+    if (sampled)
+        sampler->open_sampled |= (1ULL << depth);
+    else
+        sampler->open_sampled &= ~(1ULL << depth);
+    return sampled;
+}
+
+int sampler_end_invocation (struct tag_sampler *sampler)
+{
+    if (sampler->open_depth == 0)
+        return -1;
+    int depth = --sampler->open_depth;
+    if (depth >= MAX_SAMPLED_DEPTH)
+        return 0;
+    return (sampler->open_sampled >> depth) & 1;
+}
+
+void sampler_add_invocation (struct tag_sampler *sampler, struct poli_tag *tag)
+{
+    double time = tag->end_time - tag->start_time;
+    double energy[MAX_ENERGY_ZONES];
+    int zone;
+    sampler->num_zones = get_energy_zones(energy, &tag->end_energy, &tag->start_energy, time);
+    sampler->sampled++;
+
+    if (sampler->policy == POLI_SAMPLE_RESERVOIR)
+    {
+        struct sampled_invocation *slot;
+        if (sampler->reservoir_len < (int) sampler->parameter)
+            slot = &sampler->reservoir[sampler->reservoir_len++];
+        else
+            slot = &sampler->reservoir[next_random(sampler) % sampler->reservoir_len];
+        slot->time = time;
+        memcpy(slot->energy, energy, sizeof(slot->energy));
+        return;
+    }
+
+    double delta = time - sampler->mean_time;
+    sampler->mean_time += delta / sampler->sampled;
+    sampler->m2_time += delta * (time - sampler->mean_time);
+    for (zone = 0; zone < sampler->num_zones; zone++)
+    {
+        delta = energy[zone] - sampler->mean_energy[zone];
+        sampler->mean_energy[zone] += delta / sampler->sampled;
+        sampler->m2_energy[zone] += delta * (energy[zone] - sampler->mean_energy[zone]);
+    }
+}
+
+int get_sampler_estimate (struct tag_sampler *sampler, int value, double *total, double *ci95)
+{
+    long n;
+    double mean = 0.0;
+    double m2 = 0.0;
+    if (sampler->policy == POLI_SAMPLE_RESERVOIR)
+    {
+        n = sampler->reservoir_len;
+        int i;
+        for (i = 0; i < n; i++)
+        {
+            struct sampled_invocation *invocation = &sampler->reservoir[i];
+            double x = (value == 0) ? invocation->time : invocation->energy[value - 1];
+            double delta = x - mean;
+            mean += delta / (i + 1);
+            m2 += delta * (x - mean);
+        }
+    }
+    else
+    {
+        n = sampler->sampled;
+        mean = (value == 0) ? sampler->mean_time : sampler->mean_energy[value - 1];
+        m2 = (value == 0) ? sampler->m2_time : sampler->m2_energy[value - 1];
+    }
+    if (n == 0)
+        return 1;
+
+    double population = (double) sampler->invocations;
+    *total = population * mean;
+    if (n >= population)
+        *ci95 = 0.0;
+    else if (n < 2)
+        *ci95 = NAN;
+    else
+    {
+        //standard error of the extrapolated total, with the finite population correction
+        double variance = m2 / (n - 1);
+        *ci95 = Z_95 * population * sqrt(variance / n * (1.0 - n / population));
+    }
+    return 0;
+}
+
+const char *get_sampling_policy_name (poli_sampling_t policy)
+{
+    switch (policy)
+    {
+        case POLI_SAMPLE_EVERY_N:
+            return "every";
+        case POLI_SAMPLE_TIME:
+            return "time";
+        case POLI_SAMPLE_RESERVOIR:
+            return "reservoir";
+        default:
+            return "all";
+    }
+}
+
+void free_tag_samplers (struct system_info_t * system_info)
+{
+    unsigned int i;
+    for (i = 0; i < arena_capacity(&system_info->tag_samplers); i++)
+    {
+        struct tag_sampler *sampler = arena_at(&system_info->tag_samplers, i);
+        free(sampler->reservoir);
+    }
+    arena_free(&system_info->tag_samplers);
+}
@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tag_table.h"
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+uint32_t tag_name_hash (const char *tag_name)
+{
+    uint32_t hash = FNV_OFFSET_BASIS;
+    const unsigned char *c;
+    for (c = (const unsigned char *) tag_name; *c; c++)
+    {
+        hash ^= *c;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static int alloc_entries (struct tag_table *table, unsigned int size)
+{
+    unsigned int i;
+    struct tag_table_entry *entries = malloc(size * sizeof(struct tag_table_entry));
+    if (entries == NULL)
+        return 1;
+    for (i = 0; i < size; i++)
+        entries[i].key = -1;
+    table->entries = entries;
+    table->size = size;
+    table->mask = size - 1;
+    return 0;
+}
+
+int tag_table_init (struct tag_table *table, unsigned int size)
+{
+    unsigned int pow2 = 2;
+    while (pow2 < size)
+        pow2 <<= 1;
+
+    table->entries = 0;
+    table->size = 0;
+    table->mask = 0;
+    table->count = 0;
+    return alloc_entries(table, pow2);
+}
+
+void tag_table_free (struct tag_table *table)
+{
+    if (table->entries)
+    {
+        free(table->entries);
+        table->entries = 0;
+    }
+    table->size = 0;
+    table->mask = 0;
+    table->count = 0;
+}
+
+struct tag_table_entry *tag_table_probe (struct tag_table *table, uint32_t hash, unsigned int *position)
+{
+    if (table->entries == NULL)
+        return NULL;
+
+    unsigned int i = *position & table->mask;
+    while (table->entries[i].key != -1)
+    {
+        struct tag_table_entry *entry = &table->entries[i];
+        i = (i + 1) & table->mask;
+        if (entry->hash == hash)
+        {
+            *position = i;
+            return entry;
+        }
+    }
+    *position = i;
+    return NULL;
+}
+
+struct tag_table_entry *tag_table_find (struct tag_table *table, uint32_t hash, int key)
+{
+    unsigned int position = hash;
+    struct tag_table_entry *entry;
+    while ((entry = tag_table_probe(table, hash, &position)) != NULL)
+        if (entry->key == key)
+            return entry;
+    return NULL;
+}
+
+static void place_entry (struct tag_table *table, struct tag_table_entry *new_entry)
+{
+    unsigned int i = new_entry->hash & table->mask;
+    while (table->entries[i].key != -1)
+        i = (i + 1) & table->mask;
+    table->entries[i] = *new_entry;
+}
+
+static int grow_table (struct tag_table *table)
+{
+    struct tag_table_entry *old_entries = table->entries;
+    unsigned int old_size = table->size;
+    unsigned int i;
+
+    if (alloc_entries(table, old_size << 1) != 0)
+    {
+        table->entries = old_entries;
+        return 1;
+    }
+    for (i = 0; i < old_size; i++)
+        if (old_entries[i].key != -1)
+            place_entry(table, &old_entries[i]);
+    free(old_entries);
+    return 0;
+}
+
+int tag_table_insert (struct tag_table *table, uint32_t hash, int key, int value)
+{
+    struct tag_table_entry new_entry = {hash, key, value};
+
+    if (table->entries == NULL)
+        return 1;
+    if ((table->count + 1) * 2 > table->size && grow_table(table) != 0)
+        return 1;
+    place_entry(table, &new_entry);
+    table->count++;
+    return 0;
+}
+
+void tag_table_remove (struct tag_table *table, struct tag_table_entry *entry)
+{
+    unsigned int hole = entry - table->entries;
+    unsigned int i = hole;
+
+    table->entries[hole].key = -1;
+    table->count--;
+
+    //shift back entries whose home slot does not lie cyclically within (hole, i]
+    while (1)
+    {
+        i = (i + 1) & table->mask;
+        if (table->entries[i].key == -1)
+            break;
+        unsigned int home = table->entries[i].hash & table->mask;
+        if (((i - home) & table->mask) >= ((i - hole) & table->mask))
+        {
+            table->entries[hole] = table->entries[i];
+            table->entries[i].key = -1;
+            hole = i;
+        }
+    }
+}
+
+int tag_names_init (struct tag_names *tag_names)
+{
+    tag_names->num_names = 0;
+    pthread_mutex_init(&tag_names->lock, NULL);
+    if (arena_init(&tag_names->entries, sizeof(struct tag_name_entry)) != 0)
+        return 1;
+    return tag_table_init(&tag_names->index, 64);
+}
+
+void tag_names_free (struct tag_names *tag_names)
+{
+    int i;
+    for (i = 0; i < tag_names_count(tag_names); i++)
+        free(tag_names_get(tag_names, i));
+    arena_free(&tag_names->entries);
+    tag_names->num_names = 0;
+    tag_table_free(&tag_names->index);
+    pthread_mutex_destroy(&tag_names->lock);
+}
+
+char *tag_names_get (struct tag_names *tag_names, int name_id)
+{
+    struct tag_name_entry *entry = arena_at(&tag_names->entries, name_id);
+    return entry->name;
+}
+
+uint32_t tag_names_hash (struct tag_names *tag_names, int name_id)
+{
+    struct tag_name_entry *entry = arena_at(&tag_names->entries, name_id);
+    return entry->hash;
+}
+
+static int find_name (struct tag_names *tag_names, uint32_t hash, const char *tag_name)
+{
+    unsigned int position = hash;
+    struct tag_table_entry *entry;
+    while ((entry = tag_table_probe(&tag_names->index, hash, &position)) != NULL)
+        if (strcmp(tag_names_get(tag_names, entry->key), tag_name) == 0)
+            return entry->key;
+    return -1;
+}
+
+int tag_names_lookup (struct tag_names *tag_names, const char *tag_name)
+{
+    uint32_t hash = tag_name_hash(tag_name);
+    pthread_mutex_lock(&tag_names->lock);
+    int name_id = find_name(tag_names, hash, tag_name);
+    pthread_mutex_unlock(&tag_names->lock);
+    return name_id;
+}
+
+static int add_name (struct tag_names *tag_names, uint32_t hash, const char *tag_name)
+{
+    int name_id = find_name(tag_names, hash, tag_name);
+    if (name_id >= 0)
+        return name_id;
+
+    name_id = tag_names->num_names;
+    struct tag_name_entry *entry = arena_at(&tag_names->entries, name_id);
+    if (entry == NULL)
+        return -1;
+    entry->name = strdup(tag_name);
+    if (entry->name == NULL)
+        return -1;
+    entry->hash = hash;
+    if (tag_table_insert(&tag_names->index, hash, name_id, name_id) != 0)
+    {
+        free(entry->name);
+        entry->name = 0;
+        return -1;
+    }
+    //publish the name before its id can reach other threads
+    __atomic_store_n(&tag_names->num_names, name_id + 1, __ATOMIC_RELEASE);
+    return name_id;
+}
+
+int tag_names_intern (struct tag_names *tag_names, const char *tag_name)
+{
+    uint32_t hash = tag_name_hash(tag_name);
+    pthread_mutex_lock(&tag_names->lock);
+    int name_id = add_name(tag_names, hash, tag_name);
+    pthread_mutex_unlock(&tag_names->lock);
+    return name_id;
+}
+
+int tag_names_count (struct tag_names *tag_names)
+{
+    return __atomic_load_n(&tag_names->num_names, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "powercap_handler.h"
+
+/* Checks the powercap reader on a fake intel-rapl tree: the discovery of the zones and which package and energy zone
+   they count to, the accounting of energy_uj wraps, and power caps written and read back.
+   usage: ./powercap_test [directory to build the tree in, default /tmp]*/
+
+#define RANGE 1000000 //max_energy_range_uj of every zone
+
+static char root[4096];
+static int failed = 0;
+
+static void check (int ok, const char *what)
+{
+    printf("%s\t%s\n", ok ? "ok" : "FAILED", what);
+    if (!ok)
+        failed = 1;
+}
+
+static void write_file (const char *zone, const char *file, const char *value)
+{
+    char path[8192];
+    snprintf(path, sizeof(path), "%s/%s/%s", root, zone, file);
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL)
+    {
+        perror(path);
+        exit(1);
+    }
+    fprintf(fp, "%s\n", value);
+    fclose(fp);
+}
+
+static long read_file (const char *zone, const char *file)
+{
+    char path[8192];
+    long value = -1;
+    snprintf(path, sizeof(path), "%s/%s/%s", root, zone, file);
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL)
+        return -1;
+    if (fscanf(fp, "%ld", &value) != 1)
+        value = -1;
+    fclose(fp);
+    return value;
+}
+
+static void set_energy (const char *zone, long uj)
+{
+    char value[32];
+    snprintf(value, sizeof(value), "%ld", uj);
+    write_file(zone, "energy_uj", value);
+}
+
+/* make_zone - a zone called name with its energy counter at uj, and a long_term (and short_term) constraint if asked*/
+static void make_zone (const char *zone, const char *name, long uj, int constraints)
+{
+    char path[8192];
+    char value[32];
+    snprintf(path, sizeof(path), "%s/%s", root, zone);
+    mkdir(path, 0755);
+    write_file(zone, "name", name);
+    set_energy(zone, uj);
+    snprintf(value, sizeof(value), "%d", RANGE);
+    write_file(zone, "max_energy_range_uj", value);
+    if (constraints < 1)
+        return;
+    write_file(zone, "enabled", "0");
+    write_file(zone, "constraint_0_name", "long_term");
+    write_file(zone, "constraint_0_power_limit_uw", "0");
+    write_file(zone, "constraint_0_time_window_us", "0");
+    write_file(zone, "constraint_0_max_power_uw", "150000000");
+    if (constraints < 2)
+        return;
+    write_file(zone, "constraint_1_name", "short_term");
+    write_file(zone, "constraint_1_power_limit_uw", "0");
+    write_file(zone, "constraint_1_time_window_us", "0");
+}
+
+static struct powercap_zone *find_zone (struct powercap_info *pc, const char *zone)
+{
+    int i;
+    for (i = 0; i < pc->num_zones; i++)
+    {
+        char *dir = strrchr(pc->zones[i].path, '/');
+        if (dir && strcmp(dir + 1, zone) == 0)
+            return &pc->zones[i];
+    }
+    return NULL;
+}
+
+static int close_to (double value, double expected)
+{
+    return fabs(value - expected) < 1e-9;
+}
+
+int main (int argc, char **argv)
+{
+    snprintf(root, sizeof(root), "%s/polimer_powercap_XXXXXX", (argc > 1) ? argv[1] : "/tmp");
+    if (mkdtemp(root) == NULL)
+    {
+        perror(root);
+        return 1;
+    }
+
+    //package 0 has two dies, with a core and a dram zone on the first. package 1 has one die with a dram zone
+    make_zone("intel-rapl:0", "package-0-die-0", 1000, 2);
+    make_zone("intel-rapl:0:0", "core", 2000, 0);
+    make_zone("intel-rapl:0:1", "dram", 3000, 1);
+    make_zone("intel-rapl:1", "package-0-die-1", 4000, 2);
+    make_zone("intel-rapl:2", "package-1-die-0", 5000, 2);
+    make_zone("intel-rapl:2:0", "dram", 6000, 1);
+    make_zone("intel-rapl:3", "psys", 7000, 1);
+    make_zone("intel-rapl:4", "unknown", 0, 0);
+
+    struct powercap_info *pc = init_powercap(root);
+    check(pc != NULL, "init_powercap finds the tree");
+    if (pc == NULL)
+        return 1;
+
+    //discovery and mapping
+    static const struct { const char *zone; int package, energy_zone; } expected[] = {
+        { "intel-rapl:0", 0, 0 }, { "intel-rapl:0:0", 0, 1 }, { "intel-rapl:0:1", 0, 4 }, { "intel-rapl:1", 0, 0 },
+        { "intel-rapl:2", 1, 0 }, { "intel-rapl:2:0", 1, 4 }, { "intel-rapl:3", 0, 3 } };
+    int i, mapped = 1;
+    for (i = 0; i < (int) (sizeof(expected) / sizeof(expected[0])); i++)
+    {
+        struct powercap_zone *pz = find_zone(pc, expected[i].zone);
+        if (pz == NULL || pz->package != expected[i].package || pz->zone != expected[i].energy_zone)
+        {
+            printf("%s\tmapped wrong\n", expected[i].zone);
+            mapped = 0;
+        }
+    }
+    check(pc->num_packages == 2, "two packages");
+    check(pc->num_zones == 7, "seven zones, the unknown one left out");
+    check(mapped, "zones mapped to their package and energy zone");
+
+    //the totals go on from the counters at init_powercap, the dies of a package add up
+    struct rapl_energy node, packages[MAX_RECORDED_PACKAGES];
+    set_energy("intel-rapl:0", 1100);
+    set_energy("intel-rapl:1", 4300);
+    set_energy("intel-rapl:2", 5500);
+    set_energy("intel-rapl:0:1", 3010);
+    powercap_read_energy(&node, packages, pc);
+    check(close_to(packages[0].package, 5400e-6) && close_to(packages[1].package, 5500e-6) && close_to(node.package, 10900e-6),
+        "package energy adds up the dies");
+    check(close_to(packages[0].dram, 3010e-6) && close_to(packages[1].dram, 6000e-6) && close_to(node.dram, 9010e-6), "dram energy");
+
+    //energy_uj below its last value wrapped at max_energy_range_uj
+    set_energy("intel-rapl:2", 200);
+    powercap_read_energy(&node, packages, pc);
+    check(close_to(packages[1].package, (RANGE + 200) * 1e-6), "energy_uj wrap accounted");
+    set_energy("intel-rapl:2", 700);
+    powercap_read_energy(&node, packages, pc);
+    check(close_to(packages[1].package, (RANGE + 700) * 1e-6), "counting goes on after the wrap");
+
+    uint32_t counters[2 * NUM_RAPL_DOMAINS];
+    double units[2 * NUM_RAPL_DOMAINS];
+    check(powercap_read_raw_energy(counters, units, pc) == 2 * NUM_RAPL_DOMAINS && counters[NUM_RAPL_DOMAINS] == RANGE + 700
+        && counters[0] == 5400 && units[0] == 1e-6, "raw counters add up the dies and account the wrap");
+
+    //caps are per package, split across its dies, and read back for the node
+    check(powercap_set_power_cap("PACKAGE", 100, 120, 1, 0.01, 1, pc) == 0, "powercap_set_power_cap");
+    check(read_file("intel-rapl:0", "constraint_0_power_limit_uw") == 50000000 && read_file("intel-rapl:1", "constraint_0_power_limit_uw") == 50000000
+        && read_file("intel-rapl:2", "constraint_0_power_limit_uw") == 100000000 && read_file("intel-rapl:2", "constraint_1_power_limit_uw") == 120000000
+        && read_file("intel-rapl:0", "constraint_0_time_window_us") == 1000000 && read_file("intel-rapl:0", "enabled") == 1,
+        "caps written to the zones");
+
+    struct msr_pcap pcap;
+    check(powercap_get_power_cap(&pcap, "PACKAGE", pc) == 0 && close_to(pcap.watts_long, 200) && close_to(pcap.watts_short, 240)
+        && close_to(pcap.seconds_long, 1) && close_to(pcap.seconds_short, 0.01) && pcap.enabled_long && pcap.enabled_short,
+        "powercap_get_power_cap reads the caps back");
+
+    check(powercap_set_power_cap("DRAM", 30, 0, 0, 0, 1, pc) == 0 && powercap_get_power_cap(&pcap, "DRAM", pc) == 0
+        && close_to(pcap.watts_long, 60) && pcap.enabled_long && !pcap.enabled_short, "dram caps");
+
+    write_file("intel-rapl:1", "enabled", "0");
+    check(powercap_get_power_cap(&pcap, "PACKAGE", pc) == 0 && !pcap.enabled_long, "a cap is enabled only if it is on every zone");
+
+    char path[8192];
+    snprintf(path, sizeof(path), "%s/intel-rapl:1/enabled", root);
+    unlink(path);
+    check(powercap_get_power_cap(&pcap, "PACKAGE", pc) != 0, "a missing enabled file is an error");
+
+    finalize_powercap(pc);
+
+    char command[8192];
+    snprintf(command, sizeof(command), "rm -rf %s", root);
+    if (system(command) != 0)
+        printf("Couldn't remove %s\n", root);
+
+    return failed;
+}
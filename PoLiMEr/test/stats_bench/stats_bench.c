@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "stats_kernels.h"
+
+/* Times the statistics kernels on synthetic power windows, for each kernel set the cpu supports,
+   against the scalar kernels and the sort based median the power manager used before.
+   usage: ./stats_bench [largest window, default 1000000]*/
+
+static const char *kernel_sets[] = { "scalar", "avx2", "avx512" };
+
+static double now (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* package power around 150 W with noise, a phase change and occasional glitches*/
+static void fill_window (double *x, long n)
+{
+    long i;
+    srand(42);
+    for (i = 0; i < n; i++)
+    {
+        x[i] = ((i < n / 2) ? 120.0 : 180.0) + 10.0 * rand() / RAND_MAX;
+        if (rand() % 100 == 0)
+            x[i] = (rand() % 2) ? 0.0 : 400.0;
+    }
+}
+
+/* the exchange sort median formerly in power_manager.c*/
+static double sort_median (int n, double x[])
+{
+    int i, j;
+    for (i = 0; i < n - 1; i++)
+        for (j = i + 1; j < n; j++)
+            if (x[j] < x[i])
+            {
+                double temp = x[i];
+                x[i] = x[j];
+                x[j] = temp;
+            }
+    return x[n / 2];
+}
+
+/* repeats a kernel for about 0.2 s, returns nanoseconds per value*/
+#define TIME_KERNEL(n, result, statement) \
+    do { \
+        long reps = 0; \
+        double start = now(), elapsed; \
+        do { statement; reps++; elapsed = now() - start; } while (elapsed < 0.2); \
+        result = elapsed * 1e9 / ((double) reps * (n)); \
+    } while (0)
+
+int main (int argc, char **argv)
+{
+    long largest = (argc > 1) ? atol(argv[1]) : 1000000;
+    double *x = malloc(largest * sizeof(double));
+    double *out = malloc(largest * sizeof(double));
+    double *scratch = malloc(largest * sizeof(double));
+    double *reference = malloc(largest * sizeof(double));
+    if (x == NULL || out == NULL || scratch == NULL || reference == NULL)
+        return 1;
+
+    printf("Window\tKernels\tSummarize (ns/value)\tMax Index (ns/value)\tMedian3 (ns/value)\tMedian Index (ns/value)\tSort Median (ns/value)\tSpeedup\n");
+    long n;
+    int failed = 0;
+    for (n = 1000; n <= largest; n *= 10)
+    {
+        fill_window(x, n);
+        struct range_summary expected;
+        stats_use_kernels("scalar");
+        stats_summarize(x, n, 36.0, 312.0, &expected);
+        long expected_max = stats_max_index(x, n);
+        long expected_median = stats_median_index(x, n);
+        stats_median3(x, reference, n);
+
+        double scalar_time = 0.0;
+        int k;
+        for (k = 0; k < 3; k++)
+        {
+            if (stats_use_kernels(kernel_sets[k]) != 0)
+                continue;
+            struct range_summary summary;
+            long max_index = 0, median_index = 0;
+            double summarize_time, max_time, median3_time, median_time, sort_time = NAN;
+            TIME_KERNEL(n, summarize_time, stats_summarize(x, n, 36.0, 312.0, &summary));
+            TIME_KERNEL(n, max_time, max_index = stats_max_index(x, n));
+            TIME_KERNEL(n, median3_time, stats_median3(x, out, n));
+            TIME_KERNEL(n, median_time, median_index = stats_median_index(x, n));
+            if (k == 0 && n <= 10000)
+                TIME_KERNEL(n, sort_time, memcpy(scratch, x, n * sizeof(double)); sort_median((int) n, scratch));
+            if (k == 0)
+                scalar_time = summarize_time;
+
+            //every kernel set has to agree with the scalar one
+            if (summary.count != expected.count || summary.min != expected.min || summary.max != expected.max
+                || fabs(summary.sum - expected.sum) > 1e-9 * fabs(expected.sum) || max_index != expected_max
+                || median_index != expected_median || memcmp(out, reference, n * sizeof(double)) != 0)
+            {
+                printf("%ld\t%s\tresults differ from the scalar kernels\n", n, kernel_sets[k]);
+                failed = 1;
+            }
+            printf("%ld\t%s\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\t%.2f\n", n, kernel_sets[k], summarize_time, max_time, median3_time,
+                median_time, sort_time, scalar_time / summarize_time);
+        }
+    }
+
+    free(x);
+    free(out);
+    free(scratch);
+    free(reference);
+    return failed;
+}
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "PoLiMEr.h"
+#include "helpers.h"
+#include "thread_tags.h"
+
+static __thread struct thread_tag_buffer *my_buffer = 0;
+static __thread int my_generation = -1;
+static int buffers_generation = 0; //invalidates the cached buffers of all threads once they are freed
+
+struct thread_tag_buffer *add_thread_tag_buffer (int thread_id, int rank, struct system_info_t * system_info)
+{
+    struct thread_tag_buffer *buffer = malloc(sizeof(struct thread_tag_buffer));
+    if (buffer == NULL)
+        return NULL;
+    buffer->thread_id = thread_id;
+    buffer->rank = rank;
+    buffer->num_events = 0;
+    buffer->attributed = 0;
+    if (arena_init(&buffer->events, sizeof(struct thread_tag_event)) != 0)
+    {
+        free(buffer);
+        return NULL;
+    }
+
+    buffer->next = __atomic_load_n(&system_info->thread_tag_buffers, __ATOMIC_ACQUIRE);
+    while (!__atomic_compare_exchange_n(&system_info->thread_tag_buffers, &buffer->next, buffer, 0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+        ;
+    return buffer;
+}
+
+static struct thread_tag_buffer *get_thread_tag_buffer (int thread_id, int rank, struct system_info_t * system_info)
+{
+    if (my_buffer != NULL && my_generation == __atomic_load_n(&buffers_generation, __ATOMIC_ACQUIRE))
+        return my_buffer;
+
+    //allocated by the owning thread so that its events stay local to it
+    struct thread_tag_buffer *buffer = add_thread_tag_buffer(thread_id, rank, system_info);
+    if (buffer == NULL)
+        return NULL;
+    my_buffer = buffer;
+    my_generation = __atomic_load_n(&buffers_generation, __ATOMIC_ACQUIRE);
+    return buffer;
+}
+
+int record_thread_tag_event (thread_tag_event_t type, int name_id, int thread_id, int rank, struct system_info_t * system_info)
+{
+    struct thread_tag_buffer *buffer = get_thread_tag_buffer(thread_id, rank, system_info);
+    if (buffer == NULL)
+        return 1;
+    return append_thread_tag_event(buffer, type, name_id, get_time());
+}
+
+int append_thread_tag_event (struct thread_tag_buffer *buffer, thread_tag_event_t type, int name_id, double wtime)
+{
+    struct thread_tag_event *event = arena_at(&buffer->events, buffer->num_events);
+    if (event == NULL)
+        return 1;
+    event->type = type;
+    event->name_id = name_id;
+    event->wtime = wtime;
+
+    __atomic_store_n(&buffer->num_events, buffer->num_events + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void init_thread_tag_attribution (struct system_info_t * system_info)
+{
+    struct thread_tag_attribution *state = &system_info->thread_tag_attribution;
+    state->last_wtime = system_info->initial_mpi_wtime;
+    state->last_energy = system_info->initial_energy;
+    memset(state->node_energy, 0, sizeof(state->node_energy));
+}
+
+void attribute_thread_tag_events (double wtime, struct energy_reading *energy, struct system_info_t * system_info)
+{
+    struct thread_tag_attribution *state = &system_info->thread_tag_attribution;
+    if (wtime < state->last_wtime)
+        return;
+
+    double elapsed = wtime - state->last_wtime;
+    double delta[MAX_ENERGY_ZONES];
+    int zone, num_zones = get_energy_zones(delta, energy, &state->last_energy, elapsed);
+
+    struct thread_tag_buffer *buffer;
+    for (buffer = __atomic_load_n(&system_info->thread_tag_buffers, __ATOMIC_ACQUIRE); buffer != NULL; buffer = buffer->next)
+    {
+        int num_events = __atomic_load_n(&buffer->num_events, __ATOMIC_ACQUIRE);
+        for (; buffer->attributed < num_events; buffer->attributed++)
+        {
+            struct thread_tag_event *event = arena_at(&buffer->events, buffer->attributed);
+            if (event->wtime > wtime)
+                break;
+            //an event published only after a later reading was attributed gets the energy at that reading
+            double fraction = 0.0;
+            if (elapsed > 0 && event->wtime > state->last_wtime)
+                fraction = (event->wtime - state->last_wtime) / elapsed;
+            for (zone = 0; zone < num_zones; zone++)
+                event->energy[zone] = state->node_energy[zone] + fraction * delta[zone];
+        }
+    }
+
+    for (zone = 0; zone < num_zones; zone++)
+        state->node_energy[zone] += delta[zone];
+    state->last_wtime = wtime;
+    state->last_energy = *energy;
+}
+
+void free_thread_tag_buffers (struct system_info_t * system_info)
+{
+    struct thread_tag_buffer *buffer = system_info->thread_tag_buffers;
+    while (buffer != NULL)
+    {
+        struct thread_tag_buffer *next = buffer->next;
+        arena_free(&buffer->events);
+        free(buffer);
+        buffer = next;
+    }
+    system_info->thread_tag_buffers = 0;
+    __atomic_add_fetch(&buffers_generation, 1, __ATOMIC_RELEASE);
+}